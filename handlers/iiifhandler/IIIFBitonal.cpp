@@ -0,0 +1,123 @@
+/*
+ * Copyright © 2022 Lukas Rosenthaler
+ * This file is part of OMAS/cserve
+ * OMAS/cserve is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * OMAS/cserve is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "IIIFBitonal.h"
+#include "IIIFComputePool.h"
+#include "IIIFPixelKernels.h"
+
+namespace cserve {
+
+    //
+    // A row publishes its progress after every chunk of pixels; the row below waits for it
+    // chunk by chunk. A multiple of 8, so that the packed bytes are written by one chunk.
+    //
+    static const uint32_t dither_chunk = 64;
+
+    static bool is_bitonal(const uint8_t *pixels, uint32_t nx, uint32_t ny) {
+        std::atomic<bool> found{false}; // will be set true if we find a value not equal 0 or 255
+        IIIFComputePool::parallel_for(ny, [&](uint32_t first, uint32_t last) {
+            for (size_t y = first; (y < last) && !found; y++) {
+                const uint8_t *row = pixels + y * nx;
+                if (std::any_of(row, row + nx, [](uint8_t v) { return (v != 0) && (v != 255); })) {
+                    found = true;
+                }
+            }
+        });
+        return !found;
+    }
+    //============================================================================
+
+    //
+    // Floyd-Steinberg: pixel (x, y) receives the errors of (x - 1, y), (x - 1, y - 1), (x, y - 1)
+    // and (x + 1, y - 1). Row y can therefore process pixel x as soon as row y - 1 is done up to
+    // x + 1. The rows are claimed one after the other by the threads of the operation, and a row
+    // is only finished after the row above. The errors for the next row are kept in a ring of
+    // nthreads + 1 rows: when a thread claims row y, all rows up to y - nthreads are finished.
+    //
+    static void dither(uint8_t *pixels, uint8_t *packed, uint32_t nx, uint32_t ny, bool invert) {
+        auto pool = IIIFComputePool::instance();
+        const size_t nring = ((pool == nullptr) ? 1 : pool->per_request()) + 1;
+        const size_t sll = (nx + 7) / 8;
+        std::vector<int16_t> errors(nring * (nx + 2)); // one guard sample at each end of a row
+        auto progress = std::make_unique<std::atomic<uint32_t>[]>(ny);
+        std::atomic<uint32_t> next_row{0};
+
+        IIIFComputePool::BandFunc rows = [&](uint32_t, uint32_t) {
+            for (;;) {
+                const uint32_t y = next_row++;
+                if (y >= ny) return;
+                // pixel x is at x + 1
+                const int16_t *above = errors.data() + (y % nring) * (nx + 2);
+                int16_t *below = errors.data() + ((y + 1) % nring) * (nx + 2);
+                std::fill_n(below, nx + 2, 0);
+                uint8_t *row = pixels + static_cast<size_t>(y) * nx;
+                uint8_t *bits = packed + y * sll;
+
+                uint32_t ready = (y == 0) ? nx : 0; // pixels done in the row above
+                int carry = 0;
+                for (uint32_t x0 = 0; x0 < nx; x0 += dither_chunk) {
+                    const uint32_t x1 = std::min(x0 + dither_chunk, nx);
+                    const uint32_t needed = std::min(x1 + 1, nx);
+                    while (ready < needed) {
+                        ready = progress[y - 1].load(std::memory_order_acquire);
+                        if (ready < needed) std::this_thread::yield();
+                    }
+                    uint8_t byte = 0;
+                    for (uint32_t x = x0; x < x1; x++) {
+                        const int val = row[x] + above[x + 1] + carry;
+                        const int bw = (val > 127) ? 255 : 0;
+                        const int err = val - bw;
+                        carry = (7 * err) >> 4;
+                        below[x] += static_cast<int16_t>((3 * err) >> 4);
+                        below[x + 1] += static_cast<int16_t>((5 * err) >> 4);
+                        below[x + 2] += static_cast<int16_t>(err >> 4);
+                        row[x] = static_cast<uint8_t>(bw);
+                        if ((bw != 0) != invert) byte |= 0x80 >> (x & 7);
+                        if (((x & 7) == 7) || (x == nx - 1)) {
+                            bits[x / 8] = byte;
+                            byte = 0;
+                        }
+                    }
+                    progress[y].store(x1, std::memory_order_release);
+                }
+            }
+        };
+        if ((pool == nullptr) || (ny < 16)) {
+            rows(0, ny);
+        } else {
+            pool->run(ny, rows, 8);
+        }
+    }
+    //============================================================================
+
+    void makeBitonal(uint8_t *pixels, uint8_t *packed, uint32_t nx, uint32_t ny, BitonalMethod method, bool invert) {
+        if (nx == 0) return;
+        if ((method == BITONAL_DITHER) && !is_bitonal(pixels, nx, ny)) {
+            dither(pixels, packed, nx, ny, invert);
+            return;
+        }
+        const size_t sll = (nx + 7) / 8;
+        IIIFComputePool::parallel_for(ny, [&](uint32_t first, uint32_t last) {
+            for (size_t y = first; y < last; y++) {
+                uint8_t *row = pixels + y * nx;
+                eight2one(row, packed + y * sll, nx, 127, invert, row);
+            }
+        });
+    }
+    //============================================================================
+
+}
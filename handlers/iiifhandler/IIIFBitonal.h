@@ -0,0 +1,48 @@
+/*
+ * Copyright © 2022 Lukas Rosenthaler
+ * This file is part of OMAS/cserve
+ * OMAS/cserve is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * OMAS/cserve is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+#ifndef __defined_iiif_bitonal_h
+#define __defined_iiif_bitonal_h
+
+#include <cstdint>
+
+namespace cserve {
+
+    typedef enum {
+        BITONAL_DITHER,     //!< Floyd-Steinberg error diffusion
+        BITONAL_THRESHOLD   //!< values above 127 become white, the others black
+    } BitonalMethod;
+
+    /*!
+     * Convert a gray image (8 bit, one channel) to black and white. The samples are replaced by
+     * 0 and 255, and the image is packed to 1 bit per pixel in the same pass, as written to
+     * bitonal TIFF files (see eight2one()).
+     *
+     * The error diffusion runs as a wavefront on the IIIFComputePool: every row is processed by
+     * one thread and follows the row above at a distance of a few pixels, which is all that the
+     * Floyd-Steinberg weights depend on. The result is exactly that of the serial algorithm.
+     * An image consisting of 0 and 255 only isn't changed by the error diffusion and is just
+     * packed, as with BITONAL_THRESHOLD.
+     *
+     * \param[in,out] pixels nx * ny samples
+     * \param[out] packed ny rows of (nx + 7) / 8 bytes
+     * \param[in] nx Width of the image
+     * \param[in] ny Height of the image
+     * \param[in] method Error diffusion or threshold
+     * \param[in] invert Set the bits of the black instead of the white pixels
+     */
+    void makeBitonal(uint8_t *pixels, uint8_t *packed, uint32_t nx, uint32_t ny, BitonalMethod method, bool invert);
+
+}
+
+#endif
@@ -0,0 +1,170 @@
+/*
+ * Copyright © 2022 Lukas Rosenthaler
+ * This file is part of OMAS/cserve
+ * OMAS/cserve is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * OMAS/cserve is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+#include <algorithm>
+
+#include "IIIFBufferPool.h"
+
+namespace cserve {
+
+    std::shared_ptr<IIIFBufferPool> IIIFBufferPool::shared_pool;
+
+    IIIFBufferPool::IIIFBufferPool(size_t max_idle_bytes_p) : max_idle_bytes(max_idle_bytes_p) {}
+    //============================================================================
+
+    template<>
+    std::multimap<size_t, std::vector<uint8_t>> &IIIFBufferPool::idle_map<uint8_t>() { return idle8; }
+    //============================================================================
+
+    template<>
+    std::multimap<size_t, std::vector<uint16_t>> &IIIFBufferPool::idle_map<uint16_t>() { return idle16; }
+    //============================================================================
+
+    size_t IIIFBufferPool::size_class(size_t n) {
+        if (n <= 4) return n;
+        size_t step = 1;
+        while ((step << 3) < n) step <<= 1; // n is between 4 * step and 8 * step
+        return (n + step - 1) / step * step;
+    }
+    //============================================================================
+
+    template<typename T>
+    std::vector<T> IIIFBufferPool::get(size_t n) {
+        if (n * sizeof(T) < min_bytes) return std::vector<T>(n);
+        std::vector<T> buf;
+        {
+            std::lock_guard<std::mutex> lock(locking);
+            largest_request = std::max(largest_request, n * sizeof(T));
+            auto &idle = idle_map<T>();
+            auto it = idle.lower_bound(n);
+            if ((it != idle.end()) && (it->first <= n + n / 2)) {
+                buf = std::move(it->second);
+                idle_bytes -= it->first * sizeof(T);
+                idle.erase(it);
+            }
+        }
+        if (buf.capacity() >= n) {
+            ++n_hits;
+        } else {
+            ++n_misses;
+            buf.reserve(size_class(n));
+        }
+        buf.resize(n); // only touches the samples beyond the old size
+        return buf;
+    }
+    //============================================================================
+
+    template<typename T>
+    void IIIFBufferPool::put(std::vector<T> &&buf) {
+        const size_t capacity = buf.capacity();
+        if ((capacity * sizeof(T) < min_bytes) || (capacity * sizeof(T) > max_idle_bytes)) {
+            if (capacity * sizeof(T) >= min_bytes) ++n_discarded;
+            std::vector<T>().swap(buf);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(locking);
+        idle_map<T>().emplace(capacity, std::move(buf));
+        idle_bytes += capacity * sizeof(T);
+        trim();
+        peak_idle_bytes = std::max(peak_idle_bytes, idle_bytes);
+    }
+    //============================================================================
+
+    void IIIFBufferPool::trim() {
+        while (idle_bytes > max_idle_bytes) {
+            //
+            // the smallest buffers are freed first: faulting in a large buffer again costs
+            // the most, and small ones are more likely to be replaced by the next request
+            //
+            auto it8 = idle8.begin();
+            auto it16 = idle16.begin();
+            if (!idle8.empty() && (idle16.empty() || it8->first <= it16->first * 2)) {
+                idle_bytes -= it8->first;
+                idle8.erase(it8);
+            } else {
+                idle_bytes -= it16->first * sizeof(uint16_t);
+                idle16.erase(it16);
+            }
+            ++n_discarded;
+        }
+    }
+    //============================================================================
+
+    void IIIFBufferPool::clear() {
+        std::lock_guard<std::mutex> lock(locking);
+        idle8.clear();
+        idle16.clear();
+        idle_bytes = 0;
+    }
+    //============================================================================
+
+    size_t IIIFBufferPool::getIdleBytes() {
+        std::lock_guard<std::mutex> lock(locking);
+        return idle_bytes;
+    }
+    //============================================================================
+
+    size_t IIIFBufferPool::getPeakIdleBytes() {
+        std::lock_guard<std::mutex> lock(locking);
+        return peak_idle_bytes;
+    }
+    //============================================================================
+
+    size_t IIIFBufferPool::getLargestRequest() {
+        std::lock_guard<std::mutex> lock(locking);
+        return largest_request;
+    }
+    //============================================================================
+
+    void IIIFBufferPool::configure(size_t max_idle_bytes) {
+        std::shared_ptr<IIIFBufferPool> pool;
+        if (max_idle_bytes > 0) {
+            pool = std::make_shared<IIIFBufferPool>(max_idle_bytes);
+        }
+        std::atomic_store(&shared_pool, pool);
+    }
+    //============================================================================
+
+    std::shared_ptr<IIIFBufferPool> IIIFBufferPool::instance() {
+        return std::atomic_load(&shared_pool);
+    }
+    //============================================================================
+
+    template<typename T>
+    std::vector<T> acquirePixels(size_t n) {
+        auto pool = IIIFBufferPool::instance();
+        if (pool == nullptr) return std::vector<T>(n);
+        return pool->get<T>(n);
+    }
+    //============================================================================
+
+    template<typename T>
+    void releasePixels(std::vector<T> &&buf) {
+        auto pool = IIIFBufferPool::instance();
+        if (pool == nullptr) {
+            std::vector<T>().swap(buf);
+        } else {
+            pool->put<T>(std::move(buf));
+        }
+        buf.clear();
+    }
+    //============================================================================
+
+    template std::vector<uint8_t> IIIFBufferPool::get<uint8_t>(size_t n);
+    template std::vector<uint16_t> IIIFBufferPool::get<uint16_t>(size_t n);
+    template void IIIFBufferPool::put<uint8_t>(std::vector<uint8_t> &&buf);
+    template void IIIFBufferPool::put<uint16_t>(std::vector<uint16_t> &&buf);
+    template std::vector<uint8_t> acquirePixels<uint8_t>(size_t n);
+    template std::vector<uint16_t> acquirePixels<uint16_t>(size_t n);
+    template void releasePixels<uint8_t>(std::vector<uint8_t> &&buf);
+    template void releasePixels<uint16_t>(std::vector<uint16_t> &&buf);
+
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright © 2022 Lukas Rosenthaler
+ * This file is part of OMAS/cserve
+ * OMAS/cserve is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * OMAS/cserve is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef __defined_iiif_buffer_pool_h
+#define __defined_iiif_buffer_pool_h
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace cserve {
+
+    /*!
+     * Pixel buffers kept for reuse by the following requests.
+     *
+     * Every request allocates several buffers of the size of the image (reading, cropping,
+     * scaling, color conversion...). Buffers of this size are mapped freshly by malloc() and
+     * returned to the kernel when freed, so that every page is faulted in (and zeroed) again
+     * for every request. The pool keeps the released buffers up to a configurable amount of
+     * memory and hands them out again for requests of similar size.
+     *
+     * The capacity of a new buffer is rounded up to a size class (2^k times 1, 1.25, 1.5 or
+     * 1.75), and an idle buffer is reused for requests needing at least 2/3 of its capacity.
+     * Small buffers (below min_bytes) are not pooled, malloc() handles them well. The pool
+     * is used by all request threads; since only a few buffers are taken per operation, a
+     * single lock is sufficient.
+     */
+    class IIIFBufferPool {
+    private:
+        std::mutex locking;
+        std::multimap<size_t, std::vector<uint8_t>> idle8;   //!< idle buffers by capacity (in samples)
+        std::multimap<size_t, std::vector<uint16_t>> idle16; //!< idle buffers by capacity (in samples)
+        size_t max_idle_bytes;
+        size_t idle_bytes{0};
+        size_t peak_idle_bytes{0};
+        size_t largest_request{0};
+        std::atomic<unsigned long long> n_hits{0};
+        std::atomic<unsigned long long> n_misses{0};
+        std::atomic<unsigned long long> n_discarded{0};
+
+        static std::shared_ptr<IIIFBufferPool> shared_pool;
+
+        template<typename T>
+        std::multimap<size_t, std::vector<T>> &idle_map();
+
+        void trim();
+
+    public:
+        static constexpr size_t min_bytes = 256 * 1024; //!< smaller buffers are not pooled
+
+        /*!
+         * Constructor
+         *
+         * @param max_idle_bytes_p Maximal memory kept in idle buffers
+         */
+        explicit IIIFBufferPool(size_t max_idle_bytes_p);
+
+        IIIFBufferPool(const IIIFBufferPool&) = delete;
+
+        IIIFBufferPool &operator=(const IIIFBufferPool&) = delete;
+
+        /*!
+         * Get a buffer of n samples. The content is undefined if the buffer is reused.
+         *
+         * @param n Number of samples
+         * @return Buffer with size() == n
+         */
+        template<typename T>
+        std::vector<T> get(size_t n);
+
+        /*!
+         * Give a buffer back to the pool. If the idle buffers exceed the limit, the smallest
+         * ones are freed.
+         *
+         * @param buf Buffer no longer used
+         */
+        template<typename T>
+        void put(std::vector<T> &&buf);
+
+        /*!
+         * Free all idle buffers
+         */
+        void clear();
+
+        [[nodiscard]] inline size_t max_idle() const { return max_idle_bytes; }
+
+        [[nodiscard]] inline unsigned long long hits() const { return n_hits; }
+
+        [[nodiscard]] inline unsigned long long misses() const { return n_misses; }
+
+        [[nodiscard]] inline unsigned long long discarded() const { return n_discarded; }
+
+        size_t getIdleBytes();
+
+        size_t getPeakIdleBytes();
+
+        size_t getLargestRequest(); //!< largest buffer requested (in bytes)
+
+        /*!
+         * Capacity allocated for a buffer of n samples (the size class)
+         */
+        static size_t size_class(size_t n);
+
+        /*!
+         * Set up the pool used by acquirePixels() and releasePixels(). With max_idle_bytes == 0
+         * no pool is used.
+         *
+         * @param max_idle_bytes Maximal memory kept in idle buffers
+         */
+        static void configure(size_t max_idle_bytes);
+
+        /*!
+         * The pool used by acquirePixels() and releasePixels(), nullptr if buffers are not pooled
+         */
+        static std::shared_ptr<IIIFBufferPool> instance();
+    };
+
+    /*!
+     * Get a pixel buffer of n samples from the shared pool (or allocate it if there is no pool).
+     * The content is undefined, the buffer must be filled completely by the caller.
+     *
+     * @param n Number of samples
+     * @return Buffer with size() == n
+     */
+    template<typename T>
+    std::vector<T> acquirePixels(size_t n);
+
+    /*!
+     * Give a pixel buffer back to the shared pool (or free it if there is no pool). The
+     * buffer is empty afterwards.
+     *
+     * @param buf Buffer no longer used
+     */
+    template<typename T>
+    void releasePixels(std::vector<T> &&buf);
+
+    extern template std::vector<uint8_t> IIIFBufferPool::get<uint8_t>(size_t n);
+    extern template std::vector<uint16_t> IIIFBufferPool::get<uint16_t>(size_t n);
+    extern template void IIIFBufferPool::put<uint8_t>(std::vector<uint8_t> &&buf);
+    extern template void IIIFBufferPool::put<uint16_t>(std::vector<uint16_t> &&buf);
+    extern template std::vector<uint8_t> acquirePixels<uint8_t>(size_t n);
+    extern template std::vector<uint16_t> acquirePixels<uint16_t>(size_t n);
+    extern template void releasePixels<uint8_t>(std::vector<uint8_t> &&buf);
+    extern template void releasePixels<uint16_t>(std::vector<uint16_t> &&buf);
+
+}
+
+#endif
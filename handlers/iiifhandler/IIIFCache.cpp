@@ -10,6 +10,7 @@
  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
  */
 
+#include <chrono>
 #include <string>
 #include <iostream>
 #include <fstream>
@@ -20,6 +21,7 @@
 #include <vector>
 #include <cmath>
 #include <memory>
+#include <unordered_set>
 
 
 #ifdef HAVE_MALLOC_H
@@ -39,6 +41,8 @@
 
 static const char file_[] = __FILE__;
 
+static const size_t max_buffered_accesses = 4096; // per shard, between two runs of the evictor
+
 namespace cserve {
 
     typedef struct AListEle_ {
@@ -60,20 +64,94 @@ namespace cserve {
     } AListEle;
 
 
+    static bool _compare_access_time_asc(const AListEle &e1, const AListEle &e2) {
+        double d = difftime(e1.access_time, e2.access_time);
+        return (d < 0.0);
+    }
+    //============================================================================
+
+    static bool _compare_access_time_desc(const AListEle &e1, const AListEle &e2) {
+        double d = difftime(e1.access_time, e2.access_time);
+        return (d > 0.0);
+    }
+    //============================================================================
+
+    static bool _compare_fsize_asc(const AListEle &e1, const AListEle &e2) {
+        return (e1.fsize < e2.fsize);
+    }
+    //============================================================================
+
+    static bool _compare_fsize_desc(const AListEle &e1, const AListEle &e2) {
+        return (e1.fsize > e2.fsize);
+    }
+    //============================================================================
+
+    IIIFCache::Pin::Pin(Pin &&other) noexcept : cache(other.cache), entry(std::move(other.entry)),
+                                                 _path(std::move(other._path)) {
+        other.cache = nullptr;
+    }
+    //============================================================================
+
+    IIIFCache::Pin &IIIFCache::Pin::operator=(Pin &&other) noexcept {
+        if (this != &other) {
+            release();
+            cache = other.cache;
+            entry = std::move(other.entry);
+            _path = std::move(other._path);
+            other.cache = nullptr;
+        }
+        return *this;
+    }
+    //============================================================================
+
+    IIIFCache::Pin::~Pin() {
+        release();
+    }
+    //============================================================================
+
+    void IIIFCache::Pin::release() {
+        if (entry == nullptr) return;
+        if ((--entry->pins == 0) && entry->removed) {
+            cache->unlink_file(*entry); // the entry has been purged or replaced while the file was in use
+        }
+        entry = nullptr;
+        cache = nullptr;
+    }
+    //============================================================================
+
+    void IIIFCache::unlink_file(CacheEntry &entry) {
+        if (!entry.unlinked.exchange(true)) {
+            std::string delpath = _cachedir + "/" + entry.record.cachepath;
+            ::unlink(delpath.c_str());
+        }
+    }
+    //============================================================================
+
+    void IIIFCache::retire(const std::shared_ptr<CacheEntry> &entry) {
+        cachesize -= entry->record.fsize;
+        --nfiles;
+        entry->removed = true;
+        if (entry->pins == 0) {
+            unlink_file(*entry);
+        } else {
+            Server::logger()->debug("Cache file \"{}\" in use, deleting it later", entry->record.cachepath);
+        }
+    }
+    //============================================================================
+
     IIIFCache::IIIFCache(const std::string &cachedir_p, long long max_cachesize_p, unsigned max_nfiles_p,
-                         float cache_hysteresis_p) : _cachedir(cachedir_p), max_cachesize(max_cachesize_p),
-                                                     max_nfiles(max_nfiles_p), cache_hysteresis(cache_hysteresis_p) {
+                         float cache_hysteresis_p, IIIFCachePolicy::Type policy_p)
+            : _cachedir(cachedir_p), policy(policy_p), cachesize(0), max_cachesize(max_cachesize_p), nfiles(0),
+              max_nfiles(max_nfiles_p), cache_hysteresis(cache_hysteresis_p) {
 
         if (access(_cachedir.c_str(), R_OK | W_OK | X_OK) != 0) {
             throw IIIFError(file_, __LINE__, "Cache directory not available", errno);
         }
 
         std::string cachefilename = _cachedir + "/.iiifcache";
-        cachesize = 0;
-        nfiles = 0;
 
-        Server::logger()->info("Cache at \"{}\" (cachesize={} nfiles={} hysteresis={})", _cachedir.c_str(), max_cachesize,
-                               max_nfiles, cache_hysteresis);
+        Server::logger()->info("Cache at \"{}\" (cachesize={} nfiles={} hysteresis={} policy={})", _cachedir.c_str(),
+                               max_cachesize, max_nfiles, cache_hysteresis, IIIFCachePolicy::type_name(policy_p));
         std::ifstream cachefile(cachefilename, std::ofstream::in | std::ofstream::binary);
 
         struct dirent **namelist;
@@ -118,7 +196,10 @@ namespace cserve {
                 cr.fsize = fr.fsize;
                 cachesize += fr.fsize;
                 nfiles++;
-                cachetable[fr.canonical] = cr;
+                auto entry = std::make_shared<CacheEntry>();
+                entry->record = cr;
+                entry->access_time = cr.access_time;
+                shard(fr.canonical).cachetable[fr.canonical] = entry;
                 Server::logger()->info("File \"{}\" adding to cache", cr.cachepath);
             }
         }
@@ -127,6 +208,10 @@ namespace cserve {
         // now we looking for files that are not in the list of cached files
         // and we delete them
         //
+        std::unordered_set<std::string> cachepaths;
+        for (const auto &sh : shards) {
+            for (const auto &ele : sh.cachetable) cachepaths.insert(ele.second->record.cachepath);
+        }
         int n = scandir(_cachedir.c_str(), &namelist, nullptr, alphasort);
 
         if (n < 0) {
@@ -135,13 +220,8 @@ namespace cserve {
             while (n--) {
                 if (namelist[n]->d_name[0] == '.') continue; // files beginning with "." are not removed
                 std::string file_on_disk = namelist[n]->d_name;
-                bool found = false;
 
-                for (const auto &ele : cachetable) {
-                    if (ele.second.cachepath == file_on_disk) found = true;
-                }
-
-                if (!found) {
+                if (cachepaths.count(file_on_disk) == 0) {
                     std::string ff = _cachedir + "/" + file_on_disk;
                     Server::logger()->info("File \"{}\" not in cache file! Deleting...", file_on_disk);
                     remove(ff.c_str());
@@ -153,43 +233,70 @@ namespace cserve {
             free(namelist);
         }
 
-        for (const auto &ele : cachetable) {
-            try {
-                (void) sizetable.at(ele.second.origpath);
-            } catch (const std::out_of_range &oor) {
-                IIIFCache::SizeRecord tmp_cr = {ele.second.img_w, ele.second.img_h, ele.second.resolutions, ele.second.mtime};
-                sizetable[ele.second.origpath] = tmp_cr;
+        for (const auto &sh : shards) {
+            for (const auto &ele : sh.cachetable) {
+                const CacheRecord &cr = ele.second->record;
+                auto &sizetable = shard(cr.origpath).sizetable;
+                if (sizetable.find(cr.origpath) == sizetable.end()) {
+                    IIIFCache::SizeRecord tmp_cr = {cr.img_w, cr.img_h, cr.resolutions, cr.mtime};
+                    sizetable[cr.origpath] = tmp_cr;
+                }
             }
         }
+
+        //
+        // the policy starts with the files in the order of their last access
+        //
+        std::vector<AListEle> alist;
+        for (const auto &sh : shards) {
+            for (const auto &ele : sh.cachetable) {
+                AListEle al = {ele.first, ele.second->access_time, ele.second->record.fsize};
+                alist.push_back(al);
+            }
+        }
+        sort(alist.begin(), alist.end(), _compare_access_time_asc);
+        for (const auto &ele : alist) policy.add(ele.canonical);
+
+        evictor = std::thread(&IIIFCache::evictor_loop, this);
     }
     //============================================================================
 
     IIIFCache::~IIIFCache() {
         Server::logger()->debug("Closing cache...");
+        {
+            std::lock_guard<std::mutex> events_guard(events_locking);
+            stop_evictor = true;
+        }
+        evict_cond.notify_one();
+        evictor.join();
+
         std::string cachefilename = _cachedir + "/.iiifcache";
         std::ofstream cachefile(cachefilename, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
 
         if (!cachefile.fail()) {
-            for (const auto &ele : cachetable) {
-                IIIFCache::FileCacheRecord fr;
-                fr.img_w = ele.second.img_w;
-                fr.img_h = ele.second.img_h;
-                fr.nresolutions = ele.second.resolutions.size();
-                for (int i = 0; i < fr.nresolutions; ++i) {
-                    fr.resolutions[sizeof(SubImageInfo)*i] = ele.second.resolutions[i].reduce;
-                    fr.resolutions[3*i + 1] = ele.second.resolutions[i].width;
-                    fr.resolutions[3*i + 2] = ele.second.resolutions[i].height;
-                    fr.resolutions[3*i + 3] = ele.second.resolutions[i].tile_width;
-                    fr.resolutions[3*i + 4] = ele.second.resolutions[i].tile_height;
+            for (const auto &sh : shards) {
+                for (const auto &ele : sh.cachetable) {
+                    const CacheRecord &cr = ele.second->record;
+                    IIIFCache::FileCacheRecord fr;
+                    fr.img_w = cr.img_w;
+                    fr.img_h = cr.img_h;
+                    fr.nresolutions = cr.resolutions.size();
+                    for (int i = 0; i < fr.nresolutions; ++i) {
+                        fr.resolutions[sizeof(SubImageInfo)*i] = cr.resolutions[i].reduce;
+                        fr.resolutions[3*i + 1] = cr.resolutions[i].width;
+                        fr.resolutions[3*i + 2] = cr.resolutions[i].height;
+                        fr.resolutions[3*i + 3] = cr.resolutions[i].tile_width;
+                        fr.resolutions[3*i + 4] = cr.resolutions[i].tile_height;
+                    }
+                    (void) snprintf(fr.canonical, 256, "%s", ele.first.c_str());
+                    (void) snprintf(fr.origpath, 256, "%s", cr.origpath.c_str());
+                    (void) snprintf(fr.cachepath, 256, "%s", cr.cachepath.c_str());
+                    fr.mtime = cr.mtime;
+                    fr.fsize = cr.fsize;
+                    fr.access_time = ele.second->access_time;
+                    cachefile.write((char *) &fr, sizeof(IIIFCache::FileCacheRecord));
+                    Server::logger()->debug("Writing \"{}\" to cache file...", cr.cachepath);
                 }
-                (void) snprintf(fr.canonical, 256, "%s", ele.first.c_str());
-                (void) snprintf(fr.origpath, 256, "%s", ele.second.origpath.c_str());
-                (void) snprintf(fr.cachepath, 256, "%s", ele.second.cachepath.c_str());
-                fr.mtime = ele.second.mtime;
-                fr.fsize = ele.second.fsize;
-                fr.access_time = ele.second.access_time;
-                cachefile.write((char *) &fr, sizeof(IIIFCache::FileCacheRecord));
-                Server::logger()->debug("Writing \"{}\" to cache file...", ele.second.cachepath);
             }
         }
         cachefile.close();
@@ -235,73 +342,113 @@ namespace cserve {
     }
     //============================================================================
 
-    static bool _compare_access_time_asc(const AListEle &e1, const AListEle &e2) {
-        double d = difftime(e1.access_time, e2.access_time);
-        return (d < 0.0);
+    void IIIFCache::record_event(EventType type, const std::string &canonical) {
+        std::lock_guard<std::mutex> events_guard(events_locking);
+        events.emplace_back(type, canonical);
     }
     //============================================================================
 
-    static bool _compare_access_time_desc(const AListEle &e1, const AListEle &e2) {
-        double d = difftime(e1.access_time, e2.access_time);
-        return (d > 0.0);
+    void IIIFCache::update_policy() {
+        std::vector<std::pair<EventType, std::string>> new_events;
+        {
+            std::lock_guard<std::mutex> events_guard(events_locking);
+            new_events.swap(events);
+        }
+        for (const auto &event : new_events) {
+            if (event.first == ADDED) {
+                policy.add(event.second);
+            } else {
+                policy.remove(event.second);
+            }
+        }
+        std::vector<std::string> accesses;
+        for (auto &sh : shards) {
+            {
+                std::lock_guard<std::mutex> access_guard(sh.access_locking);
+                accesses.swap(sh.accesses);
+            }
+            for (const auto &canonical : accesses) policy.access(canonical);
+            accesses.clear();
+        }
     }
     //============================================================================
 
-    static bool _compare_fsize_asc(const AListEle &e1, const AListEle &e2) {
-        return (e1.fsize < e2.fsize);
+    bool IIIFCache::over_limit() const {
+        return ((max_cachesize > 0) && (cachesize >= max_cachesize)) || ((max_nfiles > 0) && (nfiles >= max_nfiles));
     }
     //============================================================================
 
-    static bool _compare_fsize_desc(const AListEle &e1, const AListEle &e2) {
-        return (e1.fsize > e2.fsize);
+    void IIIFCache::evictor_loop() {
+        std::unique_lock<std::mutex> events_guard(events_locking);
+        while (!stop_evictor) {
+            //
+            // the cache hits are also collected regularly, so that the policy knows about them
+            //
+            evict_cond.wait_for(events_guard, std::chrono::seconds(1), [this] { return evict_requested || stop_evictor; });
+            if (stop_evictor) break;
+            evict_requested = false;
+            events_guard.unlock();
+            try {
+                (void) purge(true);
+            }
+            catch (const std::exception &err) {
+                Server::logger()->error("Cache eviction failed: {}", err.what());
+            }
+            events_guard.lock();
+        }
     }
     //============================================================================
 
     int IIIFCache::purge(bool use_lock) {
-        if ((max_cachesize == 0) && (max_nfiles == 0)) return 0; // allow cache to grow indefinitely! dangerous!!
-        int n = 0;
-
-        if (((max_cachesize > 0) && (cachesize >= max_cachesize)) || ((max_nfiles > 0) && (nfiles >= max_nfiles))) {
-            std::vector<AListEle> alist;
-            std::unique_lock<std::mutex> locking_mutex_guard(locking, std::defer_lock);
-            if (use_lock) locking_mutex_guard.lock();
-
-            for (const auto &ele : cachetable) {
-                AListEle al = {ele.first, ele.second.access_time, ele.second.fsize};
-                alist.push_back(al);
-            }
+        std::unique_lock<std::mutex> purging_guard(purging, std::defer_lock);
+        if (use_lock) {
+            purging_guard.lock();
+        } else if (!purging_guard.try_lock()) {
+            return 0; // another thread is already purging
+        }
 
-            sort(alist.begin(), alist.end(), _compare_access_time_asc);
+        update_policy();
 
-            long long cachesize_goal = max_cachesize * cache_hysteresis;
-            int nfiles_goal = max_nfiles * cache_hysteresis;
+        if ((max_cachesize == 0) && (max_nfiles == 0)) return 0; // allow cache to grow indefinitely! dangerous!!
+        if (!over_limit()) return 0;
+        ++n_eviction_runs;
 
-            for (const auto &ele : alist) {
-                Server::logger()->debug("Purging from cache \"{}\"...", cachetable[ele.canonical].cachepath);
-                std::string delpath = _cachedir + "/" + cachetable[ele.canonical].cachepath;
+        //
+        // the cache is purged down to cache_hysteresis * max; purging stops as soon as one of the limits is reached
+        //
+        auto cachesize_goal = static_cast<unsigned long long>(static_cast<double>(max_cachesize) * cache_hysteresis);
+        auto nfiles_goal = static_cast<unsigned>(static_cast<double>(max_nfiles) * cache_hysteresis);
 
-                try {
-                    int cnt = blocked_files.at(delpath);
-                    Server::logger()->warn("Couldn't remove cache file for {}: file in use ({})!", ele.canonical, cnt);
-                } catch (const std::out_of_range &ex) {
-                    ::unlink(delpath.c_str());
-                    cachesize -= cachetable[ele.canonical].fsize;
-                    --nfiles;
-                    ++n;
-                    (void) cachetable.erase(ele.canonical);
-                }
-                if ((max_cachesize > 0) && (cachesize < cachesize_goal)) break;
-                if ((max_nfiles > 0) && (nfiles < nfiles_goal)) break;
+        int n = 0;
+        std::string canonical;
+        while (true) {
+            if (!policy.victim(canonical)) {
+                update_policy(); // files that have been added in the meantime
+                if (!policy.victim(canonical)) break;
             }
+            policy.remove(canonical);
+            std::shared_ptr<CacheEntry> entry;
+            {
+                Shard &sh = shard(canonical);
+                std::unique_lock<std::shared_mutex> shard_guard(sh.locking);
+                auto it = sh.cachetable.find(canonical);
+                if (it == sh.cachetable.end()) continue; // already removed
+                entry = it->second;
+                sh.cachetable.erase(it);
+            }
+            Server::logger()->debug("Purging from cache \"{}\"...", entry->record.cachepath);
+            retire(entry);
+            ++n;
+            if ((max_cachesize > 0) && (cachesize < cachesize_goal)) break;
+            if ((max_nfiles > 0) && (nfiles < nfiles_goal)) break;
         }
-
+        n_evictions += n;
         return n;
     }
     //============================================================================
 
-    std::string IIIFCache::check(const std::string &origpath_p, const std::string &canonical_p, bool block_file) {
+    std::shared_ptr<IIIFCache::CacheEntry> IIIFCache::lookup(const std::string &origpath_p, const std::string &canonical_p) {
         struct stat fileinfo;
-        IIIFCache::CacheRecord fr;
 
         if (stat(origpath_p.c_str(), &fileinfo) != 0) {
             throw IIIFError(file_, __LINE__, "Couldn't stat file \"" + origpath_p + "\"!", errno);
@@ -312,41 +459,55 @@ namespace cserve {
         time_t mtime = fileinfo.st_mtime;
 #endif
 
-        std::string res;
-
-        std::lock_guard<std::mutex> locking_mutex_guard(locking);
-        try {
-            fr = cachetable.at(canonical_p);
-        } catch (const std::out_of_range &oor) {
-            return res; // return empty string, because we didn't find the file in cache
+        Shard &sh = shard(canonical_p);
+        std::shared_lock<std::shared_mutex> shard_guard(sh.locking);
+        auto it = sh.cachetable.find(canonical_p);
+        if (it == sh.cachetable.end()) {
+            ++n_misses;
+            return nullptr; // we didn't find the file in cache
         }
+        const std::shared_ptr<CacheEntry> &entry = it->second;
 
         //
         // get the current time (seconds since Epoch)
         //
         time_t at;
         time(&at);
-        cachetable[canonical_p].access_time = at;// update the access time!
+        entry->access_time = at;// update the access time!
 
-        if (tcompare(mtime, fr.mtime) > 0) { // original file is newer than cache, we have to replace it...
-            return res; // return empty string, means "replace the file in the cache!"
-        } else {
-            res = _cachedir + "/" + fr.cachepath;
-            if (block_file) {
-                blocked_files[res]++;
+        if (tcompare(mtime, entry->record.mtime) > 0) { // original file is newer than cache, we have to replace it...
+            ++n_misses;
+            return nullptr; // means "replace the file in the cache!"
+        }
+        ++n_hits;
+        ++entry->pins; // pinned before the shard lock is released, so it can't be deleted by now
+        {
+            // tell the policy about the hit, but don't wait for it (the hit is lost if the buffer is busy or full)
+            std::unique_lock<std::mutex> access_guard(sh.access_locking, std::try_to_lock);
+            if (access_guard.owns_lock() && (sh.accesses.size() < max_buffered_accesses)) {
+                sh.accesses.push_back(canonical_p);
             }
-            return res;
         }
+        return entry;
+    }
+    //============================================================================
+
+    std::string IIIFCache::check(const std::string &origpath_p, const std::string &canonical_p) {
+        Pin res = pin(origpath_p, canonical_p);
+        return res.path();
     }
     //============================================================================
 
-    void IIIFCache::deblock(const std::string &res) {
-        std::lock_guard<std::mutex> locking_mutex_guard(locking);
-        blocked_files[res]--;
-        if (blocked_files[res] < 1) {
-            blocked_files.erase(res);
+    IIIFCache::Pin IIIFCache::pin(const std::string &origpath_p, const std::string &canonical_p) {
+        Pin res;
+        res.entry = lookup(origpath_p, canonical_p);
+        if (res.entry != nullptr) {
+            res.cache = this;
+            res._path = _cachedir + "/" + res.entry->record.cachepath;
         }
+        return res;
     }
+    //============================================================================
 
     /*!
      * Creates a new cache file with a unique name.
@@ -384,13 +545,12 @@ namespace cserve {
         }
 
         struct stat fileinfo{};
-        IIIFCache::CacheRecord fr;
-        IIIFCache::SizeRecord sr;
+        auto entry = std::make_shared<CacheEntry>();
+        IIIFCache::CacheRecord &fr = entry->record;
 
-        fr.img_w = sr.img_w = img_w_p;
-        fr.img_h = sr.img_h = img_h_p;
+        fr.img_w = img_w_p;
+        fr.img_h = img_h_p;
         fr.resolutions = resolutions;
-        sr.resolutions = resolutions;
         fr.origpath = origpath_p;
         fr.cachepath = cachepath;
 
@@ -409,63 +569,76 @@ namespace cserve {
         time_t at;
         time(&at);
         fr.access_time = at;
+        entry->access_time = at;
         fr.fsize = fileinfo.st_size;
 
         //
         // we check if there is already a file with the same canonical name. If so,
         // we remove it
         //
-        std::lock_guard<std::mutex> locking_mutex_guard(locking);
-        try {
-            IIIFCache::CacheRecord tmp_fr = cachetable.at(canonical_p);
-            std::string toremove = _cachedir + "/" + tmp_fr.cachepath;
-            ::unlink(toremove.c_str());
-            cachesize -= tmp_fr.fsize;
-            --nfiles;
-        } catch (const std::out_of_range &oor) {
-            ; // do nothing...
+        std::shared_ptr<CacheEntry> old_entry;
+        {
+            Shard &sh = shard(canonical_p);
+            std::unique_lock<std::shared_mutex> shard_guard(sh.locking);
+            auto it = sh.cachetable.find(canonical_p);
+            if (it != sh.cachetable.end()) old_entry = it->second;
+            sh.cachetable[canonical_p] = entry;
+            record_event(ADDED, canonical_p);
         }
-
-        purge(false);
-
-        cachetable[canonical_p] = fr;
         cachesize += fr.fsize;
-
-        IIIFCache::SizeRecord tmp_cr = {img_w_p, img_h_p, resolutions};
-        sizetable[origpath_p] = tmp_cr;
-
         ++nfiles;
+        if (old_entry != nullptr) retire(old_entry);
+
+        if (over_limit()) {
+            //
+            // the files are evicted in the background, the request doesn't wait for it
+            //
+            {
+                std::lock_guard<std::mutex> events_guard(events_locking);
+                evict_requested = true;
+            }
+            evict_cond.notify_one();
+        }
+
+        {
+            Shard &sh = shard(origpath_p);
+            std::unique_lock<std::shared_mutex> shard_guard(sh.locking);
+            IIIFCache::SizeRecord tmp_cr = {img_w_p, img_h_p, resolutions, fr.mtime};
+            sh.sizetable[origpath_p] = tmp_cr;
+        }
     }
     //============================================================================
 
     bool IIIFCache::remove(const std::string &canonical_p) {
-        IIIFCache::CacheRecord fr;
-        std::lock_guard<std::mutex> locking_mutex_guard(locking);
-
-        std::string delpath = _cachedir + "/" + cachetable[canonical_p].cachepath;
-        try {
-            int cnt = blocked_files.at(delpath);
-            Server::logger()->warn("Couldn't remove cache for \"{}\": file in use ({})!", canonical_p, cnt);
-            return false;
-        } catch (const std::out_of_range &ex) {
-            ;
-        }
-        Server::logger()->debug("Delete from cache \"{}\"...", cachetable[canonical_p].cachepath);
-        ::remove(delpath.c_str());
-        cachesize -= cachetable[canonical_p].fsize;
-        cachetable.erase(canonical_p);
-        --nfiles;
-
+        std::shared_ptr<CacheEntry> entry;
+        {
+            Shard &sh = shard(canonical_p);
+            std::unique_lock<std::shared_mutex> shard_guard(sh.locking);
+            auto it = sh.cachetable.find(canonical_p);
+            if (it == sh.cachetable.end()) return false;
+            entry = it->second;
+            sh.cachetable.erase(it);
+            record_event(REMOVED, canonical_p);
+        }
+        Server::logger()->debug("Delete from cache \"{}\"...", entry->record.cachepath);
+        retire(entry);
         return true;
     }
     //============================================================================
 
     void IIIFCache::loop(ProcessOneCacheFile worker, void *userdata, SortMethod sm) {
         std::vector<AListEle> alist;
-
-        for (const auto &ele : cachetable) {
-            AListEle al = {ele.first, ele.second.access_time, ele.second.fsize};
-            alist.push_back(al);
+        std::unordered_map<std::string, CacheRecord> records; // snapshot, the worker is called without holding a lock
+
+        for (auto &sh : shards) {
+            std::shared_lock<std::shared_mutex> shard_guard(sh.locking);
+            for (const auto &ele : sh.cachetable) {
+                CacheRecord cr = ele.second->record;
+                cr.access_time = ele.second->access_time;
+                AListEle al = {ele.first, cr.access_time, cr.fsize};
+                alist.push_back(al);
+                records[ele.first] = std::move(cr);
+            }
         }
 
         switch (sm) {
@@ -493,7 +666,7 @@ namespace cserve {
         int i = 1;
 
         for (const auto &ele : alist) {
-            worker(i, ele.canonical, cachetable[ele.canonical], userdata);
+            worker(i, ele.canonical, records[ele.canonical], userdata);
             i++;
         }
     }
@@ -514,23 +687,25 @@ namespace cserve {
         time_t mtime = fileinfo.st_mtime;
 #endif
 
-        try {
-            IIIFCache::SizeRecord sr = sizetable.at(origname_p);
-            if (tcompare(mtime, sr.mtime) > 0) { // original file is newer than cache, we have to replace it..
-                std::lock_guard<std::mutex> locking_mutex_guard(locking);
-
-                sizetable.erase(origname_p);
-                return false; // means "replace the file in the cache"
+        Shard &sh = shard(origname_p);
+        {
+            std::shared_lock<std::shared_mutex> shard_guard(sh.locking);
+            auto it = sh.sizetable.find(origname_p);
+            if (it == sh.sizetable.end()) return false;
+            if (tcompare(mtime, it->second.mtime) <= 0) {
+                img_w = it->second.img_w;
+                img_h = it->second.img_h;
+                resolutions = it->second.resolutions;
+                return true;
             }
-
-            img_w = sr.img_w;
-            img_h = sr.img_h;
-            resolutions = sr.resolutions;
-        } catch (const std::out_of_range &oor) {
-            return false;
         }
-
-        return true;
+        //
+        // original file is newer than cache, we have to replace it..
+        //
+        std::unique_lock<std::shared_mutex> shard_guard(sh.locking);
+        auto it = sh.sizetable.find(origname_p);
+        if ((it != sh.sizetable.end()) && (tcompare(mtime, it->second.mtime) > 0)) sh.sizetable.erase(it);
+        return false; // means "replace the file in the cache"
     }
     //============================================================================
 }
@@ -13,18 +13,26 @@
 #ifndef __defined_iiif_cache_h
 #define __defined_iiif_cache_h
 
+#include <array>
+#include <atomic>
+#include <condition_variable>
 #include <ctime>
+#include <memory>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 #include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <thread>
 #include <sys/time.h>
 #include <algorithm>
 
 #include "IIIFImage.h"
+#include "IIIFCachePolicy.h"
 
 #define MAX_NUM_CLEVELS 16
+#define CACHE_NUM_SHARDS 64
 
 namespace cserve {
 
@@ -35,6 +43,14 @@ namespace cserve {
      * If the file has already been cached, the cached version is sent (but only, if the "original"
      * is older than the cached file. In order to identify the different versions, the
      * canonocal URL according to the IIIF 2.0 standard is used.
+     *
+     * The index is split into CACHE_NUM_SHARDS shards by the hash of the key. Lookups (pin(), check(),
+     * getSize()) only take a shared lock of one shard, so they don't block each other. A cache file
+     * that is being sent is pinned by a reference count in its entry; if the entry is removed
+     * meanwhile, the file is deleted when the last pin is released.
+     *
+     * Files are evicted by a background thread according to a replacement policy (see IIIFCachePolicy).
+     * Requests only record which files they add and use, they never wait for the eviction.
      */
     class IIIFCache {
     public:
@@ -107,17 +123,118 @@ namespace cserve {
                                             void *userdata);
 
     private:
-        std::mutex locking;
+        /*!
+         * Entry of the index. The record is not changed after the entry has been made, except for
+         * the access time, which is updated atomically by lookups.
+         */
+        typedef struct CacheEntry_ {
+            CacheRecord record;
+            std::atomic<time_t> access_time{0};
+            std::atomic<int> pins{0};          //!< number of Pin's of the cache file
+            std::atomic<bool> removed{false};  //!< not in the index anymore, delete the file after the last pin
+            std::atomic<bool> unlinked{false}; //!< the file has been deleted
+        } CacheEntry;
+
+        typedef struct Shard_ {
+            std::shared_mutex locking;
+            std::unordered_map<std::string, std::shared_ptr<CacheEntry>> cachetable; //!< cached files by canonical URL
+            std::unordered_map<std::string, SizeRecord> sizetable; //!< image sizes by original file path
+            std::mutex access_locking;
+            std::vector<std::string> accesses; //!< cache hits not yet seen by the policy (lossy)
+        } Shard;
+
+        typedef enum {
+            ADDED, REMOVED
+        } EventType;
+
         std::string _cachedir; //!< path to the cache directory
-        std::unordered_map<std::string, CacheRecord> cachetable; //!< Internal map of all cached files
-        std::unordered_map<std::string, SizeRecord> sizetable; //!< Internal map of original file paths and image size
-        std::unordered_map<std::string, int> blocked_files;
-        unsigned long long cachesize; //!< number of bytes in the cache
+        std::array<Shard, CACHE_NUM_SHARDS> shards;
+        std::mutex purging; //!< only one thread purges the cache at a time, protects policy
+        IIIFCachePolicy policy;
+        std::mutex events_locking;
+        std::vector<std::pair<EventType, std::string>> events; //!< files added or removed, not yet seen by the policy
+        std::condition_variable evict_cond;
+        bool evict_requested{false};
+        bool stop_evictor{false};
+        std::thread evictor; //!< evicts files in the background
+        std::atomic<unsigned long long> cachesize; //!< number of bytes in the cache
         unsigned long long max_cachesize; //!< maximum number of bytes that can be cached
-        unsigned nfiles; //!< number of files in cache
+        std::atomic<unsigned> nfiles; //!< number of files in cache
         unsigned max_nfiles; //!< maximum number of files that can be cached
         float cache_hysteresis; //!< If files are purged, what percentage we go below the maximum
+        std::atomic<unsigned long long> n_hits{0}; //!< number of successful lookups by check()
+        std::atomic<unsigned long long> n_misses{0}; //!< number of failed lookups by check()
+        std::atomic<unsigned long long> n_evictions{0}; //!< number of files evicted
+        std::atomic<unsigned long long> n_eviction_runs{0}; //!< number of times the limits have been exceeded
+
+        /*!
+         * Record that a file has been added or removed. Called with the shard locked, so that the
+         * policy sees the changes of a key in the same order as the index.
+         */
+        void record_event(EventType type, const std::string &canonical);
+
+        /*!
+         * Feed the recorded events and cache hits to the policy. Called with purging locked.
+         */
+        void update_policy();
+
+        bool over_limit() const;
+
+        void evictor_loop();
+
+        inline Shard &shard(const std::string &key) {
+            return shards[std::hash<std::string>{}(key) % CACHE_NUM_SHARDS];
+        }
+
+        /*!
+         * Take an entry out of the accounting and delete its file, unless it is pinned
+         */
+        void retire(const std::shared_ptr<CacheEntry> &entry);
+
+        void unlink_file(CacheEntry &entry);
+
+        std::shared_ptr<CacheEntry> lookup(const std::string &origpath_p, const std::string &canonical_p);
+
     public:
+        /*!
+         * A cache file in use. The file is not deleted before the Pin is destroyed (or released),
+         * even if the entry is purged or replaced in the meantime.
+         */
+        class Pin {
+            friend class IIIFCache;
+        private:
+            IIIFCache *cache{nullptr};
+            std::shared_ptr<CacheEntry> entry;
+            std::string _path;
+
+        public:
+            Pin() = default;
+
+            Pin(const Pin&) = delete;
+
+            Pin(Pin &&other) noexcept;
+
+            Pin &operator=(const Pin&) = delete;
+
+            Pin &operator=(Pin &&other) noexcept;
+
+            ~Pin();
+
+            /*!
+             * @return true, if a cache file has been found
+             */
+            explicit operator bool() const { return entry != nullptr; }
+
+            /*!
+             * @return Path of the cache file, empty if there is none
+             */
+            [[nodiscard]] inline const std::string &path() const { return _path; }
+
+            /*!
+             * Allow the file to be deleted again
+             */
+            void release();
+        };
 
         /*!
          * Create a Cache instance an initialized the cache.
@@ -132,9 +249,10 @@ namespace cserve {
          * \param[in] cache_hsyteresis_p If the maximum size of the cache is reached, some of the files that
          * have not been accessed recently will be deleted. The cache_hysteresis (between 0.0 and 1.0) defines the
          * amount of bytes that have to be cleared in relation to the max_cachesize_p.
+         * \param[in] policy_p Replacement policy that selects the files to be evicted
          */
         IIIFCache(const std::string &cachedir_p, long long max_cachesize_p = 0, unsigned max_nfiles_p = 0,
-                  float cache_hysteresis_p = 0.1);
+                  float cache_hysteresis_p = 0.1, IIIFCachePolicy::Type policy_p = IIIFCachePolicy::SLRU);
 
         /*!
          * Cleans up the cache, serializes the actual cache content into a file and closes all caching
@@ -160,9 +278,10 @@ namespace cserve {
 
         /*!
          * Purge the cache to make room for more files. Uses the cache_hysteresis, max_cachesize and max_nfiles values
-         * for the amount of files that should be purged.
+         * for the amount of files that should be purged, the replacement policy selects them. This is done
+         * in the background whenever a limit is exceeded, it only has to be called to purge immediately.
          *
-         * \param[in] Use the cache-lock mutex
+         * \param[in] use_lock Wait if another thread is purging the cache. If false, return immediately in this case.
          *
          * \returns Number of files being purged.
          */
@@ -177,9 +296,18 @@ namespace cserve {
          * \returns Returns an empty string if the file is not in the cache or if the file needs to be replaced.
          *          Otherwise returns tha path to the cached file.
          */
-        std::string check(const std::string &origpath_p, const std::string &canonical_p, bool block_file = false);
+        std::string check(const std::string &origpath_p, const std::string &canonical_p);
 
-        void deblock(const std::string &res);
+        /*!
+         * check if a file is already in the cache and up-to-date and pin it, so that it's not deleted
+         * while it is in use
+         *
+         * \param[in] origpath_p The original path to the master file
+         * \param[in] canonical_p The canonical URL according to the IIIF standard
+         *
+         * \returns The pinned cache file. It's empty if the file is not in the cache or has to be replaced.
+         */
+        Pin pin(const std::string &origpath_p, const std::string &canonical_p);
 
 
         /*!
@@ -235,6 +363,31 @@ namespace cserve {
          */
         inline unsigned getMaxNfiles(void) { return max_nfiles; }
 
+        /*!
+         * Get the number of lookups (check()) that found an up-to-date cache file
+         */
+        inline unsigned long long getHits(void) { return n_hits; }
+
+        /*!
+         * Get the number of lookups (check()) that did not find an up-to-date cache file
+         */
+        inline unsigned long long getMisses(void) { return n_misses; }
+
+        /*!
+         * Get the number of files evicted by the replacement policy
+         */
+        inline unsigned long long getEvictions(void) { return n_evictions; }
+
+        /*!
+         * Get the number of times the cache has been purged because a limit was exceeded
+         */
+        inline unsigned long long getEvictionRuns(void) { return n_eviction_runs; }
+
+        /*!
+         * Get the replacement policy
+         */
+        inline IIIFCachePolicy::Type getPolicy(void) { return policy.type(); }
+
         /*!
          * get the path to the cache directory
          * \returns Path of the cache directory
@@ -0,0 +1,101 @@
+/*
+ * Copyright © 2022 Lukas Rosenthaler
+ * This file is part of OMAS/cserve
+ * OMAS/cserve is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * OMAS/cserve is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+#include <algorithm>
+#include <iterator>
+
+#include "IIIFCachePolicy.h"
+
+namespace cserve {
+
+    IIIFCachePolicy::IIIFCachePolicy(Type type_p, float protected_ratio_p) : _type(type_p),
+                                                                             protected_ratio(protected_ratio_p) {}
+    //============================================================================
+
+    void IIIFCachePolicy::add(const std::string &key) {
+        remove(key); // a replaced file starts again as a new one
+        probation.push_front(key);
+        nodes[key] = {PROBATION, probation.begin()};
+    }
+    //============================================================================
+
+    void IIIFCachePolicy::access(const std::string &key) {
+        auto it = nodes.find(key);
+        if (it == nodes.end()) return;
+        Node &node = it->second;
+        if ((_type == LRU) || (node.segment == PROTECTED)) {
+            KeyList &segment = (node.segment == PROTECTED) ? protected_ : probation;
+            segment.splice(segment.begin(), segment, node.pos);
+            return;
+        }
+        //
+        // SLRU: used again, promote the file to the protected segment. If the protected segment
+        // becomes too large, its least recently used file goes back to the probationary one.
+        //
+        protected_.splice(protected_.begin(), probation, node.pos);
+        node.segment = PROTECTED;
+        auto max_protected = std::max<size_t>(1, static_cast<size_t>(protected_ratio * static_cast<float>(nodes.size())));
+        if (protected_.size() > max_protected) {
+            auto demoted = std::prev(protected_.end());
+            Node &demoted_node = nodes[*demoted];
+            probation.splice(probation.begin(), protected_, demoted);
+            demoted_node.segment = PROBATION;
+        }
+    }
+    //============================================================================
+
+    void IIIFCachePolicy::remove(const std::string &key) {
+        auto it = nodes.find(key);
+        if (it == nodes.end()) return;
+        if (it->second.segment == PROTECTED) {
+            protected_.erase(it->second.pos);
+        } else {
+            probation.erase(it->second.pos);
+        }
+        nodes.erase(it);
+    }
+    //============================================================================
+
+    bool IIIFCachePolicy::victim(std::string &key) const {
+        if (!probation.empty()) {
+            key = probation.back();
+            return true;
+        }
+        if (!protected_.empty()) {
+            key = protected_.back();
+            return true;
+        }
+        return false;
+    }
+    //============================================================================
+
+    std::string IIIFCachePolicy::type_name(Type type) {
+        switch (type) {
+            case LRU: return "lru";
+            case SLRU: return "slru";
+        }
+        return "";
+    }
+    //============================================================================
+
+    bool IIIFCachePolicy::type_from_name(const std::string &name, Type &type) {
+        if (name == "lru") {
+            type = LRU;
+        } else if (name == "slru") {
+            type = SLRU;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    //============================================================================
+
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright © 2022 Lukas Rosenthaler
+ * This file is part of OMAS/cserve
+ * OMAS/cserve is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * OMAS/cserve is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef __defined_iiif_cache_policy_h
+#define __defined_iiif_cache_policy_h
+
+#include <list>
+#include <string>
+#include <unordered_map>
+
+namespace cserve {
+
+    /*!
+     * Replacement policy of the IIIF file cache. It decides which cache file is evicted next.
+     * All operations are O(1).
+     *
+     * - LRU: the least recently used file is evicted first.
+     * - SLRU (segmented LRU): new files enter a probationary segment; a file that is used again is
+     *   moved into a protected segment (at most protected_ratio of all files). Files are evicted
+     *   from the probationary segment first, so files that are requested only once do not push
+     *   frequently used files out of the cache.
+     *
+     * The class is not thread safe, IIIFCache only uses it from the thread that evicts.
+     */
+    class IIIFCachePolicy {
+    public:
+        typedef enum {
+            LRU, SLRU
+        } Type;
+
+    private:
+        typedef enum {
+            PROBATION, PROTECTED
+        } Segment;
+
+        typedef std::list<std::string> KeyList;
+
+        typedef struct {
+            Segment segment;
+            KeyList::iterator pos;
+        } Node;
+
+        Type _type;
+        float protected_ratio;
+        KeyList probation; //!< most recently used first (the only segment used by LRU)
+        KeyList protected_; //!< most recently used first
+        std::unordered_map<std::string, Node> nodes;
+
+    public:
+        /*!
+         * Constructor
+         *
+         * @param type_p The policy
+         * @param protected_ratio_p SLRU: maximal part of the files in the protected segment
+         */
+        explicit IIIFCachePolicy(Type type_p = SLRU, float protected_ratio_p = 0.8f);
+
+        /*!
+         * A file has been added to the cache (or replaced)
+         */
+        void add(const std::string &key);
+
+        /*!
+         * A file has been used. Unknown keys are ignored.
+         */
+        void access(const std::string &key);
+
+        /*!
+         * A file has been removed from the cache
+         */
+        void remove(const std::string &key);
+
+        /*!
+         * Get the file that should be evicted next
+         *
+         * @param key Key of the file to be evicted
+         * @return false, if there is no file
+         */
+        bool victim(std::string &key) const;
+
+        [[nodiscard]] inline size_t size() const { return nodes.size(); }
+
+        [[nodiscard]] inline Type type() const { return _type; }
+
+        /*!
+         * Name of the policy ("lru" or "slru")
+         */
+        static std::string type_name(Type type);
+
+        /*!
+         * Get the policy from its name
+         *
+         * @param name "lru" or "slru"
+         * @param type The policy
+         * @return false, if the name is unknown
+         */
+        static bool type_from_name(const std::string &name, Type &type);
+    };
+
+}
+
+#endif
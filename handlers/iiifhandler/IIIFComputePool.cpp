@@ -0,0 +1,154 @@
+/*
+ * Copyright © 2022 Lukas Rosenthaler
+ * This file is part of OMAS/cserve
+ * OMAS/cserve is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * OMAS/cserve is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+#include <algorithm>
+
+#include "IIIFComputePool.h"
+
+namespace cserve {
+
+    std::shared_ptr<IIIFComputePool> IIIFComputePool::shared_pool;
+
+    IIIFComputePool::IIIFComputePool(uint32_t nthreads, uint32_t max_per_request)
+            : max_per_request(std::max(max_per_request, 1u)) {
+        if (nthreads == 0) {
+            nthreads = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+        workers.reserve(nthreads);
+        for (uint32_t i = 0; i < nthreads; i++) {
+            workers.emplace_back(&IIIFComputePool::worker_loop, this);
+        }
+    }
+    //============================================================================
+
+    IIIFComputePool::~IIIFComputePool() {
+        {
+            std::lock_guard<std::mutex> guard(locking);
+            stopping = true;
+        }
+        work_available.notify_all();
+        for (auto &worker: workers) {
+            worker.join();
+        }
+    }
+    //============================================================================
+
+    void IIIFComputePool::work(Job &job) {
+        for (;;) {
+            uint32_t band = job.next++;
+            if (band >= job.nbands) return;
+            if (!job.failed) {
+                uint32_t first = static_cast<uint32_t>(static_cast<uint64_t>(band) * job.nrows / job.nbands);
+                uint32_t last = static_cast<uint32_t>(static_cast<uint64_t>(band + 1) * job.nrows / job.nbands);
+                try {
+                    (*job.func)(first, last);
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> guard(job.locking);
+                    if (!job.failed) {
+                        job.error = std::current_exception();
+                        job.failed = true;
+                    }
+                }
+            }
+            if (++job.done == job.nbands) {
+                std::lock_guard<std::mutex> guard(job.locking);
+                job.finished.notify_all();
+            }
+        }
+    }
+    //============================================================================
+
+    void IIIFComputePool::worker_loop() {
+        for (;;) {
+            std::shared_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> guard(locking);
+                work_available.wait(guard, [this] { return stopping || !queue.empty(); });
+                if (stopping) return;
+                job = std::move(queue.front());
+                queue.pop_front();
+            }
+            work(*job);
+        }
+    }
+    //============================================================================
+
+    void IIIFComputePool::run(uint32_t nrows, const BandFunc &func, uint32_t min_rows) {
+        if (nrows == 0) return;
+        min_rows = std::max(min_rows, 1u);
+        //
+        // a few bands more than threads, so that a slow band (or a helper that starts late)
+        // doesn't delay the whole operation
+        //
+        uint32_t nbands = std::min((nrows + min_rows - 1) / min_rows, 4 * max_per_request);
+        uint32_t nhelpers = std::min({max_per_request - 1, nbands - 1, static_cast<uint32_t>(workers.size())});
+        if (nhelpers == 0) {
+            func(0, nrows);
+            return;
+        }
+
+        auto job = std::make_shared<Job>();
+        job->func = &func;
+        job->nrows = nrows;
+        job->nbands = nbands;
+        {
+            std::lock_guard<std::mutex> guard(locking);
+            for (uint32_t i = 0; i < nhelpers; i++) queue.push_back(job);
+        }
+        if (nhelpers == 1) {
+            work_available.notify_one();
+        } else {
+            work_available.notify_all();
+        }
+
+        work(*job); // the caller takes its share of the bands
+
+        {
+            std::unique_lock<std::mutex> guard(job->locking);
+            job->finished.wait(guard, [&job] { return job->done == job->nbands; });
+        }
+        //
+        // helpers that haven't started yet have nothing left to do
+        //
+        {
+            std::lock_guard<std::mutex> guard(locking);
+            queue.erase(std::remove(queue.begin(), queue.end(), job), queue.end());
+        }
+        if (job->error) std::rethrow_exception(job->error);
+    }
+    //============================================================================
+
+    void IIIFComputePool::configure(uint32_t nthreads, uint32_t max_per_request) {
+        std::shared_ptr<IIIFComputePool> pool;
+        if (max_per_request > 1) {
+            pool = std::make_shared<IIIFComputePool>(nthreads, max_per_request);
+        }
+        std::atomic_store(&shared_pool, pool);
+    }
+    //============================================================================
+
+    std::shared_ptr<IIIFComputePool> IIIFComputePool::instance() {
+        return std::atomic_load(&shared_pool);
+    }
+    //============================================================================
+
+    void IIIFComputePool::parallel_for(uint32_t nrows, const BandFunc &func, uint32_t min_rows) {
+        auto pool = instance();
+        if ((pool == nullptr) || (nrows < 2 * std::max(min_rows, 1u))) {
+            func(0, nrows);
+            return;
+        }
+        pool->run(nrows, func, min_rows);
+    }
+    //============================================================================
+
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright © 2022 Lukas Rosenthaler
+ * This file is part of OMAS/cserve
+ * OMAS/cserve is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * OMAS/cserve is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef __defined_iiif_compute_pool_h
+#define __defined_iiif_compute_pool_h
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cserve {
+
+    /*!
+     * Worker threads shared by all requests for the pixel operations of IIIFImage.
+     *
+     * An operation is split into bands of rows which are processed by the calling (request)
+     * thread together with at most max_per_request - 1 workers. The bands are claimed one
+     * after the other, so that a busy pool only makes the caller do more of the work itself,
+     * and a single large image can't occupy all workers while tiles are requested.
+     */
+    class IIIFComputePool {
+    public:
+        typedef std::function<void(uint32_t, uint32_t)> BandFunc; //!< processes rows [first, last)
+
+    private:
+        typedef struct Job_ {
+            const BandFunc *func{nullptr};
+            uint32_t nrows{0};
+            uint32_t nbands{0};
+            std::atomic<uint32_t> next{0}; //!< next band to be claimed
+            std::atomic<uint32_t> done{0}; //!< number of bands finished (or skipped after an error)
+            std::atomic<bool> failed{false};
+            std::mutex locking;
+            std::condition_variable finished;
+            std::exception_ptr error;
+        } Job;
+
+        std::mutex locking;
+        std::condition_variable work_available;
+        std::deque<std::shared_ptr<Job>> queue; //!< one entry per helper a job asks for
+        std::vector<std::thread> workers;
+        uint32_t max_per_request;
+        bool stopping{false};
+
+        static std::shared_ptr<IIIFComputePool> shared_pool;
+
+        static void work(Job &job);
+
+        void worker_loop();
+
+    public:
+        /*!
+         * Constructor, starts the worker threads
+         *
+         * @param nthreads Number of worker threads, 0 for one per core
+         * @param max_per_request Maximal number of threads (including the caller) used for one operation
+         */
+        IIIFComputePool(uint32_t nthreads, uint32_t max_per_request);
+
+        IIIFComputePool(const IIIFComputePool&) = delete;
+
+        IIIFComputePool &operator=(const IIIFComputePool&) = delete;
+
+        /*!
+         * Destructor, waits for the workers to terminate
+         */
+        ~IIIFComputePool();
+
+        /*!
+         * Process nrows rows in bands. Returns when all bands are done. If func throws,
+         * the remaining bands are skipped and the first exception is rethrown.
+         *
+         * @param nrows Number of rows
+         * @param func Called with the first and the last (exclusive) row of a band
+         * @param min_rows Minimal number of rows of a band
+         */
+        void run(uint32_t nrows, const BandFunc &func, uint32_t min_rows = 32);
+
+        [[nodiscard]] inline size_t nthreads() const { return workers.size(); }
+
+        [[nodiscard]] inline uint32_t per_request() const { return max_per_request; }
+
+        /*!
+         * Set up the pool used by parallel_for(). With max_per_request < 2 no pool is used.
+         *
+         * @param nthreads Number of worker threads, 0 for one per core
+         * @param max_per_request Maximal number of threads (including the caller) used for one operation
+         */
+        static void configure(uint32_t nthreads, uint32_t max_per_request);
+
+        /*!
+         * The pool used by parallel_for(), nullptr if the operations run on the calling thread only
+         */
+        static std::shared_ptr<IIIFComputePool> instance();
+
+        /*!
+         * Process nrows rows in bands on the shared pool (see run()). Without pool, or
+         * if there are too few rows, func(0, nrows) is called directly.
+         */
+        static void parallel_for(uint32_t nrows, const BandFunc &func, uint32_t min_rows = 32);
+    };
+
+}
+
+#endif
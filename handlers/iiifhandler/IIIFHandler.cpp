@@ -9,6 +9,7 @@
  * but WITHOUT ANY WARRANTY; without even the implied warranty of
  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
  */
+#include <algorithm>
 #include <regex>
 #include <unordered_map>
 
@@ -18,14 +19,17 @@
 #include "HttpSendError.h"
 #include "IIIFHandler.h"
 #include "IIIFCache.h"
+#include "IIIFComputePool.h"
+#include "IIIFBufferPool.h"
 #include "IIIFLua.h"
+#include "imgformats/IIIFIOJpeg.h"
 #include "imgformats/IIIFIOTiff.h"
 
 namespace cserve {
 
     const std::string IIIFHandler::_name = "iiifhandler";
 
-    IIIFHandler::IIIFHandler() : RequestHandler() {
+    IIIFHandler::IIIFHandler() : RequestHandler(), _renders(std::make_shared<IIIFSingleFlight>()) {
         IIIFIOTiff::initLibrary();
     }
 
@@ -338,8 +342,18 @@ namespace cserve {
         conf.add_config(_name, "file_preflight_name", "file_preflight", "Name of the preflight lua function for file requests (..../file).");
         conf.add_config(_name, "max_num_cache_files", 200, "The maximal number of files to be cached.");
         conf.add_config(_name, "cache_hysteresis", 0.15f, "If the cache becomes full, the given percentage of file space is marked for reuse (0.0 - 1.0).");
+        conf.add_config(_name, "cache_policy", "slru", "Replacement policy of the cache: \"lru\" or \"slru\" (segmented LRU, files used only once are evicted first). [Default: \"slru\"]");
+        conf.add_config(_name, "memcachesize", DataSize("64MB"), "Memory for frequently requested responses in front of the file cache, e.g. '256MB'. 0 disables it. [Default: 64MB]");
+        conf.add_config(_name, "compute_threads", 0, "Number of threads for the image operations, shared by all requests. 0 uses one thread per CPU core. [Default: 0]");
+        conf.add_config(_name, "compute_threads_per_request", 4, "Maximal number of threads working on one image operation, including the request thread. 1 disables the parallel image operations. [Default: 4]");
+        conf.add_config(_name, "bufferpoolsize", DataSize("32MB"), "Memory for released pixel buffers kept for reuse by the following requests, e.g. '256MB'. The pool saves the allocation and page faulting of large buffers, but the memory stays resident while the server is idle. 0 disables the pool. [Default: 32MB]");
         conf.add_config(_name, "thumbsize", "!128,128", "Size of the thumbnails (to be used within Lua).");
         conf.add_config(_name, "jpeg_quality", 80, "Default quality for JPEG file compression. Range 1-100. [Default: 80]");
+        conf.add_config(_name, "jpeg_dct_method", "islow", "DCT of the JPEG decoder and encoder: \"islow\" (accurate integer), \"ifast\" (faster, less accurate) or \"float\". [Default: \"islow\"]");
+        conf.add_config(_name, "jpeg_optimize_coding", true, "Optimize the Huffman tables of JPEG images: smaller files, more CPU. Progressive images are always optimized. [Default: true]");
+        conf.add_config(_name, "jpeg_progressive", true, "Deliver progressive JPEG images. [Default: true]");
+        conf.add_config(_name, "jpeg_parallel_megapixels", 0, "JPEG images with at least this number of megapixels are compressed in parallel stripes by the compute threads (baseline JPEG with restart markers, standard Huffman tables). 0 disables it. [Default: 0]");
+        conf.add_config(_name, "jpeg_subsampling", "4:2:0", "Chroma subsampling of JPEG images: \"4:4:4\", \"4:2:2\" or \"4:2:0\". [Default: \"4:2:0\"]");
         conf.add_config(_name, "jpeg_scaling_quality", "medium", "Scaling quality for JPEG images [Default: \"medium\"]");
         conf.add_config(_name, "tiff_scaling_quality", "high", "Scaling quality for TIFF images [Default: \"high\"]");
         conf.add_config(_name, "png_scaling_quality", "medium", "Scaling quality for PNG images [Default: \"medium\"]");
@@ -367,10 +381,20 @@ namespace cserve {
         _cache_size = conf.get_datasize("cachesize").value_or(DataSize("200MB"));
         _max_num_chache_files = conf.get_int("max_num_cache_files").value_or(200);
         _cache_hysteresis = conf.get_float("cache_hysteresis").value_or(0.15f);
+        _cache_policy = conf.get_string("cache_policy").value_or("slru");
+        _memcache_size = conf.get_datasize("memcachesize").value_or(DataSize("64MB"));
+        _compute_threads = conf.get_int("compute_threads").value_or(0);
+        _compute_threads_per_request = conf.get_int("compute_threads_per_request").value_or(4);
+        _buffer_pool_size = conf.get_datasize("bufferpoolsize").value_or(DataSize("32MB"));
         _iiif_preflight_funcname = conf.get_string("iiif_preflight_name").value_or("iiif_preflight");
         _file_preflight_funcname = conf.get_string("file_preflight_name").value_or("file_preflight");
         _thumbnail_size = conf.get_string("thumbsize").value_or("!128,128");
         _jpeg_quality = conf.get_int("jpeg_quality").value_or(80);
+        _jpeg_dct_method = conf.get_string("jpeg_dct_method").value_or("islow");
+        _jpeg_optimize_coding = conf.get_bool("jpeg_optimize_coding").value_or(true);
+        _jpeg_progressive = conf.get_bool("jpeg_progressive").value_or(true);
+        _jpeg_subsampling = conf.get_string("jpeg_subsampling").value_or("4:2:0");
+        _jpeg_parallel_megapixels = conf.get_int("jpeg_parallel_megapixels").value_or(0);
         _scaling_quality.jpeg = get_scaling_quality(conf, "jpeg_scaling_quality", "medium");
         _scaling_quality.tiff = get_scaling_quality(conf, "tiff_scaling_quality", "high");
         _scaling_quality.png = get_scaling_quality(conf, "png_scaling_quality", "medium");
@@ -379,13 +403,39 @@ namespace cserve {
         _iiif_max_image_height = conf.get_int("iiif_max_height").value_or(0);
         std::vector<std::string> vv{"--$$$$$$$$$$$$$$$$$$$$$--"};
         _iiif_specials = conf.get_stringvec("iiif_specials").value_or(vv);
+        if (!IIIFIOJpeg::dct_method_from_name(_jpeg_dct_method, _scaling_quality.jpeg_dct)) {
+            Server::logger()->warn("Unknown JPEG DCT method \"{}\", using \"islow\"", _jpeg_dct_method);
+            _jpeg_dct_method = "islow";
+            _scaling_quality.jpeg_dct = DCT_ISLOW;
+        }
+        int h_samp, v_samp;
+        if (!IIIFIOJpeg::subsampling_from_name(_jpeg_subsampling, h_samp, v_samp)) {
+            Server::logger()->warn("Unknown JPEG chroma subsampling \"{}\", using \"4:2:0\"", _jpeg_subsampling);
+            _jpeg_subsampling = "4:2:0";
+        }
+        IIIFCachePolicy::Type cache_policy;
+        if (!IIIFCachePolicy::type_from_name(_cache_policy, cache_policy)) {
+            Server::logger()->warn("Unknown cache policy \"{}\", using \"slru\"", _cache_policy);
+            _cache_policy = "slru";
+            cache_policy = IIIFCachePolicy::SLRU;
+        }
         try {
-            _cache = std::make_shared<IIIFCache>(_cachedir, _cache_size.as_size_t(), _max_num_chache_files, _cache_hysteresis);
+            _cache = std::make_shared<IIIFCache>(_cachedir, _cache_size.as_size_t(), _max_num_chache_files, _cache_hysteresis,
+                                                 cache_policy);
         }
         catch (const IIIFError &err) {
             _cache = nullptr;
             Server::logger()->warn("Couldn't open cache directory {}: {}", _cachedir, err.to_string());
         }
+        IIIFComputePool::configure(static_cast<uint32_t>(std::max(_compute_threads, 0)),
+                                   static_cast<uint32_t>(std::max(_compute_threads_per_request, 1)));
+        IIIFBufferPool::configure(_buffer_pool_size.as_size_t());
+        //
+        // the in-memory cache is filled from the file cache, it can't be used without
+        //
+        if ((_cache != nullptr) && (_memcache_size.as_size_t() > 0)) {
+            _memcache = std::make_shared<IIIFMemoryCache>(_memcache_size.as_size_t());
+        }
 
     }
 
@@ -416,6 +466,10 @@ namespace cserve {
         lua_pushinteger(L, _max_num_chache_files);
         lua_rawset(L, -3); // table1
 
+        lua_pushstring(L, "memcachesize");
+        lua_pushstring(L, _memcache_size.as_string().c_str());
+        lua_rawset(L, -3); // table1
+
         //
         // we round the hysteresis value to 3 digits
         //
@@ -423,6 +477,22 @@ namespace cserve {
         lua_pushnumber(L, _cache_hysteresis);
         lua_rawset(L, -3); // table1
 
+        lua_pushstring(L, "cache_policy");
+        lua_pushstring(L, _cache_policy.c_str());
+        lua_rawset(L, -3); // table1
+
+        lua_pushstring(L, "compute_threads");
+        lua_pushinteger(L, _compute_threads);
+        lua_rawset(L, -3); // table1
+
+        lua_pushstring(L, "compute_threads_per_request");
+        lua_pushinteger(L, _compute_threads_per_request);
+        lua_rawset(L, -3); // table1
+
+        lua_pushstring(L, "bufferpoolsize");
+        lua_pushstring(L, _buffer_pool_size.as_string().c_str());
+        lua_rawset(L, -3); // table1
+
         lua_pushstring(L, "iiif_preflight_name");
         lua_pushstring(L, _iiif_preflight_funcname.c_str());
         lua_rawset(L, -3); // table1
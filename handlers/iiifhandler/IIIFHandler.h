@@ -12,6 +12,7 @@
 #ifndef CSERVER_IIIFHANDLER_H
 #define CSERVER_IIIFHANDLER_H
 
+#include <ctime>
 #include <string>
 
 #include "../../lib/LuaServer.h"
@@ -19,6 +20,8 @@
 #include "../../lib/RequestHandler.h"
 
 #include "IIIFCache.h"
+#include "IIIFMemoryCache.h"
+#include "IIIFSingleFlight.h"
 #include "IIIFImage.h"
 #include "iiifparser/IIIFRotation.h"
 #include "iiifparser/IIIFQualityFormat.h"
@@ -51,13 +54,37 @@ namespace cserve {
         DataSize _cache_size;
         int _max_num_chache_files;
         float _cache_hysteresis;
+        std::string _cache_policy;
+        DataSize _memcache_size;
+        int _compute_threads;
+        int _compute_threads_per_request;
+        DataSize _buffer_pool_size;
         std::string _thumbnail_size;
         int _jpeg_quality;
+        std::string _jpeg_dct_method;
+        bool _jpeg_optimize_coding;
+        bool _jpeg_progressive;
+        std::string _jpeg_subsampling;
+        int _jpeg_parallel_megapixels;
         ScalingQuality _scaling_quality;
         size_t _iiif_max_image_width;
         size_t _iiif_max_image_height;
 
         std::shared_ptr<IIIFCache> _cache;
+        std::shared_ptr<IIIFMemoryCache> _memcache; //!< hot responses in RAM, IIIFCache is the second tier
+        std::shared_ptr<IIIFSingleFlight> _renders; //!< renders in progress, identical requests wait for them
+
+        /*!
+         * Send the response from the cache, if it is there and up-to-date
+         *
+         * @return true, if the response has been sent (or sending it failed), false if it's not in the cache
+         */
+        bool send_cached_file(Connection &conn,
+                              const std::string &infile,
+                              const std::string &canonical,
+                              const std::string &canonical_header,
+                              const std::string &mimetype,
+                              const struct timespec &orig_mtime) const;
     public:
         /**
          * Initializes the libraries the IIF handler needs
@@ -109,6 +136,10 @@ namespace cserve {
 
         inline std::shared_ptr<IIIFCache> cache() const { return _cache; }
 
+        inline std::shared_ptr<IIIFMemoryCache> memcache() const { return _memcache; }
+
+        inline std::shared_ptr<IIIFSingleFlight> renders() const { return _renders; }
+
         std::pair<std::string, std::string> get_canonical_url  (
                 uint32_t tmp_w,
                 uint32_t tmp_h,
@@ -19,6 +19,7 @@
 
 #include "IIIFIO.h"
 #include "IIIFImage.h"
+#include "IIIFStrips.h"
 #include "iiifparser/IIIFRegion.h"
 #include "iiifparser/IIIFSize.h"
 
@@ -74,6 +75,19 @@ namespace cserve {
                  {HIGH, HIGH, HIGH, HIGH});
         }
 
+        /*!
+         * Open an image file for reading its rows strip by strip. The parameters are the same as
+         * for read(). The default implementation reads the whole image into memory.
+         */
+        virtual std::unique_ptr<IIIFStripSource> read_strips(const std::string &filepath,
+                                                             std::shared_ptr<IIIFRegion> region,
+                                                             std::shared_ptr<IIIFSize> size,
+                                                             bool force_bps_8,
+                                                             ScalingQuality scaling_quality) {
+            return std::make_unique<IIIFStripImage>(read(filepath, std::move(region), std::move(size),
+                                                         force_bps_8, scaling_quality));
+        }
+
         /*!
          * Get the dimension of the image
          *
@@ -99,6 +113,20 @@ namespace cserve {
         void write(IIIFImage &img, const std::string &filepath) {
             write(img, filepath, {});
         }
+
+        /*!
+         * Write the rows of a strip source. The default implementation reads all rows into
+         * memory and calls write().
+         *
+         * \param strips The rows to be written, the header holds the metadata and the connection
+         * \param filepath Name of the image file to be written (see write())
+         */
+        virtual void write_strips(std::unique_ptr<IIIFStripSource> strips,
+                                  const std::string &filepath,
+                                  const IIIFCompressionParams &params) {
+            IIIFImage img = IIIFStripSource::materialize(std::move(strips));
+            write(img, filepath, params);
+        }
     };
 
 }
@@ -9,7 +9,9 @@
  * but WITHOUT ANY WARRANTY; without even the implied warranty of
  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
  */
+#include <atomic>
 #include <iostream>
+#include <mutex>
 #include <string>
 #include <utility>
 #include <vector>
@@ -26,6 +28,14 @@
 #include "IIIFImage.h"
 #include "Parsing.h"
 #include "IIIFImgTools.h"
+#include "IIIFPixelKernels.h"
+#include "IIIFResample.h"
+#include "IIIFRotate.h"
+#include "IIIFComputePool.h"
+#include "IIIFBufferPool.h"
+#include "IIIFStrips.h"
+#include "IIIFTransformCache.h"
+#include "IIIFWatermark.h"
 #include "imgformats/IIIFIOTiff.h"
 #include "imgformats/IIIFIOJ2k.h"
 #include "imgformats/IIIFIOJpeg.h"
@@ -68,7 +78,7 @@ namespace cserve {
                 throw IIIFImageError(file_, __LINE__, fmt::format("Image with invalid bps (bps = {}).", bps));
             }
         }
-
+        bitonal = img_p.bitonal;
     }
     //============================================================================
 
@@ -85,6 +95,7 @@ namespace cserve {
         photo = other.photo;
         bpixels = std::move(other.bpixels);
         wpixels = std::move(other.wpixels);
+        bitonal = std::move(other.bitonal);
         xmp = other.xmp;
         icc = other.icc;
         iptc = other.iptc;
@@ -143,6 +154,7 @@ namespace cserve {
     }
 
     [[maybe_unused]] void IIIFImage::setPixel(uint32_t x, uint32_t y, uint32_t c, int val) {
+        bitonal.clear();
         if (x >= nx) throw IIIFImageError(file_, __LINE__, "Error in setPixel: x >= nx");
         if (y >= ny) throw IIIFImageError(file_, __LINE__, "Error in setPixel: y >= ny");
         if (c >= nc) throw IIIFImageError(file_, __LINE__, "Error in setPixel: c >= nc");
@@ -189,6 +201,7 @@ namespace cserve {
                     throw IIIFImageError(file_, __LINE__, fmt::format("Image with invalid bps (bps = {}).", bps));
                 }
             }
+            bitonal = img_p.bitonal;
             xmp = img_p.xmp;
             icc = img_p.icc;
             iptc = img_p.iptc;
@@ -203,8 +216,8 @@ namespace cserve {
         if (this != &other) {
             es = {};
             orientation = TOPLEFT;
-            bpixels.clear();
-            wpixels.clear();
+            releasePixels(std::move(bpixels));
+            releasePixels(std::move(wpixels));
             xmp.reset();
             icc.reset();
             iptc.reset();
@@ -221,6 +234,7 @@ namespace cserve {
             photo = other.photo;
             bpixels = std::move(other.bpixels);
             wpixels = std::move(other.wpixels);
+            bitonal = std::move(other.bitonal);
             xmp = other.xmp;
             icc = other.icc;
             iptc = other.iptc;
@@ -246,6 +260,12 @@ namespace cserve {
         return *this;
     }
 
+    IIIFImage::~IIIFImage() {
+        releasePixels(std::move(bpixels));
+        releasePixels(std::move(wpixels));
+    }
+    //============================================================================
+
     /*!
      * If this image has no SipiExif, creates an empty one.
      */
@@ -253,6 +273,59 @@ namespace cserve {
         if (exif == nullptr) exif = std::make_shared<IIIFExif>();
     }
 
+    //============================================================================
+
+    /*!
+     * If this image has no ICC profile, assigns the default profile for the number of channels.
+     */
+    void IIIFImage::ensure_icc() {
+        if (icc == nullptr) {
+            switch (nc) {
+                case 1: {
+                    icc = std::make_shared<IIIFIcc>(icc_GRAY_D50); // assume gray value image with D50
+                    break;
+                }
+                case 3: {
+                    icc = std::make_shared<IIIFIcc>(icc_sRGB); // assume sRGB
+                    break;
+                }
+                case 4: {
+                    icc = std::make_shared<IIIFIcc>(icc_CYMK_standard); // assume CYMK
+                    break;
+                }
+                default: {
+                    throw IIIFImageError(file_, __LINE__,
+                                         "Cannot assign ICC profile to image with nc=" + std::to_string(nc));
+                }
+            }
+        }
+    }
+    //============================================================================
+
+    /*!
+     * The photometric interpretation of an image converted to the given ICC profile.
+     */
+    PhotometricInterpretation IIIFImage::icc_photometric(const IIIFIcc &icc, PhotometricInterpretation photo) {
+        switch (icc.getProfileType()) {
+            case icc_GRAY_D50: {
+                return MINISBLACK;
+            }
+            case icc_RGB:
+            case icc_sRGB:
+            case icc_AdobeRGB: {
+                return RGB;
+            }
+            case icc_CYMK_standard: {
+                return SEPARATED;
+            }
+            case icc_LAB: {
+                return CIELAB;
+            }
+            default: {
+                return photo;
+            }
+        }
+    }
     //============================================================================
 
      IIIFImage IIIFImage::read(const std::string& filepath,
@@ -304,6 +377,32 @@ namespace cserve {
     }
     //============================================================================
 
+    std::unique_ptr<IIIFStripSource> IIIFImage::read_strips(const std::string& filepath,
+                                                            const std::shared_ptr<IIIFRegion>& region,
+                                                            const std::shared_ptr<IIIFSize>& size,
+                                                            bool force_bps_8,
+                                                            ScalingQuality scaling_quality) {
+        std::filesystem::path fpath(filepath);
+        std::string fext(fpath.extension().string());
+        std::transform(fext.begin(), fext.end(), fext.begin(), [](unsigned char c) { return std::tolower(c); });
+
+        try {
+            if ((fext == ".tif") || (fext == ".tiff")) {
+                return io["tif"]->read_strips(fpath.string(), region, size, force_bps_8, scaling_quality);
+            } else if ((fext == ".jpg") || (fext == ".jpeg")) {
+                return io["jpg"]->read_strips(fpath.string(), region, size, force_bps_8, scaling_quality);
+            }
+        }
+        catch (const IIIFImageError &err) {
+            // the file may have the wrong extension, read() tries all image formats
+        }
+        //
+        // the other formats (and files with an unexpected extension) are read completely
+        //
+        return std::make_unique<IIIFStripImage>(read(filepath, region, size, force_bps_8, scaling_quality));
+    }
+    //============================================================================
+
     IIIFImage IIIFImage::readOriginal(const std::string &filepath,
                                       const std::shared_ptr<IIIFRegion>& region,
                                       const std::shared_ptr<IIIFSize>& size,
@@ -424,53 +523,30 @@ namespace cserve {
    }
     //============================================================================
 
+    void IIIFImage::write_strips(const std::string &ftype, std::unique_ptr<IIIFStripSource> strips,
+                                 const std::string &filepath, const IIIFCompressionParams &params) {
+        io[ftype]->write_strips(std::move(strips), filepath, params);
+    }
+    //============================================================================
+
     [[maybe_unused]]
     void IIIFImage::convertYCC2RGB() {
+        bitonal.clear();
         if (bps == 8) {
-            auto outbuf = std::vector<uint8_t>(nc*nx*ny);
-
-            for (size_t j = 0; j < ny; j++) {
-                for (size_t i = 0; i < nx; i++) {
-                    auto Y = (double) bpixels[nc * (j * nx + i) + 2];
-                    auto Cb = (double) bpixels[nc * (j * nx + i) + 1];
-                    auto Cr = (double) bpixels[nc * (j * nx + i) + 0];
-
-                    int r = (int) (Y + 1.40200 * (Cr - 0x80));
-                    int g = (int) (Y - 0.34414 * (Cb - 0x80) - 0.71414 * (Cr - 0x80));
-                    int b = (int) (Y + 1.77200 * (Cb - 0x80));
-
-                    outbuf[nc * (j * nx + i) + 0] = std::max(0, std::min(255, r));
-                    outbuf[nc * (j * nx + i) + 1] = std::max(0, std::min(255, g));
-                    outbuf[nc * (j * nx + i) + 2] = std::max(0, std::min(255, b));
-
-                    for (size_t k = 3; k < nc; k++) {
-                        outbuf[nc * (j * nx + i) + k] = bpixels[nc * (j * nx + i) + k];
-                    }
-                }
-            }
+            auto outbuf = acquirePixels<uint8_t>(nc*nx*ny);
+            IIIFComputePool::parallel_for(ny, [&](uint32_t first, uint32_t last) {
+                const size_t offset = static_cast<size_t>(first) * nx * nc;
+                ycc2rgb(bpixels.data() + offset, outbuf.data() + offset, static_cast<size_t>(last - first) * nx, nc);
+            });
+            releasePixels(std::move(bpixels));
             bpixels = std::move(outbuf);
         } else if (bps == 16) {
-            auto outbuf = std::vector<uint16_t>(nc*nx*ny);
-
-            for (size_t j = 0; j < ny; j++) {
-                for (size_t i = 0; i < nx; i++) {
-                    auto Y = (double) wpixels[nc * (j * nx + i) + 2];
-                    auto Cb = (double) wpixels[nc * (j * nx + i) + 1];
-                    auto Cr = (double) wpixels[nc * (j * nx + i) + 0];
-
-                    int r = (int) (Y + 1.40200 * (Cr - 0x80));
-                    int g = (int) (Y - 0.34414 * (Cb - 0x80) - 0.71414 * (Cr - 0x80));
-                    int b = (int) (Y + 1.77200 * (Cb - 0x80));
-
-                    outbuf[nc * (j * nx + i) + 0] = std::max(0, std::min(65535, r));
-                    outbuf[nc * (j * nx + i) + 1] = std::max(0, std::min(65535, g));
-                    outbuf[nc * (j * nx + i) + 2] = std::max(0, std::min(65535, b));
-
-                    for (size_t k = 3; k < nc; k++) {
-                        outbuf[nc * (j * nx + i) + k] = wpixels[nc * (j * nx + i) + k];
-                    }
-                }
-            }
+            auto outbuf = acquirePixels<uint16_t>(nc*nx*ny);
+            IIIFComputePool::parallel_for(ny, [&](uint32_t first, uint32_t last) {
+                const size_t offset = static_cast<size_t>(first) * nx * nc;
+                ycc2rgb(wpixels.data() + offset, outbuf.data() + offset, static_cast<size_t>(last - first) * nx, nc);
+            });
+            releasePixels(std::move(wpixels));
             wpixels = std::move(outbuf);
         } else {
             throw IIIFImageError(file_, __LINE__, fmt::format("Bits per sample is not supported for operation (bps={})", bps));
@@ -479,45 +555,31 @@ namespace cserve {
     //============================================================================
 
     void IIIFImage::convertToIcc(const IIIFIcc &target_icc_p, uint32_t new_bps) {
+        bitonal.clear();
         cmsSetLogErrorHandler(icc_error_logger);
         cmsUInt32Number in_formatter, out_formatter;
 
-        if (icc == nullptr) {
-            switch (nc) {
-                case 1: {
-                    icc = std::make_shared<IIIFIcc>(icc_GRAY_D50); // assume gray value image with D50
-                    break;
-                }
-                case 3: {
-                    icc = std::make_shared<IIIFIcc>(icc_sRGB); // assume sRGB
-                    break;
-                }
-                case 4: {
-                    icc = std::make_shared<IIIFIcc>(icc_CYMK_standard); // assume CYMK
-                    break;
-                }
-                default: {
-                    throw IIIFImageError(file_, __LINE__,
-                                         "Cannot assign ICC profile to image with nc=" + std::to_string(nc));
-                }
-            }
-        }
+        ensure_icc();
         unsigned int nnc = cmsChannelsOf(cmsGetColorSpace(target_icc_p.getIccProfile()));
 
         if (!((new_bps == 8) || (new_bps == 16))) {
             throw IIIFImageError(file_, __LINE__, "Unsupported bits/sample (" + std::to_string(bps) + ")");
         }
 
-        cmsHTRANSFORM hTransform;
         in_formatter = icc->iccFormatter(nc, bps, photo);
         out_formatter = target_icc_p.iccFormatter(new_bps);
 
-        hTransform = cmsCreateTransform(icc->getIccProfile(), in_formatter, target_icc_p.getIccProfile(), out_formatter,
-                                        INTENT_PERCEPTUAL, 0);
-
-        if (hTransform == nullptr) {
+        auto transform = IIIFTransformCache::shared().get(*icc, in_formatter, target_icc_p, out_formatter);
+        if (transform == nullptr) {
             throw IIIFImageError(file_, __LINE__, "Couldn't create color transform");
         }
+        if (transform->identity()) { // the profiles are equivalent, the pixels remain as they are
+            icc = std::make_shared<IIIFIcc>(target_icc_p);
+            photo = icc_photometric(target_icc_p, photo);
+            return;
+        }
+        cmsHTRANSFORM hTransform = transform->get();
+        auto pool = IIIFComputePool::instance();
 
         void *inbuf;
         switch (bps) {
@@ -534,55 +596,49 @@ namespace cserve {
             }
         }
 
+        const size_t in_sll = static_cast<size_t>(nx) * nc * (bps / 8);
+        const size_t out_sll = static_cast<size_t>(nx) * nnc * (new_bps / 8);
+        auto transform_rows = [&](void *outbuf) {
+            IIIFComputePool::BandFunc band = [&](uint32_t first, uint32_t last) {
+                cmsDoTransform(hTransform, static_cast<uint8_t *>(inbuf) + first * in_sll,
+                               static_cast<uint8_t *>(outbuf) + first * out_sll, (last - first) * nx);
+            };
+            if (pool != nullptr) {
+                pool->run(ny, band);
+            } else {
+                band(0, ny);
+            }
+        };
         switch (new_bps) {
             case 8: {
-                auto boutbuf = std::vector<uint8_t>(nx*ny*nnc);
-                cmsDoTransform(hTransform, inbuf, boutbuf.data(), nx * ny);
-                wpixels.clear();
+                auto boutbuf = acquirePixels<uint8_t>(nx*ny*nnc);
+                transform_rows(boutbuf.data());
+                releasePixels(std::move(wpixels));
+                releasePixels(std::move(bpixels));
                 bpixels = std::move(boutbuf);
                 break;
             }
             case 16: {
-                auto woutbuf = std::vector<uint16_t>(nx*ny*nnc);
-                cmsDoTransform(hTransform, inbuf, woutbuf.data(), nx * ny);
-                bpixels.clear();
+                auto woutbuf = acquirePixels<uint16_t>(nx*ny*nnc);
+                transform_rows(woutbuf.data());
+                releasePixels(std::move(bpixels));
+                releasePixels(std::move(wpixels));
                 wpixels = std::move(woutbuf);
                 break;
             }
             default: { }
         }
-        cmsDeleteTransform(hTransform);
         icc = std::make_shared<IIIFIcc>(target_icc_p);
         nc = nnc;
         bps = new_bps;
-
-        PredefinedProfiles targetPT = target_icc_p.getProfileType();
-        switch (targetPT) {
-            case icc_GRAY_D50: {
-                photo = MINISBLACK;
-                break;
-            }
-            case icc_RGB:
-            case icc_sRGB:
-            case icc_AdobeRGB: {
-                photo = RGB;
-                break;
-            }
-            case icc_CYMK_standard: {
-                photo = SEPARATED;
-                break;
-            }
-            case icc_LAB: {
-                photo = CIELAB;
-                break;
-            }
-            default: { }
-        }
+        photo = icc_photometric(target_icc_p, photo);
     }
+    //============================================================================
 
 
     [[maybe_unused]]
     void IIIFImage::removeChan(uint32_t chan) {
+        bitonal.clear();
         if ((nc == 1) || (chan >= nc)) {
             std::string msg = "Cannot remove component: nc=" + std::to_string(nc) + " chan=" + std::to_string(chan);
             throw IIIFImageError(file_, __LINE__, msg);
@@ -605,30 +661,32 @@ namespace cserve {
 
         if (bps == 8) {
             size_t nnc = nc - 1;
-            auto boutbuf = std::vector<uint8_t>(nnc*nx*ny);
+            auto boutbuf = acquirePixels<uint8_t>(nnc*nx*ny);
 
             for (size_t j = 0; j < ny; j++) {
                 for (size_t i = 0; i < nx; i++) {
                     for (size_t k = 0; k < nc; k++) {
                         if (k == chan) continue;
-                        boutbuf[nnc * (j * nx + i) + k] = bpixels[nc * (j * nx + i) + k];
+                        boutbuf[nnc * (j * nx + i) + (k < chan ? k : k - 1)] = bpixels[nc * (j * nx + i) + k];
                     }
                 }
             }
+            releasePixels(std::move(bpixels));
             bpixels = std::move(boutbuf);
         } else if (bps == 16) {
             size_t nnc = nc - 1;
-            auto woutbuf = std::vector<uint16_t>(nnc*nx*ny);
+            auto woutbuf = acquirePixels<uint16_t>(nnc*nx*ny);
 
             for (size_t j = 0; j < ny; j++) {
                 for (size_t i = 0; i < nx; i++) {
                     for (size_t k = 0; k < nc; k++) {
                         if (k == chan) continue;
-                        woutbuf[nnc * (j * nx + i) + k] = wpixels[nc * (j * nx + i) + k];
+                        woutbuf[nnc * (j * nx + i) + (k < chan ? k : k - 1)] = wpixels[nc * (j * nx + i) + k];
                     }
                 }
             }
 
+            releasePixels(std::move(wpixels));
             wpixels = std::move(woutbuf);
         } else {
             if (bps != 8) {
@@ -640,6 +698,7 @@ namespace cserve {
 
     [[maybe_unused]]
     bool IIIFImage::crop(const std::shared_ptr<IIIFRegion> &region) {
+        bitonal.clear();
         int x, y;
         uint32_t width, height;
         if (region->getType() == IIIFRegion::FULL) return true; // we do not have to crop;
@@ -667,14 +726,15 @@ namespace cserve {
     }
 
     bool IIIFImage::scaleFast(uint32_t nnx, uint32_t nny) {
+        bitonal.clear();
         if ((nx == nnx) && (ny == nny)) {
             return true;
         }
         if (bps == 8) {
-            bpixels = doScaleFast<uint8_t>(std::move(bpixels), nx, ny, nc, nnx, nny);
+            bpixels = doResample<uint8_t>(std::move(bpixels), nx, ny, nc, nnx, nny, RESAMPLE_AREA);
         }
         else if (bps == 16) {
-            wpixels = doScaleFast<uint16_t>(std::move(wpixels), nx, ny, nc, nnx, nny);
+            wpixels = doResample<uint16_t>(std::move(wpixels), nx, ny, nc, nnx, nny, RESAMPLE_AREA);
         } else {
             return false;
         }
@@ -684,14 +744,15 @@ namespace cserve {
     }
 
     bool IIIFImage::scaleMedium(uint32_t nnx, uint32_t nny) {
+        bitonal.clear();
         if ((nx == nnx) && (ny == nny)) {
             return true;
         }
         if (bps == 8) {
-            bpixels = doScaleMedium<uint8_t>(std::move(bpixels), nx, ny, nc, nnx, nny);
+            bpixels = doResample<uint8_t>(std::move(bpixels), nx, ny, nc, nnx, nny, RESAMPLE_BICUBIC);
         }
         else if (bps == 16) {
-            wpixels = doScaleMedium<uint16_t>(std::move(wpixels), nx, ny, nc, nnx, nny);
+            wpixels = doResample<uint16_t>(std::move(wpixels), nx, ny, nc, nnx, nny, RESAMPLE_BICUBIC);
         } else {
             return false;
         }
@@ -702,6 +763,7 @@ namespace cserve {
     /*==========================================================================*/
 
     bool IIIFImage::reduce(uint32_t reduce_p) {
+        bitonal.clear();
         uint32_t nnx{0};
         uint32_t nny{0};
         if (bps == 8) {
@@ -717,15 +779,47 @@ namespace cserve {
         return true;
     }
 
+    bool IIIFImage::cropAndScale(const std::shared_ptr<IIIFRegion> &region, uint32_t nnx, uint32_t nny, ScalingMethod quality) {
+        bitonal.clear();
+        int32_t x = 0, y = 0;
+        uint32_t width = nx, height = ny;
+        if ((region != nullptr) && (region->getType() != IIIFRegion::FULL)) {
+            region->crop_coords(nx, ny, x, y, width, height);
+        }
+        if ((nnx == 0) || (nny == 0)) {
+            throw IIIFImageError(file_, __LINE__, fmt::format("Invalid size for scaling: {}x{}", nnx, nny));
+        }
+        uint32_t reduce = std::min(width / nnx, height / nny);
+        ResampleFilter filter = RESAMPLE_AREA;
+        if (quality == MEDIUM) filter = RESAMPLE_BICUBIC;
+        else if (quality == HIGH) filter = RESAMPLE_LANCZOS3;
+        if (filter != RESAMPLE_AREA) reduce /= 2;
+        if (reduce < 1) reduce = 1;
+
+        if (bps == 8) {
+            bpixels = doCropReduceResample<uint8_t>(std::move(bpixels), nx, ny, nc, x, y, width, height, reduce, nnx, nny, filter);
+        }
+        else if (bps == 16) {
+            wpixels = doCropReduceResample<uint16_t>(std::move(wpixels), nx, ny, nc, x, y, width, height, reduce, nnx, nny, filter);
+        } else {
+            throw IIIFImageError(file_, __LINE__, fmt::format("Bits per sample is not supported for operation (bps={})", bps));
+        }
+        nx = nnx;
+        ny = nny;
+        return true;
+    }
+    //============================================================================
+
     bool IIIFImage::scale(uint32_t nnx, uint32_t nny) {
+        bitonal.clear();
         if ((nx == nnx) && (ny == nny)) {
             return true;
         }
         if (bps == 8) {
-            bpixels = doScale<uint8_t>(std::move(bpixels), nx, ny, nc, nnx, nny);
+            bpixels = doResample<uint8_t>(std::move(bpixels), nx, ny, nc, nnx, nny, RESAMPLE_LANCZOS3);
         }
         else if (bps == 16) {
-            wpixels = doScale<uint16_t>(std::move(wpixels), nx, ny, nc, nnx, nny);
+            wpixels = doResample<uint16_t>(std::move(wpixels), nx, ny, nc, nnx, nny, RESAMPLE_LANCZOS3);
         } else {
             return false;
         }
@@ -735,7 +829,8 @@ namespace cserve {
     }
 
     bool IIIFImage::rotate(float angle, bool mirror) {
-        uint32_t nnx, nny;
+        bitonal.clear();
+        uint32_t nnx = nx, nny = ny;
         if (bps == 8) {
              bpixels = doRotate<uint8_t>(std::move(bpixels), nx, ny, nc, nnx, nny, angle, mirror);
         }
@@ -749,6 +844,7 @@ namespace cserve {
     //============================================================================
 
     bool IIIFImage::set_topleft() {
+        bitonal.clear();
         switch (orientation) {
             case TOPLEFT: // 1
                 return true;
@@ -785,6 +881,7 @@ namespace cserve {
     //============================================================================
 
     bool IIIFImage::to8bps() {
+        bitonal.clear();
         // little-endian architecture assumed
         //
         // we just use the shift-right operater (>> 8) to devide the values by 256 (2^8)!
@@ -794,10 +891,12 @@ namespace cserve {
             //icc = NULL;
 
             //byte *outbuf = new(std::nothrow) Sipi::byte[nc*nx*ny];
-            auto boutbuf = std::vector<uint8_t>(nc * nx * ny);
-            for (uint32_t i = 0; i < nx*ny*nc; ++i) {
-                boutbuf[i] = static_cast<uint8_t>(wpixels[i] >> 8);
-            }
+            auto boutbuf = acquirePixels<uint8_t>(nc * nx * ny);
+            const size_t sll = static_cast<size_t>(nx) * nc;
+            IIIFComputePool::parallel_for(ny, [&](uint32_t first, uint32_t last) {
+                sixteen2eight(wpixels.data() + first * sll, boutbuf.data() + first * sll, (last - first) * sll);
+            });
+            releasePixels(std::move(wpixels));
             bpixels = std::move(boutbuf);
             bps = 8;
         }
@@ -806,86 +905,79 @@ namespace cserve {
     //============================================================================
 
 
-    bool IIIFImage::toBitonal() {
+    bool IIIFImage::toBitonal(BitonalMethod method) {
         if ((photo != MINISBLACK) && (photo != MINISWHITE)) {
             convertToIcc(IIIFIcc(icc_GRAY_D50), 8);
+        } else if (bps == 16) {
+            to8bps();
         }
 
-        bool doit = false; // will be set true if we find a value not equal 0 or 255
-        for (size_t i = 0; i < nx * ny; i++) {
-            if ((bpixels[i] != 0) && (bpixels[i] != 255)) {
-                doit = true;
-                break;
-            }
-        }
-
-        if (!doit) return true; // we have to do nothing, it's already bitonal
-
-        // must be signed!! Error propagation my result in values < 0 or > 255
-        //auto *outbuf = new(std::nothrow) short[nx * ny];
-        auto outbuf = std::make_unique<short[]>(nx * ny);
-
-        for (size_t i = 0; i < nx * ny; i++) {
-            outbuf[i] = bpixels[i];  // copy buffer
-        }
-
-        for (size_t y = 0; y < ny; y++) {
-            for (size_t x = 0; x < nx; x++) {
-                short oldpixel = outbuf[y * nx + x];
-                outbuf[y * nx + x] = (oldpixel > 127) ? 255 : 0;
-                int properr = (oldpixel - outbuf[y * nx + x]);
-                if (x < (nx - 1)) outbuf[y * nx + (x + 1)] += (7 * properr) >> 4;
-                if ((x > 0) && (y < (ny - 1))) outbuf[(y + 1) * nx + (x - 1)] += (3 * properr) >> 4;
-                if (y < (ny - 1)) outbuf[(y + 1) * nx + x] += (5 * properr) >> 4;
-                if ((x < (nx - 1)) && (y < (ny - 1))) outbuf[(y + 1) * nx + (x + 1)] += properr >> 4;
-            }
-        }
-
-        for (size_t i = 0; i < nx * ny; i++) bpixels[i] = outbuf[i];
+        //
+        // the samples are dithered (or thresholded) and packed to 1 bit in the same pass
+        //
+        auto packed = std::vector<uint8_t>(static_cast<size_t>((nx + 7) / 8) * ny);
+        makeBitonal(bpixels.data(), packed.data(), nx, ny, method, photo == MINISWHITE);
+        bitonal = std::move(packed);
         return true;
     }
     //============================================================================
 
-
-    bool IIIFImage::add_watermark(const std::string &wmfilename) {
-        uint32_t wm_nx, wm_ny, wm_nc;
-        std::vector<uint8_t> wmbuf = read_watermark(wmfilename, wm_nx, wm_ny, wm_nc);
-        if (wmbuf.empty()) {
-            throw IIIFImageError(file_, __LINE__, "Cannot read watermark file " + wmfilename);
+    const uint8_t *IIIFImage::bitonalPixels() const {
+        if (bitonal.empty() || (bps != 8) || (nc != 1) || ((photo != MINISBLACK) && (photo != MINISWHITE)) ||
+            (bitonal.size() != static_cast<size_t>((nx + 7) / 8) * ny)) {
+            return nullptr;
         }
+        return bitonal.data();
+    }
+    //============================================================================
 
-        auto xlut = std::vector<double>(nx);
-        auto ylut = std::vector<double>(ny);
 
-        for (size_t i = 0; i < nx; i++) {
-            xlut[i] = (double) (wm_nx * i) / (double) nx;
-        }
-        for (size_t j = 0; j < ny; j++) {
-            ylut[j] = (double) (wm_ny * j) / (double) ny;
+    //
+    // watermarks scaled to the sizes of the recent images are kept up to this total size (one byte per pixel)
+    //
+    static const size_t watermark_cache_bytes = 64 * 1024 * 1024;
+
+    //
+    // the watermark of a larger image is scaled in bands of this many rows while it is blended
+    //
+    static const uint32_t watermark_band_rows = 64;
+
+    template<typename T>
+    static void blend_watermark(T *pixels, uint32_t nx, uint32_t ny, uint32_t nc, IIIFWatermarkCache &cache,
+                                const std::string &wmfilename) {
+        const size_t sll = static_cast<size_t>(nx) * nc;
+        if (cache.fits(nx, ny)) {
+            auto values = cache.get(wmfilename, nx, ny);
+            if (values == nullptr) {
+                throw IIIFImageError(file_, __LINE__, "Cannot read watermark file " + wmfilename);
+            }
+            IIIFComputePool::parallel_for(ny, [&](uint32_t first, uint32_t last) {
+                blendWatermark(pixels + first * sll, values->data() + static_cast<size_t>(first) * nx,
+                               static_cast<size_t>(last - first) * nx, nc);
+            });
+            return;
+        }
+        auto wm = cache.watermark(wmfilename);
+        if (wm == nullptr) {
+            throw IIIFImageError(file_, __LINE__, "Cannot read watermark file " + wmfilename);
         }
+        IIIFComputePool::parallel_for(ny, [&](uint32_t first, uint32_t last) {
+            std::vector<uint8_t> values(static_cast<size_t>(nx) * std::min(watermark_band_rows, last - first));
+            for (uint32_t band_first = first; band_first < last; band_first += watermark_band_rows) {
+                const uint32_t band_last = std::min(band_first + watermark_band_rows, last);
+                scaleWatermarkRows(wm->pixels, wm->nx, wm->ny, wm->nc, nx, ny, band_first, band_last, values.data());
+                blendWatermark(pixels + band_first * sll, values.data(), static_cast<size_t>(band_last - band_first) * nx, nc);
+            }
+        });
+    }
 
+    bool IIIFImage::add_watermark(const std::string &wmfilename) {
+        bitonal.clear();
+        static IIIFWatermarkCache cache(watermark_cache_bytes, read_watermark);
         if (bps == 8) {
-            for (size_t j = 0; j < ny; j++) {
-                for (size_t i = 0; i < nx; i++) {
-                    auto val = bilinn<uint8_t>(wmbuf, wm_nx, xlut[i], ylut[j], 0, wm_nc);
-
-                    for (size_t k = 0; k < nc; k++) {
-                        double nval = (bpixels[nc * (j * nx + i) + k] / 255.) * (1.0 + val / 2550.0) + val / 2550.0;
-                        bpixels[nc * (j * nx + i) + k] = (nval > 1.0) ? 255 : static_cast<uint8_t>(floorl(nval * 255. + .5));
-                    }
-                }
-            }
+            blend_watermark(bpixels.data(), nx, ny, nc, cache, wmfilename);
         } else if (bps == 16) {
-            for (size_t j = 0; j < ny; j++) {
-                for (size_t i = 0; i < nx; i++) {
-                    for (size_t k = 0; k < nc; k++) {
-                        byte val = bilinn<uint8_t>(wmbuf, wm_nx, xlut[i], ylut[j], 0, wm_nc);
-                        double nval =
-                                (wpixels[nc * (j * nx + i) + k] / 65535.0) * (1.0 + val / 655350.0) + val / 352500.;
-                        wpixels[nc * (j * nx + i) + k] = (nval > 1.0) ? static_cast<uint16_t>(65535) : static_cast<uint16_t>(floorl(nval * 65535. + .5));
-                    }
-                }
-            }
+            blend_watermark(wpixels.data(), nx, ny, nc, cache, wmfilename);
         }
         return true;
     }
@@ -894,6 +986,7 @@ namespace cserve {
 
 
     IIIFImage &IIIFImage::operator-=(const IIIFImage &rhs) {
+        bitonal.clear();
         if ((nx != rhs.nx) || (ny != rhs.ny) || (nc != rhs.nc) || (bps != rhs.bps) || (photo != rhs.photo)) {
             std::stringstream ss;
             ss << "Image op: images not compatible" << std::endl;
@@ -904,18 +997,44 @@ namespace cserve {
         }
 
 
+        //
+        // the bands compute their own minimum and maximum, which are merged afterwards
+        //
+        const size_t sll = static_cast<size_t>(nx) * nc;
         auto diffbuf = std::vector<int32_t>(nx * ny * nc);
+        int32_t min = INT_MAX;
+        int32_t max = INT_MIN;
+        std::mutex minmax_lock;
+        auto merge_minmax = [&](int32_t band_min, int32_t band_max) {
+            std::lock_guard<std::mutex> guard(minmax_lock);
+            if (band_max > max) max = band_max;
+            if (band_min < min) min = band_min;
+        };
         switch (bps) {
             case 8: {
-                for (uint32_t i = 0; i < nx * ny * nc; ++i) {
-                    diffbuf[i] = bpixels[i] - rhs.bpixels[i];
-                }
+                IIIFComputePool::parallel_for(ny, [&](uint32_t first, uint32_t last) {
+                    int32_t band_min = INT_MAX;
+                    int32_t band_max = INT_MIN;
+                    for (size_t i = first * sll; i < last * sll; ++i) {
+                        diffbuf[i] = bpixels[i] - rhs.bpixels[i];
+                        if (diffbuf[i] > band_max) band_max = diffbuf[i];
+                        if (diffbuf[i] < band_min) band_min = diffbuf[i];
+                    }
+                    merge_minmax(band_min, band_max);
+                });
                 break;
             }
             case 16: {
-                for (uint32_t i = 0; i < nx * ny * nc; ++i) {
-                    diffbuf[i] = wpixels[i] - rhs.wpixels[i];
-                }
+                IIIFComputePool::parallel_for(ny, [&](uint32_t first, uint32_t last) {
+                    int32_t band_min = INT_MAX;
+                    int32_t band_max = INT_MIN;
+                    for (size_t i = first * sll; i < last * sll; ++i) {
+                        diffbuf[i] = wpixels[i] - rhs.wpixels[i];
+                        if (diffbuf[i] > band_max) band_max = diffbuf[i];
+                        if (diffbuf[i] < band_min) band_min = diffbuf[i];
+                    }
+                    merge_minmax(band_min, band_max);
+                });
                 break;
             }
             default: {
@@ -923,26 +1042,23 @@ namespace cserve {
             }
         }
 
-        int32_t min = INT_MAX;
-        int32_t max = INT_MIN;
-        for (uint32_t i = 0; i < nx * ny * nc; ++i) {
-            if (diffbuf[i] > max) max = diffbuf[i];
-            if (diffbuf[i] < min) min = diffbuf[i];
-        }
-
         int32_t maxmax = abs(min) > abs(max) ? abs(min) : abs(max);
 
         switch (bps) {
             case 8: {
-                for (uint32_t i = 0; i < nx * ny * nc; ++i) {
-                    bpixels[i] = (uint8_t) ((diffbuf[i] + maxmax) * UCHAR_MAX / (2 * maxmax));
-                }
+                IIIFComputePool::parallel_for(ny, [&](uint32_t first, uint32_t last) {
+                    for (size_t i = first * sll; i < last * sll; ++i) {
+                        bpixels[i] = (uint8_t) ((diffbuf[i] + maxmax) * UCHAR_MAX / (2 * maxmax));
+                    }
+                });
                 break;
             }
             case 16: {
-                for (uint32_t i = 0; i < nx * ny * nc; ++i) {
-                    wpixels[i] = (word) ((diffbuf[i] + maxmax) * USHRT_MAX / (2 * maxmax));
-                }
+                IIIFComputePool::parallel_for(ny, [&](uint32_t first, uint32_t last) {
+                    for (size_t i = first * sll; i < last * sll; ++i) {
+                        wpixels[i] = (word) ((diffbuf[i] + maxmax) * USHRT_MAX / (2 * maxmax));
+                    }
+                });
                 break;
             }
 
@@ -965,6 +1081,7 @@ namespace cserve {
     /*==========================================================================*/
 
     IIIFImage &IIIFImage::operator+=(const IIIFImage &rhs) {
+        bitonal.clear();
         if ((nx != rhs.nx) || (ny != rhs.ny) || (nc != rhs.nc) || (bps != rhs.bps) || (photo != rhs.photo)) {
             std::stringstream ss;
             ss << "Image op: images not compatible" << std::endl;
@@ -974,18 +1091,35 @@ namespace cserve {
             throw IIIFImageError(file_, __LINE__, ss.str());
         }
 
+        const size_t sll = static_cast<size_t>(nx) * nc;
         auto diffbuf = std::vector<int32_t>(nx * ny * nc);
+        int max = INT_MIN;
+        std::mutex max_lock;
+        auto merge_max = [&](int band_max) {
+            std::lock_guard<std::mutex> guard(max_lock);
+            if (band_max > max) max = band_max;
+        };
         switch (bps) {
             case 8: {
-                for (uint32_t i = 0; i < nx * ny * nc; ++i) {
-                    diffbuf[i] = bpixels[i] + rhs.bpixels[i];
-                }
+                IIIFComputePool::parallel_for(ny, [&](uint32_t first, uint32_t last) {
+                    int band_max = INT_MIN;
+                    for (size_t i = first * sll; i < last * sll; ++i) {
+                        diffbuf[i] = bpixels[i] + rhs.bpixels[i];
+                        if (diffbuf[i] > band_max) band_max = diffbuf[i];
+                    }
+                    merge_max(band_max);
+                });
                 break;
             }
             case 16: {
-                for (uint32_t i = 0; i < nx * ny * nc; ++i) {
-                    diffbuf[i] = wpixels[i] + rhs.wpixels[i];
-                }
+                IIIFComputePool::parallel_for(ny, [&](uint32_t first, uint32_t last) {
+                    int band_max = INT_MIN;
+                    for (size_t i = first * sll; i < last * sll; ++i) {
+                        diffbuf[i] = wpixels[i] + rhs.wpixels[i];
+                        if (diffbuf[i] > band_max) band_max = diffbuf[i];
+                    }
+                    merge_max(band_max);
+                });
                 break;
             }
 
@@ -994,22 +1128,21 @@ namespace cserve {
             }
         }
 
-        int max = INT_MIN;
-        for (uint32_t i = 0; i < nx * ny * nc; ++i) {
-            if (diffbuf[i] > max) max = diffbuf[i];
-        }
-
         switch (bps) {
             case 8: {
-                for (uint32_t i = 0; i < nx * ny * nc; ++i) {
-                    bpixels[i] = static_cast<uint8_t>(diffbuf[i] * UCHAR_MAX / max);
-                }
+                IIIFComputePool::parallel_for(ny, [&](uint32_t first, uint32_t last) {
+                    for (size_t i = first * sll; i < last * sll; ++i) {
+                        bpixels[i] = static_cast<uint8_t>(diffbuf[i] * UCHAR_MAX / max);
+                    }
+                });
                 break;
             }
             case 16: {
-                for (uint32_t i = 0; i < nx * ny * nc; ++i) {
-                    wpixels[i] = static_cast<uint16_t>(diffbuf[i] * USHRT_MAX / max);
-                }
+                IIIFComputePool::parallel_for(ny, [&](uint32_t first, uint32_t last) {
+                    for (size_t i = first * sll; i < last * sll; ++i) {
+                        wpixels[i] = static_cast<uint16_t>(diffbuf[i] * USHRT_MAX / max);
+                    }
+                });
                 break;
             }
             default: {
@@ -1034,26 +1167,31 @@ namespace cserve {
             return false;
         }
 
-        uint64_t n_differences = 0;
+        const size_t sll = static_cast<size_t>(nx) * nc;
+        std::atomic<uint64_t> n_differences{0};
         switch (bps) {
             case 8: {
-                for (uint32_t i = 0; i < nx*ny*nc; ++i) {
-                    if (bpixels[i] != rhs.bpixels[i]) {
-                        n_differences++;
+                IIIFComputePool::parallel_for(ny, [&](uint32_t first, uint32_t last) {
+                    uint64_t band_differences = 0;
+                    for (size_t i = first * sll; i < last * sll; ++i) {
+                        if (bpixels[i] != rhs.bpixels[i]) {
+                            band_differences++;
+                        }
                     }
-                }
+                    n_differences += band_differences;
+                });
                 break;
             }
             case 16: {
-                for (size_t j = 0; j < ny; j++) {
-                    for (size_t i = 0; i < nx; i++) {
-                        for (size_t k = 0; k < nc; k++) {
-                            if (wpixels[nc * (j * nx + i) + k] != rhs.wpixels[nc * (j * nx + i) + k]) {
-                                n_differences++;
-                            }
+                IIIFComputePool::parallel_for(ny, [&](uint32_t first, uint32_t last) {
+                    uint64_t band_differences = 0;
+                    for (size_t i = first * sll; i < last * sll; ++i) {
+                        if (wpixels[i] != rhs.wpixels[i]) {
+                            band_differences++;
                         }
                     }
-                }
+                    n_differences += band_differences;
+                });
                 break;
             }
             default: {
@@ -18,6 +18,7 @@
 #include <unordered_map>
 #include <exception>
 #include <memory.h>
+#include <memory>
 #include <vector>
 
 #include "IIIFError.h"
@@ -34,6 +35,7 @@
 #include "Connection.h"
 #include "Hash.h"
 #include "IIIFPhotometricInterpretation.h"
+#include "IIIFBitonal.h"
 
 
 namespace cserve {
@@ -64,11 +66,18 @@ namespace cserve {
         HIGH = 0, MEDIUM = 1, LOW = 2
     } ScalingMethod;
 
+    typedef enum {
+        DCT_ISLOW = 0, //!< accurate integer DCT
+        DCT_IFAST = 1, //!< fast integer DCT, less accurate
+        DCT_FLOAT = 2  //!< floating point DCT
+    } DctMethod;
+
     typedef struct ScalingQuality_ {
         ScalingMethod jk2;
         ScalingMethod jpeg;
         ScalingMethod tiff;
         ScalingMethod png;
+        DctMethod jpeg_dct = DCT_ISLOW; //!< inverse DCT used by the JPEG decoder
     } ScalingQuality;
 
     typedef enum : unsigned short { // from the TIFF specification...
@@ -99,6 +108,11 @@ namespace cserve {
 
     enum {
         JPEG_QUALITY,
+        JPEG_DCT_METHOD,
+        JPEG_OPTIMIZE,
+        JPEG_PROGRESSIVE,
+        JPEG_SUBSAMPLING,
+        JPEG_PARALLEL,
         J2K_Sprofile,
         J2K_Creversible,
         J2K_Clayers,
@@ -158,6 +172,7 @@ class IIIFImageError : public IIIFError {
     };
 
     class IIIFIO;
+    class IIIFStripSource;
 
     /*!
     * \class SipiImage
@@ -177,11 +192,17 @@ class IIIFImageError : public IIIFError {
         friend class IIIFIOJ2k;     //!< I/O class for the JPEG2000 file format
         friend class IIIFIOJpeg;    //!< I/O class for the JPEG file format
         friend class IIIFIOPng;     //!< I/O class for the PNG file format
+        friend class IIIFStripSource; //!< Header of the rows of the streaming pipeline
+        friend class IIIFStripIcc;  //!< Color conversion of the streaming pipeline
     private:
         static std::unordered_map<std::string, std::shared_ptr<IIIFIO>> io; //!< member variable holding a map of I/O class instances for the different file formats
 
         void ensure_exif();
 
+        void ensure_icc();
+
+        static PhotometricInterpretation icc_photometric(const IIIFIcc &icc, PhotometricInterpretation photo);
+
     protected:
         uint32_t nx;         //!< Number of horizontal pixels (width)
         uint32_t ny;         //!< Number of vertical pixels (height)
@@ -192,6 +213,7 @@ class IIIFImageError : public IIIFError {
         PhotometricInterpretation photo;    //!< Image type, that is the meaning of the channels
         std::vector<uint8_t> bpixels;   //!< Pointer to block of memory holding the pixels
         std::vector<uint16_t> wpixels;   //!< Pointer to block of memory holding the pixels
+        std::vector<uint8_t> bitonal;   //!< Pixels packed to 1 bit by toBitonal(), empty if the pixels have been changed since
         std::shared_ptr<IIIFXmp> xmp{};   //!< Pointer to instance SipiXmp class (\ref SipiXmp), or NULL
         std::shared_ptr<IIIFIcc> icc{};   //!< Pointer to instance of SipiIcc class (\ref SipiIcc), or NULL
         std::shared_ptr<IIIFIptc> iptc{}; //!< Pointer to instance of SipiIptc class (\ref SipiIptc), or NULL
@@ -305,9 +327,10 @@ class IIIFImageError : public IIIFError {
 
         /*! Destructor
          *
-         * Destroys the image and frees all the resources associated with it
+         * Destroys the image and frees all the resources associated with it. The pixel
+         * buffers are given back to the buffer pool.
          */
-        ~IIIFImage() = default;
+        ~IIIFImage();
 
         /*!
          * Sets a pixel to a given value
@@ -378,6 +401,25 @@ class IIIFImageError : public IIIFError {
                               bool force_bps_8 = false,
                               ScalingQuality scaling_quality = {HIGH, HIGH, HIGH, HIGH});
 
+        /*!
+         * Open an image for reading its rows strip by strip (see IIIFStripSource). Cropping,
+         * scaling and the reduction to 8 bits/sample are done while the rows are read.
+         * Formats which can't be streamed are read completely into memory.
+         *
+         * \param[in] filepath A string containing the path to the image file
+         * \param[in] region Pointer to a SipiRegion which indicates that we
+         *            are only interested in this region. The image will be cropped.
+         * \param[in] size Pointer to a size object. The image will be scaled accordingly
+         * \param[in] force_bps_8 We want in any case a 8 Bit/sample image. Reduce if necessary
+         *
+         * \throws SipiError
+         */
+        static std::unique_ptr<IIIFStripSource> read_strips(const std::string& filepath,
+                                                            const std::shared_ptr<IIIFRegion>& region = nullptr,
+                                                            const std::shared_ptr<IIIFSize>& size = nullptr,
+                                                            bool force_bps_8 = false,
+                                                            ScalingQuality scaling_quality = {HIGH, HIGH, HIGH, HIGH});
+
         /*!
          * Read an image that is to be considered an "original image". In this case
          * a SipiEssentials object is created containing the original name, the
@@ -464,6 +506,17 @@ class IIIFImageError : public IIIFError {
          */
         void write(const std::string &ftype, const std::string &filepath, const IIIFCompressionParams &params = {});
 
+        /*!
+         * Write the rows of a strip source. The formats which can't be written strip by strip
+         * read all rows into memory first.
+         *
+         * \param[in] ftype The file format that should be used to write the file (see write())
+         * \param[in] strips The rows to be written. The connection is taken from its header
+         * \param[in] filepath String containing the path/filename
+         */
+        static void write_strips(const std::string &ftype, std::unique_ptr<IIIFStripSource> strips,
+                                 const std::string &filepath, const IIIFCompressionParams &params = {});
+
 
         /*!
          * Convert full range YCbCr (YCC) to RGB colors
@@ -510,7 +563,7 @@ class IIIFImageError : public IIIFError {
         void crop(uint32_t x, uint32_t y, uint32_t width = 0, uint32_t height = 0);
 
         /*!
-         * Resize an image using a high speed algorithm which may result in poor image quality
+         * Resize an image using a high speed algorithm (area average, no interpolation)
          *
          * \param[in] nnx New horizontal dimension (width)
          * \param[in] nny New vertical dimension (height)
@@ -518,7 +571,7 @@ class IIIFImageError : public IIIFError {
         bool scaleFast(uint32_t nnx, uint32_t nny);
 
         /*!
-         * Resize an image using some balance between speed and quality
+         * Resize an image using some balance between speed and quality (bicubic interpolation)
          *
          * \param[in] nnx New horizontal dimension (width)
          * \param[in] nny New vertical dimension (height)
@@ -528,7 +581,20 @@ class IIIFImageError : public IIIFError {
         bool reduce(uint32_t reduce_p);
 
         /*!
-         * Resize an image using the best (but slow) algorithm
+         * Crop a region and resize it to the given size in one pass (see doCropReduceResample()).
+         * If the region is much larger than the result, it's first reduced by an integer
+         * factor (a block average), so that the interpolation filter covers fewer pixels. For
+         * MEDIUM and HIGH quality, at least a factor of 2 is left to the filter.
+         *
+         * \param[in] region Region to crop, nullptr for the whole image
+         * \param[in] nnx New horizontal dimension (width)
+         * \param[in] nny New vertical dimension (height)
+         * \param[in] quality Interpolation filter: LOW (area), MEDIUM (bicubic) or HIGH (Lanczos3)
+         */
+        bool cropAndScale(const std::shared_ptr<IIIFRegion> &region, uint32_t nnx, uint32_t nny, ScalingMethod quality);
+
+        /*!
+         * Resize an image using the best (but slowest) algorithm (Lanczos3 interpolation)
          *
          * \param[in] nnx New horizontal dimension (width)
          * \param[in] nny New vertical dimension (height)
@@ -559,16 +625,31 @@ class IIIFImageError : public IIIFError {
         /*!
          * Convert an image to a bitonal representation using Steinberg-Floyd dithering.
          *
-         * The method does nothing if the image is already bitonal. Otherwise, the image is converted
-         * into a gray value image if necessary and then a FLoyd-Steinberg dithering is applied.
+         * The pixels don't change if the image is already bitonal. Otherwise, the image is converted
+         * into an 8 bit gray value image if necessary and then a Floyd-Steinberg dithering (or a
+         * threshold) is applied (see makeBitonal()). The pixels packed to 1 bit are kept, so that
+         * the TIFF writer doesn't have to scan and pack the image again.
          *
+         * \param[in] method Error diffusion or threshold
          * \returns Returns true on success, false on error
          */
-        bool toBitonal();
+        bool toBitonal(BitonalMethod method = BITONAL_DITHER);
+
+        /*!
+         * The pixels packed to 1 bit per pixel (rows of (nx + 7) / 8 bytes) as written to bitonal
+         * TIFF files, if toBitonal() has been called and the pixels haven't been changed since
+         *
+         * \returns Pointer to the packed pixels, or nullptr
+         */
+        [[nodiscard]] const uint8_t *bitonalPixels() const;
 
         /*!
          * Add a watermark to a file...
          *
+         * The decoded watermark and its versions scaled to the recent image sizes are cached
+         * (see IIIFWatermarkCache); the file is read again when it has been modified. The watermark
+         * of an image too large for the cache is scaled in bands of rows while it is blended.
+         *
          * \param[in] wmfilename Path to watermakfile (which must be a TIFF file at the moment)
          */
         bool add_watermark(const std::string &wmfilename);
@@ -3,6 +3,9 @@
 //
 
 #include "IIIFImgTools.h"
+#include "IIIFBufferPool.h"
+#include "IIIFComputePool.h"
+#include "IIIFResample.h"
 #include "fmt/format.h"
 #include "IIIFPhotometricInterpretation.h"
 
@@ -13,11 +16,6 @@ namespace cserve {
 
 
 
-    template<typename T>
-    void separate2contig(T *buf, uint32_t nx, uint32_t ny, uint32_t nc) {
-        auto tmp = std::make_unique<T[]>(nx*nc);
-    }
-
     std::unique_ptr<uint8_t[]> cvrt1BitTo8Bit(std::unique_ptr<uint8_t[]> &&inbuf,
                                               uint32_t nx, uint32_t ny, uint32_t sll,
                                               uint8_t black, uint8_t white) {
@@ -86,14 +84,13 @@ namespace cserve {
 
     template<typename T>
     std::vector<T> separateToContig(std::vector<T> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t sll) {
-        auto tmpptr = std::vector<T>(nc * ny * nx);
-        for (uint32_t c = 0; c < nc; ++c) {
-            for (uint32_t y = 0; y < ny; ++y) {
-                for (uint32_t x = 0; x < nx; ++x) {
-                    tmpptr[nc * (y * nx + x) + c] = inbuf[c * ny * sll + y * nx + x];
-                }
-            }
-        }
+        auto tmpptr = acquirePixels<T>(nc * ny * nx);
+        IIIFComputePool::parallel_for(ny, [&](uint32_t first, uint32_t last) {
+            const size_t offset = static_cast<size_t>(first) * nx;
+            separate2contig(inbuf.data() + offset, tmpptr.data() + nc * offset,
+                            static_cast<size_t>(last - first) * nx, nc, static_cast<size_t>(ny) * sll);
+        });
+        releasePixels(std::move(inbuf));
         return tmpptr;
     }
 
@@ -154,7 +151,7 @@ namespace cserve {
         int32_t x, y;
         uint32_t width, height;
         region->crop_coords(nx, ny, x, y, width, height);
-        auto outbuf = std::vector<T>(width * height * nc);
+        auto outbuf = acquirePixels<T>(width * height * nc);
 
         for (uint32_t j = 0; j < height; j++) {
             for (uint32_t i = 0; i < width; i++) {
@@ -163,6 +160,7 @@ namespace cserve {
                 }
             }
         }
+        releasePixels(std::move(inbuf));
         return outbuf;
     }
 
@@ -181,7 +179,7 @@ namespace cserve {
             throw IIIFImageError(file_, __LINE__, msg);
         }
 
-        auto outbuf = std::vector<uint8_t>(img.nx * img.ny);
+        auto outbuf = acquirePixels<uint8_t>(img.nx * img.ny);
 
         if ((8 * sll) == img.nx) {
             for (uint32_t i = 0; i < img.ny*sll; ++i) {
@@ -205,10 +203,6 @@ namespace cserve {
     }
 
     std::vector<uint8_t> cvrt8BitTo1bit(const IIIFImage &img, uint32_t &sll) {
-        static unsigned char mask[8] = {128, 64, 32, 16, 8, 4, 2, 1};
-
-        unsigned int x, y;
-
         if ((img.photo != PhotometricInterpretation::MINISWHITE) &&
             (img.photo != PhotometricInterpretation::MINISBLACK)) {
             throw IIIFImageError(file_, __LINE__,
@@ -221,57 +215,26 @@ namespace cserve {
 
         sll = (img.nx + 7) / 8;
         auto outbuf = std::vector<uint8_t>(sll * img.ny);
-        if (img.photo == PhotometricInterpretation::MINISBLACK) {
-            for (y = 0; y < img.ny; y++) {
-                for (x = 0; x < img.nx; x++) {
-                    outbuf[y * sll + (x / 8)] |= (img.bpixels[y * img.nx + x] > 128) ? mask[x % 8] : !mask[x % 8];
-                }
+        const bool invert = img.photo == PhotometricInterpretation::MINISWHITE;
+        IIIFComputePool::parallel_for(img.ny, [&](uint32_t first, uint32_t last) {
+            for (size_t y = first; y < last; y++) {
+                eight2one(img.bpixels.data() + y * img.nx, outbuf.data() + y * sll, img.nx, 128, invert);
             }
-        } else { // must be MINISWHITE
-            for (y = 0; y < img.ny; y++) {
-                for (x = 0; x < img.nx; x++) {
-                    outbuf[y * sll + (x / 8)] |= (img.bpixels[y * img.nx + x] > 128) ? !mask[x % 8] : mask[x % 8];
-                }
-            }
-        }
-
+        });
         return outbuf;
     }
 
     template<typename T>
     std::vector<T> doReduce(std::vector<T> &&inbuf, uint32_t reduce,
-                            uint32_t nx, uint32_t ny, uint32_t nc, uint32_t &nnx, uint32_t nny) {
-        IIIFSize size(reduce);
-        uint32_t r = 0;
-        bool redonly;
-        size.get_size(nx, ny, nnx, nny, r, redonly);
-        auto outbuf = std::vector<T>(nnx * nny * nc);
-
-        auto inbuf_raw = inbuf.data();
-        auto outbuf_raw = outbuf.data();
+                            uint32_t nx, uint32_t ny, uint32_t nc, uint32_t &nnx, uint32_t &nny) {
         if (reduce <= 1) {
-            memcpy(outbuf_raw, inbuf_raw, nnx * nny * nc * sizeof(T));
-        }
-        else {
-            for (uint32_t y = 0; y < nny; ++y) {
-                for (uint32_t x = 0; x < nnx; ++x) {
-                    for (uint32_t c = 0; c < nc; ++c) {
-                        uint32_t cnt = 0;
-                        uint32_t tmp = 0;
-                        for (uint32_t xx = 0; xx < reduce; ++xx) {
-                            for (uint32_t yy = 0; yy < reduce; ++yy) {
-                                if (((reduce*x + xx) < nx) && ((reduce*y + yy) < ny)) {
-                                    tmp += static_cast<uint32_t>(inbuf[nc*((reduce*y + yy)*nx + (reduce*x + xx)) + c]);
-                                    ++cnt;
-                                }
-                            }
-                        }
-                        outbuf[nc*(y*nnx + x) + c] = tmp / cnt;
-                    }
-                }
-            }
+            nnx = nx;
+            nny = ny;
+            return std::move(inbuf);
         }
-        return outbuf;
+        nnx = (nx + reduce - 1) / reduce;
+        nny = (ny + reduce - 1) / reduce;
+        return doCropReduceResample<T>(std::move(inbuf), nx, ny, nc, 0, 0, nx, ny, reduce, nnx, nny, RESAMPLE_AREA);
     }
 
 
@@ -304,250 +267,6 @@ namespace cserve {
 
 #undef POSITION
 
-    template<typename T>
-    std::vector<T> doScaleFast(std::vector<T> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t nnx, uint32_t nny) {
-        auto xlut = std::make_unique<uint32_t[]>(nnx);
-        auto ylut = std::make_unique<uint32_t[]>(nny);
-
-        for (uint32_t i = 0; i < nnx; i++) {
-            xlut[i] = (uint32_t) lround(i * (nx - 1) / (double) (nnx - 1));
-        }
-        for (uint32_t i = 0; i < nny; i++) {
-            ylut[i] = (uint32_t) lround(i * (ny - 1) / (double) (nny - 1 ));
-        }
-        auto outbuf = std::vector<T>(nnx * nny * nc);
-        for (uint32_t y = 0; y < nny; y++) {
-            for (uint32_t x = 0; x < nnx; x++) {
-                for (uint32_t k = 0; k < nc; k++) {
-                    outbuf[nc * (y * nnx + x) + k] = inbuf[nc * (ylut[y] * nx + xlut[x]) + k];
-                }
-            }
-        }
-        return outbuf;
-    }
-
-    template<typename T>
-    std::vector<T> doScaleMedium(std::vector<T> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t nnx, uint32_t nny) {
-        auto xlut = std::make_unique<double[]>(nnx);
-        auto ylut = std::make_unique<double[]>(nny);
-
-        for (uint32_t i = 0; i < nnx; i++) {
-            xlut[i] = (double) (i * (nx - 1)) / (double) (nnx - 1);
-        }
-        for (uint32_t j = 0; j < nny; j++) {
-            ylut[j] = (double) (j * (ny - 1)) / (double) (nny - 1);
-        }
-        auto outbuf = std::vector<T>(nnx * nny * nc);
-        double rx, ry;
-        for (uint32_t j = 0; j < nny; j++) {
-            ry = ylut[j];
-            for (uint32_t i = 0; i < nnx; i++) {
-                rx = xlut[i];
-                for (uint32_t k = 0; k < nc; k++) {
-                    outbuf[nc * (j * nnx + i) + k] = bilinn<T>(inbuf, nx, rx, ry, k, nc);
-                }
-            }
-        }
-        return outbuf;
-    }
-    /*==========================================================================*/
-
-    template<typename T>
-    std::vector<T> doScale(std::vector<T> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t nnx, uint32_t nny) {
-        uint32_t iix = 1, iiy = 1;
-        uint32_t nnnx, nnny;
-
-        //
-        // if the scaling is less than 1 (that is, the image gets smaller), we first
-        // expand it to a integer multiple of the desired size, and then we just
-        // avarage the number of pixels. This is the "proper" way of downscale an
-        // image...
-        //
-        if (nnx < nx) {
-            while (nnx * iix < nx) iix++;
-            nnnx = nnx * iix;
-        } else {
-            nnnx = nnx;
-        }
-
-        if (nny < ny) {
-            while (nny * iiy < ny) iiy++;
-            nnny = nny * iiy;
-        } else {
-            nnny = nny;
-        }
-
-        auto xlut = std::make_unique<double[]>(nnnx);
-        auto ylut = std::make_unique<double[]>(nnny);
-
-        for (uint32_t i = 0; i < nnnx; i++) {
-            xlut[i] = (double) (i * (nx - 1)) / (double) (nnnx - 1);
-        }
-        for (uint32_t j = 0; j < nnny; j++) {
-            ylut[j] = (double) (j * (ny - 1)) / (double) (nnny - 1);
-        }
-
-        auto outbuf = std::vector<T>(nnnx * nnny * nc);
-        double rx, ry;
-
-        for (uint32_t j = 0; j < nnny; j++) {
-            ry = ylut[j];
-            for (uint32_t i = 0; i < nnnx; i++) {
-                rx = xlut[i];
-                for (uint32_t k = 0; k < nc; k++) {
-                    outbuf[nc * (j * nnnx + i) + k] = bilinn<T>(inbuf, nx, rx, ry, k, nc);
-                }
-            }
-        }
-
-
-        if ((iix > 1) || (iiy > 1)) {
-            auto outbuf2 = std::vector<T>(nnx * nny * nc);
-            for (uint32_t j = 0; j < nny; j++) {
-                for (uint32_t i = 0; i < nnx; i++) {
-                    for (uint32_t k = 0; k < nc; k++) {
-                        unsigned int accu = 0;
-
-                        for (uint32_t jj = 0; jj < iiy; jj++) {
-                            for (uint32_t ii = 0; ii < iix; ii++) {
-                                accu += outbuf[nc * ((iiy * j + jj) * nnnx + (iix * i + ii)) + k];
-                            }
-                        }
-
-                        outbuf2[nc * (j * nnx + i) + k] = accu / (iix * iiy);
-                    }
-                }
-            }
-            outbuf = std::move(outbuf2);
-        }
-        return outbuf;
-    }
-
-    template<typename T>
-    std::vector<T> doRotate(std::vector<T> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t &nnx, uint32_t &nny, float angle, bool mirror) {
-        if (mirror) {
-            auto outbuf = std::vector<T>(nx * ny * nc);
-            for (uint32_t j = 0; j < ny; j++) {
-                for (uint32_t i = 0; i < nx; i++) {
-                    for (uint32_t k = 0; k < nc; k++) {
-                        outbuf[nc * (j * nx + i) + k] = inbuf[nc * (j * nx + (nx - i - 1)) + k];
-                    }
-                }
-            }
-            inbuf = outbuf;
-        }
-
-        while (angle < 0.) angle += 360.;
-        while (angle >= 360.) angle -= 360.;
-
-        if (angle == 0.) {
-            return inbuf;
-        }
-
-        if (angle == 90.) {
-            //
-            // abcdef     mga
-            // ghijkl ==> nhb
-            // mnopqr     oic
-            //            pjd
-            //            qke
-            //            rlf
-            //
-            nnx = ny;
-            nny = nx;
-            auto outbuf = std::vector<T>(nx * ny * nc);
-            for (uint32_t j = 0; j < nny; j++) {
-                for (uint32_t i = 0; i < nnx; i++) {
-                    for (uint32_t k = 0; k < nc; k++) {
-                        outbuf[nc * (j * nnx + i) + k] = inbuf[nc * ((ny - i - 1) * nx + j) + k];
-                    }
-                }
-            }
-            return outbuf;
-        } else if (angle == 180.) {
-            //
-            // abcdef     rqponm
-            // ghijkl ==> lkjihg
-            // mnopqr     fedcba
-            //
-            nnx = nx;
-            nny = ny;
-            auto outbuf = std::vector<T>(nx * ny * nc);
-            for (uint32_t j = 0; j < nny; j++) {
-                for (uint32_t i = 0; i < nnx; i++) {
-                    for (uint32_t k = 0; k < nc; k++) {
-                        outbuf[nc * (j * nnx + i) + k] = inbuf[nc * ((ny - j - 1) * nx + (nx - i - 1)) + k];
-                    }
-                }
-            }
-            return outbuf;
-        } else if (angle == 270.) {
-            //
-            // abcdef     flr
-            // ghijkl ==> ekq
-            // mnopqr     djp
-            //            cio
-            //            bhn
-            //            agm
-            //
-            nnx = ny;
-            nny = nx;
-            auto outbuf = std::vector<T>(nx * ny * nc);
-            for (uint32_t j = 0; j < nny; j++) {
-                for (uint32_t i = 0; i < nnx; i++) {
-                    for (uint32_t k = 0; k < nc; k++) {
-                        outbuf[nc * (j * nnx + i) + k] = inbuf[nc * (i * nx + (nx - j - 1)) + k];
-                    }
-                }
-            }
-            return outbuf;
-        } else { // all other angles
-            double phi = M_PI * angle / 180.0;
-            double ptx = static_cast<double>(nx) / 2. - .5;
-            double pty = static_cast<double>(ny) / 2. - .5;
-
-            double si = sin(-phi);
-            double co = cos(-phi);
-
-            if ((angle > 0.) && (angle < 90.)) {
-                nnx = floor((double) nx * cos(phi) + (double) ny * sin(phi) + .5);
-                nny = floor((double) nx * sin(phi) + (double) ny * cos(phi) + .5);
-            } else if ((angle > 90.) && (angle < 180.)) {
-                nnx = floor(-((double) nx) * cos(phi) + (double) ny * sin(phi) + .5);
-                nny = floor((double) nx * sin(phi) - (double) ny * cosf(phi) + .5);
-            } else if ((angle > 180.) && (angle < 270.)) {
-                nnx = floor(-((double) nx) * cos(phi) - (double) ny * sin(phi) + .5);
-                nny = floor(-((double) nx) * sinf(phi) - (double) ny * cosf(phi) + .5);
-            } else {
-                nnx = floor((double) nx * cos(phi) - (double) ny * sin(phi) + .5);
-                nny = floor(-((double) nx) * sin(phi) + (double) ny * cos(phi) + .5);
-            }
-
-            double pptx = ptx * (double) nnx / (double) nx;
-            double ppty = pty * (double) nny / (double) ny;
-
-            auto outbuf = std::vector<T>(nnx * nny * nc);
-            byte bg = 0;
-            for (uint32_t j = 0; j < nny; j++) {
-                for (uint32_t i = 0; i < nnx; i++) {
-                    double rx = ((double) i - pptx) * co - ((double) j - ppty) * si + ptx;
-                    double ry = ((double) i - pptx) * si + ((double) j - ppty) * co + pty;
-
-                    if ((rx < 0.0) || (rx >= (double) (nx - 1)) || (ry < 0.0) || (ry >= (double) (ny - 1))) {
-                        for (uint32_t k = 0; k < nc; k++) {
-                            outbuf[nc * (j * nnx + i) + k] = bg;
-                        }
-                    } else {
-                        for (uint32_t k = 0; k < nc; k++) {
-                            outbuf[nc * (j * nnx + i) + k] = bilinn<T>(inbuf, nx, rx, ry, k, nc);
-                        }
-                    }
-                }
-            }
-            return outbuf;
-        }
-    }
-
     template std::unique_ptr<uint8_t[]> separateToContig<uint8_t[]>(std::unique_ptr<uint8_t[]> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t sll);
     template std::unique_ptr<uint16_t[]> separateToContig<uint16_t[]>(std::unique_ptr<uint16_t[]> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t sll);
 
@@ -563,19 +282,8 @@ namespace cserve {
     template uint8_t bilinn<uint8_t>(const std::vector<uint8_t> &buf, uint32_t nx, double x, double y, uint32_t c, uint32_t n);
     template uint16_t bilinn<uint16_t>(const std::vector<uint16_t> &buf, uint32_t nx, double x, double y, uint32_t c, uint32_t n);
 
-    template std::vector<uint8_t> doReduce<uint8_t>(std::vector<uint8_t> &&inbuf, uint32_t reduce, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t &nnx, uint32_t nny);
-    template std::vector<uint16_t> doReduce<uint16_t>(std::vector<uint16_t> &&inbuf, uint32_t reduce, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t &nnx, uint32_t nny);
-
-    template std::vector<uint8_t> doScaleFast<uint8_t>(std::vector<uint8_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t nnx, uint32_t nny);
-    template std::vector<uint16_t> doScaleFast<uint16_t>(std::vector<uint16_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t nnx, uint32_t nny);
-
-    template std::vector<uint8_t> doScaleMedium<uint8_t>(std::vector<uint8_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t nnx, uint32_t nny);
-    template std::vector<uint16_t> doScaleMedium<uint16_t>(std::vector<uint16_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t nnx, uint32_t nny);
-
-    template std::vector<uint8_t> doScale<uint8_t>(std::vector<uint8_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t nnx, uint32_t nny);
-    template std::vector<uint16_t> doScale<uint16_t>(std::vector<uint16_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t nnx, uint32_t nny);
+    template std::vector<uint8_t> doReduce<uint8_t>(std::vector<uint8_t> &&inbuf, uint32_t reduce, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t &nnx, uint32_t &nny);
+    template std::vector<uint16_t> doReduce<uint16_t>(std::vector<uint16_t> &&inbuf, uint32_t reduce, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t &nnx, uint32_t &nny);
 
-    template std::vector<uint8_t> doRotate<uint8_t>(std::vector<uint8_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t &nnx, uint32_t &nny, float angle, bool mirror);
-    template std::vector<uint16_t> doRotate<uint16_t>(std::vector<uint16_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t &nnx, uint32_t &nny, float angle, bool mirror);
 
 }
\ No newline at end of file
@@ -9,75 +9,10 @@
 #include <vector>
 
 #include "IIIFImage.h"
+#include "IIIFPixelKernels.h"
 
 namespace cserve {
 
-    template<typename T>
-    void one2eight(const uint8_t *in, T *out, uint32_t len, uint8_t black, uint8_t white) {
-        static uint8_t mask[8] = {0b10000000,
-                                  0b01000000,
-                                  0b00100000,
-                                  0b00010000,
-                                  0b00001000,
-                                  0b00000100,
-                                  0b00000010,
-                                  0b00000001};
-        uint32_t ii = 0;
-        for (uint32_t i = 0; i < len; i += 8) {
-            for (uint32_t k = 0; (k < 8) && ((k + i) < len); ++k) {
-                out[i + k] = mask[k] & in[ii] ? white : black;
-            }
-            ++ii;
-        }
-    }
-
-    template<typename T>
-    void four2eight(const uint8_t *in, T *out, uint32_t len, bool is_palette = false) {
-        static uint8_t mask[2] = { 0b11110000, 0b00001111 };
-
-        if (is_palette) {
-            uint32_t ii = 0;
-            for (uint32_t i = 0; i < len; i += 2, ++ii) {
-                out[i] = (mask[0] & in[ii]) >> 4;
-                if ((i + 1) < len) {
-                    out[i + 1] = mask[1] & in[ii];
-                }
-            }
-        }
-        else {
-            uint32_t ii = 0;
-            for (uint32_t i = 0; i < len; i += 2, ++ii) {
-                out[i] = mask[0] & in[ii];
-                if ((i + 1) < len) {
-                    out[i + 1] = (mask[1] & in[ii]) << 4;
-                }
-            }
-        }
-    }
-
-    template<typename T>
-    void twelve2sixteen(const uint8_t *in, T *out, uint32_t len, bool is_palette = false) {
-        static uint8_t mask[2] = { 0b11110000, 0b00001111 };
-        if (is_palette) {
-            uint32_t ii = 0;
-            for (uint32_t i = 0; i < len; i += 2, ii += 3) {
-                out[i] = (in[ii] << 4) | ((in[ii + 1] & mask[0]) >> 4);
-                if ((i + 1) < len) {
-                    out[i + 1] = ((in[ii + 1] & mask[1]) << 8) | in[ii + 2];
-                }
-            }
-        }
-        else {
-            uint32_t ii = 0;
-            for (uint32_t i = 0; i < len; i += 2, ii += 3) {
-                out[i] = (in[ii] << 8) | (in[ii + 1] & mask[0]);
-                if ((i + 1) < len) {
-                    out[i + 1] = ((in[ii + 1] & mask[1]) << 12) | (in[ii + 2] << 4);
-                }
-            }
-        }
-    }
-
     std::unique_ptr<uint8_t[]> cvrt1BitTo8Bit(std::unique_ptr<uint8_t[]> &&inbuf,
                                               uint32_t nx, uint32_t ny, uint32_t sll,
                                               uint8_t black, uint8_t white);
@@ -117,35 +52,15 @@ namespace cserve {
     extern template uint8_t bilinn<uint8_t>(const std::vector<uint8_t> &buf, uint32_t nx, double x, double y, uint32_t c, uint32_t n);
     extern template uint16_t bilinn<uint16_t>(const std::vector<uint16_t> &buf, uint32_t nx, double x, double y, uint32_t c, uint32_t n);
 
+    /*!
+     * Reduce an image by an integer factor: each pixel is the average of a block of
+     * reduce x reduce pixels. nnx and nny are set to the reduced size.
+     */
     template<typename T>
-    std::vector<T> doReduce(std::vector<T> &&inbuf, uint32_t reduce, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t &nnx, uint32_t nny);
-
-    extern template std::vector<uint8_t> doReduce<uint8_t>(std::vector<uint8_t> &&inbuf, uint32_t reduce, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t &nnx, uint32_t nny);
-    extern template std::vector<uint16_t> doReduce<uint16_t>(std::vector<uint16_t> &&inbuf, uint32_t reduce, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t &nnx, uint32_t nny);
-
-    template<typename T>
-    std::vector<T> doScaleFast(std::vector<T> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t nnx, uint32_t nny);
-
-    extern template std::vector<uint8_t> doScaleFast<uint8_t>(std::vector<uint8_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t nnx, uint32_t nny);
-    extern template std::vector<uint16_t> doScaleFast<uint16_t>(std::vector<uint16_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t nnx, uint32_t nny);
-
-    template<typename T>
-    std::vector<T> doScaleMedium(std::vector<T> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t nnx, uint32_t nny);
-
-    extern template std::vector<uint8_t> doScaleMedium<uint8_t>(std::vector<uint8_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t nnx, uint32_t nny);
-    extern template std::vector<uint16_t> doScaleMedium<uint16_t>(std::vector<uint16_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t nnx, uint32_t nny);
-
-    template<typename T>
-    std::vector<T> doScale(std::vector<T> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t nnx, uint32_t nny);
-
-    extern template std::vector<uint8_t> doScale<uint8_t>(std::vector<uint8_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t nnx, uint32_t nny);
-    extern template std::vector<uint16_t> doScale<uint16_t>(std::vector<uint16_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t nnx, uint32_t nny);
-
-    template<typename T>
-    std::vector<T> doRotate(std::vector<T> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t &nnx, uint32_t &nny, float angle, bool mirror);
+    std::vector<T> doReduce(std::vector<T> &&inbuf, uint32_t reduce, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t &nnx, uint32_t &nny);
 
-    extern template std::vector<uint8_t> doRotate<uint8_t>(std::vector<uint8_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t &nnx, uint32_t &nny, float angle, bool mirror);
-    extern template std::vector<uint16_t> doRotate<uint16_t>(std::vector<uint16_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t &nnx, uint32_t &nny, float angle, bool mirror);
+    extern template std::vector<uint8_t> doReduce<uint8_t>(std::vector<uint8_t> &&inbuf, uint32_t reduce, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t &nnx, uint32_t &nny);
+    extern template std::vector<uint16_t> doReduce<uint16_t>(std::vector<uint16_t> &&inbuf, uint32_t reduce, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t &nnx, uint32_t &nny);
 
 }
 
@@ -5,6 +5,7 @@
 #include <Parsing.h>
 
 #include "IIIFCache.h"
+#include "IIIFBufferPool.h"
 #include "IIIFImage.h"
 #include "IIIFLua.h"
 #include "IIIFError.h"
@@ -52,6 +53,13 @@ namespace cserve {
         return iiif_handler->cache();
     }
 
+    static std::shared_ptr<IIIFMemoryCache> memcache_getter(lua_State *L) {
+        lua_getglobal(L, iiifhandler_token);
+        auto *iiif_handler = (IIIFHandler *) lua_touserdata(L, -1);
+        lua_remove(L, -1); // remove from stack
+        return iiif_handler->memcache();
+    }
+
     /*!
      * Get the size of the cache
      * LUA: cache_size = cache.size()
@@ -203,6 +211,8 @@ namespace cserve {
         if (top == 1) {
             canonical = std::string(lua_tostring(L, 1));
             lua_pop(L, 1);
+            std::shared_ptr<IIIFMemoryCache> memcache = memcache_getter(L);
+            if (memcache != nullptr) memcache->remove(canonical);
             lua_pushboolean(L, cache->remove(canonical));
         } else {
             lua_pop(L, top);
@@ -211,6 +221,34 @@ namespace cserve {
         return 1;
     }
 
+    /*!
+     * Get the replacement policy of the cache
+     * LUA: policy = cache.policy() -- "lru" or "slru"
+     */
+    static int lua_cache_policy(lua_State *L) {
+        std::shared_ptr<IIIFCache> cache = cache_getter(L);
+        if (cache == nullptr) {
+            lua_pushnil(L);
+            return 1;
+        }
+        lua_pushstring(L, IIIFCachePolicy::type_name(cache->getPolicy()).c_str());
+        return 1;
+    }
+
+    /*!
+     * Get the number of files evicted by the replacement policy
+     * LUA: nevicted = cache.evictions()
+     */
+    static int lua_cache_evictions(lua_State *L) {
+        std::shared_ptr<IIIFCache> cache = cache_getter(L);
+        if (cache == nullptr) {
+            lua_pushnil(L);
+            return 1;
+        }
+        lua_pushinteger(L, static_cast<lua_Integer>(cache->getEvictions()));
+        return 1;
+    }
+
     static int lua_purge_cache(lua_State *L) {
         std::shared_ptr<IIIFCache> cache = cache_getter(L);
         if (cache == nullptr) {
@@ -222,6 +260,108 @@ namespace cserve {
         return 1;
     }
 
+    /*!
+     * Get the hit/miss counters of the in-memory and the file cache
+     * LUA: stats = cache.stats()
+     *      stats = { memory_hits = n, memory_misses = n, memory_rejected = n, memory_size = n,
+     *                memory_max_size = n, memory_nentries = n, file_hits = n, file_misses = n,
+     *                coalesced = n, renders = n, policy = "slru", evictions = n, eviction_runs = n }
+     * coalesced is the number of requests that waited for an identical render instead of rendering themselves,
+     * renders the number of responses that have been decoded and transcoded.
+     * The memory_* fields are missing if the in-memory cache is disabled.
+     */
+    static int lua_cache_stats(lua_State *L) {
+        std::shared_ptr<IIIFCache> cache = cache_getter(L);
+        if (cache == nullptr) {
+            lua_pushnil(L);
+            return 1;
+        }
+        std::shared_ptr<IIIFMemoryCache> memcache = memcache_getter(L);
+        lua_createtable(L, 0, 8); // table
+        if (memcache != nullptr) {
+            lua_pushstring(L, "memory_hits");
+            lua_pushinteger(L, static_cast<lua_Integer>(memcache->hits()));
+            lua_rawset(L, -3);
+
+            lua_pushstring(L, "memory_misses");
+            lua_pushinteger(L, static_cast<lua_Integer>(memcache->misses()));
+            lua_rawset(L, -3);
+
+            lua_pushstring(L, "memory_rejected");
+            lua_pushinteger(L, static_cast<lua_Integer>(memcache->rejected()));
+            lua_rawset(L, -3);
+
+            lua_pushstring(L, "memory_size");
+            lua_pushinteger(L, static_cast<lua_Integer>(memcache->getSize()));
+            lua_rawset(L, -3);
+
+            lua_pushstring(L, "memory_max_size");
+            lua_pushinteger(L, static_cast<lua_Integer>(memcache->getMaxSize()));
+            lua_rawset(L, -3);
+
+            lua_pushstring(L, "memory_nentries");
+            lua_pushinteger(L, static_cast<lua_Integer>(memcache->getNentries()));
+            lua_rawset(L, -3);
+        }
+        std::shared_ptr<IIIFBufferPool> bufferpool = IIIFBufferPool::instance();
+        if (bufferpool != nullptr) {
+            lua_pushstring(L, "buffer_hits");
+            lua_pushinteger(L, static_cast<lua_Integer>(bufferpool->hits()));
+            lua_rawset(L, -3);
+
+            lua_pushstring(L, "buffer_misses");
+            lua_pushinteger(L, static_cast<lua_Integer>(bufferpool->misses()));
+            lua_rawset(L, -3);
+
+            lua_pushstring(L, "buffer_discarded");
+            lua_pushinteger(L, static_cast<lua_Integer>(bufferpool->discarded()));
+            lua_rawset(L, -3);
+
+            lua_pushstring(L, "buffer_idle_size");
+            lua_pushinteger(L, static_cast<lua_Integer>(bufferpool->getIdleBytes()));
+            lua_rawset(L, -3);
+
+            lua_pushstring(L, "buffer_peak_idle_size");
+            lua_pushinteger(L, static_cast<lua_Integer>(bufferpool->getPeakIdleBytes()));
+            lua_rawset(L, -3);
+
+            lua_pushstring(L, "buffer_largest_request");
+            lua_pushinteger(L, static_cast<lua_Integer>(bufferpool->getLargestRequest()));
+            lua_rawset(L, -3);
+        }
+        lua_pushstring(L, "file_hits");
+        lua_pushinteger(L, static_cast<lua_Integer>(cache->getHits()));
+        lua_rawset(L, -3);
+
+        lua_pushstring(L, "file_misses");
+        lua_pushinteger(L, static_cast<lua_Integer>(cache->getMisses()));
+        lua_rawset(L, -3);
+
+        lua_pushstring(L, "policy");
+        lua_pushstring(L, IIIFCachePolicy::type_name(cache->getPolicy()).c_str());
+        lua_rawset(L, -3);
+
+        lua_pushstring(L, "evictions");
+        lua_pushinteger(L, static_cast<lua_Integer>(cache->getEvictions()));
+        lua_rawset(L, -3);
+
+        lua_pushstring(L, "eviction_runs");
+        lua_pushinteger(L, static_cast<lua_Integer>(cache->getEvictionRuns()));
+        lua_rawset(L, -3);
+
+        lua_getglobal(L, iiifhandler_token);
+        auto *iiif_handler = (IIIFHandler *) lua_touserdata(L, -1);
+        lua_pop(L, 1);
+        lua_pushstring(L, "coalesced");
+        lua_pushinteger(L, static_cast<lua_Integer>(iiif_handler->renders()->coalesced()));
+        lua_rawset(L, -3);
+
+        lua_pushstring(L, "renders");
+        lua_pushinteger(L, static_cast<lua_Integer>(iiif_handler->renders()->rendered()));
+        lua_rawset(L, -3);
+        return 1;
+    }
+
     static const luaL_Reg cache_methods[] = {{"size",       lua_cache_size},
                                              {"max_size",   lua_cache_max_size},
                                              {"nfiles",     lua_cache_nfiles},
@@ -230,6 +370,9 @@ namespace cserve {
                                              {"filelist",   lua_cache_filelist},
                                              {"delete",     lua_delete_cache_file},
                                              {"purge",      lua_purge_cache},
+                                             {"stats",      lua_cache_stats},
+                                             {"policy",     lua_cache_policy},
+                                             {"evictions",  lua_cache_evictions},
                                              {nullptr,            nullptr}};
 
 
@@ -1566,6 +1709,48 @@ namespace cserve {
                         comp_params[J2K_rates] = value;
                     } else if (key == std::string("quality")) {
                         comp_params[JPEG_QUALITY] = value;
+                    } else if (key == std::string("dct")) {
+                        std::set<std::string> validvalues = {"islow", "ifast", "float"};
+                        if (validvalues.find(value) != validvalues.end()) {
+                            comp_params[JPEG_DCT_METHOD] = value;
+                        } else {
+                            lua_pop(L, lua_gettop(L));
+                            lua_pushstring(L, "IIIFImage.write(): invalid dct!");
+                            return lua_error(L);
+                        }
+                    } else if (key == std::string("optimize")) {
+                        if (value == "yes" || value == "no") {
+                            comp_params[JPEG_OPTIMIZE] = value;
+                        } else {
+                            lua_pop(L, lua_gettop(L));
+                            lua_pushstring(L, "IIIFImage.write(): invalid optimize!");
+                            return lua_error(L);
+                        }
+                    } else if (key == std::string("progressive")) {
+                        if (value == "yes" || value == "no") {
+                            comp_params[JPEG_PROGRESSIVE] = value;
+                        } else {
+                            lua_pop(L, lua_gettop(L));
+                            lua_pushstring(L, "IIIFImage.write(): invalid progressive!");
+                            return lua_error(L);
+                        }
+                    } else if (key == std::string("parallel")) {
+                        if (value == "yes" || value == "no") {
+                            comp_params[JPEG_PARALLEL] = value;
+                        } else {
+                            lua_pop(L, lua_gettop(L));
+                            lua_pushstring(L, "IIIFImage.write(): invalid parallel!");
+                            return lua_error(L);
+                        }
+                    } else if (key == std::string("subsampling")) {
+                        std::set<std::string> validvalues = {"4:4:4", "4:2:2", "4:2:0"};
+                        if (validvalues.find(value) != validvalues.end()) {
+                            comp_params[JPEG_SUBSAMPLING] = value;
+                        } else {
+                            lua_pop(L, lua_gettop(L));
+                            lua_pushstring(L, "IIIFImage.write(): invalid subsampling!");
+                            return lua_error(L);
+                        }
                     } else if (key == std::string("compression")) {
                         comp_params[TIFF_COMPRESSION] = value;
                     } else if (key == std::string("pyramid")) {
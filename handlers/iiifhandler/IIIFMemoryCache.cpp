@@ -0,0 +1,187 @@
+/*
+ * Copyright © 2022 Lukas Rosenthaler
+ * This file is part of OMAS/cserve
+ * OMAS/cserve is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * OMAS/cserve is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+#include <algorithm>
+#include <functional>
+
+#include "IIIFMemoryCache.h"
+
+namespace cserve {
+
+    static const int sketch_depth = 4;
+
+    IIIFFrequencySketch::IIIFFrequencySketch(size_t width) : nincrements(0) {
+        size_t w = 1;
+        while (w < width) w <<= 1;
+        mask = w - 1;
+        sample_size = 10 * w;
+        table.resize(sketch_depth * w, 0);
+    }
+    //============================================================================
+
+    void IIIFFrequencySketch::increment(size_t key_hash) {
+        for (int i = 0; i < sketch_depth; i++) {
+            uint8_t &counter = table[i * (mask + 1) + index(key_hash, i, mask)];
+            if (counter < 15) counter++;
+        }
+        if (++nincrements >= sample_size) {
+            //
+            // aging: halve all counters, so that old popularity fades out
+            //
+            for (auto &counter: table) counter >>= 1;
+            nincrements /= 2;
+        }
+    }
+    //============================================================================
+
+    unsigned IIIFFrequencySketch::frequency(size_t key_hash) const {
+        unsigned freq = 15;
+        for (int i = 0; i < sketch_depth; i++) {
+            freq = std::min<unsigned>(freq, table[i * (mask + 1) + index(key_hash, i, mask)]);
+        }
+        return freq;
+    }
+    //============================================================================
+
+    static inline size_t entry_cost(const std::string &canonical, const IIIFMemoryCache::Entry &entry) {
+        // the key is stored twice (table and LRU list), plus some bookkeeping
+        return entry.data.size() + entry.mimetype.size() + 2 * canonical.size() + 128;
+    }
+    //============================================================================
+
+    IIIFMemoryCache::IIIFMemoryCache(size_t max_size_p) : sketch(std::max<size_t>(1024, max_size_p / 4096)),
+                                                          max_size(max_size_p), max_entry_size(max_size_p / 8),
+                                                          cur_size(0), n_hits(0), n_misses(0), n_rejected(0) {}
+    //============================================================================
+
+    void IIIFMemoryCache::erase(std::unordered_map<std::string, Slot>::iterator it) {
+        cur_size -= it->second.cost;
+        lru.erase(it->second.lru_pos);
+        table.erase(it);
+    }
+    //============================================================================
+
+    std::shared_ptr<const IIIFMemoryCache::Entry>
+    IIIFMemoryCache::get(const std::string &canonical, const struct timespec &orig_mtime) {
+        std::lock_guard<std::mutex> locking_mutex_guard(locking);
+        sketch.increment(std::hash<std::string>{}(canonical));
+        auto it = table.find(canonical);
+        if (it == table.end()) {
+            ++n_misses;
+            return nullptr;
+        }
+        const struct timespec &mtime = it->second.entry->orig_mtime;
+        if ((mtime.tv_sec != orig_mtime.tv_sec) || (mtime.tv_nsec != orig_mtime.tv_nsec)) {
+            erase(it); // the master file has been changed
+            ++n_misses;
+            return nullptr;
+        }
+        lru.splice(lru.begin(), lru, it->second.lru_pos); // now the most recently used one
+        ++n_hits;
+        return it->second.entry;
+    }
+    //============================================================================
+
+    bool IIIFMemoryCache::admits(const std::string &canonical, size_t size) {
+        size_t cost = size + 2 * canonical.size() + 128;
+        if (cost > max_entry_size) return false;
+
+        std::lock_guard<std::mutex> locking_mutex_guard(locking);
+        size_t avail = max_size - cur_size;
+        auto it = table.find(canonical);
+        if (it != table.end()) avail += it->second.cost;
+        if (cost <= avail) return true;
+
+        //
+        // the least recently used entries would have to go. They are only replaced by an
+        // entry that has been requested more often recently.
+        //
+        unsigned freq = sketch.frequency(std::hash<std::string>{}(canonical));
+        for (auto victim = lru.rbegin(); (victim != lru.rend()) && (cost > avail); ++victim) {
+            if (*victim == canonical) continue;
+            if (sketch.frequency(std::hash<std::string>{}(*victim)) >= freq) return false;
+            avail += table[*victim].cost;
+        }
+        return cost <= avail;
+    }
+    //============================================================================
+
+    bool IIIFMemoryCache::put(const std::string &canonical, std::shared_ptr<const Entry> entry) {
+        size_t cost = entry_cost(canonical, *entry);
+        if (cost > max_entry_size) {
+            ++n_rejected;
+            return false;
+        }
+
+        std::lock_guard<std::mutex> locking_mutex_guard(locking);
+
+        //
+        // collect the victims first, nothing is evicted (not even an existing entry of the same
+        // image) if the new entry is not admitted
+        //
+        unsigned freq = sketch.frequency(std::hash<std::string>{}(canonical));
+        size_t avail = max_size - cur_size;
+        auto old = table.find(canonical);
+        if (old != table.end()) avail += old->second.cost;
+        std::vector<std::string> victims;
+        for (auto victim = lru.rbegin(); (victim != lru.rend()) && (cost > avail); ++victim) {
+            if (*victim == canonical) continue;
+            if (sketch.frequency(std::hash<std::string>{}(*victim)) >= freq) {
+                ++n_rejected;
+                return false;
+            }
+            avail += table[*victim].cost;
+            victims.push_back(*victim);
+        }
+        if (cost > avail) {
+            ++n_rejected;
+            return false;
+        }
+        if (old != table.end()) erase(old);
+        for (const auto &victim: victims) {
+            erase(table.find(victim));
+        }
+
+        lru.push_front(canonical);
+        table[canonical] = {std::move(entry), lru.begin(), cost};
+        cur_size += cost;
+        return true;
+    }
+    //============================================================================
+
+    void IIIFMemoryCache::remove(const std::string &canonical) {
+        std::lock_guard<std::mutex> locking_mutex_guard(locking);
+        auto it = table.find(canonical);
+        if (it != table.end()) erase(it);
+    }
+    //============================================================================
+
+    void IIIFMemoryCache::clear() {
+        std::lock_guard<std::mutex> locking_mutex_guard(locking);
+        table.clear();
+        lru.clear();
+        cur_size = 0;
+    }
+    //============================================================================
+
+    size_t IIIFMemoryCache::getSize() {
+        std::lock_guard<std::mutex> locking_mutex_guard(locking);
+        return cur_size;
+    }
+    //============================================================================
+
+    size_t IIIFMemoryCache::getNentries() {
+        std::lock_guard<std::mutex> locking_mutex_guard(locking);
+        return table.size();
+    }
+    //============================================================================
+
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright © 2022 Lukas Rosenthaler
+ * This file is part of OMAS/cserve
+ * OMAS/cserve is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * OMAS/cserve is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef __defined_iiif_memory_cache_h
+#define __defined_iiif_memory_cache_h
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cserve {
+
+    /*!
+     * Approximate access frequency of keys (count-min sketch with 4 bit counters). All
+     * counters are halved periodically, so that the frequencies reflect the recent past.
+     * Used as admission filter ("TinyLFU") by IIIFMemoryCache.
+     */
+    class IIIFFrequencySketch {
+    private:
+        std::vector<uint8_t> table;
+        size_t mask;
+        size_t nincrements;
+        size_t sample_size; //!< number of increments after which all counters are halved
+
+        [[nodiscard]] static inline size_t index(size_t hash, int i, size_t mask) {
+            hash ^= hash >> 17;
+            hash *= 0x9E3779B97F4A7C15ULL + 2 * static_cast<size_t>(i);
+            return (hash >> 23) & mask;
+        }
+
+    public:
+        /*!
+         * Constructor
+         * @param width Number of counters per row, rounded up to a power of 2
+         */
+        explicit IIIFFrequencySketch(size_t width);
+
+        /*!
+         * Count an access to the key
+         * @param key_hash Hash of the key
+         */
+        void increment(size_t key_hash);
+
+        /*!
+         * Estimate the recent number of accesses of the key (at most 15)
+         * @param key_hash Hash of the key
+         */
+        [[nodiscard]] unsigned frequency(size_t key_hash) const;
+    };
+
+    /*!
+     * In-memory cache of encoded IIIF responses ("hot tiles") in front of IIIFCache.
+     *
+     * The entries are kept in LRU order within a memory budget. A new entry only replaces
+     * the least recently used ones if it has been requested more often recently (TinyLFU
+     * admission). Therefore a scan through many tiles that are requested only once does
+     * not flush the popular tiles out of the cache.
+     */
+    class IIIFMemoryCache {
+    public:
+        /*!
+         * An encoded response together with what is needed to validate and send it
+         */
+        typedef struct Entry_ {
+            std::string data;         //!< encoded image (the response body)
+            std::string mimetype;     //!< value of the Content-Type header
+            struct timespec orig_mtime; //!< modification time of the master file when the entry was made
+        } Entry;
+
+    private:
+        typedef std::list<std::string> LruList;
+
+        typedef struct {
+            std::shared_ptr<const Entry> entry;
+            LruList::iterator lru_pos;
+            size_t cost;
+        } Slot;
+
+        std::mutex locking;
+        std::unordered_map<std::string, Slot> table;
+        LruList lru; //!< canonical URLs, most recently used first
+        IIIFFrequencySketch sketch;
+        size_t max_size; //!< memory budget in bytes
+        size_t max_entry_size; //!< larger responses are not cached
+        size_t cur_size;
+        std::atomic<unsigned long long> n_hits;
+        std::atomic<unsigned long long> n_misses;
+        std::atomic<unsigned long long> n_rejected;
+
+        void erase(std::unordered_map<std::string, Slot>::iterator it);
+
+    public:
+        /*!
+         * Create an in-memory cache
+         *
+         * @param max_size_p Memory budget in bytes (encoded data and keys)
+         */
+        explicit IIIFMemoryCache(size_t max_size_p);
+
+        IIIFMemoryCache(const IIIFMemoryCache&) = delete;
+
+        IIIFMemoryCache &operator=(const IIIFMemoryCache&) = delete;
+
+        /*!
+         * Look up a response. An entry made from an older version of the master file is removed.
+         *
+         * @param canonical Canonical IIIF URL
+         * @param orig_mtime Current modification time of the master file
+         * @return The entry or nullptr
+         */
+        std::shared_ptr<const Entry> get(const std::string &canonical, const struct timespec &orig_mtime);
+
+        /*!
+         * Test if an entry of the given size would be admitted now. This allows to skip
+         * reading a cache file into memory that would be rejected anyway.
+         *
+         * @param canonical Canonical IIIF URL
+         * @param size Size of the encoded response in bytes
+         * @return true, if put() would store the entry
+         */
+        bool admits(const std::string &canonical, size_t size);
+
+        /*!
+         * Add (or replace) a response
+         *
+         * @param canonical Canonical IIIF URL
+         * @param entry The encoded response
+         * @return true, if the entry has been admitted to the cache
+         */
+        bool put(const std::string &canonical, std::shared_ptr<const Entry> entry);
+
+        /*!
+         * Remove a response
+         *
+         * @param canonical Canonical IIIF URL
+         */
+        void remove(const std::string &canonical);
+
+        /*!
+         * Remove all responses
+         */
+        void clear();
+
+        [[nodiscard]] inline unsigned long long hits() const { return n_hits; }
+
+        [[nodiscard]] inline unsigned long long misses() const { return n_misses; }
+
+        [[nodiscard]] inline unsigned long long rejected() const { return n_rejected; }
+
+        [[nodiscard]] inline size_t getMaxSize() const { return max_size; }
+
+        size_t getSize();
+
+        size_t getNentries();
+    };
+
+}
+
+#endif
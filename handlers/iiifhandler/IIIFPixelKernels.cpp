@@ -0,0 +1,891 @@
+/*
+ * Copyright © 2022 Lukas Rosenthaler
+ * This file is part of OMAS/cserve
+ * OMAS/cserve is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * OMAS/cserve is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define IIIF_PIXEL_X86
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define IIIF_PIXEL_NEON
+#include <arm_neon.h>
+#endif
+
+#include "IIIFPixelKernels.h"
+
+//
+// As in IIIFResample.cpp, the SIMD kernels are compiled for their instruction set only.
+// The AVX2 kernels don't use FMA, so that the double precision arithmetic of the YCbCr
+// conversion rounds exactly like the scalar code.
+//
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+
+namespace cserve {
+
+    static ResampleKernel usable_kernel(ResampleKernel kernel) {
+        //
+        // a kernel of another CPU (or one not supported by this one) falls back to the scalar code
+        //
+        ResampleKernel best = resampleKernel();
+        if ((kernel != RESAMPLE_SCALAR) && ((kernel > best) || ((kernel == RESAMPLE_NEON) != (best == RESAMPLE_NEON)))) {
+            return RESAMPLE_SCALAR;
+        }
+        return kernel;
+    }
+    //============================================================================
+
+    //
+    // The scalar code, also used for the samples left over by the SIMD kernels.
+    // i0 is the first sample to convert.
+    //
+    template<typename T>
+    static void one2eight_scalar(const uint8_t *in, T *out, uint32_t i0, uint32_t len, uint8_t black, uint8_t white) {
+        static const uint8_t mask[8] = {0b10000000,
+                                        0b01000000,
+                                        0b00100000,
+                                        0b00010000,
+                                        0b00001000,
+                                        0b00000100,
+                                        0b00000010,
+                                        0b00000001};
+        uint32_t ii = i0 / 8;
+        for (uint32_t i = i0; i < len; i += 8) {
+            for (uint32_t k = 0; (k < 8) && ((k + i) < len); ++k) {
+                out[i + k] = mask[k] & in[ii] ? white : black;
+            }
+            ++ii;
+        }
+    }
+    //============================================================================
+
+    template<typename T>
+    static void four2eight_scalar(const uint8_t *in, T *out, uint32_t i0, uint32_t len, bool is_palette) {
+        static const uint8_t mask[2] = {0b11110000, 0b00001111};
+        uint32_t ii = i0 / 2;
+        if (is_palette) {
+            for (uint32_t i = i0; i < len; i += 2, ++ii) {
+                out[i] = (mask[0] & in[ii]) >> 4;
+                if ((i + 1) < len) {
+                    out[i + 1] = mask[1] & in[ii];
+                }
+            }
+        } else {
+            for (uint32_t i = i0; i < len; i += 2, ++ii) {
+                out[i] = mask[0] & in[ii];
+                if ((i + 1) < len) {
+                    out[i + 1] = (mask[1] & in[ii]) << 4;
+                }
+            }
+        }
+    }
+    //============================================================================
+
+    template<typename T>
+    static void twelve2sixteen_scalar(const uint8_t *in, T *out, uint32_t i0, uint32_t len, bool is_palette) {
+        static const uint8_t mask[2] = {0b11110000, 0b00001111};
+        uint32_t ii = i0 / 2 * 3;
+        if (is_palette) {
+            for (uint32_t i = i0; i < len; i += 2, ii += 3) {
+                out[i] = (in[ii] << 4) | ((in[ii + 1] & mask[0]) >> 4);
+                if ((i + 1) < len) {
+                    out[i + 1] = ((in[ii + 1] & mask[1]) << 8) | in[ii + 2];
+                }
+            }
+        } else {
+            for (uint32_t i = i0; i < len; i += 2, ii += 3) {
+                out[i] = (in[ii] << 8) | (in[ii + 1] & mask[0]);
+                if ((i + 1) < len) {
+                    out[i + 1] = ((in[ii + 1] & mask[1]) << 12) | (in[ii + 2] << 4);
+                }
+            }
+        }
+    }
+    //============================================================================
+
+    template<typename T>
+    static void separate2contig_scalar(const T *in, T *out, size_t i0, size_t n, uint32_t nc, size_t plane_stride) {
+        for (uint32_t c = 0; c < nc; ++c) {
+            const T *plane = in + c * plane_stride;
+            for (size_t i = i0; i < n; ++i) {
+                out[nc * i + c] = plane[i];
+            }
+        }
+    }
+    //============================================================================
+
+    template<typename T>
+    static void ycc2rgb_scalar(const T *in, T *out, size_t i0, size_t n, uint32_t nc) {
+        constexpr int maxval = std::is_same<T, uint8_t>::value ? 255 : 65535;
+        for (size_t i = i0; i < n; i++) {
+            auto Y = (double) in[nc * i + 2];
+            auto Cb = (double) in[nc * i + 1];
+            auto Cr = (double) in[nc * i + 0];
+
+            int r = (int) (Y + 1.40200 * (Cr - 0x80));
+            int g = (int) (Y - 0.34414 * (Cb - 0x80) - 0.71414 * (Cr - 0x80));
+            int b = (int) (Y + 1.77200 * (Cb - 0x80));
+
+            out[nc * i + 0] = std::max(0, std::min(maxval, r));
+            out[nc * i + 1] = std::max(0, std::min(maxval, g));
+            out[nc * i + 2] = std::max(0, std::min(maxval, b));
+
+            for (size_t k = 3; k < nc; k++) {
+                out[nc * i + k] = in[nc * i + k];
+            }
+        }
+    }
+    //============================================================================
+
+    template<typename T>
+    static void blend_watermark_scalar(T *pixels, const uint8_t *values, size_t i0, size_t n) {
+        for (size_t i = i0; i < n; ++i) {
+            const uint32_t v = values[i];
+            if constexpr (std::is_same<T, uint8_t>::value) {
+                const uint32_t p = pixels[i];
+                pixels[i] = static_cast<uint8_t>(std::min<uint32_t>(255, p + (v * (p + 255) + 1275) / 2550));
+            } else {
+                double nval = (pixels[i] / 65535.0) * (1.0 + v / 655350.0) + v / 352500.;
+                pixels[i] = (nval > 1.0) ? static_cast<uint16_t>(65535) : static_cast<uint16_t>(std::floor(nval * 65535. + .5));
+            }
+        }
+    }
+    //============================================================================
+
+    static void sixteen2eight_scalar(const uint16_t *in, uint8_t *out, size_t i0, size_t n) {
+        for (size_t i = i0; i < n; ++i) {
+            out[i] = static_cast<uint8_t>(in[i] >> 8);
+        }
+    }
+    //============================================================================
+
+    // i0 must be a multiple of 8
+    static void eight2one_scalar(const uint8_t *in, uint8_t *out, uint32_t i0, uint32_t len, uint8_t threshold,
+                                 bool invert, uint8_t *bw) {
+        for (uint32_t i = i0; i < len; i += 8) {
+            uint8_t bits = 0;
+            for (uint32_t k = 0; (k < 8) && (i + k < len); ++k) {
+                const bool white = in[i + k] > threshold;
+                if (bw != nullptr) bw[i + k] = white ? 255 : 0;
+                if (white != invert) bits |= 0x80 >> k;
+            }
+            out[i / 8] = bits;
+        }
+    }
+    //============================================================================
+
+#ifdef IIIF_PIXEL_X86
+    //
+    // pshufb masks for the conversions between planar (or single channel) vectors and
+    // interleaved pixels. 0x80 clears the byte.
+    //
+    struct InterleaveMasks {
+        alignas(16) uint8_t rgb[2][3][3][16]; //!< [sample size - 1][output block][channel]: 3 planes to 3 channels
+    };
+
+    struct YccMasks {
+        alignas(16) uint8_t in[3][2][16];  //!< [channel][input block]: channel of 4 pixels to int32 lanes
+        alignas(16) uint8_t out[2][2][16]; //!< [output block][packed vector]: R, G and B back to the pixels
+        alignas(16) uint8_t alpha[2][16];  //!< [block]: the channels copied from the input (0xff)
+        uint32_t nblocks;                  //!< number of 16 byte blocks covering 4 pixels
+    };
+
+    static const InterleaveMasks &interleave_masks() {
+        static const InterleaveMasks masks = []() {
+            InterleaveMasks m{};
+            for (uint32_t s = 1; s <= 2; s++) {
+                for (uint32_t b = 0; b < 3; b++) {
+                    for (uint32_t c = 0; c < 3; c++) {
+                        for (uint32_t o = 0; o < 16; o++) {
+                            const uint32_t g = 16 * b + o;
+                            const uint32_t q = g / s; // sample in the output
+                            m.rgb[s - 1][b][c][o] = (q % 3 == c) ? static_cast<uint8_t>((q / 3) * s + g % s) : 0x80;
+                        }
+                    }
+                }
+            }
+            return m;
+        }();
+        return masks;
+    }
+    //============================================================================
+
+    //
+    // The packed result holds R, G and B of 4 pixels: 8 bit as bytes R0-R3 G0-G3 B0-B3 in one
+    // vector, 16 bit as words R0-R3 G0-G3 in the first and B0-B3 in the second vector.
+    //
+    static YccMasks make_ycc_masks(uint32_t s, uint32_t nc) {
+        YccMasks m{};
+        const uint32_t nbytes = 4 * nc * s;
+        m.nblocks = (nbytes + 15) / 16;
+        for (uint32_t c = 0; c < 3; c++) {
+            for (uint32_t j = 0; j < 2; j++) {
+                for (uint32_t o = 0; o < 16; o++) {
+                    const uint32_t k = o / 4, b = o % 4;
+                    const uint32_t off = (k * nc + c) * s + b;
+                    m.in[c][j][o] = ((b < s) && (off >= 16 * j) && (off < 16 * j + 16)) ? static_cast<uint8_t>(off - 16 * j) : 0x80;
+                }
+            }
+        }
+        for (uint32_t j = 0; j < 2; j++) {
+            for (uint32_t o = 0; o < 16; o++) {
+                const uint32_t g = 16 * j + o;
+                m.out[j][0][o] = m.out[j][1][o] = 0x80;
+                m.alpha[j][o] = 0;
+                if (g >= nbytes) continue;
+                const uint32_t q = g / s, h = g % s;
+                const uint32_t k = q / nc, c = q % nc;
+                if (c >= 3) {
+                    m.alpha[j][o] = 0xff;
+                } else if (s == 1) {
+                    m.out[j][0][o] = static_cast<uint8_t>(c * 4 + k);
+                } else {
+                    m.out[j][c / 2][o] = static_cast<uint8_t>(2 * ((c % 2) * 4 + k) + h);
+                }
+            }
+        }
+        return m;
+    }
+    //============================================================================
+
+    template<typename T>
+    static const YccMasks &ycc_masks(uint32_t nc) {
+        static const YccMasks masks3 = make_ycc_masks(sizeof(T), 3);
+        static const YccMasks masks4 = make_ycc_masks(sizeof(T), 4);
+        return (nc == 3) ? masks3 : masks4;
+    }
+    //============================================================================
+
+    //
+    // 16 unpacked bytes to 16 samples
+    //
+    template<typename T>
+    TARGET_SSE41
+    static inline void store_bytes_sse41(T *out, __m128i v) {
+        if constexpr (std::is_same<T, uint8_t>::value) {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out), v);
+        } else {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_cvtepu8_epi16(v));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 8), _mm_cvtepu8_epi16(_mm_srli_si128(v, 8)));
+        }
+    }
+    //============================================================================
+
+    template<typename T>
+    TARGET_SSE41
+    static uint32_t one2eight_sse41(const uint8_t *in, T *out, uint32_t len, uint8_t black, uint8_t white) {
+        const __m128i spread = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+        const __m128i bits = _mm_setr_epi8(-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1);
+        const __m128i vblack = _mm_set1_epi8(static_cast<char>(black));
+        const __m128i vwhite = _mm_set1_epi8(static_cast<char>(white));
+        uint32_t i = 0;
+        for (; i + 16 <= len; i += 16) {
+            uint16_t packed;
+            std::memcpy(&packed, in + i / 8, sizeof(packed));
+            __m128i v = _mm_shuffle_epi8(_mm_cvtsi32_si128(packed), spread);
+            __m128i set = _mm_cmpeq_epi8(_mm_and_si128(v, bits), bits);
+            store_bytes_sse41(out + i, _mm_blendv_epi8(vblack, vwhite, set));
+        }
+        return i;
+    }
+    //============================================================================
+
+    template<typename T>
+    TARGET_AVX2
+    static uint32_t one2eight_avx2(const uint8_t *in, T *out, uint32_t len, uint8_t black, uint8_t white) {
+        const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                                2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+        const __m256i bits = _mm256_setr_epi8(-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1,
+                                              -128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1);
+        const __m256i vblack = _mm256_set1_epi8(static_cast<char>(black));
+        const __m256i vwhite = _mm256_set1_epi8(static_cast<char>(white));
+        uint32_t i = 0;
+        for (; i + 32 <= len; i += 32) {
+            uint32_t packed;
+            std::memcpy(&packed, in + i / 8, sizeof(packed));
+            __m256i v = _mm256_shuffle_epi8(_mm256_set1_epi32(static_cast<int>(packed)), spread);
+            __m256i set = _mm256_cmpeq_epi8(_mm256_and_si256(v, bits), bits);
+            __m256i res = _mm256_blendv_epi8(vblack, vwhite, set);
+            if constexpr (std::is_same<T, uint8_t>::value) {
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), res);
+            } else {
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(res)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i + 16), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(res, 1)));
+            }
+        }
+        return i;
+    }
+    //============================================================================
+
+    template<typename T>
+    TARGET_SSE41
+    static uint32_t four2eight_sse41(const uint8_t *in, T *out, uint32_t len, bool is_palette) {
+        const __m128i low = _mm_set1_epi8(0x0f);
+        const __m128i high = _mm_set1_epi8(static_cast<char>(0xf0));
+        uint32_t i = 0;
+        for (; i + 16 <= len; i += 16) {
+            __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(in + i / 2));
+            __m128i first, second;
+            if (is_palette) {
+                first = _mm_and_si128(_mm_srli_epi16(v, 4), low);
+                second = _mm_and_si128(v, low);
+            } else {
+                first = _mm_and_si128(v, high);
+                second = _mm_and_si128(_mm_slli_epi16(v, 4), high);
+            }
+            store_bytes_sse41(out + i, _mm_unpacklo_epi8(first, second));
+        }
+        return i;
+    }
+    //============================================================================
+
+    template<typename T>
+    TARGET_SSE41
+    static uint32_t twelve2sixteen_sse41(const uint8_t *in, T *out, uint32_t len, bool is_palette) {
+        if constexpr (!std::is_same<T, uint16_t>::value) {
+            return 0; // 12 bit samples are not stored in 8 bit
+        } else {
+            //
+            // 8 samples from 12 bytes: the words of the even samples hold the bytes 0 and 1 of a
+            // group of 3 bytes, the odd ones the bytes 1 and 2 (big endian)
+            //
+            const __m128i spread = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+            uint32_t i = 0;
+            for (; i + 12 <= len; i += 8) {
+                __m128i v = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i / 2 * 3)), spread);
+                __m128i res;
+                if (is_palette) {
+                    res = _mm_blend_epi16(_mm_srli_epi16(v, 4), _mm_and_si128(v, _mm_set1_epi16(0x0fff)), 0xaa);
+                } else {
+                    res = _mm_blend_epi16(_mm_and_si128(v, _mm_set1_epi16(static_cast<short>(0xfff0))), _mm_slli_epi16(v, 4), 0xaa);
+                }
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), res);
+            }
+            return i;
+        }
+    }
+    //============================================================================
+
+    template<typename T>
+    TARGET_SSE41
+    static size_t separate2contig_sse41(const T *in, T *out, size_t n, uint32_t nc, size_t plane_stride) {
+        constexpr size_t m = 16 / sizeof(T); // samples per vector
+        const bool words = sizeof(T) == 2;
+        auto load = [](const T *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); };
+        auto store = [](T *p, __m128i v) { _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v); };
+        const T *p0 = in, *p1 = in + plane_stride, *p2 = in + 2 * plane_stride, *p3 = in + 3 * plane_stride;
+        size_t i = 0;
+        switch (nc) {
+            case 2:
+                for (; i + m <= n; i += m) {
+                    __m128i a = load(p0 + i), b = load(p1 + i);
+                    store(out + 2 * i, words ? _mm_unpacklo_epi16(a, b) : _mm_unpacklo_epi8(a, b));
+                    store(out + 2 * i + m, words ? _mm_unpackhi_epi16(a, b) : _mm_unpackhi_epi8(a, b));
+                }
+                break;
+            case 3: {
+                const auto &rgb = interleave_masks().rgb[sizeof(T) - 1];
+                for (; i + m <= n; i += m) {
+                    __m128i v[3] = {load(p0 + i), load(p1 + i), load(p2 + i)};
+                    for (uint32_t b = 0; b < 3; b++) {
+                        __m128i res = _mm_shuffle_epi8(v[0], _mm_load_si128(reinterpret_cast<const __m128i *>(rgb[b][0])));
+                        res = _mm_or_si128(res, _mm_shuffle_epi8(v[1], _mm_load_si128(reinterpret_cast<const __m128i *>(rgb[b][1]))));
+                        res = _mm_or_si128(res, _mm_shuffle_epi8(v[2], _mm_load_si128(reinterpret_cast<const __m128i *>(rgb[b][2]))));
+                        store(out + 3 * i + b * m, res);
+                    }
+                }
+                break;
+            }
+            case 4:
+                for (; i + m <= n; i += m) {
+                    __m128i a = load(p0 + i), b = load(p1 + i), c = load(p2 + i), d = load(p3 + i);
+                    __m128i ab_lo = words ? _mm_unpacklo_epi16(a, b) : _mm_unpacklo_epi8(a, b);
+                    __m128i ab_hi = words ? _mm_unpackhi_epi16(a, b) : _mm_unpackhi_epi8(a, b);
+                    __m128i cd_lo = words ? _mm_unpacklo_epi16(c, d) : _mm_unpacklo_epi8(c, d);
+                    __m128i cd_hi = words ? _mm_unpackhi_epi16(c, d) : _mm_unpackhi_epi8(c, d);
+                    store(out + 4 * i, words ? _mm_unpacklo_epi32(ab_lo, cd_lo) : _mm_unpacklo_epi16(ab_lo, cd_lo));
+                    store(out + 4 * i + m, words ? _mm_unpackhi_epi32(ab_lo, cd_lo) : _mm_unpackhi_epi16(ab_lo, cd_lo));
+                    store(out + 4 * i + 2 * m, words ? _mm_unpacklo_epi32(ab_hi, cd_hi) : _mm_unpacklo_epi16(ab_hi, cd_hi));
+                    store(out + 4 * i + 3 * m, words ? _mm_unpackhi_epi32(ab_hi, cd_hi) : _mm_unpackhi_epi16(ab_hi, cd_hi));
+                }
+                break;
+            default:
+                break;
+        }
+        return i;
+    }
+    //============================================================================
+
+    //
+    // Cr, Cb and Y of 4 pixels as int32, and back
+    //
+    template<typename T>
+    TARGET_SSE41
+    static inline void ycc_load_sse41(const T *in, const YccMasks &masks, __m128i v[2], __m128i &cr, __m128i &cb, __m128i &y) {
+        v[0] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+        v[1] = (masks.nblocks > 1) ? _mm_loadu_si128(reinterpret_cast<const __m128i *>(in) + 1) : _mm_setzero_si128();
+        __m128i ch[3];
+        for (uint32_t c = 0; c < 3; c++) {
+            ch[c] = _mm_or_si128(_mm_shuffle_epi8(v[0], _mm_load_si128(reinterpret_cast<const __m128i *>(masks.in[c][0]))),
+                                 _mm_shuffle_epi8(v[1], _mm_load_si128(reinterpret_cast<const __m128i *>(masks.in[c][1]))));
+        }
+        cr = ch[0];
+        cb = ch[1];
+        y = ch[2];
+    }
+    //============================================================================
+
+    template<typename T>
+    TARGET_SSE41
+    static inline void ycc_store_sse41(T *out, const YccMasks &masks, const __m128i v[2], __m128i r, __m128i g, __m128i b) {
+        __m128i packed[2];
+        if constexpr (std::is_same<T, uint8_t>::value) {
+            packed[0] = _mm_packus_epi16(_mm_packus_epi32(r, g), _mm_packus_epi32(b, b)); // clamps to [0, 255]
+            packed[1] = _mm_setzero_si128();
+        } else {
+            packed[0] = _mm_packus_epi32(r, g); // clamps to [0, 65535]
+            packed[1] = _mm_packus_epi32(b, b);
+        }
+        for (uint32_t j = 0; j < masks.nblocks; j++) {
+            __m128i res = _mm_or_si128(_mm_shuffle_epi8(packed[0], _mm_load_si128(reinterpret_cast<const __m128i *>(masks.out[j][0]))),
+                                       _mm_shuffle_epi8(packed[1], _mm_load_si128(reinterpret_cast<const __m128i *>(masks.out[j][1]))));
+            res = _mm_or_si128(res, _mm_and_si128(v[j], _mm_load_si128(reinterpret_cast<const __m128i *>(masks.alpha[j]))));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out) + j, res);
+        }
+    }
+    //============================================================================
+
+    template<typename T>
+    TARGET_SSE41
+    static size_t ycc2rgb_sse41(const T *in, T *out, size_t n, uint32_t nc) {
+        if ((nc != 3) && (nc != 4)) return 0;
+        const YccMasks &masks = ycc_masks<T>(nc);
+        const __m128d c128 = _mm_set1_pd(128.0);
+        const __m128d kr = _mm_set1_pd(1.40200), kgb = _mm_set1_pd(0.34414), kgr = _mm_set1_pd(0.71414), kb = _mm_set1_pd(1.77200);
+        const size_t total = n * nc * sizeof(T);
+        size_t i = 0;
+        for (; i * nc * sizeof(T) + 16 * masks.nblocks <= total; i += 4) {
+            __m128i v[2], cr, cb, y;
+            ycc_load_sse41(in + nc * i, masks, v, cr, cb, y);
+            __m128i res[3][2];
+            for (int h = 0; h < 2; h++) { // two pixels per __m128d
+                __m128d Y = _mm_cvtepi32_pd(h ? _mm_unpackhi_epi64(y, y) : y);
+                __m128d dCb = _mm_sub_pd(_mm_cvtepi32_pd(h ? _mm_unpackhi_epi64(cb, cb) : cb), c128);
+                __m128d dCr = _mm_sub_pd(_mm_cvtepi32_pd(h ? _mm_unpackhi_epi64(cr, cr) : cr), c128);
+                res[0][h] = _mm_cvttpd_epi32(_mm_add_pd(Y, _mm_mul_pd(kr, dCr)));
+                res[1][h] = _mm_cvttpd_epi32(_mm_sub_pd(_mm_sub_pd(Y, _mm_mul_pd(kgb, dCb)), _mm_mul_pd(kgr, dCr)));
+                res[2][h] = _mm_cvttpd_epi32(_mm_add_pd(Y, _mm_mul_pd(kb, dCb)));
+            }
+            ycc_store_sse41(out + nc * i, masks, v, _mm_unpacklo_epi64(res[0][0], res[0][1]),
+                            _mm_unpacklo_epi64(res[1][0], res[1][1]), _mm_unpacklo_epi64(res[2][0], res[2][1]));
+        }
+        return i;
+    }
+    //============================================================================
+
+    template<typename T>
+    TARGET_AVX2
+    static size_t ycc2rgb_avx2(const T *in, T *out, size_t n, uint32_t nc) {
+        if ((nc != 3) && (nc != 4)) return 0;
+        const YccMasks &masks = ycc_masks<T>(nc);
+        const __m256d c128 = _mm256_set1_pd(128.0);
+        const __m256d kr = _mm256_set1_pd(1.40200), kgb = _mm256_set1_pd(0.34414), kgr = _mm256_set1_pd(0.71414), kb = _mm256_set1_pd(1.77200);
+        const size_t total = n * nc * sizeof(T);
+        size_t i = 0;
+        for (; i * nc * sizeof(T) + 16 * masks.nblocks <= total; i += 4) {
+            __m128i v[2], cr, cb, y;
+            ycc_load_sse41(in + nc * i, masks, v, cr, cb, y);
+            __m256d Y = _mm256_cvtepi32_pd(y);
+            __m256d dCb = _mm256_sub_pd(_mm256_cvtepi32_pd(cb), c128);
+            __m256d dCr = _mm256_sub_pd(_mm256_cvtepi32_pd(cr), c128);
+            __m128i r = _mm256_cvttpd_epi32(_mm256_add_pd(Y, _mm256_mul_pd(kr, dCr)));
+            __m128i g = _mm256_cvttpd_epi32(_mm256_sub_pd(_mm256_sub_pd(Y, _mm256_mul_pd(kgb, dCb)), _mm256_mul_pd(kgr, dCr)));
+            __m128i b = _mm256_cvttpd_epi32(_mm256_add_pd(Y, _mm256_mul_pd(kb, dCb)));
+            ycc_store_sse41(out + nc * i, masks, v, r, g, b);
+        }
+        return i;
+    }
+    //============================================================================
+
+    //
+    // The quotient (v * (p + 255) + 1275) / 2550 is at most 51. Computed in single precision with
+    // the reciprocal, it is off by far less than the bias, which is far less than 1 / 2550.
+    //
+    TARGET_SSE41
+    static inline __m128i blend_quad_sse41(__m128i p, __m128i v) {
+        const __m128 fp = _mm_cvtepi32_ps(p);
+        const __m128 y = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(v), _mm_add_ps(fp, _mm_set1_ps(255.0f))), _mm_set1_ps(1275.0f));
+        const __m128i q = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(y, _mm_set1_ps(1.0f / 2550.0f)), _mm_set1_ps(1.0e-4f)));
+        return _mm_add_epi32(p, q);
+    }
+    //============================================================================
+
+    TARGET_SSE41
+    static size_t blend_watermark_sse41(uint8_t *pixels, const uint8_t *values, size_t n) {
+        const __m128i zero = _mm_setzero_si128();
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + i));
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i));
+            __m128i p_lo = _mm_unpacklo_epi8(p, zero), p_hi = _mm_unpackhi_epi8(p, zero);
+            __m128i v_lo = _mm_unpacklo_epi8(v, zero), v_hi = _mm_unpackhi_epi8(v, zero);
+            __m128i r0 = blend_quad_sse41(_mm_unpacklo_epi16(p_lo, zero), _mm_unpacklo_epi16(v_lo, zero));
+            __m128i r1 = blend_quad_sse41(_mm_unpackhi_epi16(p_lo, zero), _mm_unpackhi_epi16(v_lo, zero));
+            __m128i r2 = blend_quad_sse41(_mm_unpacklo_epi16(p_hi, zero), _mm_unpacklo_epi16(v_hi, zero));
+            __m128i r3 = blend_quad_sse41(_mm_unpackhi_epi16(p_hi, zero), _mm_unpackhi_epi16(v_hi, zero));
+            __m128i res = _mm_packus_epi16(_mm_packus_epi32(r0, r1), _mm_packus_epi32(r2, r3)); // clamps to 255
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(pixels + i), res);
+        }
+        return i;
+    }
+    //============================================================================
+
+    TARGET_AVX2
+    static inline __m256i blend_oct_avx2(const uint8_t *pixels, const uint8_t *values) {
+        const __m256i p = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(pixels)));
+        const __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(values)));
+        const __m256 fp = _mm256_cvtepi32_ps(p);
+        const __m256 y = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(v), _mm256_add_ps(fp, _mm256_set1_ps(255.0f))), _mm256_set1_ps(1275.0f));
+        const __m256i q = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(y, _mm256_set1_ps(1.0f / 2550.0f)), _mm256_set1_ps(1.0e-4f)));
+        return _mm256_add_epi32(p, q);
+    }
+    //============================================================================
+
+    TARGET_AVX2
+    static size_t blend_watermark_avx2(uint8_t *pixels, const uint8_t *values, size_t n) {
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m256i words = _mm256_permute4x64_epi64(_mm256_packus_epi32(blend_oct_avx2(pixels + i, values + i),
+                                                                         blend_oct_avx2(pixels + i + 8, values + i + 8)), 0xd8);
+            __m128i res = _mm_packus_epi16(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(pixels + i), res);
+        }
+        return i;
+    }
+    //============================================================================
+
+    TARGET_SSE41
+    static size_t sixteen2eight_sse41(const uint16_t *in, uint8_t *out, size_t n) {
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m128i a = _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i)), 8);
+            __m128i b = _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i + 8)), 8);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_packus_epi16(a, b));
+        }
+        return i;
+    }
+    //============================================================================
+
+    TARGET_AVX2
+    static size_t sixteen2eight_avx2(const uint16_t *in, uint8_t *out, size_t n) {
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32) {
+            __m256i a = _mm256_srli_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i)), 8);
+            __m256i b = _mm256_srli_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i + 16)), 8);
+            __m256i packed = _mm256_packus_epi16(a, b); // a0-7 b0-7 a8-15 b8-15
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_permute4x64_epi64(packed, 0xd8));
+        }
+        return i;
+    }
+    //============================================================================
+
+    //
+    // The comparison gives 0xff for the white samples, which is what bw receives. The samples of
+    // each group of 8 are reversed before movemask, so that the first sample gets the highest bit.
+    //
+    TARGET_SSE41
+    static uint32_t eight2one_sse41(const uint8_t *in, uint8_t *out, uint32_t len, uint8_t threshold, bool invert,
+                                    uint8_t *bw) {
+        const __m128i reverse = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+        const __m128i sign = _mm_set1_epi8(static_cast<char>(0x80));
+        const __m128i limit = _mm_set1_epi8(static_cast<char>(threshold ^ 0x80));
+        const uint32_t flip = invert ? 0xffff : 0;
+        uint32_t i = 0;
+        for (; i + 16 <= len; i += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+            __m128i white = _mm_cmpgt_epi8(_mm_xor_si128(v, sign), limit); // unsigned comparison
+            if (bw != nullptr) _mm_storeu_si128(reinterpret_cast<__m128i *>(bw + i), white);
+            uint32_t bits = static_cast<uint32_t>(_mm_movemask_epi8(_mm_shuffle_epi8(white, reverse))) ^ flip;
+            out[i / 8] = static_cast<uint8_t>(bits);
+            out[i / 8 + 1] = static_cast<uint8_t>(bits >> 8);
+        }
+        return i;
+    }
+    //============================================================================
+
+    TARGET_AVX2
+    static uint32_t eight2one_avx2(const uint8_t *in, uint8_t *out, uint32_t len, uint8_t threshold, bool invert,
+                                   uint8_t *bw) {
+        const __m256i reverse = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                                                 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+        const __m256i sign = _mm256_set1_epi8(static_cast<char>(0x80));
+        const __m256i limit = _mm256_set1_epi8(static_cast<char>(threshold ^ 0x80));
+        const uint32_t flip = invert ? 0xffffffff : 0;
+        uint32_t i = 0;
+        for (; i + 32 <= len; i += 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+            __m256i white = _mm256_cmpgt_epi8(_mm256_xor_si256(v, sign), limit);
+            if (bw != nullptr) _mm256_storeu_si256(reinterpret_cast<__m256i *>(bw + i), white);
+            uint32_t bits = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_shuffle_epi8(white, reverse))) ^ flip;
+            for (uint32_t k = 0; k < 4; ++k) {
+                out[i / 8 + k] = static_cast<uint8_t>(bits >> (8 * k));
+            }
+        }
+        return i;
+    }
+    //============================================================================
+#endif
+
+#ifdef IIIF_PIXEL_NEON
+    template<typename T>
+    static size_t separate2contig_neon(const T *in, T *out, size_t n, uint32_t nc, size_t plane_stride) {
+        const T *p0 = in, *p1 = in + plane_stride, *p2 = in + 2 * plane_stride, *p3 = in + 3 * plane_stride;
+        size_t i = 0;
+        if constexpr (std::is_same<T, uint8_t>::value) {
+            switch (nc) {
+                case 2:
+                    for (; i + 16 <= n; i += 16) vst2q_u8(out + 2 * i, (uint8x16x2_t) {{vld1q_u8(p0 + i), vld1q_u8(p1 + i)}});
+                    break;
+                case 3:
+                    for (; i + 16 <= n; i += 16) vst3q_u8(out + 3 * i, (uint8x16x3_t) {{vld1q_u8(p0 + i), vld1q_u8(p1 + i), vld1q_u8(p2 + i)}});
+                    break;
+                case 4:
+                    for (; i + 16 <= n; i += 16) vst4q_u8(out + 4 * i, (uint8x16x4_t) {{vld1q_u8(p0 + i), vld1q_u8(p1 + i), vld1q_u8(p2 + i), vld1q_u8(p3 + i)}});
+                    break;
+                default:
+                    break;
+            }
+        } else {
+            switch (nc) {
+                case 2:
+                    for (; i + 8 <= n; i += 8) vst2q_u16(out + 2 * i, (uint16x8x2_t) {{vld1q_u16(p0 + i), vld1q_u16(p1 + i)}});
+                    break;
+                case 3:
+                    for (; i + 8 <= n; i += 8) vst3q_u16(out + 3 * i, (uint16x8x3_t) {{vld1q_u16(p0 + i), vld1q_u16(p1 + i), vld1q_u16(p2 + i)}});
+                    break;
+                case 4:
+                    for (; i + 8 <= n; i += 8) vst4q_u16(out + 4 * i, (uint16x8x4_t) {{vld1q_u16(p0 + i), vld1q_u16(p1 + i), vld1q_u16(p2 + i), vld1q_u16(p3 + i)}});
+                    break;
+                default:
+                    break;
+            }
+        }
+        return i;
+    }
+    //============================================================================
+
+    static size_t sixteen2eight_neon(const uint16_t *in, uint8_t *out, size_t n) {
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            vst1q_u8(out + i, vcombine_u8(vshrn_n_u16(vld1q_u16(in + i), 8), vshrn_n_u16(vld1q_u16(in + i + 8), 8)));
+        }
+        return i;
+    }
+    //============================================================================
+#endif
+
+    template<typename T>
+    void one2eight(const uint8_t *in, T *out, uint32_t len, uint8_t black, uint8_t white, ResampleKernel kernel) {
+        uint32_t done = 0;
+        switch (usable_kernel(kernel)) {
+#ifdef IIIF_PIXEL_X86
+            case RESAMPLE_SSE41:
+                done = one2eight_sse41(in, out, len, black, white);
+                break;
+            case RESAMPLE_AVX2:
+                done = one2eight_avx2(in, out, len, black, white);
+                break;
+#endif
+            default:
+                break;
+        }
+        one2eight_scalar(in, out, done, len, black, white);
+    }
+    //============================================================================
+
+    template<typename T>
+    void four2eight(const uint8_t *in, T *out, uint32_t len, bool is_palette, ResampleKernel kernel) {
+        uint32_t done = 0;
+        switch (usable_kernel(kernel)) {
+#ifdef IIIF_PIXEL_X86
+            case RESAMPLE_SSE41:
+            case RESAMPLE_AVX2: // nothing to gain from wider vectors
+                done = four2eight_sse41(in, out, len, is_palette);
+                break;
+#endif
+            default:
+                break;
+        }
+        four2eight_scalar(in, out, done, len, is_palette);
+    }
+    //============================================================================
+
+    template<typename T>
+    void twelve2sixteen(const uint8_t *in, T *out, uint32_t len, bool is_palette, ResampleKernel kernel) {
+        uint32_t done = 0;
+        switch (usable_kernel(kernel)) {
+#ifdef IIIF_PIXEL_X86
+            case RESAMPLE_SSE41:
+            case RESAMPLE_AVX2:
+                done = twelve2sixteen_sse41(in, out, len, is_palette);
+                break;
+#endif
+            default:
+                break;
+        }
+        twelve2sixteen_scalar(in, out, done, len, is_palette);
+    }
+    //============================================================================
+
+    template<typename T>
+    void separate2contig(const T *in, T *out, size_t n, uint32_t nc, size_t plane_stride, ResampleKernel kernel) {
+        size_t done = 0;
+        switch (usable_kernel(kernel)) {
+#ifdef IIIF_PIXEL_X86
+            case RESAMPLE_SSE41:
+            case RESAMPLE_AVX2: // limited by the memory bandwidth, AVX2 doesn't help
+                done = separate2contig_sse41(in, out, n, nc, plane_stride);
+                break;
+#endif
+#ifdef IIIF_PIXEL_NEON
+            case RESAMPLE_NEON:
+                done = separate2contig_neon(in, out, n, nc, plane_stride);
+                break;
+#endif
+            default:
+                break;
+        }
+        separate2contig_scalar(in, out, done, n, nc, plane_stride);
+    }
+    //============================================================================
+
+    template<typename T>
+    void ycc2rgb(const T *in, T *out, size_t n, uint32_t nc, ResampleKernel kernel) {
+        size_t done = 0;
+        switch (usable_kernel(kernel)) {
+#ifdef IIIF_PIXEL_X86
+            case RESAMPLE_SSE41:
+                done = ycc2rgb_sse41(in, out, n, nc);
+                break;
+            case RESAMPLE_AVX2:
+                done = ycc2rgb_avx2(in, out, n, nc);
+                break;
+#endif
+            default:
+                break;
+        }
+        ycc2rgb_scalar(in, out, done, n, nc);
+    }
+    //============================================================================
+
+    template<typename T>
+    static void blend_watermark_samples(T *pixels, const uint8_t *values, size_t n, ResampleKernel kernel) {
+        size_t done = 0;
+        if constexpr (std::is_same<T, uint8_t>::value) {
+            switch (usable_kernel(kernel)) {
+#ifdef IIIF_PIXEL_X86
+                case RESAMPLE_SSE41:
+                    done = blend_watermark_sse41(pixels, values, n);
+                    break;
+                case RESAMPLE_AVX2:
+                    done = blend_watermark_avx2(pixels, values, n);
+                    break;
+#endif
+                default:
+                    break;
+            }
+        }
+        blend_watermark_scalar(pixels, values, done, n);
+    }
+    //============================================================================
+
+    template<typename T>
+    void blendWatermark(T *pixels, const uint8_t *values, size_t n, uint32_t nc, ResampleKernel kernel) {
+        if (nc == 1) {
+            blend_watermark_samples(pixels, values, n, kernel);
+            return;
+        }
+        //
+        // the value of each pixel is repeated for its samples in small chunks, which stay in the L1 cache
+        //
+        const size_t chunk = std::max<size_t>(1, 4096 / nc);
+        std::vector<uint8_t> samples(chunk * nc);
+        for (size_t first = 0; first < n; first += chunk) {
+            const size_t m = std::min(chunk, n - first);
+            for (size_t i = 0; i < m; ++i) {
+                std::fill_n(samples.data() + i * nc, nc, values[first + i]);
+            }
+            blend_watermark_samples(pixels + first * nc, samples.data(), m * nc, kernel);
+        }
+    }
+    //============================================================================
+
+    void sixteen2eight(const uint16_t *in, uint8_t *out, size_t n, ResampleKernel kernel) {
+        size_t done = 0;
+        switch (usable_kernel(kernel)) {
+#ifdef IIIF_PIXEL_X86
+            case RESAMPLE_SSE41:
+                done = sixteen2eight_sse41(in, out, n);
+                break;
+            case RESAMPLE_AVX2:
+                done = sixteen2eight_avx2(in, out, n);
+                break;
+#endif
+#ifdef IIIF_PIXEL_NEON
+            case RESAMPLE_NEON:
+                done = sixteen2eight_neon(in, out, n);
+                break;
+#endif
+            default:
+                break;
+        }
+        sixteen2eight_scalar(in, out, done, n);
+    }
+    //============================================================================
+
+    void eight2one(const uint8_t *in, uint8_t *out, uint32_t len, uint8_t threshold, bool invert, uint8_t *bw,
+                   ResampleKernel kernel) {
+        uint32_t done = 0;
+        switch (usable_kernel(kernel)) {
+#ifdef IIIF_PIXEL_X86
+            case RESAMPLE_SSE41:
+                done = eight2one_sse41(in, out, len, threshold, invert, bw);
+                break;
+            case RESAMPLE_AVX2:
+                done = eight2one_avx2(in, out, len, threshold, invert, bw);
+                break;
+#endif
+            default:
+                break;
+        }
+        eight2one_scalar(in, out, done, len, threshold, invert, bw);
+    }
+    //============================================================================
+
+    template void one2eight<uint8_t>(const uint8_t *in, uint8_t *out, uint32_t len, uint8_t black, uint8_t white, ResampleKernel kernel);
+    template void one2eight<uint16_t>(const uint8_t *in, uint16_t *out, uint32_t len, uint8_t black, uint8_t white, ResampleKernel kernel);
+    template void four2eight<uint8_t>(const uint8_t *in, uint8_t *out, uint32_t len, bool is_palette, ResampleKernel kernel);
+    template void four2eight<uint16_t>(const uint8_t *in, uint16_t *out, uint32_t len, bool is_palette, ResampleKernel kernel);
+    template void twelve2sixteen<uint8_t>(const uint8_t *in, uint8_t *out, uint32_t len, bool is_palette, ResampleKernel kernel);
+    template void twelve2sixteen<uint16_t>(const uint8_t *in, uint16_t *out, uint32_t len, bool is_palette, ResampleKernel kernel);
+    template void separate2contig<uint8_t>(const uint8_t *in, uint8_t *out, size_t n, uint32_t nc, size_t plane_stride, ResampleKernel kernel);
+    template void separate2contig<uint16_t>(const uint16_t *in, uint16_t *out, size_t n, uint32_t nc, size_t plane_stride, ResampleKernel kernel);
+    template void ycc2rgb<uint8_t>(const uint8_t *in, uint8_t *out, size_t n, uint32_t nc, ResampleKernel kernel);
+    template void ycc2rgb<uint16_t>(const uint16_t *in, uint16_t *out, size_t n, uint32_t nc, ResampleKernel kernel);
+    template void blendWatermark<uint8_t>(uint8_t *pixels, const uint8_t *values, size_t n, uint32_t nc, ResampleKernel kernel);
+    template void blendWatermark<uint16_t>(uint16_t *pixels, const uint8_t *values, size_t n, uint32_t nc, ResampleKernel kernel);
+
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright © 2022 Lukas Rosenthaler
+ * This file is part of OMAS/cserve
+ * OMAS/cserve is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * OMAS/cserve is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef __defined_iiif_pixel_kernels_h
+#define __defined_iiif_pixel_kernels_h
+
+#include <cstddef>
+#include <cstdint>
+
+#include "IIIFResample.h"
+
+//
+// Per-sample conversions run on every decode: unpacking of TIFF samples with 1, 4 and 12 bits,
+// interleaving of planar channels, YCbCr to RGB, 16 to 8 bit, the watermark blending and the
+// packing of bitonal images to 1 bit.
+// Like the resampler, the SIMD implementations are selected at runtime (see resampleKernel())
+// and give exactly the results of the scalar code. The functions work on a run of samples; the callers split
+// whole images into bands of rows for the IIIFComputePool.
+//
+namespace cserve {
+
+    /*!
+     * Unpack samples with 1 bit (most significant bit first) to one sample per value.
+     *
+     * \param[in] in Packed samples
+     * \param[out] out len unpacked samples
+     * \param[in] len Number of samples
+     * \param[in] black Value of a 0 bit
+     * \param[in] white Value of a 1 bit
+     * \param[in] kernel Implementation (for testing and benchmarks)
+     */
+    template<typename T>
+    void one2eight(const uint8_t *in, T *out, uint32_t len, uint8_t black, uint8_t white,
+                   ResampleKernel kernel = resampleKernel());
+
+    /*!
+     * Unpack samples with 4 bits (high nibble first). Palette indices are kept, other values
+     * are scaled to 8 bit (multiplied by 16).
+     *
+     * \param[in] in Packed samples
+     * \param[out] out len unpacked samples
+     * \param[in] len Number of samples
+     * \param[in] is_palette The samples are palette indices
+     * \param[in] kernel Implementation (for testing and benchmarks)
+     */
+    template<typename T>
+    void four2eight(const uint8_t *in, T *out, uint32_t len, bool is_palette = false,
+                    ResampleKernel kernel = resampleKernel());
+
+    /*!
+     * Unpack samples with 12 bits (2 samples in 3 bytes, big endian). Palette indices are kept,
+     * other values are scaled to 16 bit (multiplied by 16).
+     *
+     * \param[in] in Packed samples
+     * \param[out] out len unpacked samples
+     * \param[in] len Number of samples
+     * \param[in] is_palette The samples are palette indices
+     * \param[in] kernel Implementation (for testing and benchmarks)
+     */
+    template<typename T>
+    void twelve2sixteen(const uint8_t *in, T *out, uint32_t len, bool is_palette = false,
+                        ResampleKernel kernel = resampleKernel());
+
+    /*!
+     * Interleave planar channels: out[nc * i + c] = in[c * plane_stride + i]
+     *
+     * \param[in] in The first sample of channel 0
+     * \param[out] out n pixels with nc interleaved channels
+     * \param[in] n Number of pixels
+     * \param[in] nc Number of channels
+     * \param[in] plane_stride Distance between the channels in in (in samples)
+     * \param[in] kernel Implementation (for testing and benchmarks)
+     */
+    template<typename T>
+    void separate2contig(const T *in, T *out, size_t n, uint32_t nc, size_t plane_stride,
+                         ResampleKernel kernel = resampleKernel());
+
+    /*!
+     * Convert pixels from YCbCr to RGB. The first three channels hold Cr, Cb and Y (in this
+     * order) and are replaced by R, G and B; further channels are copied.
+     *
+     * \param[in] in n pixels YCbCr
+     * \param[out] out n pixels RGB
+     * \param[in] n Number of pixels
+     * \param[in] nc Number of channels (at least 3)
+     * \param[in] kernel Implementation (for testing and benchmarks)
+     */
+    template<typename T>
+    void ycc2rgb(const T *in, T *out, size_t n, uint32_t nc, ResampleKernel kernel = resampleKernel());
+
+    /*!
+     * Reduce 16 bit samples to 8 bit (out[i] = in[i] >> 8)
+     *
+     * \param[in] in n samples with 16 bit
+     * \param[out] out n samples with 8 bit
+     * \param[in] n Number of samples
+     * \param[in] kernel Implementation (for testing and benchmarks)
+     */
+    void sixteen2eight(const uint16_t *in, uint8_t *out, size_t n, ResampleKernel kernel = resampleKernel());
+
+    /*!
+     * Blend a watermark into the pixels. Every sample of a pixel is brightened by the watermark
+     * value v (0...255) of the pixel: 8 bit samples become p + (p + 255) * v / 2550 (rounded
+     * to the nearest integer and clamped), 16 bit samples are computed in double precision
+     * as IIIFImage::add_watermark() always did. Only the 8 bit blending is vectorized.
+     *
+     * \param[in,out] pixels n * nc samples
+     * \param[in] values Watermark value for each pixel
+     * \param[in] n Number of pixels
+     * \param[in] nc Number of samples per pixel
+     * \param[in] kernel Implementation (for testing and benchmarks)
+     */
+    template<typename T>
+    void blendWatermark(T *pixels, const uint8_t *values, size_t n, uint32_t nc, ResampleKernel kernel = resampleKernel());
+
+    /*!
+     * Threshold 8 bit samples and pack them to 1 bit (most significant bit first). The bit of a
+     * sample above the threshold is set (cleared if invert is true). The unused bits of the last
+     * byte are 0.
+     *
+     * \param[in] in len samples
+     * \param[out] out (len + 7) / 8 bytes
+     * \param[in] len Number of samples
+     * \param[in] threshold Samples above are white, the others black
+     * \param[in] invert Set the bits of the black samples
+     * \param[out] bw If not nullptr, receives 255 for the white and 0 for the black samples (may be in)
+     * \param[in] kernel Implementation (for testing and benchmarks)
+     */
+    void eight2one(const uint8_t *in, uint8_t *out, uint32_t len, uint8_t threshold, bool invert,
+                   uint8_t *bw = nullptr, ResampleKernel kernel = resampleKernel());
+
+    extern template void one2eight<uint8_t>(const uint8_t *in, uint8_t *out, uint32_t len, uint8_t black, uint8_t white, ResampleKernel kernel);
+    extern template void one2eight<uint16_t>(const uint8_t *in, uint16_t *out, uint32_t len, uint8_t black, uint8_t white, ResampleKernel kernel);
+    extern template void four2eight<uint8_t>(const uint8_t *in, uint8_t *out, uint32_t len, bool is_palette, ResampleKernel kernel);
+    extern template void four2eight<uint16_t>(const uint8_t *in, uint16_t *out, uint32_t len, bool is_palette, ResampleKernel kernel);
+    extern template void twelve2sixteen<uint8_t>(const uint8_t *in, uint8_t *out, uint32_t len, bool is_palette, ResampleKernel kernel);
+    extern template void twelve2sixteen<uint16_t>(const uint8_t *in, uint16_t *out, uint32_t len, bool is_palette, ResampleKernel kernel);
+    extern template void separate2contig<uint8_t>(const uint8_t *in, uint8_t *out, size_t n, uint32_t nc, size_t plane_stride, ResampleKernel kernel);
+    extern template void separate2contig<uint16_t>(const uint16_t *in, uint16_t *out, size_t n, uint32_t nc, size_t plane_stride, ResampleKernel kernel);
+    extern template void ycc2rgb<uint8_t>(const uint8_t *in, uint8_t *out, size_t n, uint32_t nc, ResampleKernel kernel);
+    extern template void ycc2rgb<uint16_t>(const uint16_t *in, uint16_t *out, size_t n, uint32_t nc, ResampleKernel kernel);
+    extern template void blendWatermark<uint8_t>(uint8_t *pixels, const uint8_t *values, size_t n, uint32_t nc, ResampleKernel kernel);
+    extern template void blendWatermark<uint16_t>(uint16_t *pixels, const uint8_t *values, size_t n, uint32_t nc, ResampleKernel kernel);
+
+}
+
+#endif
@@ -0,0 +1,886 @@
+/*
+ * Copyright © 2022 Lukas Rosenthaler
+ * This file is part of OMAS/cserve
+ * OMAS/cserve is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * OMAS/cserve is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define IIIF_RESAMPLE_X86
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define IIIF_RESAMPLE_NEON
+#include <arm_neon.h>
+#endif
+
+#include "IIIFResample.h"
+#include "IIIFComputePool.h"
+#include "IIIFBufferPool.h"
+
+//
+// The SSE4.1 and AVX2 kernels are compiled for their instruction set only, the build
+// itself doesn't require it. They are selected at runtime (see resampleKernel()).
+//
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+
+namespace cserve {
+
+    /*!
+     * Fixed-point precision of the weights. The sum of the products of the pixel values
+     * with the (partly negative) weights must fit into an int32.
+     */
+    template<typename T>
+    struct ResampleTraits;
+
+    template<>
+    struct ResampleTraits<uint8_t> {
+        static constexpr int bits = 14;
+        static constexpr int32_t maxval = 255;
+    };
+
+    template<>
+    struct ResampleTraits<uint16_t> {
+        static constexpr int bits = 13;
+        static constexpr int32_t maxval = 65535;
+    };
+
+    /*!
+     * Weights of the source samples for each output sample in one direction
+     */
+    typedef struct ResampleWeights_ {
+        uint32_t nout;                //!< number of output samples
+        uint32_t ksize;               //!< row length of the coefficient table (a multiple of 8)
+        std::vector<uint32_t> start;  //!< first source sample
+        std::vector<uint32_t> count;  //!< number of source samples
+        std::vector<int16_t> coeffs;  //!< nout rows of ksize weights, padded with zeros
+    } ResampleWeights;
+
+    static double sinc(double x) {
+        if (x == 0.0) return 1.0;
+        x *= M_PI;
+        return std::sin(x) / x;
+    }
+    //============================================================================
+
+    static double lanczos3(double x) {
+        if ((x <= -3.0) || (x >= 3.0)) return 0.0;
+        return sinc(x) * sinc(x / 3.0);
+    }
+    //============================================================================
+
+    static double bicubic(double x) {
+        const double a = -0.5;
+        x = std::fabs(x);
+        if (x < 1.0) return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+        if (x < 2.0) return (((x - 5.0) * x + 8.0) * x - 4.0) * a;
+        return 0.0;
+    }
+    //============================================================================
+
+    static ResampleWeights compute_weights(uint32_t in_size, uint32_t out_size, ResampleFilter filter, int bits) {
+        const double scale = static_cast<double>(in_size) / static_cast<double>(out_size);
+        const double filterscale = std::max(scale, 1.0); // when reducing, the filter is stretched (antialiasing)
+        double support = 0.5;
+        if (filter == RESAMPLE_BICUBIC) support = 2.0;
+        else if (filter == RESAMPLE_LANCZOS3) support = 3.0;
+        support *= filterscale;
+
+        ResampleWeights w;
+        w.nout = out_size;
+        w.ksize = (static_cast<uint32_t>(std::ceil(2.0 * support)) + 2 + 7) & ~7U;
+        w.start.resize(out_size);
+        w.count.resize(out_size);
+        w.coeffs.assign(static_cast<size_t>(out_size) * w.ksize, 0);
+
+        const int32_t one = 1 << bits;
+        std::vector<double> tmp(w.ksize);
+        for (uint32_t xx = 0; xx < out_size; xx++) {
+            double center = (xx + 0.5) * scale;
+            double lo, hi;
+            if (filter == RESAMPLE_AREA) {
+                lo = xx * scale; // the area covered by the output pixel
+                hi = (xx + 1) * scale;
+            } else {
+                lo = center - support;
+                hi = center + support;
+            }
+            auto xmin = static_cast<int64_t>(std::max(std::floor(lo), 0.0));
+            auto xmax = std::min(static_cast<int64_t>(std::ceil(hi)), static_cast<int64_t>(in_size));
+            auto n = static_cast<uint32_t>(std::min<int64_t>(std::max<int64_t>(xmax - xmin, 1), w.ksize));
+            if (xmin + n > in_size) xmin = in_size - n;
+
+            double total = 0.0;
+            for (uint32_t t = 0; t < n; t++) {
+                double x = static_cast<double>(xmin + t);
+                double weight;
+                if (filter == RESAMPLE_AREA) {
+                    weight = std::max(std::min(hi, x + 1.0) - std::max(lo, x), 0.0);
+                } else if (filter == RESAMPLE_BICUBIC) {
+                    weight = bicubic((x + 0.5 - center) / filterscale);
+                } else {
+                    weight = lanczos3((x + 0.5 - center) / filterscale);
+                }
+                tmp[t] = weight;
+                total += weight;
+            }
+            if (total == 0.0) { // can't happen with the filters above, just in case...
+                std::fill(tmp.begin(), tmp.begin() + n, 1.0);
+                total = n;
+            }
+
+            //
+            // the weights are rounded such that their sum is exactly one, so that a
+            // uniform area remains unchanged
+            //
+            int16_t *k = &w.coeffs[static_cast<size_t>(xx) * w.ksize];
+            int32_t sum = 0;
+            uint32_t tmax = 0;
+            for (uint32_t t = 0; t < n; t++) {
+                k[t] = static_cast<int16_t>(std::lround(tmp[t] / total * one));
+                sum += k[t];
+                if (tmp[t] > tmp[tmax]) tmax = t;
+            }
+            k[tmax] = static_cast<int16_t>(k[tmax] + one - sum);
+
+            //
+            // source samples without weight are skipped
+            //
+            uint32_t first = 0;
+            while ((first < n - 1) && (k[first] == 0)) ++first;
+            while ((n > first + 1) && (k[n - 1] == 0)) --n;
+            if (first > 0) {
+                std::memmove(k, k + first, (n - first) * sizeof(int16_t));
+                std::fill(k + n - first, k + n, 0);
+            }
+            w.start[xx] = static_cast<uint32_t>(xmin) + first;
+            w.count[xx] = n - first;
+        }
+        return w;
+    }
+    //============================================================================
+
+    template<typename T>
+    static inline T descale(int32_t acc) {
+        acc >>= ResampleTraits<T>::bits; // acc includes the rounding offset
+        return static_cast<T>(std::min(std::max(acc, 0), ResampleTraits<T>::maxval));
+    }
+    //============================================================================
+
+    template<typename T>
+    static inline void hpixel_scalar(const T *src, const int16_t *k, uint32_t count, uint32_t nc, T *dst) {
+        for (uint32_t c = 0; c < nc; c++) {
+            int32_t acc = 1 << (ResampleTraits<T>::bits - 1);
+            for (uint32_t t = 0; t < count; t++) {
+                acc += k[t] * static_cast<int32_t>(src[t * nc + c]);
+            }
+            dst[c] = descale<T>(acc);
+        }
+    }
+    //============================================================================
+
+    template<typename T>
+    static void hpass_scalar(const T *in, T *out, uint32_t nc, const ResampleWeights &w) {
+        for (uint32_t x = 0; x < w.nout; x++) {
+            hpixel_scalar(in + static_cast<size_t>(w.start[x]) * nc, &w.coeffs[static_cast<size_t>(x) * w.ksize],
+                          w.count[x], nc, out + static_cast<size_t>(x) * nc);
+        }
+    }
+    //============================================================================
+
+    template<typename T>
+    static void vpass_scalar(const T *const *rows, const int16_t *k, uint32_t count, T *out, size_t i0, size_t n) {
+        for (size_t i = i0; i < n; i++) {
+            int32_t acc = 1 << (ResampleTraits<T>::bits - 1);
+            for (uint32_t t = 0; t < count; t++) {
+                acc += k[t] * static_cast<int32_t>(rows[t][i]);
+            }
+            out[i] = descale<T>(acc);
+        }
+    }
+    //============================================================================
+
+#ifdef IIIF_RESAMPLE_X86
+
+    static inline int32_t weight_pair(const int16_t *k) {
+        return static_cast<int32_t>(static_cast<uint16_t>(k[0]) | (static_cast<uint32_t>(static_cast<uint16_t>(k[1])) << 16));
+    }
+    //============================================================================
+
+    //
+    // Horizontal pass: the channels of consecutive pixels are shuffled into pairs, so that
+    // one multiply-add applies two taps to all channels (nc = 3 or 4). The loads read a
+    // few pixels beyond the taps (with zero weight), the last pixels of the image are
+    // therefore done by the scalar code. Grey images (nc = 1) are vectorized over the taps.
+    //
+    TARGET_SSE41
+    static void hpass_sse41(const uint8_t *in, uint8_t *out, uint32_t nc, uint32_t n_in, const ResampleWeights &w) {
+        const int bits = ResampleTraits<uint8_t>::bits;
+        const __m128i shuf_lo = (nc == 4) ? _mm_setr_epi8(0, -1, 4, -1, 1, -1, 5, -1, 2, -1, 6, -1, 3, -1, 7, -1) :
+                                            _mm_setr_epi8(0, -1, 3, -1, 1, -1, 4, -1, 2, -1, 5, -1, -1, -1, -1, -1);
+        const __m128i shuf_hi = (nc == 4) ? _mm_setr_epi8(8, -1, 12, -1, 9, -1, 13, -1, 10, -1, 14, -1, 11, -1, 15, -1) :
+                                            _mm_setr_epi8(6, -1, 9, -1, 7, -1, 10, -1, 8, -1, 11, -1, -1, -1, -1, -1);
+        for (uint32_t x = 0; x < w.nout; x++) {
+            const uint8_t *src = in + static_cast<size_t>(w.start[x]) * nc;
+            const int16_t *k = &w.coeffs[static_cast<size_t>(x) * w.ksize];
+            const uint32_t count = w.count[x];
+            uint8_t *dst = out + static_cast<size_t>(x) * nc;
+            if (nc == 1) {
+                if (w.start[x] + ((count + 7) & ~7U) > n_in) {
+                    hpixel_scalar(src, k, count, nc, dst);
+                    continue;
+                }
+                __m128i acc = _mm_setzero_si128();
+                for (uint32_t t = 0; t < count; t += 8) {
+                    __m128i v = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + t)));
+                    acc = _mm_add_epi32(acc, _mm_madd_epi16(v, _mm_loadu_si128(reinterpret_cast<const __m128i *>(k + t))));
+                }
+                acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0x4E));
+                acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0xB1));
+                *dst = descale<uint8_t>(_mm_cvtsi128_si32(acc) + (1 << (bits - 1)));
+                continue;
+            }
+            if ((nc == 2) || (nc > 4) || (w.start[x] + ((count + 3) & ~3U) + 2 > n_in)) {
+                hpixel_scalar(src, k, count, nc, dst);
+                continue;
+            }
+            __m128i acc = _mm_set1_epi32(1 << (bits - 1));
+            for (uint32_t t = 0; t < count; t += 4) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + t * nc));
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_shuffle_epi8(v, shuf_lo), _mm_set1_epi32(weight_pair(k + t))));
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_shuffle_epi8(v, shuf_hi), _mm_set1_epi32(weight_pair(k + t + 2))));
+            }
+            acc = _mm_srai_epi32(acc, bits);
+            __m128i v = _mm_packus_epi16(_mm_packs_epi32(acc, acc), acc);
+            int32_t res = _mm_cvtsi128_si32(v);
+            std::memcpy(dst, &res, nc);
+        }
+    }
+    //============================================================================
+
+    //
+    // 16 bit samples don't fit into the signed multiply-add, they are offset by 32768. As
+    // the weights sum up to one, this is compensated by a constant.
+    //
+    TARGET_SSE41
+    static void hpass_sse41(const uint16_t *in, uint16_t *out, uint32_t nc, uint32_t n_in, const ResampleWeights &w) {
+        const int bits = ResampleTraits<uint16_t>::bits;
+        const __m128i bias = _mm_set1_epi16(static_cast<int16_t>(0x8000));
+        const __m128i shuf = (nc == 4) ? _mm_setr_epi8(0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15) :
+                                         _mm_setr_epi8(0, 1, 6, 7, 2, 3, 8, 9, 4, 5, 10, 11, -1, -1, -1, -1);
+        for (uint32_t x = 0; x < w.nout; x++) {
+            const uint16_t *src = in + static_cast<size_t>(w.start[x]) * nc;
+            const int16_t *k = &w.coeffs[static_cast<size_t>(x) * w.ksize];
+            const uint32_t count = w.count[x];
+            uint16_t *dst = out + static_cast<size_t>(x) * nc;
+            if (nc == 1) {
+                if (w.start[x] + ((count + 7) & ~7U) > n_in) {
+                    hpixel_scalar(src, k, count, nc, dst);
+                    continue;
+                }
+                __m128i acc = _mm_setzero_si128();
+                for (uint32_t t = 0; t < count; t += 8) {
+                    __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + t)), bias);
+                    acc = _mm_add_epi32(acc, _mm_madd_epi16(v, _mm_loadu_si128(reinterpret_cast<const __m128i *>(k + t))));
+                }
+                acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0x4E));
+                acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0xB1));
+                *dst = descale<uint16_t>(_mm_cvtsi128_si32(acc) + (1 << (bits - 1)) + (32768 << bits));
+                continue;
+            }
+            if ((nc == 2) || (nc > 4) || (w.start[x] + ((count + 1) & ~1U) + 1 > n_in)) {
+                hpixel_scalar(src, k, count, nc, dst);
+                continue;
+            }
+            __m128i acc = _mm_set1_epi32((1 << (bits - 1)) + (32768 << bits));
+            for (uint32_t t = 0; t < count; t += 2) {
+                __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + t * nc)), bias);
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_shuffle_epi8(v, shuf), _mm_set1_epi32(weight_pair(k + t))));
+            }
+            acc = _mm_srai_epi32(acc, bits);
+            __m128i v = _mm_packus_epi32(acc, acc);
+            uint16_t res[8];
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(res), v);
+            std::memcpy(dst, res, nc * sizeof(uint16_t));
+        }
+    }
+    //============================================================================
+
+    //
+    // Vertical pass: all samples of the output row are interpolated from the same rows,
+    // two rows are combined with one multiply-add (8 bit).
+    //
+    TARGET_SSE41
+    static void vpass_sse41(const uint8_t *const *rows, const int16_t *k, uint32_t count, uint8_t *out, size_t i0, size_t n) {
+        const int bits = ResampleTraits<uint8_t>::bits;
+        size_t i = i0;
+        for (; i + 8 <= n; i += 8) {
+            __m128i acc_lo = _mm_set1_epi32(1 << (bits - 1));
+            __m128i acc_hi = acc_lo;
+            uint32_t t = 0;
+            for (; t + 2 <= count; t += 2) {
+                __m128i a = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(rows[t] + i)));
+                __m128i b = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(rows[t + 1] + i)));
+                __m128i wt = _mm_set1_epi32(weight_pair(k + t));
+                acc_lo = _mm_add_epi32(acc_lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), wt));
+                acc_hi = _mm_add_epi32(acc_hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), wt));
+            }
+            if (t < count) {
+                __m128i a = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(rows[t] + i)));
+                __m128i wt = _mm_set1_epi32(static_cast<uint16_t>(k[t]));
+                acc_lo = _mm_add_epi32(acc_lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, _mm_setzero_si128()), wt));
+                acc_hi = _mm_add_epi32(acc_hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, _mm_setzero_si128()), wt));
+            }
+            acc_lo = _mm_srai_epi32(acc_lo, bits);
+            acc_hi = _mm_srai_epi32(acc_hi, bits);
+            __m128i v = _mm_packus_epi16(_mm_packs_epi32(acc_lo, acc_hi), _mm_setzero_si128());
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(out + i), v);
+        }
+        vpass_scalar(rows, k, count, out, i, n);
+    }
+    //============================================================================
+
+    TARGET_SSE41
+    static void vpass_sse41(const uint16_t *const *rows, const int16_t *k, uint32_t count, uint16_t *out, size_t i0, size_t n) {
+        const int bits = ResampleTraits<uint16_t>::bits;
+        size_t i = i0;
+        for (; i + 8 <= n; i += 8) {
+            __m128i acc_lo = _mm_set1_epi32(1 << (bits - 1));
+            __m128i acc_hi = acc_lo;
+            for (uint32_t t = 0; t < count; t++) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[t] + i));
+                __m128i wt = _mm_set1_epi32(k[t]);
+                acc_lo = _mm_add_epi32(acc_lo, _mm_mullo_epi32(_mm_cvtepu16_epi32(v), wt));
+                acc_hi = _mm_add_epi32(acc_hi, _mm_mullo_epi32(_mm_cvtepu16_epi32(_mm_srli_si128(v, 8)), wt));
+            }
+            __m128i v = _mm_packus_epi32(_mm_srai_epi32(acc_lo, bits), _mm_srai_epi32(acc_hi, bits));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), v);
+        }
+        vpass_scalar(rows, k, count, out, i, n);
+    }
+    //============================================================================
+
+    TARGET_AVX2
+    static void vpass_avx2(const uint8_t *const *rows, const int16_t *k, uint32_t count, uint8_t *out, size_t i0, size_t n) {
+        const int bits = ResampleTraits<uint8_t>::bits;
+        size_t i = i0;
+        for (; i + 16 <= n; i += 16) {
+            __m256i acc_lo = _mm256_set1_epi32(1 << (bits - 1));
+            __m256i acc_hi = acc_lo;
+            uint32_t t = 0;
+            for (; t + 2 <= count; t += 2) {
+                __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[t] + i)));
+                __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[t + 1] + i)));
+                __m256i wt = _mm256_set1_epi32(weight_pair(k + t));
+                acc_lo = _mm256_add_epi32(acc_lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), wt));
+                acc_hi = _mm256_add_epi32(acc_hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), wt));
+            }
+            if (t < count) {
+                __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[t] + i)));
+                __m256i wt = _mm256_set1_epi32(static_cast<uint16_t>(k[t]));
+                acc_lo = _mm256_add_epi32(acc_lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, _mm256_setzero_si256()), wt));
+                acc_hi = _mm256_add_epi32(acc_hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, _mm256_setzero_si256()), wt));
+            }
+            //
+            // unpack/pack work within the 128 bit lanes, the samples are in order again
+            // after packing, except for the 64 bit blocks of the final bytes
+            //
+            __m256i v = _mm256_packs_epi32(_mm256_srai_epi32(acc_lo, bits), _mm256_srai_epi32(acc_hi, bits));
+            v = _mm256_permute4x64_epi64(_mm256_packus_epi16(v, v), 0x08);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm256_castsi256_si128(v));
+        }
+        vpass_sse41(rows, k, count, out, i, n);
+    }
+    //============================================================================
+
+    TARGET_AVX2
+    static void vpass_avx2(const uint16_t *const *rows, const int16_t *k, uint32_t count, uint16_t *out, size_t i0, size_t n) {
+        const int bits = ResampleTraits<uint16_t>::bits;
+        size_t i = i0;
+        for (; i + 16 <= n; i += 16) {
+            __m256i acc_lo = _mm256_set1_epi32(1 << (bits - 1));
+            __m256i acc_hi = acc_lo;
+            for (uint32_t t = 0; t < count; t++) {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rows[t] + i));
+                __m256i wt = _mm256_set1_epi32(k[t]);
+                acc_lo = _mm256_add_epi32(acc_lo, _mm256_mullo_epi32(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(v)), wt));
+                acc_hi = _mm256_add_epi32(acc_hi, _mm256_mullo_epi32(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1)), wt));
+            }
+            __m256i v = _mm256_packus_epi32(_mm256_srai_epi32(acc_lo, bits), _mm256_srai_epi32(acc_hi, bits));
+            v = _mm256_permute4x64_epi64(v, 0xD8);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), v);
+        }
+        vpass_sse41(rows, k, count, out, i, n);
+    }
+    //============================================================================
+
+#endif
+
+#ifdef IIIF_RESAMPLE_NEON
+
+    static void hpass_neon(const uint8_t *in, uint8_t *out, uint32_t nc, uint32_t n_in, const ResampleWeights &w) {
+        const int bits = ResampleTraits<uint8_t>::bits;
+        for (uint32_t x = 0; x < w.nout; x++) {
+            const uint8_t *src = in + static_cast<size_t>(w.start[x]) * nc;
+            const int16_t *k = &w.coeffs[static_cast<size_t>(x) * w.ksize];
+            const uint32_t count = w.count[x];
+            uint8_t *dst = out + static_cast<size_t>(x) * nc;
+            if (((nc != 3) && (nc != 4)) || ((nc == 3) && (w.start[x] + count == n_in))) {
+                hpixel_scalar(src, k, count, nc, dst);
+                continue;
+            }
+            int32x4_t acc = vdupq_n_s32(0);
+            for (uint32_t t = 0; t < count; t++) {
+                uint32_t px;
+                std::memcpy(&px, src + t * nc, sizeof(px));
+                uint16x8_t v = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(px)));
+                acc = vmlaq_n_s32(acc, vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(v))), k[t]);
+            }
+            uint16x4_t r = vqrshrun_n_s32(acc, bits);
+            uint32_t res = vget_lane_u32(vreinterpret_u32_u8(vqmovn_u16(vcombine_u16(r, r))), 0);
+            std::memcpy(dst, &res, nc);
+        }
+    }
+    //============================================================================
+
+    static void hpass_neon(const uint16_t *in, uint16_t *out, uint32_t nc, uint32_t n_in, const ResampleWeights &w) {
+        const int bits = ResampleTraits<uint16_t>::bits;
+        for (uint32_t x = 0; x < w.nout; x++) {
+            const uint16_t *src = in + static_cast<size_t>(w.start[x]) * nc;
+            const int16_t *k = &w.coeffs[static_cast<size_t>(x) * w.ksize];
+            const uint32_t count = w.count[x];
+            uint16_t *dst = out + static_cast<size_t>(x) * nc;
+            if (((nc != 3) && (nc != 4)) || ((nc == 3) && (w.start[x] + count == n_in))) {
+                hpixel_scalar(src, k, count, nc, dst);
+                continue;
+            }
+            int32x4_t acc = vdupq_n_s32(0);
+            for (uint32_t t = 0; t < count; t++) {
+                int32x4_t v = vreinterpretq_s32_u32(vmovl_u16(vld1_u16(src + t * nc)));
+                acc = vmlaq_n_s32(acc, v, k[t]);
+            }
+            uint16_t res[4];
+            vst1_u16(res, vqrshrun_n_s32(acc, bits));
+            std::memcpy(dst, res, nc * sizeof(uint16_t));
+        }
+    }
+    //============================================================================
+
+    static void vpass_neon(const uint8_t *const *rows, const int16_t *k, uint32_t count, uint8_t *out, size_t i0, size_t n) {
+        const int bits = ResampleTraits<uint8_t>::bits;
+        size_t i = i0;
+        for (; i + 8 <= n; i += 8) {
+            int32x4_t acc_lo = vdupq_n_s32(0);
+            int32x4_t acc_hi = acc_lo;
+            for (uint32_t t = 0; t < count; t++) {
+                int16x8_t v = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(rows[t] + i)));
+                acc_lo = vmlal_n_s16(acc_lo, vget_low_s16(v), k[t]);
+                acc_hi = vmlal_n_s16(acc_hi, vget_high_s16(v), k[t]);
+            }
+            uint16x8_t r = vcombine_u16(vqrshrun_n_s32(acc_lo, bits), vqrshrun_n_s32(acc_hi, bits));
+            vst1_u8(out + i, vqmovn_u16(r));
+        }
+        vpass_scalar(rows, k, count, out, i, n);
+    }
+    //============================================================================
+
+    static void vpass_neon(const uint16_t *const *rows, const int16_t *k, uint32_t count, uint16_t *out, size_t i0, size_t n) {
+        const int bits = ResampleTraits<uint16_t>::bits;
+        size_t i = i0;
+        for (; i + 8 <= n; i += 8) {
+            int32x4_t acc_lo = vdupq_n_s32(0);
+            int32x4_t acc_hi = acc_lo;
+            for (uint32_t t = 0; t < count; t++) {
+                uint16x8_t v = vld1q_u16(rows[t] + i);
+                acc_lo = vmlaq_n_s32(acc_lo, vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(v))), k[t]);
+                acc_hi = vmlaq_n_s32(acc_hi, vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(v))), k[t]);
+            }
+            vst1q_u16(out + i, vcombine_u16(vqrshrun_n_s32(acc_lo, bits), vqrshrun_n_s32(acc_hi, bits)));
+        }
+        vpass_scalar(rows, k, count, out, i, n);
+    }
+    //============================================================================
+
+#endif
+
+    template<typename T>
+    static void hpass(const T *in, T *out, uint32_t nc, uint32_t n_in, const ResampleWeights &w, ResampleKernel kernel) {
+        switch (kernel) {
+#ifdef IIIF_RESAMPLE_X86
+            case RESAMPLE_SSE41:
+            case RESAMPLE_AVX2:
+                hpass_sse41(in, out, nc, n_in, w);
+                return;
+#endif
+#ifdef IIIF_RESAMPLE_NEON
+            case RESAMPLE_NEON:
+                hpass_neon(in, out, nc, n_in, w);
+                return;
+#endif
+            default:
+                hpass_scalar(in, out, nc, w);
+        }
+    }
+    //============================================================================
+
+    template<typename T>
+    static void vpass(const T *const *rows, const int16_t *k, uint32_t count, T *out, size_t n, ResampleKernel kernel) {
+        switch (kernel) {
+#ifdef IIIF_RESAMPLE_X86
+            case RESAMPLE_SSE41:
+                vpass_sse41(rows, k, count, out, 0, n);
+                return;
+            case RESAMPLE_AVX2:
+                vpass_avx2(rows, k, count, out, 0, n);
+                return;
+#endif
+#ifdef IIIF_RESAMPLE_NEON
+            case RESAMPLE_NEON:
+                vpass_neon(rows, k, count, out, 0, n);
+                return;
+#endif
+            default:
+                vpass_scalar(rows, k, count, out, 0, n);
+        }
+    }
+    //============================================================================
+
+    ResampleKernel resampleKernel() {
+#if defined(IIIF_RESAMPLE_X86)
+        static const ResampleKernel kernel = __builtin_cpu_supports("avx2") ? RESAMPLE_AVX2 :
+                                             (__builtin_cpu_supports("sse4.1") ? RESAMPLE_SSE41 : RESAMPLE_SCALAR);
+        return kernel;
+#elif defined(IIIF_RESAMPLE_NEON)
+        return RESAMPLE_NEON;
+#else
+        return RESAMPLE_SCALAR;
+#endif
+    }
+    //============================================================================
+
+    const char *resampleKernelName(ResampleKernel kernel) {
+        switch (kernel) {
+            case RESAMPLE_SCALAR: return "scalar";
+            case RESAMPLE_SSE41: return "sse4.1";
+            case RESAMPLE_AVX2: return "avx2";
+            case RESAMPLE_NEON: return "neon";
+        }
+        return "unknown";
+    }
+    //============================================================================
+
+    template<typename T>
+    std::vector<T> doResample(std::vector<T> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc,
+                              uint32_t nnx, uint32_t nny, ResampleFilter filter, ResampleKernel kernel) {
+        if ((nx == nnx) && (ny == nny)) {
+            return std::move(inbuf);
+        }
+        //
+        // a kernel of another CPU (or one not supported by this one) falls back to the scalar code
+        //
+        ResampleKernel best = resampleKernel();
+        if ((kernel != RESAMPLE_SCALAR) && ((kernel > best) || ((kernel == RESAMPLE_NEON) != (best == RESAMPLE_NEON)))) {
+            kernel = RESAMPLE_SCALAR;
+        }
+
+        std::vector<T> src = std::move(inbuf);
+        const bool hscale = nnx != nx;
+        const bool vscale = nny != ny;
+        const size_t in_sll = static_cast<size_t>(nx) * nc;
+        const size_t out_sll = static_cast<size_t>(nnx) * nc;
+        const ResampleWeights xw = compute_weights(nx, nnx, filter, ResampleTraits<T>::bits);
+        const ResampleWeights yw = compute_weights(ny, nny, filter, ResampleTraits<T>::bits);
+
+        std::vector<T> outbuf = acquirePixels<T>(out_sll * nny);
+        if (!vscale) {
+            IIIFComputePool::parallel_for(nny, [&](uint32_t first, uint32_t last) {
+                for (uint32_t y = first; y < last; y++) {
+                    hpass(src.data() + y * in_sll, outbuf.data() + y * out_sll, nc, nx, xw, kernel);
+                }
+            });
+            releasePixels(std::move(src));
+            return outbuf;
+        }
+
+        //
+        // The horizontally resampled rows are kept in a ring buffer. The source windows of
+        // consecutive output rows are ascending (apart from trimmed zero taps), so that every
+        // source row is resampled horizontally only once and at most yw.ksize rows are needed
+        // at the same time. Each band of output rows has its own ring; the source rows at the
+        // border of two bands are resampled twice, therefore a band covers at least 4 kernel sizes.
+        //
+        const uint32_t min_rows = std::max(8u, static_cast<uint32_t>(4ull * yw.ksize * nny / ny));
+        IIIFComputePool::parallel_for(nny, [&](uint32_t first, uint32_t last) {
+            std::vector<T> ring(hscale ? yw.ksize * out_sll : 0);
+            std::vector<const T *> rows(yw.ksize);
+            uint32_t next_row = *std::min_element(yw.start.begin() + first, yw.start.begin() + last);
+            for (uint32_t j = first; j < last; j++) {
+                const uint32_t start = yw.start[j];
+                const uint32_t count = yw.count[j];
+                if (hscale) {
+                    for (; next_row < start + count; next_row++) {
+                        hpass(src.data() + next_row * in_sll, ring.data() + (next_row % yw.ksize) * out_sll, nc, nx, xw, kernel);
+                    }
+                }
+                for (uint32_t t = 0; t < count; t++) {
+                    const uint32_t y = start + t;
+                    rows[t] = hscale ? ring.data() + (y % yw.ksize) * out_sll : src.data() + y * in_sll;
+                }
+                vpass(rows.data(), &yw.coeffs[static_cast<size_t>(j) * yw.ksize], count, outbuf.data() + j * out_sll, out_sll, kernel);
+            }
+        }, min_rows);
+        releasePixels(std::move(src));
+        return outbuf;
+    }
+    //============================================================================
+
+    template std::vector<uint8_t> doResample<uint8_t>(std::vector<uint8_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t nnx, uint32_t nny, ResampleFilter filter, ResampleKernel kernel);
+    template std::vector<uint16_t> doResample<uint16_t>(std::vector<uint16_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t nnx, uint32_t nny, ResampleFilter filter, ResampleKernel kernel);
+
+    /*!
+     * Average of the blocks of a row of column sums: each output pixel is the sum of
+     * width consecutive pixels divided by cnt (rounded). NC is the number of channels, so
+     * that the inner loops are unrolled, or 0 for any other number of channels.
+     */
+    template<typename T, uint32_t NC>
+    static inline void reduce_blocks(const uint32_t *sum, uint32_t nblocks, uint32_t width, uint32_t cnt,
+                                     uint32_t nc, T *out) {
+        if (NC != 0) nc = NC;
+        const uint32_t half = cnt / 2;
+        for (uint32_t i = 0; i < nblocks; i++, sum += width * nc, out += nc) {
+            uint32_t acc[NC != 0 ? NC : 1];
+            for (uint32_t k = 0; k < (NC != 0 ? NC : 1); k++) acc[k] = 0;
+            if (NC != 0) {
+                for (uint32_t t = 0; t < width; t++) {
+                    for (uint32_t k = 0; k < NC; k++) acc[k] += sum[t * NC + k];
+                }
+                for (uint32_t k = 0; k < NC; k++) out[k] = static_cast<T>((acc[k] + half) / cnt);
+            } else {
+                for (uint32_t k = 0; k < nc; k++) {
+                    uint32_t a = 0;
+                    for (uint32_t t = 0; t < width; t++) a += sum[t * nc + k];
+                    out[k] = static_cast<T>((a + half) / cnt);
+                }
+            }
+        }
+    }
+    //============================================================================
+
+    /*!
+     * Integer reduction of one row: the output pixels are the averages of blocks of
+     * reduce x nrows source pixels. The rows are summed up first (a loop over contiguous
+     * samples), then the blocks of the sums; only the last block of a row may be narrower.
+     *
+     * \param[in] src First source row of the block
+     * \param[in] in_sll Distance of the source rows (in samples)
+     * \param[in] nrows Number of source rows (reduce, or less at the bottom)
+     * \param[in] w Number of source pixels of a row
+     * \param[in] sum Scratch row of w * nc column sums
+     */
+    template<typename T, uint32_t NC>
+    static void reduce_row_nc(const T *src, size_t in_sll, uint32_t nrows, uint32_t w, uint32_t nc,
+                              uint32_t reduce, uint32_t *sum, T *out) {
+        if (NC != 0) nc = NC;
+        const size_t n = static_cast<size_t>(w) * nc;
+        for (size_t i = 0; i < n; i++) sum[i] = src[i];
+        for (uint32_t r = 1; r < nrows; r++) {
+            const T *row = src + r * in_sll;
+            for (size_t i = 0; i < n; i++) sum[i] += row[i];
+        }
+        const uint32_t nfull = w / reduce;
+        reduce_blocks<T, NC>(sum, nfull, reduce, reduce * nrows, nc, out);
+        const uint32_t rest = w - nfull * reduce;
+        if (rest > 0) {
+            reduce_blocks<T, NC>(sum + static_cast<size_t>(nfull) * reduce * nc, 1, rest, rest * nrows, nc,
+                                 out + static_cast<size_t>(nfull) * nc);
+        }
+    }
+    //============================================================================
+
+    template<typename T>
+    static void reduce_row(const T *src, size_t in_sll, uint32_t nrows, uint32_t w, uint32_t nc,
+                           uint32_t reduce, uint32_t *sum, T *out) {
+        switch (nc) {
+            case 1:
+                reduce_row_nc<T, 1>(src, in_sll, nrows, w, nc, reduce, sum, out);
+                break;
+            case 3:
+                reduce_row_nc<T, 3>(src, in_sll, nrows, w, nc, reduce, sum, out);
+                break;
+            case 4:
+                reduce_row_nc<T, 4>(src, in_sll, nrows, w, nc, reduce, sum, out);
+                break;
+            default:
+                reduce_row_nc<T, 0>(src, in_sll, nrows, w, nc, reduce, sum, out);
+        }
+    }
+    //============================================================================
+
+    template<typename T>
+    std::vector<T> doCropReduceResample(std::vector<T> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc,
+                                        uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t reduce,
+                                        uint32_t nnx, uint32_t nny, ResampleFilter filter, ResampleKernel kernel) {
+        if (reduce < 1) reduce = 1;
+        if ((x == 0) && (y == 0) && (w == nx) && (h == ny) && (reduce == 1)) {
+            return doResample<T>(std::move(inbuf), nx, ny, nc, nnx, nny, filter, kernel);
+        }
+        ResampleKernel best = resampleKernel();
+        if ((kernel != RESAMPLE_SCALAR) && ((kernel > best) || ((kernel == RESAMPLE_NEON) != (best == RESAMPLE_NEON)))) {
+            kernel = RESAMPLE_SCALAR;
+        }
+
+        const uint32_t rw = (w + reduce - 1) / reduce; // size after the integer reduction
+        const uint32_t rh = (h + reduce - 1) / reduce;
+        const bool hscale = nnx != rw;
+        const bool vscale = nny != rh;
+        const size_t in_sll = static_cast<size_t>(nx) * nc;
+        const size_t red_sll = static_cast<size_t>(rw) * nc;
+        const size_t out_sll = static_cast<size_t>(nnx) * nc;
+        const T *roi = inbuf.data() + (static_cast<size_t>(y) * nx + x) * nc;
+        const ResampleWeights xw = hscale ? compute_weights(rw, nnx, filter, ResampleTraits<T>::bits) : ResampleWeights{};
+        const ResampleWeights yw = vscale ? compute_weights(rh, nny, filter, ResampleTraits<T>::bits) : ResampleWeights{};
+
+        //
+        // Row ry of the reduced region: reduced into buf, or (without reduction) in place
+        //
+        auto reduced = [&](uint32_t ry, T *buf, uint32_t *sum) -> const T * {
+            const T *src = roi + static_cast<size_t>(ry) * reduce * in_sll;
+            if (reduce == 1) return src;
+            reduce_row<T>(src, in_sll, std::min(reduce, h - ry * reduce), w, nc, reduce, sum, buf);
+            return buf;
+        };
+
+        auto outbuf = acquirePixels<T>(out_sll * nny);
+        if (!vscale) {
+            IIIFComputePool::parallel_for(nny, [&](uint32_t first, uint32_t last) {
+                std::vector<uint32_t> sum(reduce > 1 ? static_cast<size_t>(w) * nc : 0);
+                std::vector<T> row(hscale && (reduce > 1) ? red_sll : 0);
+                for (uint32_t j = first; j < last; j++) {
+                    T *dst = outbuf.data() + j * out_sll;
+                    if (hscale) {
+                        hpass(reduced(j, row.data(), sum.data()), dst, nc, rw, xw, kernel);
+                    } else if (reduce > 1) {
+                        reduced(j, dst, sum.data());
+                    } else {
+                        std::memcpy(dst, roi + j * in_sll, out_sll * sizeof(T));
+                    }
+                }
+            }, std::max(1u, 32u / reduce));
+            releasePixels(std::move(inbuf));
+            return outbuf;
+        }
+
+        //
+        // As in doResample(), the rows of the reduced region are resampled horizontally into
+        // a ring buffer from which the output rows are interpolated vertically. Without
+        // horizontal scaling, the ring holds the reduced rows (if there is a reduction).
+        //
+        const bool use_ring = hscale || (reduce > 1);
+        const uint32_t min_rows = std::max(8u, static_cast<uint32_t>(4ull * yw.ksize * nny / rh));
+        IIIFComputePool::parallel_for(nny, [&](uint32_t first, uint32_t last) {
+            std::vector<T> ring(use_ring ? yw.ksize * out_sll : 0);
+            std::vector<T> row(hscale && (reduce > 1) ? red_sll : 0);
+            std::vector<uint32_t> sum(reduce > 1 ? static_cast<size_t>(w) * nc : 0);
+            std::vector<const T *> rows(yw.ksize);
+            uint32_t next_row = *std::min_element(yw.start.begin() + first, yw.start.begin() + last);
+            for (uint32_t j = first; j < last; j++) {
+                const uint32_t start = yw.start[j];
+                const uint32_t count = yw.count[j];
+                if (use_ring) {
+                    for (; next_row < start + count; next_row++) {
+                        T *slot = ring.data() + (next_row % yw.ksize) * out_sll;
+                        if (hscale) {
+                            hpass(reduced(next_row, row.data(), sum.data()), slot, nc, rw, xw, kernel);
+                        } else {
+                            reduced(next_row, slot, sum.data());
+                        }
+                    }
+                }
+                for (uint32_t t = 0; t < count; t++) {
+                    const uint32_t yy = start + t;
+                    rows[t] = use_ring ? ring.data() + (yy % yw.ksize) * out_sll : roi + yy * in_sll;
+                }
+                vpass(rows.data(), &yw.coeffs[static_cast<size_t>(j) * yw.ksize], count, outbuf.data() + j * out_sll, out_sll, kernel);
+            }
+        }, min_rows);
+        releasePixels(std::move(inbuf));
+        return outbuf;
+    }
+    //============================================================================
+
+    template std::vector<uint8_t> doCropReduceResample<uint8_t>(std::vector<uint8_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t reduce, uint32_t nnx, uint32_t nny, ResampleFilter filter, ResampleKernel kernel);
+    template std::vector<uint16_t> doCropReduceResample<uint16_t>(std::vector<uint16_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t reduce, uint32_t nnx, uint32_t nny, ResampleFilter filter, ResampleKernel kernel);
+
+
+    template<typename T>
+    IIIFResampler<T>::IIIFResampler(uint32_t nx, uint32_t ny, uint32_t nc, uint32_t nnx, uint32_t nny,
+                                    ResampleFilter filter, ResampleKernel kernel)
+            : nc(nc), nx(nx), ny(ny), nnx(nnx), nny(nny), kernel(kernel) {
+        ResampleKernel best = resampleKernel();
+        if ((kernel != RESAMPLE_SCALAR) && ((kernel > best) || ((kernel == RESAMPLE_NEON) != (best == RESAMPLE_NEON)))) {
+            this->kernel = RESAMPLE_SCALAR;
+        }
+        xw = std::make_unique<ResampleWeights>(compute_weights(nx, nnx, filter, ResampleTraits<T>::bits));
+        yw = std::make_unique<ResampleWeights>(compute_weights(ny, nny, filter, ResampleTraits<T>::bits));
+        ring.resize(static_cast<size_t>(yw->ksize) * nnx * nc);
+        rows.resize(yw->ksize);
+    }
+    //============================================================================
+
+    template<typename T>
+    IIIFResampler<T>::~IIIFResampler() = default;
+    //============================================================================
+
+    template<typename T>
+    uint32_t IIIFResampler<T>::needed() const {
+        if (npulled >= nny) return ny;
+        if (nny == ny) return npulled + 1;
+        return yw->start[npulled] + yw->count[npulled];
+    }
+    //============================================================================
+
+    template<typename T>
+    void IIIFResampler<T>::push(const T *row) {
+        const size_t out_sll = static_cast<size_t>(nnx) * nc;
+        T *slot = ring.data() + (npushed % yw->ksize) * out_sll;
+        if (nnx != nx) {
+            hpass(row, slot, nc, nx, *xw, kernel);
+        } else {
+            std::memcpy(slot, row, out_sll * sizeof(T));
+        }
+        ++npushed;
+    }
+    //============================================================================
+
+    template<typename T>
+    bool IIIFResampler<T>::pull(T *out) {
+        if ((npulled >= nny) || (npushed < needed())) return false;
+        const size_t out_sll = static_cast<size_t>(nnx) * nc;
+        if (nny == ny) {
+            std::memcpy(out, ring.data() + (npulled % yw->ksize) * out_sll, out_sll * sizeof(T));
+        } else {
+            const uint32_t start = yw->start[npulled];
+            const uint32_t count = yw->count[npulled];
+            for (uint32_t t = 0; t < count; t++) {
+                rows[t] = ring.data() + ((start + t) % yw->ksize) * out_sll;
+            }
+            vpass(rows.data(), &yw->coeffs[static_cast<size_t>(npulled) * yw->ksize], count, out, out_sll, kernel);
+        }
+        ++npulled;
+        return true;
+    }
+    //============================================================================
+
+    template class IIIFResampler<uint8_t>;
+    template class IIIFResampler<uint16_t>;
+
+}
@@ -0,0 +1,184 @@
+/*
+ * Copyright © 2022 Lukas Rosenthaler
+ * This file is part of OMAS/cserve
+ * OMAS/cserve is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * OMAS/cserve is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef __defined_iiif_resample_h
+#define __defined_iiif_resample_h
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace cserve {
+
+    /*!
+     * Interpolation filters of the resampler. They are used for the scaling qualities
+     * HIGH (Lanczos3), MEDIUM (bicubic) and LOW (area).
+     */
+    typedef enum {
+        RESAMPLE_AREA = 0,     //!< average of the covered source pixels (box filter)
+        RESAMPLE_BICUBIC = 1,  //!< cubic convolution (Keys, a = -0.5), 4 taps at scale 1
+        RESAMPLE_LANCZOS3 = 2  //!< windowed sinc, 6 taps at scale 1
+    } ResampleFilter;
+
+    /*!
+     * Implementations of the inner loops. Apart from RESAMPLE_SCALAR, a kernel is
+     * only used if the CPU supports it. All kernels give identical results.
+     */
+    typedef enum {
+        RESAMPLE_SCALAR = 0,
+        RESAMPLE_SSE41 = 1,
+        RESAMPLE_AVX2 = 2,
+        RESAMPLE_NEON = 3
+    } ResampleKernel;
+
+    /*!
+     * The fastest kernel supported by this CPU (determined once at runtime)
+     */
+    ResampleKernel resampleKernel();
+
+    /*!
+     * Name of a kernel for log messages and benchmarks
+     */
+    const char *resampleKernelName(ResampleKernel kernel);
+
+    /*!
+     * Resize an image with interleaved channels.
+     *
+     * The image is resampled separately in both directions with precomputed fixed-point
+     * weights: each source row is resampled horizontally into a small ring buffer, from
+     * which the output rows are interpolated vertically. Thus only the output and a few
+     * intermediate rows are allocated in addition to the source image. Bands of output
+     * rows are resampled in parallel on the IIIFComputePool.
+     *
+     * \param[in] inbuf Pixels of the source image, released when the function returns
+     * \param[in] nx Width of the source image
+     * \param[in] ny Height of the source image
+     * \param[in] nc Number of channels
+     * \param[in] nnx Width of the resized image
+     * \param[in] nny Height of the resized image
+     * \param[in] filter Interpolation filter
+     * \param[in] kernel Implementation of the inner loops (for testing and benchmarks)
+     * \returns The pixels of the resized image
+     */
+    template<typename T>
+    std::vector<T> doResample(std::vector<T> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc,
+                              uint32_t nnx, uint32_t nny, ResampleFilter filter,
+                              ResampleKernel kernel = resampleKernel());
+
+    extern template std::vector<uint8_t> doResample<uint8_t>(std::vector<uint8_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t nnx, uint32_t nny, ResampleFilter filter, ResampleKernel kernel);
+    extern template std::vector<uint16_t> doResample<uint16_t>(std::vector<uint16_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t nnx, uint32_t nny, ResampleFilter filter, ResampleKernel kernel);
+
+    /*!
+     * Crop a region, reduce it by an integer factor and resize it, in one sweep over the source.
+     *
+     * The reduction averages blocks of reduce x reduce pixels (blocks at the right and bottom
+     * border of the region may be smaller), the result is resampled to the final size like
+     * in doResample(). The reduced rows are produced one after the other while they are
+     * needed by the resampler; neither the cropped nor the reduced image is stored.
+     *
+     * \param[in] inbuf Pixels of the source image, released when the function returns
+     * \param[in] nx Width of the source image
+     * \param[in] ny Height of the source image
+     * \param[in] nc Number of channels
+     * \param[in] x Left edge of the region (the region must lie inside the image)
+     * \param[in] y Top edge of the region
+     * \param[in] w Width of the region
+     * \param[in] h Height of the region
+     * \param[in] reduce Integer reduction factor, 1 for none
+     * \param[in] nnx Width of the result
+     * \param[in] nny Height of the result
+     * \param[in] filter Interpolation filter for the remaining scaling
+     * \param[in] kernel Implementation of the inner loops (for testing and benchmarks)
+     * \returns The pixels of the result
+     */
+    template<typename T>
+    std::vector<T> doCropReduceResample(std::vector<T> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc,
+                                        uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t reduce,
+                                        uint32_t nnx, uint32_t nny, ResampleFilter filter,
+                                        ResampleKernel kernel = resampleKernel());
+
+    extern template std::vector<uint8_t> doCropReduceResample<uint8_t>(std::vector<uint8_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t reduce, uint32_t nnx, uint32_t nny, ResampleFilter filter, ResampleKernel kernel);
+    extern template std::vector<uint16_t> doCropReduceResample<uint16_t>(std::vector<uint16_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t reduce, uint32_t nnx, uint32_t nny, ResampleFilter filter, ResampleKernel kernel);
+
+    struct ResampleWeights_;
+
+    /*!
+     * Resampler for the strip pipeline (see IIIFStrips.h). It uses the same weights and
+     * kernels as doResample() and gives identical results, but the source rows are pushed
+     * one after the other and each output row can be pulled as soon as the source rows it
+     * depends on have been pushed. Only a few intermediate rows are kept.
+     */
+    template<typename T>
+    class IIIFResampler {
+    private:
+        uint32_t nc;
+        uint32_t nx;
+        uint32_t ny;
+        uint32_t nnx;
+        uint32_t nny;
+        ResampleKernel kernel;
+        std::unique_ptr<ResampleWeights_> xw;
+        std::unique_ptr<ResampleWeights_> yw;
+        std::vector<T> ring;          //!< the last yw->ksize source rows, resampled horizontally
+        std::vector<const T *> rows;
+        uint32_t npushed{0};
+        uint32_t npulled{0};
+
+    public:
+        /*!
+         * Constructor
+         *
+         * \param[in] nx Width of the source image
+         * \param[in] ny Height of the source image
+         * \param[in] nc Number of channels
+         * \param[in] nnx Width of the resized image
+         * \param[in] nny Height of the resized image
+         * \param[in] filter Interpolation filter
+         * \param[in] kernel Implementation of the inner loops
+         */
+        IIIFResampler(uint32_t nx, uint32_t ny, uint32_t nc, uint32_t nnx, uint32_t nny,
+                      ResampleFilter filter, ResampleKernel kernel = resampleKernel());
+
+        IIIFResampler(const IIIFResampler&) = delete;
+
+        IIIFResampler &operator=(const IIIFResampler&) = delete;
+
+        ~IIIFResampler();
+
+        /*!
+         * Number of source rows that must have been pushed before the next output row can be pulled
+         */
+        [[nodiscard]] uint32_t needed() const;
+
+        /*!
+         * Add the next source row. Rows must only be pushed while pull() fails, otherwise
+         * rows still needed may be overwritten.
+         *
+         * \param[in] row nx * nc samples
+         */
+        void push(const T *row);
+
+        /*!
+         * Compute the next output row
+         *
+         * \param[out] out nnx * nc samples
+         * \returns false if more source rows are needed (or all output rows have been pulled)
+         */
+        bool pull(T *out);
+    };
+
+    extern template class IIIFResampler<uint8_t>;
+    extern template class IIIFResampler<uint16_t>;
+
+}
+
+#endif
@@ -0,0 +1,251 @@
+/*
+ * Copyright © 2022 Lukas Rosenthaler
+ * This file is part of OMAS/cserve
+ * OMAS/cserve is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * OMAS/cserve is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+#include "IIIFRotate.h"
+#include "IIIFComputePool.h"
+#include "IIIFBufferPool.h"
+
+namespace cserve {
+
+    //
+    // Edge of the square blocks copied by the orthogonal rotations (in pixels). A block
+    // reads rotate_block short segments of as many source rows; even with 4 channels of
+    // 16 bit these (64 * 512 bytes) stay in the L1/L2 cache while the block is written.
+    //
+    static constexpr uint32_t rotate_block = 64;
+
+    /*!
+     * Copy the pixels for a multiple of 90° (mirrored or not). The output pixel (i, j) is
+     * the input pixel base + i * di + j * dj (in pixels).
+     *
+     * NC is the number of channels, so that the copy of a pixel compiles to a few moves,
+     * or 0 for any other number of channels.
+     */
+    template<typename T, uint32_t NC>
+    static void orthogonal_copy(const T *in, T *out, uint32_t nc, uint32_t nnx, uint32_t nny,
+                                ptrdiff_t base, ptrdiff_t di, ptrdiff_t dj) {
+        if (NC != 0) nc = NC;
+        const size_t psize = nc * sizeof(T);
+        const ptrdiff_t sdi = di * static_cast<ptrdiff_t>(nc); // in samples
+        //
+        // rows of the input become rows of the output if |di| == 1, no blocking is needed then
+        //
+        const uint32_t bw = ((di == 1) || (di == -1)) ? nnx : rotate_block;
+        const uint32_t nbands = (nny + rotate_block - 1) / rotate_block;
+        IIIFComputePool::parallel_for(nbands, [&](uint32_t first, uint32_t last) {
+            for (uint32_t band = first; band < last; band++) {
+                const uint32_t j0 = band * rotate_block;
+                const uint32_t j1 = std::min(j0 + rotate_block, nny);
+                for (uint32_t i0 = 0; i0 < nnx; i0 += bw) {
+                    const uint32_t n = std::min(bw, nnx - i0);
+                    for (uint32_t j = j0; j < j1; j++) {
+                        const T *src = in + (base + static_cast<ptrdiff_t>(i0) * di + static_cast<ptrdiff_t>(j) * dj) * static_cast<ptrdiff_t>(nc);
+                        T *dst = out + (static_cast<size_t>(j) * nnx + i0) * nc;
+                        if (di == 1) {
+                            std::memcpy(dst, src, n * psize);
+                            continue;
+                        }
+                        for (uint32_t i = 0; i < n; i++, src += sdi, dst += nc) {
+                            std::memcpy(dst, src, NC != 0 ? NC * sizeof(T) : psize);
+                        }
+                    }
+                }
+            }
+        }, 2);
+    }
+    //============================================================================
+
+    template<typename T>
+    static void orthogonal_rotate(const T *in, T *out, uint32_t nc, uint32_t nnx, uint32_t nny,
+                                  ptrdiff_t base, ptrdiff_t di, ptrdiff_t dj) {
+        switch (nc) {
+            case 1:
+                orthogonal_copy<T, 1>(in, out, nc, nnx, nny, base, di, dj);
+                break;
+            case 2:
+                orthogonal_copy<T, 2>(in, out, nc, nnx, nny, base, di, dj);
+                break;
+            case 3:
+                orthogonal_copy<T, 3>(in, out, nc, nnx, nny, base, di, dj);
+                break;
+            case 4:
+                orthogonal_copy<T, 4>(in, out, nc, nnx, nny, base, di, dj);
+                break;
+            default:
+                orthogonal_copy<T, 0>(in, out, nc, nnx, nny, base, di, dj);
+        }
+    }
+    //============================================================================
+
+    /*!
+     * Rotate by an arbitrary angle with bilinear interpolation. The source coordinates of
+     * a row are computed first in a loop the compiler can vectorize; the weights of a pixel
+     * are computed once for all channels. Pixels outside the source image are black.
+     */
+    template<typename T>
+    static void bilinear_rotate(const T *in, T *out, uint32_t nx, uint32_t ny, uint32_t nc,
+                                uint32_t nnx, uint32_t nny, double angle, bool mirror) {
+        double phi = M_PI * angle / 180.0;
+        double ptx = static_cast<double>(nx) / 2. - .5;
+        double pty = static_cast<double>(ny) / 2. - .5;
+        double pptx = ptx * static_cast<double>(nnx) / static_cast<double>(nx);
+        double ppty = pty * static_cast<double>(nny) / static_cast<double>(ny);
+        double si = std::sin(-phi);
+        double co = std::cos(-phi);
+        const double xmax = static_cast<double>(nx) - 1.0;
+        const double ymax = static_cast<double>(ny) - 1.0;
+        const size_t sll = static_cast<size_t>(nx) * nc;
+
+        IIIFComputePool::parallel_for(nny, [&](uint32_t first, uint32_t last) {
+            std::vector<double> rx(nnx);
+            std::vector<double> ry(nnx);
+            for (uint32_t j = first; j < last; j++) {
+                const double x0 = -pptx * co - (static_cast<double>(j) - ppty) * si + ptx;
+                const double y0 = -pptx * si + (static_cast<double>(j) - ppty) * co + pty;
+                for (uint32_t i = 0; i < nnx; i++) {
+                    rx[i] = x0 + static_cast<double>(i) * co;
+                    ry[i] = y0 + static_cast<double>(i) * si;
+                }
+
+                T *dst = out + static_cast<size_t>(j) * nnx * nc;
+                for (uint32_t i = 0; i < nnx; i++, dst += nc) {
+                    double x = rx[i];
+                    const double y = ry[i];
+                    if ((x < 0.0) || (x >= xmax) || (y < 0.0) || (y >= ymax)) {
+                        std::fill(dst, dst + nc, T(0));
+                        continue;
+                    }
+                    if (mirror) x = xmax - x; // sample the mirrored image
+                    auto ix = static_cast<uint32_t>(x);
+                    auto iy = static_cast<uint32_t>(y);
+                    auto wx = static_cast<float>(x - ix);
+                    auto wy = static_cast<float>(y - iy);
+                    if (ix >= nx - 1) { // only possible if mirrored: x == nx - 1
+                        ix = nx - 2;
+                        wx = 1.0f;
+                    }
+                    const float w00 = (1.0f - wx) * (1.0f - wy);
+                    const float w10 = wx * (1.0f - wy);
+                    const float w01 = (1.0f - wx) * wy;
+                    const float w11 = wx * wy;
+                    const T *p = in + iy * sll + static_cast<size_t>(ix) * nc;
+                    const T *q = p + sll;
+                    for (uint32_t k = 0; k < nc; k++) {
+                        dst[k] = static_cast<T>(w00 * p[k] + w10 * p[nc + k] + w01 * q[k] + w11 * q[nc + k] + 0.5f);
+                    }
+                }
+            }
+        });
+    }
+    //============================================================================
+
+    template<typename T>
+    std::vector<T> doRotate(std::vector<T> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t &nnx, uint32_t &nny, float angle, bool mirror) {
+        while (angle < 0.) angle += 360.;
+        while (angle >= 360.) angle -= 360.;
+
+        nnx = nx;
+        nny = ny;
+        if ((angle == 0.) && !mirror) {
+            return std::move(inbuf);
+        }
+
+        const auto snx = static_cast<ptrdiff_t>(nx);
+        const auto sny = static_cast<ptrdiff_t>(ny);
+        ptrdiff_t base, di, dj;
+        if (angle == 0.) {
+            //
+            // abcdef     fedcba
+            // ghijkl ==> lkjihg
+            // mnopqr     rqponm
+            //
+            base = snx - 1; di = -1; dj = snx;
+        } else if (angle == 90.) {
+            //
+            // abcdef     mga        rlf
+            // ghijkl ==> nhb   or   qke (mirrored)
+            // mnopqr     oic        pjd
+            //            pjd        oic
+            //            qke        nhb
+            //            rlf        mga
+            //
+            nnx = ny;
+            nny = nx;
+            if (mirror) {
+                base = (sny - 1) * snx + snx - 1; di = -snx; dj = -1;
+            } else {
+                base = (sny - 1) * snx; di = -snx; dj = 1;
+            }
+        } else if (angle == 180.) {
+            //
+            // abcdef     rqponm        mnopqr
+            // ghijkl ==> lkjihg   or   ghijkl (mirrored)
+            // mnopqr     fedcba        abcdef
+            //
+            if (mirror) {
+                base = (sny - 1) * snx; di = 1; dj = -snx;
+            } else {
+                base = sny * snx - 1; di = -1; dj = -snx;
+            }
+        } else if (angle == 270.) {
+            //
+            // abcdef     flr        agm
+            // ghijkl ==> ekq   or   bhn (mirrored)
+            // mnopqr     djp        cio
+            //            cio        djp
+            //            bhn        ekq
+            //            agm        flr
+            //
+            nnx = ny;
+            nny = nx;
+            if (mirror) {
+                base = 0; di = snx; dj = 1;
+            } else {
+                base = snx - 1; di = snx; dj = -1;
+            }
+        } else { // all other angles
+            double phi = M_PI * angle / 180.0;
+            if ((angle > 0.) && (angle < 90.)) {
+                nnx = floor((double) nx * cos(phi) + (double) ny * sin(phi) + .5);
+                nny = floor((double) nx * sin(phi) + (double) ny * cos(phi) + .5);
+            } else if ((angle > 90.) && (angle < 180.)) {
+                nnx = floor(-((double) nx) * cos(phi) + (double) ny * sin(phi) + .5);
+                nny = floor((double) nx * sin(phi) - (double) ny * cosf(phi) + .5);
+            } else if ((angle > 180.) && (angle < 270.)) {
+                nnx = floor(-((double) nx) * cos(phi) - (double) ny * sin(phi) + .5);
+                nny = floor(-((double) nx) * sinf(phi) - (double) ny * cosf(phi) + .5);
+            } else {
+                nnx = floor((double) nx * cos(phi) - (double) ny * sin(phi) + .5);
+                nny = floor(-((double) nx) * sin(phi) + (double) ny * cos(phi) + .5);
+            }
+            auto outbuf = acquirePixels<T>(static_cast<size_t>(nnx) * nny * nc);
+            bilinear_rotate<T>(inbuf.data(), outbuf.data(), nx, ny, nc, nnx, nny, angle, mirror);
+            releasePixels(std::move(inbuf));
+            return outbuf;
+        }
+
+        auto outbuf = acquirePixels<T>(static_cast<size_t>(nnx) * nny * nc);
+        orthogonal_rotate<T>(inbuf.data(), outbuf.data(), nc, nnx, nny, base, di, dj);
+        releasePixels(std::move(inbuf));
+        return outbuf;
+    }
+    //============================================================================
+
+    template std::vector<uint8_t> doRotate<uint8_t>(std::vector<uint8_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t &nnx, uint32_t &nny, float angle, bool mirror);
+    template std::vector<uint16_t> doRotate<uint16_t>(std::vector<uint16_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t &nnx, uint32_t &nny, float angle, bool mirror);
+
+}
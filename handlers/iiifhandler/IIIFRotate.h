@@ -0,0 +1,48 @@
+/*
+ * Copyright © 2022 Lukas Rosenthaler
+ * This file is part of OMAS/cserve
+ * OMAS/cserve is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * OMAS/cserve is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef __defined_iiif_rotate_h
+#define __defined_iiif_rotate_h
+
+#include <cstdint>
+#include <vector>
+
+namespace cserve {
+
+    /*!
+     * Mirror and rotate an image with interleaved channels.
+     *
+     * The image is first mirrored at the vertical axis (if mirror is true) and then rotated
+     * clockwise. For multiples of 90° both steps are done in one pass which copies the pixels
+     * in square blocks, so that the rows read and written by a block stay in the cache. For
+     * other angles the rotated image is interpolated bilinearly with a black background.
+     * Bands of output rows are processed in parallel on the IIIFComputePool.
+     *
+     * \param[in] inbuf Pixels of the image, returned unchanged if there is nothing to do
+     * \param[in] nx Width of the image
+     * \param[in] ny Height of the image
+     * \param[in] nc Number of channels
+     * \param[out] nnx Width of the rotated image
+     * \param[out] nny Height of the rotated image
+     * \param[in] angle Clockwise rotation in degrees
+     * \param[in] mirror Mirror the image before rotating it
+     * \returns The pixels of the rotated image
+     */
+    template<typename T>
+    std::vector<T> doRotate(std::vector<T> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t &nnx, uint32_t &nny, float angle, bool mirror);
+
+    extern template std::vector<uint8_t> doRotate<uint8_t>(std::vector<uint8_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t &nnx, uint32_t &nny, float angle, bool mirror);
+    extern template std::vector<uint16_t> doRotate<uint16_t>(std::vector<uint16_t> &&inbuf, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t &nnx, uint32_t &nny, float angle, bool mirror);
+
+}
+
+#endif
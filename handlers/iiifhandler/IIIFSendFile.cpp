@@ -1,22 +1,102 @@
 //
 // Created by Lukas Rosenthaler on 26.07.22.
 //
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <sys/stat.h>
 
 #include "../lib/Cserve.h"
 #include "../lib/Parsing.h"
 #include "HttpSendError.h"
 #include "IIIFHandler.h"
 #include "IIIFImage.h"
+#include "IIIFStrips.h"
 #include "iiifparser/IIIFIdentifier.h"
 #include "iiifparser/IIIFRotation.h"
 #include "iiifparser/IIIFQualityFormat.h"
+#include "imgformats/IIIFIOJpeg.h"
 
 
 static const char file_[] = __FILE__;
 
+static const std::chrono::milliseconds render_wait_timeout(60000); // identical requests wait this long for the producer
+
 
 namespace cserve {
 
+    static std::string format_mimetype(IIIFQualityFormat::FormatType format) {
+        switch (format) {
+            case IIIFQualityFormat::TIF: return "image/tiff";
+            case IIIFQualityFormat::JPG: return "image/jpeg";
+            case IIIFQualityFormat::PNG: return "image/png";
+            case IIIFQualityFormat::JP2: return "image/jp2";
+            case IIIFQualityFormat::PDF: return "application/pdf";
+            default: return "";
+        }
+    }
+    //============================================================================
+
+    bool IIIFHandler::send_cached_file(Connection &conn, const std::string &infile, const std::string &canonical,
+                                       const std::string &canonical_header, const std::string &mimetype,
+                                       const struct timespec &orig_mtime) const {
+        //!>
+        //!> here we check if the file is in the cache. If so, it's being blocked from deletion
+        //!>
+        IIIFCache::Pin cachefile = _cache->pin(infile, canonical); // the file is not deleted while it is pinned
+        if (!cachefile) return false;
+
+        conn.status(Connection::OK);
+        conn.header("Cache-Control", "must-revalidate, post-check=0, pre-check=0");
+        conn.header("Link", canonical_header);
+        if (!mimetype.empty()) conn.header("Content-Type", mimetype); // set the header (mimetype)
+
+        //!>
+        //!> promote the cache file to the in-memory cache if it is requested often enough
+        //!>
+        std::shared_ptr<IIIFMemoryCache::Entry> entry;
+        if ((_memcache != nullptr) && (orig_mtime.tv_sec != 0 || orig_mtime.tv_nsec != 0)) {
+            struct stat cstatbuf{};
+            if ((stat(cachefile.path().c_str(), &cstatbuf) == 0) &&
+                _memcache->admits(canonical, static_cast<size_t>(cstatbuf.st_size))) {
+                std::ifstream cachestream(cachefile.path(), std::ios::in | std::ios::binary);
+                if (cachestream) {
+                    entry = std::make_shared<IIIFMemoryCache::Entry>();
+                    entry->data.reserve(static_cast<size_t>(cstatbuf.st_size));
+                    entry->data.assign(std::istreambuf_iterator<char>(cachestream), std::istreambuf_iterator<char>());
+                    entry->mimetype = mimetype;
+                    entry->orig_mtime = orig_mtime;
+                    if (!cachestream.good() && !cachestream.eof()) entry = nullptr;
+                }
+            }
+        }
+
+        try {
+            if (entry != nullptr) {
+                cachefile.release();
+                (void) _memcache->put(canonical, entry);
+                conn.send(entry->data.data(), static_cast<std::streamsize>(entry->data.size()));
+                return true;
+            }
+            //!> send the file from cache
+            conn.sendFile(cachefile.path());
+        }
+        catch (const InputFailure &err) {
+            // -1 was thrown
+            Server::logger()->warn("[{}] <IIIFSendFile> {} {} : Client unexpectedly closed connection",
+                                   conn.peer_ip(), conn.method_string(), conn.uri());
+            return true;
+        }
+        catch (const IIIFError &err) {
+            Server::logger()->error("[{}] <IIIFSendFile> {} {} :  Error sending cache file: \"{}\": {}",
+                                    conn.peer_ip(), conn.method_string(), conn.uri(), cachefile.path(), err.to_string());
+            send_error(conn, Connection::INTERNAL_SERVER_ERROR, err);
+            return true;
+        }
+        return true; //!> from now on the cache file can be deleted again
+    }
+    //============================================================================
+
     void IIIFHandler::send_iiif_file(Connection &conn, LuaServer &luaserver,
                                      const std::unordered_map<Parts, std::string> &params) const {
 
@@ -237,70 +317,109 @@ namespace cserve {
             return;
         } // finish sending unmodified file in toto
 
-        if (_cache != nullptr) {
-            //!>
-            //!> here we check if the file is in the cache. If so, it's being blocked from deletion
-            //!>
-            std::string cachefile = _cache->check(infile, canonical,
-                                                 true); // we block the file from being deleted if successfull
-
-            if (!cachefile.empty()) {
-                conn.status(Connection::OK);
-                conn.header("Cache-Control", "must-revalidate, post-check=0, pre-check=0");
-                conn.header("Link", canonical_header);
-
-                // set the header (mimetype)
-                switch (quality_format.format()) {
-                    case IIIFQualityFormat::TIF:
-                        conn.header("Content-Type", "image/tiff");
-                        break;
-                    case IIIFQualityFormat::JPG:
-                        conn.header("Content-Type", "image/jpeg");
-                        break;
-                    case IIIFQualityFormat::PNG:
-                        conn.header("Content-Type", "image/png");
-                        break;
-                    case IIIFQualityFormat::JP2:
-                        conn.header("Content-Type", "image/jp2");
-                        break;
-                    case IIIFQualityFormat::PDF: {
-                        conn.header("Content-Type", "application/pdf"); // set the header (mimetype)
-                        break;
+        struct timespec orig_mtime{0, 0}; // the in-memory cache entries are only valid for this version of the master file
+        if (_memcache != nullptr) {
+            struct stat fstatbuf{};
+            if (stat(infile.c_str(), &fstatbuf) == 0) {
+#ifdef __APPLE__
+                orig_mtime = fstatbuf.st_mtimespec;
+#else
+                orig_mtime = fstatbuf.st_mtim;
+#endif
+                //!>
+                //!> first tier: frequently requested responses are kept in memory
+                //!>
+                auto entry = _memcache->get(canonical, orig_mtime);
+                if (entry != nullptr) {
+                    conn.status(Connection::OK);
+                    conn.header("Cache-Control", "must-revalidate, post-check=0, pre-check=0");
+                    conn.header("Link", canonical_header);
+                    if (!entry->mimetype.empty()) conn.header("Content-Type", entry->mimetype);
+                    try {
+                        conn.send(entry->data.data(), static_cast<std::streamsize>(entry->data.size()));
                     }
-                    default: {
+                    catch (const InputFailure &err) {
+                        Server::logger()->warn("[{}] <IIIFSendFile> {} {} : Client unexpectedly closed connection",
+                                               conn.peer_ip(), conn.method_string(), conn.uri());
                     }
+                    return;
                 }
+            }
+        }
 
-                try {
-                    //!> send the file from cache
-                    conn.sendFile(cachefile);
-                    //!> from now on the cache file can be deleted again
-                }
-                catch (const InputFailure &err) {
-                    // -1 was thrown
-                    Server::logger()->warn("[{}] <IIIFSendFile> {} {} : Client unexpectedly closed connection",
-                                           conn.peer_ip(), conn.method_string(), conn.uri());
-                    _cache->deblock(cachefile);
+        IIIFSingleFlight::Ticket render_ticket;
+        if (_cache != nullptr) {
+            std::string mimetype = format_mimetype(quality_format.format());
+            if (send_cached_file(conn, infile, canonical, canonical_header, mimetype, orig_mtime)) return;
+
+            //!>
+            //!> identical requests that arrive while the response is being rendered wait for the
+            //!> first one (the producer) and are then served from its cache file
+            //!>
+            render_ticket = _renders->join(canonical);
+            if (render_ticket.producer()) {
+                // the previous producer may have finished between our cache lookup and join()
+                if (send_cached_file(conn, infile, canonical, canonical_header, mimetype, orig_mtime)) {
+                    render_ticket.complete();
                     return;
                 }
-                catch (const IIIFError &err) {
-                    Server::logger()->error("[{}] <IIIFSendFile> {} {} :  Error sending cache file: \"{}\": {}",
-                                            conn.peer_ip(), conn.method_string(), conn.uri(), cachefile, err.to_string());
-                    send_error(conn, Connection::INTERNAL_SERVER_ERROR, err);
-                    _cache->deblock(cachefile);
+            } else {
+                if (render_ticket.wait(render_wait_timeout) &&
+                    send_cached_file(conn, infile, canonical, canonical_header, mimetype, orig_mtime)) {
                     return;
                 }
-                _cache->deblock(cachefile);
-                return;
+                Server::logger()->info("[{}] <IIIFSendFile> {} {} : '{}' (coalesced render not available)",
+                                       conn.peer_ip(), conn.method_string(), conn.uri(), canonical);
             }
-            _cache->deblock(cachefile);
             Server::logger()->info("[{}] <IIIFSendFile> {} {} : '{}' (cache)",
                                    conn.peer_ip(), conn.method_string(), conn.uri(), canonical);
         }
+        _renders->count_render();
 
+        //
+        // A JPEG master which is mirrored or rotated by a multiple of 90° (without scaling) is transformed
+        // losslessly in the DCT domain, it is not decoded and encoded again. The transform reads the whole
+        // file, therefore a plain crop is only done this way for the full image, other regions are decoded
+        // selectively (only the scanlines and iMCU columns covering them).
+        //
+        std::vector<unsigned char> lossless;
+        if ((in_format == IIIFQualityFormat::JPG) && (quality_format.format() == IIIFQualityFormat::JPG) &&
+            (quality_format.quality() == IIIFQualityFormat::DEFAULT) && watermark.empty()) {
+            int32_t r_x, r_y;
+            uint32_t r_w, r_h, s_w, s_h, s_reduce{0};
+            bool s_redonly;
+            try {
+                region->crop_coords(img_w, img_h, r_x, r_y, r_w, r_h);
+                size->get_size(r_w, r_h, s_w, s_h, s_reduce, s_redonly);
+                bool full_image = (r_x == 0) && (r_y == 0) && (r_w == img_w) && (r_h == img_h);
+                if ((s_w == r_w) && (s_h == r_h) && (mirror || (angle != 0.0) || full_image)) {
+                    IIIFCompressionParams qp = {{JPEG_OPTIMIZE, _jpeg_optimize_coding ? "yes" : "no"},
+                                                {JPEG_PROGRESSIVE, _jpeg_progressive ? "yes" : "no"}};
+                    (void) IIIFIOJpeg::transform_lossless(infile, r_x, r_y, r_w, r_h, angle, mirror, qp, lossless);
+                }
+            }
+            catch (const IIIFSizeError &err) { ; // the errors are reported by the decoding path
+            }
+            catch (const IIIFError &err) { ;
+            }
+        }
+
+        //
+        // Without rotation, watermark and bitonal conversion, JPEG and PNG responses are streamed
+        // strip by strip from the decoder to the encoder, and the whole image is never in memory
+        //
+        bool streaming = (!mirror) && (angle == 0.0) && watermark.empty() &&
+                         (quality_format.quality() != IIIFQualityFormat::BITONAL) &&
+                         ((quality_format.format() == IIIFQualityFormat::JPG) ||
+                          (quality_format.format() == IIIFQualityFormat::PNG));
         IIIFImage img;
+        std::unique_ptr<IIIFStripSource> strips;
         try {
-            img = IIIFImage::read(infile, region, size, quality_format.format() == IIIFQualityFormat::JPG, _scaling_quality);
+            if (streaming && lossless.empty()) {
+                strips = IIIFImage::read_strips(infile, region, size, quality_format.format() == IIIFQualityFormat::JPG, _scaling_quality);
+            } else if (lossless.empty()) {
+                img = IIIFImage::read(infile, region, size, quality_format.format() == IIIFQualityFormat::JPG, _scaling_quality);
+            }
         }
         catch (const IIIFImageError &err) {
             send_error(conn, Connection::INTERNAL_SERVER_ERROR, err);
@@ -314,7 +433,7 @@ namespace cserve {
         //
         // now we rotate
         //
-        if (mirror || (angle != 0.0)) {
+        if (lossless.empty() && (mirror || (angle != 0.0))) {
             try {
                 img.rotate(angle, mirror);
             }
@@ -327,10 +446,18 @@ namespace cserve {
         if (quality_format.quality() != IIIFQualityFormat::DEFAULT) {
             switch (quality_format.quality()) {
                 case IIIFQualityFormat::COLOR:
-                    img.convertToIcc(IIIFIcc(icc_sRGB), 8);
+                    if (strips) {
+                        strips = std::make_unique<IIIFStripIcc>(std::move(strips), IIIFIcc(icc_sRGB), 8);
+                    } else {
+                        img.convertToIcc(IIIFIcc(icc_sRGB), 8);
+                    }
                     break; // for now, force 8 bit/sample
                 case IIIFQualityFormat::GRAY:
-                    img.convertToIcc(IIIFIcc(icc_GRAY_D50), 8);
+                    if (strips) {
+                        strips = std::make_unique<IIIFStripIcc>(std::move(strips), IIIFIcc(icc_GRAY_D50), 8);
+                    } else {
+                        img.convertToIcc(IIIFIcc(icc_GRAY_D50), 8);
+                    }
                     break; // for now, force 8 bit/sample
                 case IIIFQualityFormat::BITONAL:
                     img.toBitonal();
@@ -358,7 +485,11 @@ namespace cserve {
                                    conn.peer_ip(), conn.method_string(), conn.uri(), watermark);
         }
 
-        img.connection(&conn);
+        if (strips) {
+            strips->header().connection(&conn);
+        } else {
+            img.connection(&conn);
+        }
         conn.header("Cache-Control", "must-revalidate, post-check=0, pre-check=0");
         std::string cachefile;
 
@@ -376,19 +507,47 @@ namespace cserve {
             }
             switch (quality_format.format()) {
                 case IIIFQualityFormat::JPG: {
+                    IIIFIcc icc = IIIFIcc(icc_sRGB); // force sRGB !!
+                    if (strips) {
+                        if ((strips->header().getNc() > 3) && (strips->header().getNalpha() > 0)) { // we have an alpha channel....
+                            strips = std::make_unique<IIIFStripRemoveAlpha>(std::move(strips));
+                        }
+                        strips = std::make_unique<IIIFStripIcc>(std::move(strips), icc, 8);
+                        strips = std::make_unique<IIIFStripPrefetch>(std::move(strips)); // decoding errors before the header is sent
+                    }
+
                     conn.status(Connection::OK);
                     conn.header("Link", canonical_header);
                     conn.header("Content-Type", "image/jpeg"); // set the header (mimetype)
 
+                    if (!lossless.empty()) {
+                        conn.send(lossless.data(), static_cast<std::streamsize>(lossless.size()));
+                        break;
+                    }
+
+                    IIIFCompressionParams qp = {{JPEG_QUALITY, std::to_string(_jpeg_quality)},
+                                                {JPEG_DCT_METHOD, _jpeg_dct_method},
+                                                {JPEG_OPTIMIZE, _jpeg_optimize_coding ? "yes" : "no"},
+                                                {JPEG_PROGRESSIVE, _jpeg_progressive ? "yes" : "no"},
+                                                {JPEG_SUBSAMPLING, _jpeg_subsampling}};
+                    const IIIFImage &out = strips ? strips->header() : img;
+                    if ((_jpeg_parallel_megapixels > 0) &&
+                        (static_cast<uint64_t>(out.getNx()) * out.getNy() >= static_cast<uint64_t>(_jpeg_parallel_megapixels) * 1000000)) {
+                        qp[JPEG_PARALLEL] = "yes";
+                    }
+                    if (strips) {
+                        conn.setChunkedTransfer();
+                        IIIFImage::write_strips("jpg", std::move(strips), "HTTP", qp);
+                        break;
+                    }
+
                     if ((img.getNc() > 3) && (img.getNalpha() > 0)) { // we have an alpha channel....
                         for (size_t i = 3; i < (img.getNalpha() + 3); i++)
                             img.removeChan(i);
                     }
 
-                    IIIFIcc icc = IIIFIcc(icc_sRGB); // force sRGB !!
                     img.convertToIcc(icc, 8);
                     conn.setChunkedTransfer();
-                    IIIFCompressionParams qp = {{JPEG_QUALITY, std::to_string(_jpeg_quality)}};
                     img.write("jpg", "HTTP", qp);
                     break;
                 }
@@ -413,12 +572,19 @@ namespace cserve {
                 }
 
                 case IIIFQualityFormat::PNG: {
+                    if (strips) {
+                        strips = std::make_unique<IIIFStripPrefetch>(std::move(strips)); // decoding errors before the header is sent
+                    }
                     conn.status(Connection::OK);
                     conn.header("Link", canonical_header);
                     conn.header("Content-Type", "image/png"); // set the header (mimetype)
                     conn.setChunkedTransfer();
 
-                    img.write("png", "HTTP");
+                    if (strips) {
+                        IIIFImage::write_strips("png", std::move(strips), "HTTP");
+                    } else {
+                        img.write("png", "HTTP");
+                    }
                     break;
                 }
 
@@ -441,6 +607,7 @@ namespace cserve {
                 //!> ATTENTION!!! Here we change the list of available cache files
                 //!>
                 _cache->add(infile, canonical, cachefile, img_w, img_h, resolutions);
+                render_ticket.complete();
             }
         }
         catch (const IIIFError &err) {
@@ -448,11 +615,22 @@ namespace cserve {
                 conn.closeCacheFile();
                 unlink(cachefile.c_str());
             }
-            send_error(conn, Connection::INTERNAL_SERVER_ERROR, err);
+            if (conn.headerSent()) {
+                //
+                // the image is already under way and can't be replaced by an error message anymore. The
+                // response is cut off, a well terminated but truncated image must not be taken for valid.
+                //
+                Server::logger()->error("[{}] <IIIFSendFile> {} {} : Response aborted: {}",
+                                        conn.peer_ip(), conn.method_string(), conn.uri(), err.to_string());
+                conn.abort();
+            } else {
+                send_error(conn, Connection::INTERNAL_SERVER_ERROR, err);
+            }
             return;
         }
-        Server::logger()->info("[{}] <IIIFSendFile> {} {}: '{}' (transcode)",
-                               conn.peer_ip(), conn.method_string(), conn.uri(), canonical);
+        Server::logger()->info("[{}] <IIIFSendFile> {} {}: '{}' ({})",
+                               conn.peer_ip(), conn.method_string(), conn.uri(), canonical,
+                               lossless.empty() ? "transcode" : "lossless transform");
         conn.flush();
    }
 }
\ No newline at end of file
@@ -0,0 +1,102 @@
+/*
+ * Copyright © 2022 Lukas Rosenthaler
+ * This file is part of OMAS/cserve
+ * OMAS/cserve is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * OMAS/cserve is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+#include <utility>
+
+#include "IIIFSingleFlight.h"
+
+namespace cserve {
+
+    IIIFSingleFlight::Ticket::Ticket(Ticket &&other) noexcept
+            : owner(other.owner), key(std::move(other.key)), flight(std::move(other.flight)),
+              is_producer(other.is_producer) {
+        other.owner = nullptr;
+        other.is_producer = false;
+    }
+    //============================================================================
+
+    IIIFSingleFlight::Ticket &IIIFSingleFlight::Ticket::operator=(Ticket &&other) noexcept {
+        if (this != &other) {
+            if (is_producer && (owner != nullptr)) owner->finish(key, flight, false);
+            owner = other.owner;
+            key = std::move(other.key);
+            flight = std::move(other.flight);
+            is_producer = other.is_producer;
+            other.owner = nullptr;
+            other.is_producer = false;
+        }
+        return *this;
+    }
+    //============================================================================
+
+    IIIFSingleFlight::Ticket::~Ticket() {
+        if (is_producer && (owner != nullptr)) owner->finish(key, flight, false);
+    }
+    //============================================================================
+
+    void IIIFSingleFlight::Ticket::complete() {
+        if (is_producer && (owner != nullptr)) {
+            owner->finish(key, flight, true);
+            owner = nullptr;
+        }
+    }
+    //============================================================================
+
+    bool IIIFSingleFlight::Ticket::wait(std::chrono::milliseconds timeout) const {
+        if (flight == nullptr) return false;
+        std::unique_lock<std::mutex> flight_guard(flight->locking);
+        if (!flight->finished.wait_for(flight_guard, timeout, [this] { return flight->done; })) {
+            return false; // the producer takes too long
+        }
+        return flight->success;
+    }
+    //============================================================================
+
+    IIIFSingleFlight::Ticket IIIFSingleFlight::join(const std::string &key) {
+        Ticket ticket;
+        ticket.key = key;
+        std::lock_guard<std::mutex> locking_mutex_guard(locking);
+        auto it = flights.find(key);
+        if (it != flights.end()) {
+            ticket.flight = it->second;
+            ++n_coalesced;
+        } else {
+            ticket.flight = std::make_shared<Flight>();
+            flights[key] = ticket.flight;
+            ticket.owner = this;
+            ticket.is_producer = true;
+        }
+        return ticket;
+    }
+    //============================================================================
+
+    void IIIFSingleFlight::finish(const std::string &key, const std::shared_ptr<Flight> &flight, bool success) {
+        {
+            std::lock_guard<std::mutex> locking_mutex_guard(locking);
+            auto it = flights.find(key);
+            if ((it != flights.end()) && (it->second == flight)) flights.erase(it);
+        }
+        {
+            std::lock_guard<std::mutex> flight_guard(flight->locking);
+            flight->done = true;
+            flight->success = success;
+        }
+        flight->finished.notify_all();
+    }
+    //============================================================================
+
+    size_t IIIFSingleFlight::inflight() {
+        std::lock_guard<std::mutex> locking_mutex_guard(locking);
+        return flights.size();
+    }
+    //============================================================================
+
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright © 2022 Lukas Rosenthaler
+ * This file is part of OMAS/cserve
+ * OMAS/cserve is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * OMAS/cserve is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef __defined_iiif_single_flight_h
+#define __defined_iiif_single_flight_h
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace cserve {
+
+    /*!
+     * Coalesces identical renders ("single flight").
+     *
+     * The first request for a canonical URL that is not in the cache becomes the producer of
+     * the response. Identical requests arriving while it is being rendered wait for the
+     * producer and are then served from the cache entry it made, instead of decoding and
+     * transcoding the same image again.
+     */
+    class IIIFSingleFlight {
+    private:
+        typedef struct Flight_ {
+            std::mutex locking;
+            std::condition_variable finished;
+            bool done{false};
+            bool success{false};
+        } Flight;
+
+        std::mutex locking;
+        std::unordered_map<std::string, std::shared_ptr<Flight>> flights; //!< renders in progress
+        std::atomic<unsigned long long> n_coalesced{0};
+        std::atomic<unsigned long long> n_rendered{0};
+
+        void finish(const std::string &key, const std::shared_ptr<Flight> &flight, bool success);
+
+    public:
+        /*!
+         * Participation in a render. The producer must render the response; all others
+         * wait for it. If the producer's ticket is destroyed before complete() has been
+         * called, the render is considered failed and the waiting requests are released.
+         */
+        class Ticket {
+            friend class IIIFSingleFlight;
+        private:
+            IIIFSingleFlight *owner{nullptr};
+            std::string key;
+            std::shared_ptr<Flight> flight;
+            bool is_producer{false};
+
+        public:
+            Ticket() = default;
+
+            Ticket(const Ticket&) = delete;
+
+            Ticket(Ticket &&other) noexcept;
+
+            Ticket &operator=(const Ticket&) = delete;
+
+            Ticket &operator=(Ticket &&other) noexcept;
+
+            ~Ticket();
+
+            /*!
+             * @return true, if the holder has to render the response
+             */
+            [[nodiscard]] inline bool producer() const { return is_producer; }
+
+            /*!
+             * Producer only: the response has been rendered and is available in the cache.
+             * Releases all waiting requests.
+             */
+            void complete();
+
+            /*!
+             * Wait until the producer has finished.
+             *
+             * @param timeout Maximal time to wait
+             * @return true, if the producer has completed the render successfully within the timeout
+             */
+            bool wait(std::chrono::milliseconds timeout) const;
+        };
+
+        IIIFSingleFlight() = default;
+
+        IIIFSingleFlight(const IIIFSingleFlight&) = delete;
+
+        IIIFSingleFlight &operator=(const IIIFSingleFlight&) = delete;
+
+        /*!
+         * Join the render of the given key. The first caller becomes the producer.
+         *
+         * @param key Canonical IIIF URL
+         * @return The ticket
+         */
+        Ticket join(const std::string &key);
+
+        /*!
+         * Number of renders in progress
+         */
+        size_t inflight();
+
+        /*!
+         * Number of requests that joined a render of another request instead of rendering themselves
+         */
+        [[nodiscard]] inline unsigned long long coalesced() const { return n_coalesced; }
+
+        /*!
+         * Count a response that is decoded and transcoded (or transformed), i.e. not served from a cache
+         */
+        inline void count_render() { ++n_rendered; }
+
+        /*!
+         * Number of responses that have been rendered
+         */
+        [[nodiscard]] inline unsigned long long rendered() const { return n_rendered; }
+    };
+
+}
+
+#endif
@@ -0,0 +1,341 @@
+/*
+ * Copyright © 2022 Lukas Rosenthaler
+ * This file is part of OMAS/cserve
+ * OMAS/cserve is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * OMAS/cserve is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+#include <algorithm>
+#include <cstring>
+
+#include "lcms2.h"
+#include "fmt/format.h"
+
+#include "IIIFStrips.h"
+#include "IIIFComputePool.h"
+#include "IIIFPixelKernels.h"
+
+static const char file_[] = __FILE__;
+
+namespace cserve {
+
+    IIIFStripSource::IIIFStripSource(IIIFImage header_p) : shell(std::move(header_p)) {}
+    //============================================================================
+
+    void IIIFStripSource::set_size(uint32_t nx, uint32_t ny) {
+        shell.nx = nx;
+        shell.ny = ny;
+    }
+    //============================================================================
+
+    void IIIFStripSource::set_format(uint32_t nc, uint32_t bps, PhotometricInterpretation photo) {
+        shell.nc = nc;
+        shell.bps = bps;
+        shell.photo = photo;
+    }
+    //============================================================================
+
+    void IIIFStripSource::set_icc(std::shared_ptr<IIIFIcc> icc) {
+        shell.icc = std::move(icc);
+    }
+    //============================================================================
+
+    void IIIFStripSource::set_extra_samples(std::vector<ExtraSamples> es) {
+        shell.es = std::move(es);
+    }
+    //============================================================================
+
+    const uint8_t *IIIFStripSource::pixels_of(const IIIFImage &img) {
+        if (img.bps == 16) return reinterpret_cast<const uint8_t *>(img.wpixels.data());
+        return img.bpixels.data();
+    }
+    //============================================================================
+
+    size_t IIIFStripSource::row_size() const {
+        return static_cast<size_t>(shell.nx) * shell.nc * (shell.bps / 8);
+    }
+    //============================================================================
+
+    IIIFImage IIIFStripSource::materialize(std::unique_ptr<IIIFStripSource> strips) {
+        IIIFImage img = strips->shell;
+        const size_t sll = strips->row_size();
+        uint8_t *pixels;
+        switch (img.bps) {
+            case 8: {
+                img.bpixels = std::vector<uint8_t>(sll * img.ny);
+                pixels = img.bpixels.data();
+                break;
+            }
+            case 16: {
+                img.wpixels = std::vector<uint16_t>(sll / 2 * img.ny);
+                pixels = reinterpret_cast<uint8_t *>(img.wpixels.data());
+                break;
+            }
+            default: {
+                throw IIIFImageError(file_, __LINE__, fmt::format("Bits per sample is not supported for operation (bps={})", img.bps));
+            }
+        }
+        uint32_t y = 0;
+        while (y < img.ny) {
+            uint32_t n = strips->read(pixels + y * sll, std::min(strips->strip_height(), img.ny - y));
+            if (n == 0) {
+                throw IIIFImageError(file_, __LINE__, fmt::format("Image ends after {} of {} rows", y, img.ny));
+            }
+            y += n;
+        }
+        return img;
+    }
+    //============================================================================
+
+    IIIFImage IIIFStripSource::header_of(const IIIFImage &img) {
+        IIIFImage header;
+        header.nx = img.nx;
+        header.ny = img.ny;
+        header.nc = img.nc;
+        header.bps = img.bps;
+        header.es = img.es;
+        header.orientation = img.orientation;
+        header.photo = img.photo;
+        header.xmp = img.xmp;
+        header.icc = img.icc;
+        header.iptc = img.iptc;
+        header.exif = img.exif;
+        header.emdata = img.emdata;
+        header.conobj = img.conobj;
+        header.skip_metadata = img.skip_metadata;
+        return header;
+    }
+    //============================================================================
+
+    IIIFStripImage::IIIFStripImage(const IIIFImage &img) : IIIFStripSource(header_of(img)), image(&img) {}
+    //============================================================================
+
+    IIIFStripImage::IIIFStripImage(IIIFImage &&img)
+            : IIIFStripSource(header_of(img)), owned(std::move(img)), image(&owned) {}
+    //============================================================================
+
+    uint32_t IIIFStripImage::read(uint8_t *buf, uint32_t nrows) {
+        nrows = std::min(nrows, shell.getNy() - next_row);
+        if (nrows == 0) return 0;
+        const size_t sll = row_size();
+        std::memcpy(buf, pixels_of(*image) + next_row * sll, nrows * sll);
+        next_row += nrows;
+        return nrows;
+    }
+    //============================================================================
+
+    IIIFStripStage::IIIFStripStage(std::unique_ptr<IIIFStripSource> input_p)
+            : IIIFStripSource(input_p->header()), input(std::move(input_p)) {}
+    //============================================================================
+
+    uint32_t IIIFStripStage::read_input(uint32_t nrows) {
+        const size_t sll = input->row_size();
+        if (inbuf.size() < nrows * sll) inbuf.resize(nrows * sll);
+        uint32_t n = 0;
+        while (n < nrows) {
+            uint32_t m = input->read(inbuf.data() + n * sll, nrows - n);
+            if (m == 0) break;
+            n += m;
+        }
+        return n;
+    }
+    //============================================================================
+
+    IIIFStripCrop::IIIFStripCrop(std::unique_ptr<IIIFStripSource> input_p,
+                                 uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+            : IIIFStripStage(std::move(input_p)), x(x), y(y) {
+        if ((x + width > input->header().getNx()) || (y + height > input->header().getNy())) {
+            throw IIIFImageError(file_, __LINE__, fmt::format("Invalid cropping region ({},{},{},{}) for image {}x{}",
+                                                              x, y, width, height,
+                                                              input->header().getNx(), input->header().getNy()));
+        }
+        set_size(width, height);
+    }
+    //============================================================================
+
+    uint32_t IIIFStripCrop::read(uint8_t *buf, uint32_t nrows) {
+        while (skipped < y) {
+            uint32_t n = read_input(std::min(y - skipped, input->strip_height()));
+            if (n == 0) return 0;
+            skipped += n;
+        }
+        uint32_t n = read_input(std::min(nrows, shell.getNy() - delivered));
+        delivered += n;
+        const size_t in_sll = input->row_size();
+        const size_t sll = row_size();
+        const size_t offset = x * (in_sll / input->header().getNx());
+        for (uint32_t j = 0; j < n; j++) {
+            std::memcpy(buf + j * sll, inbuf.data() + j * in_sll + offset, sll);
+        }
+        return n;
+    }
+    //============================================================================
+
+    IIIFStripResample::IIIFStripResample(std::unique_ptr<IIIFStripSource> input_p,
+                                         uint32_t nnx, uint32_t nny, ScalingMethod quality)
+            : IIIFStripStage(std::move(input_p)) {
+        ResampleFilter filter;
+        switch (quality) {
+            case HIGH:
+                filter = RESAMPLE_LANCZOS3;
+                break;
+            case MEDIUM:
+                filter = RESAMPLE_BICUBIC;
+                break;
+            default:
+                filter = RESAMPLE_AREA;
+        }
+        const IIIFImage &in = input->header();
+        switch (in.getBps()) {
+            case 8: {
+                resampler8 = std::make_unique<IIIFResampler<uint8_t>>(in.getNx(), in.getNy(), in.getNc(), nnx, nny, filter);
+                break;
+            }
+            case 16: {
+                resampler16 = std::make_unique<IIIFResampler<uint16_t>>(in.getNx(), in.getNy(), in.getNc(), nnx, nny, filter);
+                break;
+            }
+            default: {
+                throw IIIFImageError(file_, __LINE__, fmt::format("Bits per sample is not supported for operation (bps={})", in.getBps()));
+            }
+        }
+        set_size(nnx, nny);
+    }
+    //============================================================================
+
+    template<typename T>
+    uint32_t IIIFStripResample::resample(IIIFResampler<T> &resampler, uint8_t *buf, uint32_t nrows) {
+        const size_t in_sll = input->row_size();
+        const size_t sll = row_size();
+        nrows = std::min(nrows, shell.getNy() - delivered);
+        uint32_t n = 0;
+        while (n < nrows) {
+            if (resampler.pull(reinterpret_cast<T *>(buf + n * sll))) {
+                ++n;
+                continue;
+            }
+            if (inpos == inrows) {
+                inrows = read_input(input->strip_height());
+                inpos = 0;
+                if (inrows == 0) break;
+            }
+            resampler.push(reinterpret_cast<const T *>(inbuf.data() + inpos * in_sll));
+            ++inpos;
+        }
+        delivered += n;
+        return n;
+    }
+    //============================================================================
+
+    uint32_t IIIFStripResample::read(uint8_t *buf, uint32_t nrows) {
+        if (resampler8 != nullptr) return resample(*resampler8, buf, nrows);
+        return resample(*resampler16, buf, nrows);
+    }
+    //============================================================================
+
+    IIIFStripIcc::IIIFStripIcc(std::unique_ptr<IIIFStripSource> input_p, const IIIFIcc &target_icc, uint32_t new_bps)
+            : IIIFStripStage(std::move(input_p)) {
+        cmsSetLogErrorHandler(icc_error_logger);
+        shell.ensure_icc();
+        in_nc = shell.nc;
+        in_bps = shell.bps;
+        if (!((new_bps == 8) || (new_bps == 16))) {
+            throw IIIFImageError(file_, __LINE__, "Unsupported bits/sample (" + std::to_string(new_bps) + ")");
+        }
+        cmsUInt32Number in_formatter = shell.icc->iccFormatter(in_nc, in_bps, shell.photo);
+        cmsUInt32Number out_formatter = target_icc.iccFormatter(new_bps);
+        transform = IIIFTransformCache::shared().get(*shell.icc, in_formatter, target_icc, out_formatter);
+        if (transform == nullptr) {
+            throw IIIFImageError(file_, __LINE__, "Couldn't create color transform");
+        }
+        shell.icc = std::make_shared<IIIFIcc>(target_icc);
+        shell.nc = cmsChannelsOf(cmsGetColorSpace(target_icc.getIccProfile()));
+        shell.bps = new_bps;
+        shell.photo = IIIFImage::icc_photometric(target_icc, shell.photo);
+    }
+    //============================================================================
+
+    uint32_t IIIFStripIcc::read(uint8_t *buf, uint32_t nrows) {
+        if (transform->identity()) {
+            return input->read(buf, nrows);
+        }
+        uint32_t n = read_input(nrows);
+        const size_t in_sll = input->row_size();
+        const size_t sll = row_size();
+        const uint32_t nx = shell.nx;
+        IIIFComputePool::parallel_for(n, [&](uint32_t first, uint32_t last) {
+            cmsDoTransform(transform->get(), inbuf.data() + first * in_sll, buf + first * sll, (last - first) * nx);
+        }, 4);
+        return n;
+    }
+    //============================================================================
+
+    IIIFStripTo8bps::IIIFStripTo8bps(std::unique_ptr<IIIFStripSource> input_p) : IIIFStripStage(std::move(input_p)) {
+        set_format(shell.getNc(), 8, shell.getPhoto());
+    }
+    //============================================================================
+
+    uint32_t IIIFStripTo8bps::read(uint8_t *buf, uint32_t nrows) {
+        if (input->header().getBps() != 16) {
+            return input->read(buf, nrows);
+        }
+        uint32_t n = read_input(nrows);
+        const auto *in = reinterpret_cast<const uint16_t *>(inbuf.data());
+        sixteen2eight(in, buf, static_cast<size_t>(n) * row_size());
+        return n;
+    }
+    //============================================================================
+
+    IIIFStripRemoveAlpha::IIIFStripRemoveAlpha(std::unique_ptr<IIIFStripSource> input_p)
+            : IIIFStripStage(std::move(input_p)) {
+        in_nc = shell.getNc();
+        uint32_t nalpha = std::min(shell.getNalpha(), in_nc - 1);
+        set_format(in_nc - nalpha, shell.getBps(), shell.getPhoto());
+        set_extra_samples({});
+    }
+    //============================================================================
+
+    uint32_t IIIFStripRemoveAlpha::read(uint8_t *buf, uint32_t nrows) {
+        if (in_nc == shell.getNc()) {
+            return input->read(buf, nrows);
+        }
+        uint32_t n = read_input(nrows);
+        const size_t bytes = shell.getBps() / 8;
+        const size_t in_pixel = in_nc * bytes;
+        const size_t pixel = shell.getNc() * bytes;
+        const size_t npixels = static_cast<size_t>(n) * shell.getNx();
+        for (size_t i = 0; i < npixels; ++i) {
+            std::memcpy(buf + i * pixel, inbuf.data() + i * in_pixel, pixel);
+        }
+        return n;
+    }
+    //============================================================================
+
+    IIIFStripPrefetch::IIIFStripPrefetch(std::unique_ptr<IIIFStripSource> input_p)
+            : IIIFStripStage(std::move(input_p)) {
+        nprefetched = read_input(strip_height());
+    }
+    //============================================================================
+
+    uint32_t IIIFStripPrefetch::read(uint8_t *buf, uint32_t nrows) {
+        const size_t sll = row_size();
+        uint32_t n = 0;
+        if (pos < nprefetched) {
+            n = std::min(nrows, nprefetched - pos);
+            std::memcpy(buf, inbuf.data() + pos * sll, n * sll);
+            pos += n;
+        }
+        while (n < nrows) {
+            uint32_t m = input->read(buf + n * sll, nrows - n);
+            if (m == 0) break;
+            n += m;
+        }
+        return n;
+    }
+    //============================================================================
+
+}
@@ -0,0 +1,251 @@
+/*
+ * Copyright © 2022 Lukas Rosenthaler
+ * This file is part of OMAS/cserve
+ * OMAS/cserve is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * OMAS/cserve is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef __defined_iiif_strips_h
+#define __defined_iiif_strips_h
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "IIIFImage.h"
+#include "IIIFResample.h"
+#include "IIIFTransformCache.h"
+
+namespace cserve {
+
+    /*!
+     * A source of image rows for the streaming pipeline between a decoder and an encoder.
+     *
+     * The rows are pulled from top to bottom in strips of a few rows, so that only some strips
+     * of the image are in memory at the same time. The header is an IIIFImage without pixels
+     * which describes the rows delivered (dimensions, channels, bits/sample, photometric
+     * interpretation) and carries the metadata of the image.
+     *
+     * Decoders deliver the rows of the file, the stages (IIIFStripCrop, IIIFStripResample,
+     * IIIFStripIcc, IIIFStripTo8bps, IIIFStripRemoveAlpha) transform the rows of another
+     * source, and the encoders consume the rows (see IIIFIO::read_strips() and IIIFIO::write_strips()).
+     * Operations which need the whole image (e.g. rotation) use IIIFStripSource::materialize().
+     */
+    class IIIFStripSource {
+    protected:
+        IIIFImage shell; //!< geometry and metadata of the rows delivered, no pixels
+
+        explicit IIIFStripSource(IIIFImage header_p);
+
+        void set_size(uint32_t nx, uint32_t ny);
+
+        void set_format(uint32_t nc, uint32_t bps, PhotometricInterpretation photo);
+
+        void set_icc(std::shared_ptr<IIIFIcc> icc);
+
+        void set_extra_samples(std::vector<ExtraSamples> es);
+
+        static const uint8_t *pixels_of(const IIIFImage &img);
+
+    public:
+        IIIFStripSource(const IIIFStripSource&) = delete;
+
+        IIIFStripSource &operator=(const IIIFStripSource&) = delete;
+
+        virtual ~IIIFStripSource() = default;
+
+        /*!
+         * The header of the rows delivered. The writers take the connection and the metadata from it.
+         */
+        [[nodiscard]] inline const IIIFImage &header() const { return shell; }
+
+        inline IIIFImage &header() { return shell; }
+
+        /*!
+         * Number of bytes of one row
+         */
+        [[nodiscard]] size_t row_size() const;
+
+        /*!
+         * Number of rows the source prefers to deliver at once
+         */
+        [[nodiscard]] virtual uint32_t strip_height() const { return 16; }
+
+        /*!
+         * Deliver the next rows
+         *
+         * \param[out] buf Buffer for nrows * row_size() bytes. 16 bit samples are in native byte order
+         * \param[in] nrows Number of rows requested
+         * \returns Number of rows delivered, less than nrows only at the end of the image
+         *
+         * \throws IIIFImageError
+         */
+        virtual uint32_t read(uint8_t *buf, uint32_t nrows) = 0;
+
+        /*!
+         * Read all (remaining) rows of a source into an image
+         *
+         * \param[in] strips The source
+         * \returns The image with the header of the source
+         */
+        static IIIFImage materialize(std::unique_ptr<IIIFStripSource> strips);
+
+        /*!
+         * Create a header (an image without pixels) from an image
+         */
+        static IIIFImage header_of(const IIIFImage &img);
+    };
+
+    /*!
+     * Rows of an image in memory. Used where a decoder or an operation can't stream the rows.
+     */
+    class IIIFStripImage : public IIIFStripSource {
+    private:
+        IIIFImage owned;
+        const IIIFImage *image;
+        uint32_t next_row{0};
+
+    public:
+        /*!
+         * Deliver the rows of an image which must live longer than the source
+         */
+        explicit IIIFStripImage(const IIIFImage &img);
+
+        /*!
+         * Deliver the rows of an image owned by the source
+         */
+        explicit IIIFStripImage(IIIFImage &&img);
+
+        uint32_t read(uint8_t *buf, uint32_t nrows) override;
+    };
+
+    /*!
+     * Base class of the stages that transform the rows of another source
+     */
+    class IIIFStripStage : public IIIFStripSource {
+    protected:
+        std::unique_ptr<IIIFStripSource> input;
+        std::vector<uint8_t> inbuf;
+
+        explicit IIIFStripStage(std::unique_ptr<IIIFStripSource> input_p);
+
+        /*!
+         * Read up to nrows rows of the input into inbuf
+         *
+         * \returns The number of rows read
+         */
+        uint32_t read_input(uint32_t nrows);
+
+    public:
+        [[nodiscard]] uint32_t strip_height() const override { return input->strip_height(); }
+    };
+
+    /*!
+     * Cut out a rectangle. The rows above the rectangle are read and dropped.
+     */
+    class IIIFStripCrop : public IIIFStripStage {
+    private:
+        uint32_t x;
+        uint32_t y;
+        uint32_t skipped{0};
+        uint32_t delivered{0};
+
+    public:
+        /*!
+         * Constructor, the rectangle must lie within the input (see IIIFRegion::crop_coords())
+         */
+        IIIFStripCrop(std::unique_ptr<IIIFStripSource> input_p, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+
+        uint32_t read(uint8_t *buf, uint32_t nrows) override;
+    };
+
+    /*!
+     * Scale the rows with the resampler of IIIFImage::scale(), scaleMedium() and scaleFast()
+     */
+    class IIIFStripResample : public IIIFStripStage {
+    private:
+        std::unique_ptr<IIIFResampler<uint8_t>> resampler8;
+        std::unique_ptr<IIIFResampler<uint16_t>> resampler16;
+        uint32_t inrows{0};   //!< rows in inbuf
+        uint32_t inpos{0};    //!< next row of inbuf to be pushed
+        uint32_t delivered{0};
+
+        template<typename T>
+        uint32_t resample(IIIFResampler<T> &resampler, uint8_t *buf, uint32_t nrows);
+
+    public:
+        /*!
+         * Constructor
+         *
+         * \param[in] input_p Source
+         * \param[in] nnx New width
+         * \param[in] nny New height
+         * \param[in] quality HIGH (Lanczos3), MEDIUM (bicubic) or LOW (area average)
+         */
+        IIIFStripResample(std::unique_ptr<IIIFStripSource> input_p, uint32_t nnx, uint32_t nny, ScalingMethod quality);
+
+        uint32_t read(uint8_t *buf, uint32_t nrows) override;
+    };
+
+    /*!
+     * Convert the rows to another ICC profile, like IIIFImage::convertToIcc(). If the profiles
+     * are equivalent (see IIIFTransformCache), the rows are passed through.
+     */
+    class IIIFStripIcc : public IIIFStripStage {
+    private:
+        std::shared_ptr<const IIIFTransformCache::Transform> transform;
+        uint32_t in_nc;
+        uint32_t in_bps;
+
+    public:
+        IIIFStripIcc(std::unique_ptr<IIIFStripSource> input_p, const IIIFIcc &target_icc, uint32_t new_bps);
+
+        uint32_t read(uint8_t *buf, uint32_t nrows) override;
+    };
+
+    /*!
+     * Reduce 16 bit samples to 8 bit, like IIIFImage::to8bps()
+     */
+    class IIIFStripTo8bps : public IIIFStripStage {
+    public:
+        explicit IIIFStripTo8bps(std::unique_ptr<IIIFStripSource> input_p);
+
+        uint32_t read(uint8_t *buf, uint32_t nrows) override;
+    };
+
+    /*!
+     * Drop the alpha channels (the extra samples following the color channels)
+     */
+    class IIIFStripRemoveAlpha : public IIIFStripStage {
+    private:
+        uint32_t in_nc;
+
+    public:
+        explicit IIIFStripRemoveAlpha(std::unique_ptr<IIIFStripSource> input_p);
+
+        uint32_t read(uint8_t *buf, uint32_t nrows) override;
+    };
+
+    /*!
+     * Decode the first strip of the input already in the constructor, so that a damaged file is
+     * detected before the HTTP header of the response is sent. The rows are delivered unchanged.
+     */
+    class IIIFStripPrefetch : public IIIFStripStage {
+    private:
+        uint32_t nprefetched; //!< rows in inbuf
+        uint32_t pos{0};      //!< next row of inbuf to be delivered
+
+    public:
+        explicit IIIFStripPrefetch(std::unique_ptr<IIIFStripSource> input_p);
+
+        uint32_t read(uint8_t *buf, uint32_t nrows) override;
+    };
+
+}
+
+#endif
@@ -0,0 +1,171 @@
+/*
+ * Copyright © 2022 Lukas Rosenthaler
+ * This file is part of OMAS/cserve
+ * OMAS/cserve is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * OMAS/cserve is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+#include "IIIFTransformCache.h"
+
+namespace cserve {
+
+    //
+    // number of transforms kept by the shared cache. A transform needs some 100 KB
+    // (mostly the precalculated device link)
+    //
+    static const size_t shared_max_entries = 64;
+
+    //
+    // values per channel of the test grid used to detect identity transforms
+    //
+    static const uint32_t grid_steps_3 = 16; // up to 3 channels
+    static const uint32_t grid_steps_4 = 8;  // 4 channels
+
+    IIIFTransformCache::Transform::~Transform() {
+        if (handle != nullptr) cmsDeleteTransform(handle);
+    }
+    //============================================================================
+
+    size_t IIIFTransformCache::KeyHash::operator()(const Key &key) const {
+        size_t h = std::hash<std::string>{}(key.src_digest);
+        h = h * 0x9E3779B97F4A7C15ULL ^ std::hash<std::string>{}(key.dst_digest);
+        h = h * 0x9E3779B97F4A7C15ULL ^ key.in_formatter;
+        h = h * 0x9E3779B97F4A7C15ULL ^ key.out_formatter;
+        h = h * 0x9E3779B97F4A7C15ULL ^ key.intent;
+        return h;
+    }
+    //============================================================================
+
+    IIIFTransformCache::IIIFTransformCache(size_t max_entries_p) : max_entries(max_entries_p) {}
+    //============================================================================
+
+    IIIFTransformCache &IIIFTransformCache::shared() {
+        static IIIFTransformCache cache(shared_max_entries);
+        return cache;
+    }
+    //============================================================================
+
+    bool IIIFTransformCache::same_profile(const IIIFIcc &src, const IIIFIcc &dst) {
+        cmsUInt32Number src_len = 0;
+        cmsUInt32Number dst_len = 0;
+        if (!cmsSaveProfileToMem(src.getIccProfile(), nullptr, &src_len) ||
+            !cmsSaveProfileToMem(dst.getIccProfile(), nullptr, &dst_len) || (src_len != dst_len)) {
+            return false;
+        }
+        std::vector<char> src_buf(src_len);
+        std::vector<char> dst_buf(dst_len);
+        if (!cmsSaveProfileToMem(src.getIccProfile(), src_buf.data(), &src_len) ||
+            !cmsSaveProfileToMem(dst.getIccProfile(), dst_buf.data(), &dst_len)) {
+            return false;
+        }
+        return src_buf == dst_buf;
+    }
+    //============================================================================
+
+    bool IIIFTransformCache::check_identity(cmsHTRANSFORM transform, cmsUInt32Number in_formatter, cmsUInt32Number out_formatter) {
+        if ((in_formatter != out_formatter) || (T_PLANAR(in_formatter) != 0)) return false;
+        const uint32_t nc = T_CHANNELS(in_formatter) + T_EXTRA(in_formatter);
+        const uint32_t nbytes = T_BYTES(in_formatter);
+        if ((nc == 0) || (nc > 4) || ((nbytes != 1) && (nbytes != 2))) return false;
+
+        //
+        // all combinations of steps values per channel
+        //
+        const uint32_t steps = (nc <= 3) ? grid_steps_3 : grid_steps_4;
+        uint32_t npixels = 1;
+        for (uint32_t c = 0; c < nc; c++) npixels *= steps;
+        std::vector<uint16_t> grid(static_cast<size_t>(npixels) * nc);
+        for (uint32_t p = 0; p < npixels; p++) {
+            uint32_t idx = p;
+            for (uint32_t c = 0; c < nc; c++) {
+                uint32_t v = (idx % steps) * 255 / (steps - 1);
+                grid[static_cast<size_t>(p) * nc + c] = static_cast<uint16_t>(nbytes == 2 ? v * 257 : v);
+                idx /= steps;
+            }
+        }
+
+        const int tolerance = (nbytes == 2) ? 257 : 1;
+        if (nbytes == 1) {
+            std::vector<uint8_t> in(grid.begin(), grid.end());
+            std::vector<uint8_t> out(in.size());
+            cmsDoTransform(transform, in.data(), out.data(), npixels);
+            for (size_t i = 0; i < in.size(); i++) {
+                if (std::abs(static_cast<int>(out[i]) - static_cast<int>(in[i])) > tolerance) return false;
+            }
+        } else {
+            std::vector<uint16_t> out(grid.size());
+            cmsDoTransform(transform, grid.data(), out.data(), npixels);
+            for (size_t i = 0; i < grid.size(); i++) {
+                if (std::abs(static_cast<int>(out[i]) - static_cast<int>(grid[i])) > tolerance) return false;
+            }
+        }
+        return true;
+    }
+    //============================================================================
+
+    std::shared_ptr<const IIIFTransformCache::Transform>
+    IIIFTransformCache::get(const IIIFIcc &src, cmsUInt32Number in_formatter,
+                            const IIIFIcc &dst, cmsUInt32Number out_formatter,
+                            cmsUInt32Number intent) {
+        Key key{src.profileDigest(), dst.profileDigest(), in_formatter, out_formatter, intent};
+        {
+            std::lock_guard<std::mutex> lock(locking);
+            auto it = table.find(key);
+            if (it != table.end()) {
+                lru.splice(lru.begin(), lru, it->second.lru_pos);
+                ++n_hits;
+                return it->second.transform;
+            }
+        }
+        ++n_misses;
+
+        //
+        // created without holding the lock; if another thread creates the same transform
+        // meanwhile, the first one entered is kept
+        //
+        cmsHTRANSFORM handle = cmsCreateTransform(src.getIccProfile(), in_formatter, dst.getIccProfile(), out_formatter,
+                                                  intent, cmsFLAGS_NOCACHE);
+        if (handle == nullptr) return nullptr;
+        bool identity = ((in_formatter == out_formatter) && same_profile(src, dst)) ||
+                        check_identity(handle, in_formatter, out_formatter);
+        auto transform = std::make_shared<const Transform>(handle, identity);
+
+        std::lock_guard<std::mutex> lock(locking);
+        auto it = table.find(key);
+        if (it != table.end()) {
+            lru.splice(lru.begin(), lru, it->second.lru_pos);
+            return it->second.transform;
+        }
+        if (max_entries == 0) return transform;
+        while (table.size() >= max_entries) {
+            table.erase(lru.back());
+            lru.pop_back();
+        }
+        lru.push_front(key);
+        table[key] = Slot{transform, lru.begin()};
+        return transform;
+    }
+    //============================================================================
+
+    void IIIFTransformCache::clear() {
+        std::lock_guard<std::mutex> lock(locking);
+        table.clear();
+        lru.clear();
+    }
+    //============================================================================
+
+    size_t IIIFTransformCache::getNentries() {
+        std::lock_guard<std::mutex> lock(locking);
+        return table.size();
+    }
+    //============================================================================
+
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright © 2022 Lukas Rosenthaler
+ * This file is part of OMAS/cserve
+ * OMAS/cserve is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * OMAS/cserve is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef __defined_iiif_transform_cache_h
+#define __defined_iiif_transform_cache_h
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "metadata/IIIFIcc.h"
+
+namespace cserve {
+
+    /*!
+     * Process-wide cache of littleCMS transforms.
+     *
+     * Creating a transform takes milliseconds, and most requests use the same few profile
+     * combinations (e.g. the sRGB or gray master files converted to sRGB for JPEG output).
+     * The transforms are created with cmsFLAGS_NOCACHE, so that they can be used by several
+     * threads at the same time.
+     *
+     * The transforms are found by the SHA-256 digests of the profiles (see IIIFIcc::profileDigest()),
+     * which are computed once per profile instance.
+     *
+     * When a transform is created, it is checked if it changes the pixels at all: if the
+     * profiles are byte-identical, or if the colors of a test grid are reproduced (within
+     * one 8 bit level), the transform is marked as identity and the conversion can be skipped.
+     */
+    class IIIFTransformCache {
+    public:
+        /*!
+         * A cached transform. It is released when it is no longer in the cache and in use.
+         */
+        class Transform {
+        private:
+            cmsHTRANSFORM handle;
+            bool is_identity;
+
+        public:
+            Transform(cmsHTRANSFORM handle_p, bool is_identity_p) : handle(handle_p), is_identity(is_identity_p) {}
+
+            Transform(const Transform&) = delete;
+
+            Transform &operator=(const Transform&) = delete;
+
+            ~Transform();
+
+            [[nodiscard]] inline cmsHTRANSFORM get() const { return handle; }
+
+            /*!
+             * True, if the transform doesn't change the pixels (the profiles are equivalent)
+             */
+            [[nodiscard]] inline bool identity() const { return is_identity; }
+        };
+
+    private:
+        typedef struct Key_ {
+            std::string src_digest;
+            std::string dst_digest;
+            cmsUInt32Number in_formatter;
+            cmsUInt32Number out_formatter;
+            cmsUInt32Number intent;
+
+            bool operator==(const Key_ &other) const {
+                return (src_digest == other.src_digest) && (dst_digest == other.dst_digest) &&
+                       (in_formatter == other.in_formatter) && (out_formatter == other.out_formatter) &&
+                       (intent == other.intent);
+            }
+        } Key;
+
+        struct KeyHash {
+            size_t operator()(const Key &key) const;
+        };
+
+        typedef std::list<Key> LruList;
+
+        typedef struct {
+            std::shared_ptr<const Transform> transform;
+            LruList::iterator lru_pos;
+        } Slot;
+
+        std::mutex locking;
+        std::unordered_map<Key, Slot, KeyHash> table;
+        LruList lru; //!< most recently used first
+        size_t max_entries;
+        std::atomic<unsigned long long> n_hits{0};
+        std::atomic<unsigned long long> n_misses{0};
+
+        static bool same_profile(const IIIFIcc &src, const IIIFIcc &dst);
+
+        static bool check_identity(cmsHTRANSFORM transform, cmsUInt32Number in_formatter, cmsUInt32Number out_formatter);
+
+    public:
+        /*!
+         * Constructor
+         *
+         * @param max_entries_p Maximal number of transforms kept
+         */
+        explicit IIIFTransformCache(size_t max_entries_p);
+
+        IIIFTransformCache(const IIIFTransformCache&) = delete;
+
+        IIIFTransformCache &operator=(const IIIFTransformCache&) = delete;
+
+        /*!
+         * The cache used by IIIFImage::convertToIcc() and IIIFStripIcc
+         */
+        static IIIFTransformCache &shared();
+
+        /*!
+         * Get a transform, create it if it's not in the cache
+         *
+         * @param src Profile of the pixels
+         * @param in_formatter littleCMS format of the pixels
+         * @param dst Target profile
+         * @param out_formatter littleCMS format of the converted pixels
+         * @param intent Rendering intent
+         * @return The transform, nullptr if littleCMS can't create it
+         */
+        std::shared_ptr<const Transform> get(const IIIFIcc &src, cmsUInt32Number in_formatter,
+                                             const IIIFIcc &dst, cmsUInt32Number out_formatter,
+                                             cmsUInt32Number intent = INTENT_PERCEPTUAL);
+
+        /*!
+         * Remove all transforms
+         */
+        void clear();
+
+        [[nodiscard]] inline unsigned long long hits() const { return n_hits; }
+
+        [[nodiscard]] inline unsigned long long misses() const { return n_misses; }
+
+        size_t getNentries();
+    };
+
+}
+
+#endif
@@ -0,0 +1,191 @@
+/*
+ * Copyright © 2022 Lukas Rosenthaler
+ * This file is part of OMAS/cserve
+ * OMAS/cserve is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * OMAS/cserve is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+#include <algorithm>
+#include <cmath>
+
+#include "IIIFWatermark.h"
+#include "IIIFComputePool.h"
+
+namespace cserve {
+
+    //
+    // bilinear interpolation of the first channel, like bilinn() (see IIIFImgTools.cpp), but
+    // the neighbours beyond the last column and row are replaced by the last column and row
+    //
+    static uint8_t interpolate(const std::vector<uint8_t> &wm, uint32_t wm_nx, uint32_t wm_ny, uint32_t wm_nc,
+                               double x, double y) {
+        const auto ix = static_cast<uint32_t>(x);
+        const auto iy = static_cast<uint32_t>(y);
+        const double rx = x - (double) ix;
+        const double ry = y - (double) iy;
+        const uint32_t ix1 = std::min(ix + 1, wm_nx - 1);
+        const uint32_t iy1 = std::min(iy + 1, wm_ny - 1);
+        auto at = [&](uint32_t xx, uint32_t yy) {
+            return (double) wm[static_cast<size_t>(wm_nc) * (static_cast<size_t>(yy) * wm_nx + xx)];
+        };
+
+        if ((rx < 1.0e-2) && (ry < 1.0e-2)) {
+            return static_cast<uint8_t>(at(ix, iy));
+        } else if (rx < 1.0e-2) {
+            return static_cast<uint8_t>(lround(at(ix, iy) * (1 - rx - ry + rx * ry) + at(ix, iy1) * (ry - rx * ry)));
+        } else if (ry < 1.0e-2) {
+            return static_cast<uint8_t>(lround(at(ix, iy) * (1 - rx - ry + rx * ry) + at(ix1, iy) * (rx - rx * ry)));
+        } else {
+            return static_cast<uint8_t>(lround(at(ix, iy) * (1 - rx - ry + rx * ry) +
+                                               at(ix1, iy) * (rx - rx * ry) +
+                                               at(ix, iy1) * (ry - rx * ry) +
+                                               at(ix1, iy1) * rx * ry));
+        }
+    }
+    //============================================================================
+
+    void scaleWatermarkRows(const std::vector<uint8_t> &wm, uint32_t wm_nx, uint32_t wm_ny, uint32_t wm_nc,
+                            uint32_t nx, uint32_t ny, uint32_t first, uint32_t last, uint8_t *values) {
+        std::vector<double> xlut(nx);
+        for (size_t i = 0; i < nx; i++) {
+            xlut[i] = (double) (wm_nx * i) / (double) nx;
+        }
+        for (size_t j = first; j < last; j++) {
+            const double y = (double) (wm_ny * j) / (double) ny;
+            uint8_t *row = values + (j - first) * nx;
+            for (size_t i = 0; i < nx; i++) {
+                row[i] = interpolate(wm, wm_nx, wm_ny, wm_nc, xlut[i], y);
+            }
+        }
+    }
+    //============================================================================
+
+    std::vector<uint8_t> scaleWatermark(const std::vector<uint8_t> &wm, uint32_t wm_nx, uint32_t wm_ny, uint32_t wm_nc,
+                                        uint32_t nx, uint32_t ny) {
+        std::vector<uint8_t> values(static_cast<size_t>(nx) * ny);
+        IIIFComputePool::parallel_for(ny, [&](uint32_t first, uint32_t last) {
+            scaleWatermarkRows(wm, wm_nx, wm_ny, wm_nc, nx, ny, first, last, values.data() + static_cast<size_t>(first) * nx);
+        });
+        return values;
+    }
+    //============================================================================
+
+    size_t IIIFWatermarkCache::KeyHash::operator()(const Key &key) const {
+        size_t h = std::hash<std::string>()(key.path);
+        h = h * 0x9E3779B97F4A7C15ULL ^ key.nx;
+        h = h * 0x9E3779B97F4A7C15ULL ^ key.ny;
+        return h;
+    }
+    //============================================================================
+
+    IIIFWatermarkCache::IIIFWatermarkCache(size_t max_bytes_p, Loader loader_p)
+            : loader(std::move(loader_p)), max_bytes(max_bytes_p) {}
+    //============================================================================
+
+    void IIIFWatermarkCache::drop_scaled(const std::string &path) {
+        for (auto it = lru.begin(); it != lru.end();) {
+            if (it->path == path) {
+                auto slot = table.find(*it);
+                nbytes -= slot->second.values->size();
+                table.erase(slot);
+                it = lru.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    //============================================================================
+
+    std::shared_ptr<const IIIFWatermarkCache::Watermark> IIIFWatermarkCache::watermark(const std::string &path) {
+        std::error_code ec;
+        auto mtime = std::filesystem::last_write_time(path, ec);
+        if (ec) {
+            std::lock_guard<std::mutex> lock(locking);
+            watermarks.erase(path);
+            drop_scaled(path);
+            return nullptr;
+        }
+        {
+            std::lock_guard<std::mutex> lock(locking);
+            auto it = watermarks.find(path);
+            if ((it != watermarks.end()) && (it->second->mtime == mtime)) return it->second;
+        }
+
+        //
+        // read without holding the lock. The scaled watermarks of an older version of the file
+        // are dropped.
+        //
+        ++n_loads;
+        auto wm = std::make_shared<Watermark>();
+        wm->mtime = mtime;
+        wm->pixels = loader(path, wm->nx, wm->ny, wm->nc);
+        if (wm->pixels.empty() || (wm->nx == 0) || (wm->ny == 0) || (wm->nc == 0)) return nullptr;
+
+        std::lock_guard<std::mutex> lock(locking);
+        auto it = watermarks.find(path);
+        if ((it != watermarks.end()) && (it->second->mtime == mtime)) return it->second;
+        drop_scaled(path);
+        watermarks[path] = wm;
+        return wm;
+    }
+    //============================================================================
+
+    IIIFWatermarkCache::Values IIIFWatermarkCache::get(const std::string &path, uint32_t nx, uint32_t ny) {
+        auto wm = watermark(path);
+        if (wm == nullptr) return nullptr;
+        Key key{path, nx, ny};
+        {
+            std::lock_guard<std::mutex> lock(locking);
+            auto it = table.find(key);
+            if (it != table.end()) {
+                lru.splice(lru.begin(), lru, it->second.lru_pos);
+                ++n_hits;
+                return it->second.values;
+            }
+        }
+        ++n_misses;
+
+        auto values = std::make_shared<const std::vector<uint8_t>>(scaleWatermark(wm->pixels, wm->nx, wm->ny, wm->nc, nx, ny));
+
+        std::lock_guard<std::mutex> lock(locking);
+        auto wit = watermarks.find(path);
+        if ((wit == watermarks.end()) || (wit->second != wm)) return values; // the file has been replaced meanwhile
+        auto it = table.find(key);
+        if (it != table.end()) {
+            lru.splice(lru.begin(), lru, it->second.lru_pos);
+            return it->second.values;
+        }
+        if (values->size() > max_bytes) return values;
+        while (nbytes + values->size() > max_bytes) {
+            auto slot = table.find(lru.back());
+            nbytes -= slot->second.values->size();
+            table.erase(slot);
+            lru.pop_back();
+        }
+        lru.push_front(key);
+        table[key] = Slot{values, lru.begin()};
+        nbytes += values->size();
+        return values;
+    }
+    //============================================================================
+
+    void IIIFWatermarkCache::clear() {
+        std::lock_guard<std::mutex> lock(locking);
+        table.clear();
+        lru.clear();
+        watermarks.clear();
+        nbytes = 0;
+    }
+    //============================================================================
+
+    size_t IIIFWatermarkCache::getBytes() {
+        std::lock_guard<std::mutex> lock(locking);
+        return nbytes;
+    }
+    //============================================================================
+
+}
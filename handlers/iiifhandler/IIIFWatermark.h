@@ -0,0 +1,172 @@
+/*
+ * Copyright © 2022 Lukas Rosenthaler
+ * This file is part of OMAS/cserve
+ * OMAS/cserve is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * OMAS/cserve is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef __defined_iiif_watermark_h
+#define __defined_iiif_watermark_h
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cserve {
+
+    /*!
+     * Scale a watermark (8 bit, the first channel is used) bilinearly to the size of an image
+     * and compute the given rows. There is one value per pixel, it is used for all channels
+     * of the image (see blendWatermark()).
+     *
+     * \param[in] wm Pixels of the watermark
+     * \param[in] wm_nx Width of the watermark
+     * \param[in] wm_ny Height of the watermark
+     * \param[in] wm_nc Number of channels of the watermark
+     * \param[in] nx Width of the image
+     * \param[in] ny Height of the image
+     * \param[in] first First row
+     * \param[in] last Row after the last row
+     * \param[out] values nx * (last - first) watermark values
+     */
+    void scaleWatermarkRows(const std::vector<uint8_t> &wm, uint32_t wm_nx, uint32_t wm_ny, uint32_t wm_nc,
+                            uint32_t nx, uint32_t ny, uint32_t first, uint32_t last, uint8_t *values);
+
+    /*!
+     * Scale a watermark to the size of an image (see scaleWatermarkRows())
+     *
+     * \returns nx * ny watermark values
+     */
+    std::vector<uint8_t> scaleWatermark(const std::vector<uint8_t> &wm, uint32_t wm_nx, uint32_t wm_ny, uint32_t wm_nc,
+                                        uint32_t nx, uint32_t ny);
+
+    /*!
+     * Process-wide cache of watermarks.
+     *
+     * Watermarked collections add the watermark to every tile. The cache keeps the decoded
+     * watermark files, and the watermarks scaled to the sizes of the recent images (most
+     * tiles have the same size). A watermark file is read again if its modification time
+     * has changed. The scaled watermarks are kept up to a total size, the least recently
+     * used are dropped first. Larger images are not kept, their watermark is best scaled
+     * band by band with scaleWatermarkRows() (see fits()).
+     */
+    class IIIFWatermarkCache {
+    public:
+        /*!
+         * Function reading a watermark file (see read_watermark()). It returns an empty vector
+         * if the file can't be read.
+         */
+        typedef std::function<std::vector<uint8_t>(const std::string &path, uint32_t &nx, uint32_t &ny, uint32_t &nc)> Loader;
+
+        typedef std::shared_ptr<const std::vector<uint8_t>> Values;
+
+        typedef struct {
+            std::filesystem::file_time_type mtime;
+            uint32_t nx;
+            uint32_t ny;
+            uint32_t nc;
+            std::vector<uint8_t> pixels;
+        } Watermark;
+
+    private:
+        typedef struct Key_ {
+            std::string path;
+            uint32_t nx;
+            uint32_t ny;
+
+            bool operator==(const Key_ &other) const {
+                return (nx == other.nx) && (ny == other.ny) && (path == other.path);
+            }
+        } Key;
+
+        struct KeyHash {
+            size_t operator()(const Key &key) const;
+        };
+
+        typedef std::list<Key> LruList;
+
+        typedef struct {
+            Values values;
+            LruList::iterator lru_pos;
+        } Slot;
+
+        std::mutex locking;
+        Loader loader;
+        std::unordered_map<std::string, std::shared_ptr<const Watermark>> watermarks;
+        std::unordered_map<Key, Slot, KeyHash> table;
+        LruList lru; //!< most recently used first
+        size_t max_bytes;
+        size_t nbytes{0};
+        std::atomic<unsigned long long> n_hits{0};
+        std::atomic<unsigned long long> n_misses{0};
+        std::atomic<unsigned long long> n_loads{0};
+
+        void drop_scaled(const std::string &path);
+
+    public:
+        /*!
+         * Constructor
+         *
+         * @param max_bytes_p Maximal total size of the scaled watermarks
+         * @param loader_p Function reading a watermark file
+         */
+        IIIFWatermarkCache(size_t max_bytes_p, Loader loader_p);
+
+        IIIFWatermarkCache(const IIIFWatermarkCache&) = delete;
+
+        IIIFWatermarkCache &operator=(const IIIFWatermarkCache&) = delete;
+
+        /*!
+         * Get a watermark file as it has been read
+         *
+         * @param path Path of the watermark file
+         * @return The watermark, nullptr if the file can't be read
+         */
+        std::shared_ptr<const Watermark> watermark(const std::string &path);
+
+        /*!
+         * Get a watermark scaled to the size of an image
+         *
+         * @param path Path of the watermark file
+         * @param nx Width of the image
+         * @param ny Height of the image
+         * @return nx * ny watermark values (see scaleWatermark()), nullptr if the file can't be read
+         */
+        Values get(const std::string &path, uint32_t nx, uint32_t ny);
+
+        /*!
+         * True, if the watermark scaled to the given size can be kept in the cache
+         */
+        [[nodiscard]] inline bool fits(uint32_t nx, uint32_t ny) const {
+            return static_cast<size_t>(nx) * ny <= max_bytes;
+        }
+
+        /*!
+         * Remove all watermarks
+         */
+        void clear();
+
+        [[nodiscard]] inline unsigned long long hits() const { return n_hits; }
+
+        [[nodiscard]] inline unsigned long long misses() const { return n_misses; }
+
+        [[nodiscard]] inline unsigned long long loads() const { return n_loads; } //!< watermark files read
+
+        size_t getBytes(); //!< total size of the scaled watermarks
+    };
+
+}
+
+#endif
@@ -26,6 +26,7 @@
 #include "Connection.h"
 
 #include "../IIIFError.h"
+#include "../IIIFBufferPool.h"
 #include "IIIFIOJ2k.h"
 
 
@@ -493,7 +494,7 @@ namespace cserve {
         if (force_bps_8) img.bps = 8; // forces kakadu to convert to 8 bit!
         switch (img.bps) {
             case 8: {
-                auto buffer8 = std::vector<uint8_t>(dims.area() * img.nc);
+                auto buffer8 = acquirePixels<uint8_t>(dims.area() * img.nc);
                 kdu_core::kdu_byte *raw_buffer8 = buffer8.data();
                 try {
                     decompressor.pull_stripe(raw_buffer8, stripe_heights);
@@ -510,7 +511,7 @@ namespace cserve {
             }
             case 12: {
                 std::vector<char> get_signed(img.nc, 0); // vector<bool> does not work -> special treatment in C++
-                auto buffer16 = std::vector<uint16_t>(dims.area() * img.nc);
+                auto buffer16 = acquirePixels<uint16_t>(dims.area() * img.nc);
                 auto raw_buffer16 = (kdu_core::kdu_int16 *) buffer16.data();
                 try {
                     decompressor.pull_stripe(raw_buffer16,
@@ -533,7 +534,7 @@ namespace cserve {
             }
             case 16: {
                 std::vector<char> get_signed(img.nc, 0); // vector<bool> does not work -> special treatment in C++
-                auto buffer16 = std::vector<uint16_t>(dims.area() * img.nc);
+                auto buffer16 = acquirePixels<uint16_t>(dims.area() * img.nc);
                 auto raw_buffer16 = (kdu_core::kdu_int16 *) buffer16.data();
                 try {
                     decompressor.pull_stripe(raw_buffer16,
@@ -579,6 +580,7 @@ namespace cserve {
                     tmpbuf[3 * (y * img.nx + x) + 2] = blut[img.bpixels[y * img.nx + x]];
                 }
             }
+            releasePixels(std::move(img.bpixels));
             img.bpixels = std::move(tmpbuf);
             img.nc = numcol;
         }
@@ -13,13 +13,18 @@
 #include <unistd.h>
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <functional>
 #include <iostream>
 #include <cstring>
 
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <cstdio>
 
 #include "../IIIFError.h"
+#include "../IIIFBufferPool.h"
+#include "../IIIFComputePool.h"
 #include "../iiifparser/IIIFSize.h"
 #include "IIIFIOJpeg.h"
 #include "Connection.h"
@@ -27,6 +32,7 @@
 
 #include "jpeglib.h"
 #include "jerror.h"
+#include "turbojpeg.h"
 #include "spdlog/fmt/bundled/format.h"
 
 #define ICC_MARKER  (JPEG_APP0 + 2)    /* JPEG marker code for ICC */
@@ -448,12 +454,13 @@ namespace cserve {
     //=============================================================================
 
 
-    IIIFImage IIIFIOJpeg::read(const std::string &filepath,
-                               std::shared_ptr<IIIFRegion> region,
-                               std::shared_ptr<IIIFSize> size,
-                               bool force_bps_8,
-                               ScalingQuality scaling_quality)
-    {
+    /*!
+     * Opens a JPEG file, creates the decompressor and reads the header with the markers.
+     * The caller has to destroy the decompressor and to close the file descriptor returned.
+     */
+    static int jpeg_open_file(const std::string &filepath,
+                              struct jpeg_decompress_struct *cinfo,
+                              struct jpeg_error_mgr *jerr) {
         int infile;
         //
         // open the input file
@@ -475,31 +482,23 @@ namespace cserve {
         // move infile position back to the beginning of the file
         ::lseek(infile, 0, SEEK_SET);
 
-        struct jpeg_decompress_struct cinfo{};
-        struct jpeg_error_mgr jerr{};
-
-        JSAMPARRAY linbuf;
-        jpeg_saved_marker_ptr marker;
-
         //
         // let's create the decompressor
         //
-        jpeg_create_decompress (&cinfo);
-
-        cinfo.dct_method = JDCT_FLOAT;
+        jpeg_create_decompress (cinfo);
 
-        cinfo.err = jpeg_std_error(&jerr);
-        jerr.error_exit = jpegErrorExit;
+        cinfo->err = jpeg_std_error(jerr);
+        jerr->error_exit = jpegErrorExit;
 
         try {
-            //jpeg_stdio_src(&cinfo, infile);
-            jpeg_file_src(&cinfo, infile);
-            jpeg_save_markers(&cinfo, JPEG_COM, 0xffff);
+            //jpeg_stdio_src(cinfo, infile);
+            jpeg_file_src(cinfo, infile);
+            jpeg_save_markers(cinfo, JPEG_COM, 0xffff);
             for (int i = 0; i < 16; i++) {
-                jpeg_save_markers(&cinfo, JPEG_APP0 + i, 0xffff);
+                jpeg_save_markers(cinfo, JPEG_APP0 + i, 0xffff);
             }
         } catch (JpegError &jpgerr) {
-            jpeg_destroy_decompress(&cinfo);
+            jpeg_destroy_decompress(cinfo);
             close(infile);
             throw IIIFImageError(file_, __LINE__, fmt::format("Error reading JPEG file: '{}' Error: {}", filepath, jpgerr.what()));
         }
@@ -509,57 +508,172 @@ namespace cserve {
         //
         int res;
         try {
-            res = jpeg_read_header(&cinfo, TRUE);
+            res = jpeg_read_header(cinfo, TRUE);
         } catch (JpegError &jpgerr) {
-            jpeg_destroy_decompress(&cinfo);
+            jpeg_destroy_decompress(cinfo);
             close(infile);
             throw IIIFImageError(file_, __LINE__, fmt::format("Error reading JPEG file: '{}' Error: {}", filepath, jpgerr.what()));
         }
         if (res != JPEG_HEADER_OK) {
-            jpeg_destroy_decompress(&cinfo);
+            jpeg_destroy_decompress(cinfo);
             close(infile);
             throw IIIFImageError(file_, __LINE__, fmt::format("Error reading JPEG file: '{}'", filepath));
         }
+        return infile;
+    }
+    //=============================================================================
 
-        boolean no_cropping = false;
-        if (region == nullptr) no_cropping = true;
-        if ((region != nullptr) && (region->getType()) == IIIFRegion::FULL) no_cropping = true;
-
-        uint32_t nnx, nny;
-        IIIFSize::SizeType rtype = IIIFSize::FULL;
-        if (size != nullptr) {
-            rtype = size->get_type();
+    /*!
+     * The photometric interpretation of the decompressed scanlines
+     */
+    static PhotometricInterpretation jpeg_photometric(J_COLOR_SPACE colspace) {
+        switch (colspace) { // JCS_UNKNOWN, JCS_GRAYSCALE, JCS_RGB, JCS_YCbCr, JCS_CMYK, JCS_YCCK
+            case JCS_RGB: {
+                return RGB;
+            }
+            case JCS_GRAYSCALE: {
+                return MINISBLACK;
+            }
+            case JCS_CMYK: {
+                return SEPARATED;
+            }
+            case JCS_YCbCr: {
+                return YCBCR;
+            }
+            case JCS_YCCK: {
+                throw IIIFImageError(file_, __LINE__, "Unsupported JPEG colorspace (JCS_YCCK)!");
+            }
+            case JCS_UNKNOWN: {
+                throw IIIFImageError(file_, __LINE__, "Unsupported JPEG colorspace (JCS_UNKNOWN)!");
+            }
+            default: {
+                throw IIIFImageError(file_, __LINE__, "Unsupported JPEG colorspace!");
+            }
         }
+    }
+    //=============================================================================
 
-        if (no_cropping) {
-            //
-            // here we prepare tha scaling/reduce stuff...
-            //
-            uint32_t reduce = 0;
-            bool redonly = true; // we assume that only a reduce is necessary
-            if ((size != nullptr) && (rtype != IIIFSize::FULL)) {
-                size->get_size(cinfo.image_width, cinfo.image_height, nnx, nny, reduce, redonly);
+    /*!
+     * The libjpeg implementation of a DCT method. libjpeg-turbo has SIMD versions of all of them,
+     * the accurate integer DCT is as fast as the floating point one.
+     */
+    static J_DCT_METHOD jpeg_dct_method(DctMethod method) {
+        switch (method) {
+            case DCT_IFAST: {
+                return JDCT_IFAST;
             }
-            else {
-                reduce = 1;
+            case DCT_FLOAT: {
+                return JDCT_FLOAT;
+            }
+            default: {
+                return JDCT_ISLOW;
             }
+        }
+    }
+    //=============================================================================
 
-            cinfo.scale_num = 1;
-            cinfo.scale_denom = reduce;
+    bool IIIFIOJpeg::dct_method_from_name(const std::string &name, DctMethod &method) {
+        if (name == "islow") {
+            method = DCT_ISLOW;
+        } else if (name == "ifast") {
+            method = DCT_IFAST;
+        } else if (name == "float") {
+            method = DCT_FLOAT;
+        } else {
+            return false;
         }
-        cinfo.do_fancy_upsampling = false;
+        return true;
+    }
+    //=============================================================================
 
-        IIIFImage img{};
-        img.bps = 8;
-        //img.nx = cinfo.output_width;
-        //img.ny = cinfo.output_height;
-        //img.nc = cinfo.output_components;
-        img.orientation = TOPLEFT; // may be changed in parse_photoshop or EXIF marker
+    bool IIIFIOJpeg::subsampling_from_name(const std::string &name, int &h_samp, int &v_samp) {
+        if (name == "4:4:4") {
+            h_samp = 1;
+            v_samp = 1;
+        } else if (name == "4:2:2") {
+            h_samp = 2;
+            v_samp = 1;
+        } else if (name == "4:2:0") {
+            h_samp = 2;
+            v_samp = 2;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    //=============================================================================
+
+    /*!
+     * Get a "yes"/"no" parameter of the encoder
+     */
+    static bool jpeg_flag(const IIIFCompressionParams &params, int name, bool def) {
+        auto param = params.find(name);
+        if (param == params.end()) return def;
+        if (param->second == "yes") return true;
+        if (param->second == "no") return false;
+        throw IIIFImageError(file_, __LINE__, fmt::format("Invalid JPEG compression parameter \"{}\" (must be \"yes\" or \"no\")", param->second));
+    }
+    //=============================================================================
+
+    /*!
+     * The requested region within the scanlines decompressed after jpeg_crop_region()
+     */
+    typedef struct {
+        uint32_t x;       //!< first column of the region in the decompressed scanlines
+        uint32_t width;   //!< width of the region
+        uint32_t height;  //!< number of scanlines covering the region
+    } JpegWindow;
+
+    /*!
+     * Restricts the decompression to the part of the image covering a region, must be called
+     * after jpeg_start_decompress(). The region (in the coordinates of the full image) is mapped
+     * to the DCT-scaled output and rounded outwards. The scanlines above the region are skipped:
+     * they are entropy decoded (there is no other way to find the data that follows), but not
+     * transformed (IDCT), upsampled and color converted. Only the iMCU columns covering the
+     * region are transformed; afterwards cinfo->output_width is the width of these columns.
+     * The scanlines below the region don't have to be read at all (see jpeg_abort_decompress()).
+     */
+    static JpegWindow jpeg_crop_region(struct jpeg_decompress_struct *cinfo, int32_t x, int32_t y, uint32_t w, uint32_t h) {
+        const uint64_t out_w = cinfo->output_width;
+        const uint64_t out_h = cinfo->output_height;
+        const uint64_t img_w = cinfo->image_width;
+        const uint64_t img_h = cinfo->image_height;
+        const auto sx = static_cast<JDIMENSION>(static_cast<uint64_t>(x) * out_w / img_w);
+        const auto sy = static_cast<JDIMENSION>(static_cast<uint64_t>(y) * out_h / img_h);
+        const auto ex = static_cast<JDIMENSION>(std::min(((x + w) * out_w + img_w - 1) / img_w, out_w));
+        const auto ey = static_cast<JDIMENSION>(std::min(((y + h) * out_h + img_h - 1) / img_h, out_h));
+
+        JDIMENSION xoffset = sx;
+        JDIMENSION width = ex - sx;
+        jpeg_crop_scanline(cinfo, &xoffset, &width); // widened to the iMCU columns
+        if (sy > 0) jpeg_skip_scanlines(cinfo, sy);
+        return JpegWindow{sx - xoffset, ex - sx, ey - sy};
+    }
+    //=============================================================================
+
+    /*!
+     * Decompresses the next nrows scanlines directly into buf, as many per call as the
+     * decompressor delivers at once
+     */
+    static void jpeg_read_rows(struct jpeg_decompress_struct *cinfo, uint8_t *buf, size_t sll, uint32_t nrows) {
+        std::vector<JSAMPROW> rows(nrows);
+        for (uint32_t i = 0; i < nrows; i++) {
+            rows[i] = buf + i * sll;
+        }
+        uint32_t n = 0;
+        while (n < nrows) {
+            JDIMENSION nread = jpeg_read_scanlines(cinfo, rows.data() + n, nrows - n);
+            if (nread == 0) throw JpegError("Premature end of JPEG data");
+            n += nread;
+        }
+    }
+    //=============================================================================
 
+    void IIIFIOJpeg::parse_markers(IIIFImage &img, struct jpeg_decompress_struct *cinfo, const std::string &filepath) {
         //
         // getting Metadata
         //
-        marker = cinfo.marker_list;
+        jpeg_saved_marker_ptr marker = cinfo->marker_list;
         unsigned char *icc_buffer = nullptr;
         int icc_buffer_len = 0;
         while (marker) {
@@ -657,8 +771,6 @@ namespace cserve {
                     auto *tmpptr = (unsigned char *) realloc(icc_buffer, icc_buffer_len + len);
                     if (tmpptr == nullptr) { // cleanup
                         free (icc_buffer);
-                        jpeg_destroy_decompress(&cinfo);
-                        close(infile);
                         throw IIIFImageError(file_, __LINE__, fmt::format("Error reading JPEG file '{}'. realloc failed!", filepath));
                     }
                     icc_buffer = tmpptr;
@@ -684,6 +796,79 @@ namespace cserve {
         }
         if (icc_buffer != nullptr) {
             img.icc = std::make_shared<IIIFIcc>(icc_buffer, icc_buffer_len);
+            free(icc_buffer);
+        }
+    }
+    //============================================================================
+
+    IIIFImage IIIFIOJpeg::read(const std::string &filepath,
+                               std::shared_ptr<IIIFRegion> region,
+                               std::shared_ptr<IIIFSize> size,
+                               bool force_bps_8,
+                               ScalingQuality scaling_quality)
+    {
+        struct jpeg_decompress_struct cinfo{};
+        struct jpeg_error_mgr jerr{};
+
+        int infile = jpeg_open_file(filepath, &cinfo, &jerr);
+
+        boolean no_cropping = false;
+        if (region == nullptr) no_cropping = true;
+        if ((region != nullptr) && (region->getType()) == IIIFRegion::FULL) no_cropping = true;
+
+        uint32_t nnx, nny;
+        IIIFSize::SizeType rtype = IIIFSize::FULL;
+        if (size != nullptr) {
+            rtype = size->get_type();
+        }
+        const bool scaling = (size != nullptr) && (rtype != IIIFSize::FULL);
+
+        //
+        // the region in the coordinates of the full image
+        //
+        int32_t x = 0, y = 0;
+        uint32_t w = cinfo.image_width, h = cinfo.image_height;
+        if (!no_cropping) {
+            try {
+                region->crop_coords(cinfo.image_width, cinfo.image_height, x, y, w, h);
+            } catch (IIIFError &err) {
+                jpeg_destroy_decompress(&cinfo);
+                close(infile);
+                throw IIIFImageError(file_, __LINE__, err.to_string());
+            }
+        }
+
+        //
+        // here we prepare tha scaling/reduce stuff: the decompressor reduces the image (or the
+        // region) by the largest possible factor in the DCT domain, the rest is done by the resampler
+        //
+        uint32_t reduce = 0;
+        bool redonly = true; // we assume that only a reduce is necessary
+        if (scaling) {
+            size->get_size(w, h, nnx, nny, reduce, redonly);
+        } else {
+            reduce = 1;
+            nnx = w;
+            nny = h;
+        }
+        cinfo.scale_num = 1;
+        cinfo.scale_denom = reduce;
+        cinfo.do_fancy_upsampling = false;
+        cinfo.dct_method = jpeg_dct_method(scaling_quality.jpeg_dct); // jpeg_read_header() has set the default
+
+        IIIFImage img{};
+        img.bps = 8;
+        //img.nx = cinfo.output_width;
+        //img.ny = cinfo.output_height;
+        //img.nc = cinfo.output_components;
+        img.orientation = TOPLEFT; // may be changed in parse_photoshop or EXIF marker
+
+        try {
+            parse_markers(img, &cinfo, filepath);
+        } catch (IIIFImageError &err) {
+            jpeg_destroy_decompress(&cinfo);
+            close(infile);
+            throw;
         }
 
         try {
@@ -695,56 +880,40 @@ namespace cserve {
         }
 
 
+        //
+        // with a region, only the scanlines and iMCU columns covering it are decompressed
+        //
+        JpegWindow window{0, cinfo.output_width, cinfo.output_height};
+        try {
+            if (!no_cropping) window = jpeg_crop_region(&cinfo, x, y, w, h);
+        } catch (JpegError &jpgerr) {
+            jpeg_destroy_decompress(&cinfo);
+            close(infile);
+            throw IIIFImageError(file_, __LINE__, fmt::format("Error reading JPEG file '{}'. Error: {}", filepath, jpgerr.what()));
+        }
+
         img.bps = 8;
         img.nx = cinfo.output_width;
-        img.ny = cinfo.output_height;
+        img.ny = window.height;
         img.nc = cinfo.output_components;
 
-        int colspace = cinfo.out_color_space; // JCS_UNKNOWN, JCS_GRAYSCALE, JCS_RGB, JCS_YCbCr, JCS_CMYK, JCS_YCCK
-        switch (colspace) {
-            case JCS_RGB: {
-                img.photo = RGB;
-                break;
-            }
-            case JCS_GRAYSCALE: {
-                img.photo = MINISBLACK;
-                break;
-            }
-            case JCS_CMYK: {
-                img.photo = SEPARATED;
-                break;
-            }
-            case JCS_YCbCr: {
-                img.photo = YCBCR;
-                break;
-            }
-            case JCS_YCCK: {
-                throw IIIFImageError(file_, __LINE__, "Unsupported JPEG colorspace (JCS_YCCK)!");
-            }
-            case JCS_UNKNOWN: {
-                throw IIIFImageError(file_, __LINE__, "Unsupported JPEG colorspace (JCS_UNKNOWN)!");
-            }
-            default: {
-                throw IIIFImageError(file_, __LINE__, "Unsupported JPEG colorspace!");
-            }
-        }
+        img.photo = jpeg_photometric(cinfo.out_color_space);
         uint32_t sll = cinfo.output_components * cinfo.output_width * sizeof(uint8_t);
 
-        img.bpixels = std::vector<uint8_t>(img.ny * sll);
-        byte *rawbuf = img.bpixels.data();
+        img.bpixels = acquirePixels<uint8_t>(img.ny * sll);
         try {
-            linbuf = (*cinfo.mem->alloc_sarray)((j_common_ptr) &cinfo, JPOOL_IMAGE, sll, 1);
-            for (size_t i = 0; i < img.ny; i++) {
-                jpeg_read_scanlines(&cinfo, linbuf, 1);
-                memcpy(&(rawbuf[i * sll]), linbuf[0], (size_t) sll);
-            }
+            jpeg_read_rows(&cinfo, img.bpixels.data(), sll, img.ny);
         } catch (JpegError &jpgerr) {
             jpeg_destroy_decompress(&cinfo);
             close(infile);
             throw IIIFImageError(file_, __LINE__, fmt::format("Error reading JPEG file: '{}': Error: {}", filepath, jpgerr.what()));
         }
         try {
-            jpeg_finish_decompress(&cinfo);
+            if (cinfo.output_scanline < cinfo.output_height) {
+                jpeg_abort_decompress(&cinfo); // the scanlines below the region aren't needed
+            } else {
+                jpeg_finish_decompress(&cinfo);
+            }
         } catch (JpegError &jpgerr) {
             close(infile);
             throw IIIFImageError(file_, __LINE__, fmt::format("Error reading JPEG file: '{}': Error: {}", filepath, jpgerr.what()));
@@ -759,45 +928,134 @@ namespace cserve {
         close(infile);
 
         //
-        // do some cropping...
+        // crop the region out of the decompressed iMCU columns and scale it to the desired
+        // size in one pass
         //
         if (!no_cropping) { // not no cropping (!!) means "do crop"!
-            //
-            // let's first crop the region (we read the full size image in this case)
-            //
-            (void) img.crop(region);
+            if ((window.x != 0) || (window.width != img.nx) || scaling) {
+                auto window_region = std::make_shared<IIIFRegion>(window.x, 0, window.width, window.height);
+                img.cropAndScale(window_region, nnx, nny, scaling_quality.jpeg);
+            }
+        } else if (scaling) {
+            img.cropAndScale(nullptr, nnx, nny, scaling_quality.jpeg);
+        }
 
-            //
-            // no we scale the region to the desired size
-            //
-            uint32_t reduce = 0;
-            bool redonly;
-            (void) size->get_size(img.nx, img.ny,
-                                  nnx, nny, reduce, redonly);
+        return img;
+    }
+    //============================================================================
+
+
+    namespace {
+        /*!
+         * Delivers the scanlines of a JPEG file while they are decompressed
+         */
+        class JpegStripSource : public IIIFStripSource {
+        private:
+            struct jpeg_decompress_struct cinfo{};
+            struct jpeg_error_mgr jerr{};
+            int infile;
+            std::string filepath;
+            uint32_t end_scanline{0}; //!< the scanlines below aren't read
+
+        public:
+            explicit JpegStripSource(const std::string &filepath_p)
+                    : IIIFStripSource(IIIFImage()), filepath(filepath_p) {
+                infile = jpeg_open_file(filepath, &cinfo, &jerr);
+            }
+
+            ~JpegStripSource() override {
+                jpeg_destroy_decompress(&cinfo); // also if not all scanlines have been read
+                close(infile);
+            }
+
+            inline struct jpeg_decompress_struct *decompressor() { return &cinfo; }
+
+            inline void set_header(IIIFImage header_p) {
+                end_scanline = cinfo.output_scanline + header_p.getNy();
+                shell = std::move(header_p);
+            }
+
+            uint32_t read(uint8_t *buf, uint32_t nrows) override {
+                const size_t sll = row_size();
+                nrows = std::min(nrows, end_scanline - cinfo.output_scanline);
+                try {
+                    jpeg_read_rows(&cinfo, buf, sll, nrows);
+                } catch (JpegError &jpgerr) {
+                    throw IIIFImageError(file_, __LINE__, fmt::format("Error reading JPEG file: '{}': Error: {}", filepath, jpgerr.what()));
+                }
+                return nrows;
+            }
+        };
+    }
+
+    std::unique_ptr<IIIFStripSource> IIIFIOJpeg::read_strips(const std::string &filepath,
+                                                             std::shared_ptr<IIIFRegion> region,
+                                                             std::shared_ptr<IIIFSize> size,
+                                                             bool force_bps_8,
+                                                             ScalingQuality scaling_quality) {
+        auto source = std::make_unique<JpegStripSource>(filepath);
+        struct jpeg_decompress_struct *cinfo = source->decompressor();
+
+        bool no_cropping = (region == nullptr) || (region->getType() == IIIFRegion::FULL);
+        IIIFSize::SizeType rtype = (size != nullptr) ? size->get_type() : IIIFSize::FULL;
+        const bool scaling = (size != nullptr) && (rtype != IIIFSize::FULL);
+
+        int32_t x = 0, y = 0;
+        uint32_t w = cinfo->image_width, h = cinfo->image_height;
+        if (!no_cropping) {
+            try {
+                region->crop_coords(cinfo->image_width, cinfo->image_height, x, y, w, h);
+            } catch (IIIFError &err) {
+                throw IIIFImageError(file_, __LINE__, err.to_string());
+            }
         }
 
         //
-        // resize/Scale the image if necessary
+        // the decompressor reduces the image (or the region) by the largest possible factor, the rest
+        // is done by the resampler
         //
-        if ((size != nullptr) && (rtype != IIIFSize::FULL)) {
-            switch (scaling_quality.jpeg) {
-                case HIGH:
-                    img.scale(nnx, nny);
-                    break;
-                case MEDIUM:
-                    img.scaleMedium(nnx, nny);
-                    break;
-                case LOW:
-                    img.scaleFast(nnx, nny);
-                    break;
-            }
+        uint32_t nnx = w, nny = h;
+        uint32_t reduce = 1;
+        bool redonly = true;
+        if (scaling) {
+            reduce = 0;
+            size->get_size(w, h, nnx, nny, reduce, redonly);
         }
+        cinfo->scale_num = 1;
+        cinfo->scale_denom = reduce;
+        cinfo->do_fancy_upsampling = false;
+        cinfo->dct_method = jpeg_dct_method(scaling_quality.jpeg_dct);
 
-        return img;
+        IIIFImage img{};
+        img.bps = 8;
+        img.orientation = TOPLEFT; // may be changed in parse_photoshop or EXIF marker
+        parse_markers(img, cinfo, filepath);
+
+        JpegWindow window{0, 0, 0};
+        try {
+            jpeg_start_decompress(cinfo);
+            window = JpegWindow{0, cinfo->output_width, cinfo->output_height};
+            if (!no_cropping) window = jpeg_crop_region(cinfo, x, y, w, h);
+        } catch (JpegError &jpgerr) {
+            throw IIIFImageError(file_, __LINE__, fmt::format("Error reading JPEG file '{}'. Error: {}", filepath, jpgerr.what()));
+        }
+        img.nx = cinfo->output_width;
+        img.ny = window.height;
+        img.nc = cinfo->output_components;
+        img.photo = jpeg_photometric(cinfo->out_color_space);
+        source->set_header(std::move(img));
+
+        std::unique_ptr<IIIFStripSource> strips = std::move(source);
+        if ((window.x != 0) || (window.width != strips->header().getNx())) {
+            strips = std::make_unique<IIIFStripCrop>(std::move(strips), window.x, 0, window.width, window.height);
+        }
+        if (scaling) {
+            strips = std::make_unique<IIIFStripResample>(std::move(strips), nnx, nny, scaling_quality.jpeg);
+        }
+        return strips;
     }
     //============================================================================
 
-
     IIIFImgInfo IIIFIOJpeg::getDim(const std::string &filepath) {
         // portions derived from IJG code */
 
@@ -835,8 +1093,6 @@ namespace cserve {
 
         jpeg_create_decompress (&cinfo);
 
-        cinfo.dct_method = JDCT_FLOAT;
-
         cinfo.err = jpeg_std_error(&jerr);
         jerr.error_exit = jpegErrorExit;
 
@@ -1003,9 +1259,201 @@ namespace cserve {
     //============================================================================
 
 
+    /*!
+     * A JPEG stream compressed to memory (see jpeg_mem_dest())
+     */
+    typedef struct JpegMemory_ {
+        unsigned char *buffer{nullptr};
+        unsigned long size{0};
+
+        JpegMemory_() = default;
+
+        JpegMemory_(const JpegMemory_ &) = delete;
+
+        JpegMemory_ &operator=(const JpegMemory_ &) = delete;
+
+        ~JpegMemory_() { free(buffer); }
+
+        void release() {
+            free(buffer);
+            buffer = nullptr;
+            size = 0;
+        }
+    } JpegMemory;
+
+    /*!
+     * Writes the bytes of a JPEG stream to the destination
+     */
+    typedef std::function<void(const JOCTET *data, size_t len)> JpegSink;
+
+    /*!
+     * Number of rows of the stripes which are compressed in parallel. A stripe is one restart
+     * interval, i.e. a multiple of the MCU height with at most 65535 MCUs. About a megapixel
+     * per stripe keeps the overhead of the restart markers and of the compressors small.
+     */
+    static uint32_t jpeg_stripe_rows(uint32_t nx, uint32_t mcu_width, uint32_t mcu_height) {
+        const uint32_t mcus_per_row = (nx + mcu_width - 1) / mcu_width;
+        uint32_t mcu_rows = std::max((1u << 20) / (nx * mcu_height), 1u);
+        mcu_rows = std::min(mcu_rows, 65535 / mcus_per_row);
+        return mcu_rows * mcu_height;
+    }
+    //=============================================================================
+
+    /*!
+     * Offset of the marker segment with the given marker code in the header of a JPEG stream,
+     * len if there is none before the first scan
+     */
+    static size_t jpeg_find_segment(const JOCTET *data, size_t len, JOCTET marker) {
+        size_t pos = 2; // SOI
+        while (pos + 4 <= len) {
+            if (data[pos] != 0xff) break;
+            if (data[pos + 1] == 0xff) { // fill byte
+                pos++;
+                continue;
+            }
+            if (data[pos + 1] == marker) return pos;
+            if (data[pos + 1] == 0xda) break; // SOS, the header ends
+            pos += 2 + ((static_cast<size_t>(data[pos + 2]) << 8) | data[pos + 3]);
+        }
+        return len;
+    }
+    //=============================================================================
+
+    /*!
+     * Offset of the entropy-coded data of the (only) scan of a JPEG stream. It ends before the EOI marker.
+     */
+    static size_t jpeg_scan_data(const JOCTET *data, size_t len) {
+        const size_t sos = jpeg_find_segment(data, len, 0xda);
+        if ((sos + 4 > len) || (len < 2) || (data[len - 2] != 0xff) || (data[len - 1] != 0xd9)) {
+            throw IIIFImageError(file_, __LINE__, "Compressed JPEG stripe is invalid");
+        }
+        return sos + 2 + ((static_cast<size_t>(data[sos + 2]) << 8) | data[sos + 3]);
+    }
+    //=============================================================================
+
+    /*!
+     * Compress the rows of a stripe to memory with the settings of the image (color space,
+     * sampling, quantization, DCT and the standard Huffman tables), so that its entropy-coded
+     * data can be placed into the scan of the image as one restart interval
+     */
+    static void jpeg_compress_stripe(const struct jpeg_compress_struct *image, int quality,
+                                     const uint8_t *rows, uint32_t nrows, JpegMemory &out) {
+        struct jpeg_compress_struct cinfo{};
+        struct jpeg_error_mgr jerr{};
+        cinfo.err = jpeg_std_error(&jerr);
+        jerr.error_exit = jpegErrorExit;
+        try {
+            jpeg_create_compress(&cinfo);
+            jpeg_mem_dest(&cinfo, &out.buffer, &out.size);
+            cinfo.image_width = image->image_width;
+            cinfo.image_height = nrows;
+            cinfo.input_components = image->input_components;
+            cinfo.in_color_space = image->in_color_space;
+            jpeg_set_defaults(&cinfo);
+            jpeg_set_quality(&cinfo, quality, TRUE);
+            cinfo.dct_method = image->dct_method;
+            for (int c = 0; c < cinfo.num_components; c++) {
+                cinfo.comp_info[c].h_samp_factor = image->comp_info[c].h_samp_factor;
+                cinfo.comp_info[c].v_samp_factor = image->comp_info[c].v_samp_factor;
+            }
+            cinfo.write_JFIF_header = FALSE;
+            cinfo.write_Adobe_marker = FALSE;
+            jpeg_start_compress(&cinfo, TRUE);
+            const size_t row_stride = static_cast<size_t>(image->image_width) * image->input_components;
+            std::vector<JSAMPROW> row_pointers(nrows);
+            for (uint32_t i = 0; i < nrows; i++) row_pointers[i] = const_cast<uint8_t *>(rows) + i * row_stride;
+            (void) jpeg_write_scanlines(&cinfo, row_pointers.data(), nrows);
+            jpeg_finish_compress(&cinfo);
+        } catch (JpegError &jpgerr) {
+            jpeg_destroy_compress(&cinfo);
+            throw IIIFImageError(file_, __LINE__, fmt::format("Error compressing JPEG: {}", jpgerr.what()));
+        }
+        jpeg_destroy_compress(&cinfo);
+    }
+    //=============================================================================
+
+    /*!
+     * Compress the rows of a strip source in stripes of stripe_rows rows on the compute pool.
+     * cinfo has been started with the height of the first stripe and a restart interval of one
+     * stripe, its output (headers, metadata) goes to head. The stripes are read and compressed
+     * a few at a time and written in order: the stream of cinfo with the full height in the
+     * frame header, then the entropy-coded data of the other stripes, each after a restart marker.
+     */
+    static void jpeg_compress_stripes(struct jpeg_compress_struct *cinfo, int quality, IIIFStripSource &strips,
+                                      uint32_t ny, uint32_t stripe_rows, JpegMemory &head, const JpegSink &sink) {
+        const size_t row_stride = static_cast<size_t>(cinfo->image_width) * cinfo->input_components;
+        const uint32_t nstripes = (ny + stripe_rows - 1) / stripe_rows;
+        auto pool = IIIFComputePool::instance();
+        const uint32_t batch = std::min(2 * ((pool != nullptr) ? pool->per_request() : 1), nstripes);
+        std::vector<uint8_t> rows(static_cast<size_t>(batch) * stripe_rows * row_stride);
+        std::vector<JpegMemory> compressed(batch);
+
+        for (uint32_t first = 0; first < nstripes; first += batch) {
+            const uint32_t n = std::min(batch, nstripes - first);
+            const uint32_t nrows = std::min(n * stripe_rows, ny - first * stripe_rows);
+            uint32_t done = 0;
+            while (done < nrows) {
+                uint32_t got = strips.read(rows.data() + done * row_stride, nrows - done);
+                if (got == 0) {
+                    throw IIIFImageError(file_, __LINE__, fmt::format("Image ends after {} of {} rows", first * stripe_rows + done, ny));
+                }
+                done += got;
+            }
+
+            IIIFComputePool::parallel_for(n, [&](uint32_t s0, uint32_t s1) {
+                for (uint32_t s = s0; s < s1; s++) {
+                    const uint8_t *stripe = rows.data() + static_cast<size_t>(s) * stripe_rows * row_stride;
+                    const uint32_t stripe_ny = std::min(stripe_rows, nrows - s * stripe_rows);
+                    if (first + s == 0) {
+                        std::vector<JSAMPROW> row_pointers(stripe_ny);
+                        for (uint32_t i = 0; i < stripe_ny; i++) row_pointers[i] = const_cast<uint8_t *>(stripe) + i * row_stride;
+                        try {
+                            (void) jpeg_write_scanlines(cinfo, row_pointers.data(), stripe_ny);
+                            jpeg_finish_compress(cinfo);
+                        } catch (JpegError &jpgerr) {
+                            throw IIIFImageError(file_, __LINE__, fmt::format("Error compressing JPEG: {}", jpgerr.what()));
+                        }
+                    } else {
+                        jpeg_compress_stripe(cinfo, quality, stripe, stripe_ny, compressed[s]);
+                    }
+                }
+            }, 1);
+
+            for (uint32_t s = 0; s < n; s++) {
+                if (first + s == 0) {
+                    const size_t sof = jpeg_find_segment(head.buffer, head.size, 0xc0); // baseline frame header
+                    if (sof + 9 > head.size) {
+                        throw IIIFImageError(file_, __LINE__, "Compressed JPEG header is invalid");
+                    }
+                    head.buffer[sof + 5] = static_cast<JOCTET>(ny >> 8);
+                    head.buffer[sof + 6] = static_cast<JOCTET>(ny & 0xff);
+                    (void) jpeg_scan_data(head.buffer, head.size);
+                    sink(head.buffer, head.size - 2); // without EOI
+                    head.release();
+                } else {
+                    const JOCTET rst[2] = {0xff, static_cast<JOCTET>(0xd0 + ((first + s - 1) & 7))};
+                    const size_t start = jpeg_scan_data(compressed[s].buffer, compressed[s].size);
+                    sink(rst, 2);
+                    sink(compressed[s].buffer + start, compressed[s].size - 2 - start);
+                    compressed[s].release();
+                }
+            }
+        }
+        const JOCTET eoi[2] = {0xff, 0xd9};
+        sink(eoi, 2);
+    }
+    //=============================================================================
+
     void IIIFIOJpeg::write(IIIFImage &img, const std::string &filepath, const IIIFCompressionParams &params) {
+        write_strips(std::make_unique<IIIFStripImage>(img), filepath, params);
+    }
+    //============================================================================
+
+    void IIIFIOJpeg::write_strips(std::unique_ptr<IIIFStripSource> strips,
+                                  const std::string &filepath,
+                                  const IIIFCompressionParams &params) {
         int quality = 80;
-        if (!params.empty()) {
+        if (params.find(JPEG_QUALITY) != params.end()) {
             try {
                 quality = stoi(params.at(JPEG_QUALITY));
             }
@@ -1019,15 +1467,48 @@ namespace cserve {
                 throw IIIFImageError(file_, __LINE__, "JPEG quality argument must be integer between 0 and 100");
             }
         }
+        DctMethod dct_method = DCT_ISLOW;
+        if ((params.find(JPEG_DCT_METHOD) != params.end()) &&
+            !dct_method_from_name(params.at(JPEG_DCT_METHOD), dct_method)) {
+            throw IIIFImageError(file_, __LINE__, fmt::format("Unknown JPEG DCT method \"{}\"", params.at(JPEG_DCT_METHOD)));
+        }
+        int h_samp = 2, v_samp = 2; // 4:2:0
+        if ((params.find(JPEG_SUBSAMPLING) != params.end()) &&
+            !subsampling_from_name(params.at(JPEG_SUBSAMPLING), h_samp, v_samp)) {
+            throw IIIFImageError(file_, __LINE__, fmt::format("Unknown JPEG chroma subsampling \"{}\"", params.at(JPEG_SUBSAMPLING)));
+        }
+        const bool optimize = jpeg_flag(params, JPEG_OPTIMIZE, true);
+        const bool progressive = jpeg_flag(params, JPEG_PROGRESSIVE, true);
+        const bool parallel = jpeg_flag(params, JPEG_PARALLEL, false);
 
-        if (img.bps == 16) img.to8bps();
+        if (strips->header().getBps() == 16) {
+            strips = std::make_unique<IIIFStripTo8bps>(std::move(strips));
+        }
 
         //
         // we have to check if the image has an alpha channel (not supported by JPEG). If
         // so, we remove it!
         //
-        if ((img.nc > 3) && (img.getNalpha() > 0)) { // we have an alpha channel....
-            for (size_t i = 3; i < (img.getNalpha() + 3); i++) img.removeChan(i);
+        if ((strips->header().getNc() > 3) && (strips->header().getNalpha() > 0)) { // we have an alpha channel....
+            strips = std::make_unique<IIIFStripRemoveAlpha>(std::move(strips));
+        }
+        if (strips->header().getPhoto() == CIELAB) {
+            strips = std::make_unique<IIIFStripIcc>(std::move(strips), IIIFIcc(PredefinedProfiles::icc_sRGB), 8);
+        }
+        const IIIFImage &img = strips->header();
+
+        //
+        // in parallel mode, the image is written as baseline JPEG whose stripes are compressed
+        // concurrently (see jpeg_compress_stripes()), if there are at least two stripes. The
+        // MCU is 16 or 8 pixels wide and high for YCbCr (depending on the subsampling), 8x8 else.
+        //
+        const bool ycc = (img.photo == RGB) || (img.photo == YCBCR);
+        const uint32_t mcu_width = ycc ? 8 * h_samp : 8;
+        const uint32_t mcu_height = ycc ? 8 * v_samp : 8;
+        uint32_t stripe_rows = 0;
+        if (parallel && (IIIFComputePool::instance() != nullptr) && (img.nx > 0)) {
+            stripe_rows = jpeg_stripe_rows(img.nx, mcu_width, mcu_height);
+            if (img.ny <= stripe_rows) stripe_rows = 0;
         }
 
         struct jpeg_compress_struct cinfo{};
@@ -1037,7 +1518,6 @@ namespace cserve {
         jerr.error_exit = jpegErrorExit;
 
         int outfile = -1;        /* target file */
-        JSAMPROW row_pointer[1];    /* pointer to JSAMPLE row[s] */
         uint32_t row_stride;        /* physical row width in image buffer */
 
         try {
@@ -1046,7 +1526,43 @@ namespace cserve {
             throw IIIFImageError(file_, __LINE__, fmt::format("JPEG writing of file '{}' failed: {}", filepath, jpgerr.what()));
         }
 
-        if (filepath == "HTTP") { // we are transmitting the data through the webserver
+        JpegMemory head; // parallel mode: the stream of cinfo
+        JpegSink sink;   // parallel mode: the destination of the stitched stream
+        if (stripe_rows > 0) {
+            if (filepath == "HTTP") {
+                Connection *conobj = img.connection();
+                sink = [conobj](const JOCTET *data, size_t len) {
+                    try {
+                        conobj->sendAndFlush(data, static_cast<std::streamsize>(len));
+                    } catch (int i) { // an error occurred (possibly a broken pipe)
+                        throw IIIFImageError(file_, __LINE__, "Couldn't write to HTTP socket");
+                    }
+                };
+            } else if (filepath == "stdout:") {
+                sink = [](const JOCTET *data, size_t len) {
+                    if (fwrite(data, 1, len, stdout) != len) {
+                        throw IIIFImageError(file_, __LINE__, "Couldn't write to stdout");
+                    }
+                };
+            } else {
+                if ((outfile = open(filepath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) ==
+                    -1) {
+                    jpeg_destroy_compress(&cinfo);
+                    throw IIIFImageError(file_, __LINE__, fmt::format("Cannot open JPEG file '{}'", filepath));
+                }
+                sink = [outfile](const JOCTET *data, size_t len) {
+                    size_t nn = 0;
+                    while (nn < len) {
+                        ssize_t n = ::write(outfile, data + nn, len - nn);
+                        if (n < 0) {
+                            throw IIIFImageError(file_, __LINE__, "Couldn't write to file!");
+                        }
+                        nn += n;
+                    }
+                };
+            }
+            jpeg_mem_dest(&cinfo, &head.buffer, &head.size);
+        } else if (filepath == "HTTP") { // we are transmitting the data through the webserver
             Connection *conobj = img.connection();
             try {
                 jpeg_html_dest(&cinfo, conobj);
@@ -1059,7 +1575,7 @@ namespace cserve {
             if (filepath == "stdout:") {
                 jpeg_stdio_dest(&cinfo, stdout);
             } else {
-                if ((outfile = open(filepath.c_str(), O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) ==
+                if ((outfile = open(filepath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) ==
                     -1) {
                     jpeg_destroy_compress(&cinfo);
                     throw IIIFImageError(file_, __LINE__, fmt::format("Cannot open JPEG file '{}'", filepath));
@@ -1109,25 +1625,38 @@ namespace cserve {
                 cinfo.jpeg_color_space = JCS_YCbCr;
                 break;
             }
-            case CIELAB: {
-                img.convertToIcc(IIIFIcc(PredefinedProfiles::icc_sRGB), 8);
-                cinfo.in_color_space = JCS_RGB;
-                cinfo.jpeg_color_space = JCS_RGB;
-                break;
-            }
             default: {
                 jpeg_destroy_compress(&cinfo);
                 throw IIIFImageError(file_, __LINE__, fmt::format("Unsupported JPEG colorspace: {}", img.photo));
             }
         }
-        cinfo.progressive_mode = TRUE;
         cinfo.write_Adobe_marker = TRUE;
         cinfo.write_JFIF_header = TRUE;
         try {
             jpeg_set_defaults(&cinfo);
             jpeg_set_quality(&cinfo, quality, TRUE /* TRUE, then limit to baseline-JPEG values */);
 
-            jpeg_simple_progression(&cinfo);
+            //
+            // the encoder profile. jpeg_set_defaults() has reset the DCT method and the sampling factors
+            // (the chroma components have 1x1, the subsampling is given by the luminance)
+            //
+            cinfo.dct_method = jpeg_dct_method(dct_method);
+            cinfo.optimize_coding = optimize ? TRUE : FALSE;
+            if (cinfo.jpeg_color_space == JCS_YCbCr) {
+                cinfo.comp_info[0].h_samp_factor = h_samp;
+                cinfo.comp_info[0].v_samp_factor = v_samp;
+            }
+            if (stripe_rows > 0) {
+                //
+                // cinfo compresses the first stripe, one restart interval per stripe. Huffman tables
+                // can't be optimized, as the stripes are compressed independently.
+                //
+                cinfo.image_height = stripe_rows;
+                cinfo.restart_interval = ((img.nx + mcu_width - 1) / mcu_width) * (stripe_rows / mcu_height);
+                cinfo.optimize_coding = FALSE;
+            } else if (progressive) {
+                jpeg_simple_progression(&cinfo);
+            }
             jpeg_start_compress(&cinfo, TRUE);
         } catch (JpegError &jpgerr) {
             jpeg_finish_compress(&cinfo);
@@ -1302,21 +1831,44 @@ namespace cserve {
             }
         }
 
+        if (stripe_rows > 0) {
+            try {
+                jpeg_compress_stripes(&cinfo, quality, *strips, img.ny, stripe_rows, head, sink);
+            } catch (IIIFError &err) {
+                jpeg_destroy_compress(&cinfo);
+                if (outfile != -1) close(outfile);
+                throw;
+            }
+            if (outfile != -1) close(outfile);
+            jpeg_destroy_compress(&cinfo);
+            return;
+        }
+
         row_stride = img.nx * img.nc;    /* JSAMPLEs per row in image_buffer */
 
-        byte *rawbuf = img.bpixels.data();
+        //
+        // the scanlines are compressed strip by strip while they are delivered by the source
+        //
+        const uint32_t strip_height = std::max(strips->strip_height(), 1u);
+        std::vector<uint8_t> strip(static_cast<size_t>(strip_height) * row_stride);
+        std::vector<JSAMPROW> row_pointers(strip_height);
         try {
             while (cinfo.next_scanline < cinfo.image_height) {
-                // jpeg_write_scanlines expects an array of pointers to scanlines.
-                // Here the array is only one element long, but you could pass
-                // more than one scanline at a time if that's more convenient.
-                row_pointer[0] = &rawbuf[cinfo.next_scanline * row_stride];
-                (void) jpeg_write_scanlines(&cinfo, row_pointer, 1);
+                uint32_t n = strips->read(strip.data(), std::min(strip_height, cinfo.image_height - cinfo.next_scanline));
+                if (n == 0) {
+                    throw IIIFImageError(file_, __LINE__, fmt::format("Image ends after {} of {} rows", cinfo.next_scanline, cinfo.image_height));
+                }
+                for (uint32_t i = 0; i < n; i++) row_pointers[i] = strip.data() + i * row_stride;
+                (void) jpeg_write_scanlines(&cinfo, row_pointers.data(), n);
             }
         } catch (JpegError &jpgerr) {
             jpeg_destroy_compress(&cinfo);
             if (outfile != -1) close(outfile);
             throw IIIFImageError(file_, __LINE__, fmt::format("Error compressing JPEG: ", jpgerr.what()));
+        } catch (IIIFError &err) {
+            jpeg_destroy_compress(&cinfo);
+            if (outfile != -1) close(outfile);
+            throw;
         }
 
         try {
@@ -1331,4 +1883,121 @@ namespace cserve {
         jpeg_destroy_compress(&cinfo);
     }
 
+    /*!
+     * True if the header of a JPEG stream contains an ICC profile (APP2 "ICC_PROFILE")
+     */
+    static bool jpeg_has_icc_profile(const JOCTET *data, size_t len) {
+        static const char icc_signature[] = "ICC_PROFILE"; // including the terminating 0
+        size_t pos = 2; // SOI
+        while (pos + 4 <= len) {
+            if (data[pos] != 0xff) break;
+            if (data[pos + 1] == 0xff) { // fill byte
+                pos++;
+                continue;
+            }
+            if (data[pos + 1] == 0xda) break; // SOS, the header ends
+            if ((data[pos + 1] == JPEG_APP0 + 2) && (pos + 4 + sizeof(icc_signature) <= len) &&
+                (memcmp(data + pos + 4, icc_signature, sizeof(icc_signature)) == 0)) {
+                return true;
+            }
+            pos += 2 + ((static_cast<size_t>(data[pos + 2]) << 8) | data[pos + 3]);
+        }
+        return false;
+    }
+    //=============================================================================
+
+    bool IIIFIOJpeg::transform_lossless(const std::string &filepath,
+                                        int32_t x, int32_t y, uint32_t w, uint32_t h,
+                                        float angle, bool mirror,
+                                        const IIIFCompressionParams &params,
+                                        std::vector<unsigned char> &jpeg) {
+        jpeg.clear();
+        //
+        // the region is cut before mirroring and rotating (IIIF), the transform cuts after it
+        //
+        int op;
+        if (angle == 0.0F) {
+            op = mirror ? TJXOP_HFLIP : TJXOP_NONE;
+        } else if (angle == 90.0F) {
+            op = mirror ? TJXOP_TRANSVERSE : TJXOP_ROT90;
+        } else if (angle == 180.0F) {
+            op = mirror ? TJXOP_VFLIP : TJXOP_ROT180;
+        } else if (angle == 270.0F) {
+            op = mirror ? TJXOP_TRANSPOSE : TJXOP_ROT270;
+        } else {
+            return false;
+        }
+        [[maybe_unused]] const bool optimize = jpeg_flag(params, JPEG_OPTIMIZE, true);
+        const bool progressive = jpeg_flag(params, JPEG_PROGRESSIVE, true);
+
+        std::vector<unsigned char> src;
+        int infile = ::open(filepath.c_str(), O_RDONLY);
+        if (infile == -1) return false;
+        struct stat statbuf{};
+        if (fstat(infile, &statbuf) == 0) {
+            src.resize(static_cast<size_t>(statbuf.st_size));
+            size_t done = 0;
+            while (done < src.size()) {
+                ssize_t n = ::read(infile, src.data() + done, src.size() - done);
+                if (n <= 0) break;
+                done += static_cast<size_t>(n);
+            }
+            src.resize(done);
+        }
+        close(infile);
+        if (src.empty() || jpeg_has_icc_profile(src.data(), src.size())) return false;
+
+        std::unique_ptr<void, int (*)(tjhandle)> handle(tjInitTransform(), tjDestroy);
+        if (handle == nullptr) return false;
+        int width, height, subsamp, colorspace;
+        if (tjDecompressHeader3(handle.get(), src.data(), static_cast<unsigned long>(src.size()),
+                                &width, &height, &subsamp, &colorspace) != 0) {
+            return false;
+        }
+        if ((subsamp < 0) || (colorspace == TJCS_CMYK) || (colorspace == TJCS_YCCK)) return false;
+
+        tjtransform transform{};
+        transform.op = op;
+        transform.options = TJXOPT_PERFECT;
+        if (progressive) transform.options |= TJXOPT_PROGRESSIVE;
+#ifdef TJXOPT_OPTIMIZE // libjpeg-turbo 3
+        if (optimize) transform.options |= TJXOPT_OPTIMIZE;
+#endif
+        if ((x != 0) || (y != 0) || (w != static_cast<uint32_t>(width)) || (h != static_cast<uint32_t>(height))) {
+            //
+            // the region in the coordinates of the transformed image
+            //
+            const int rx = x, ry = y, rw = static_cast<int>(w), rh = static_cast<int>(h);
+            switch (op) {
+                case TJXOP_NONE: transform.r = {rx, ry, rw, rh}; break;
+                case TJXOP_HFLIP: transform.r = {width - rx - rw, ry, rw, rh}; break;
+                case TJXOP_VFLIP: transform.r = {rx, height - ry - rh, rw, rh}; break;
+                case TJXOP_ROT180: transform.r = {width - rx - rw, height - ry - rh, rw, rh}; break;
+                case TJXOP_ROT90: transform.r = {height - ry - rh, rx, rh, rw}; break;
+                case TJXOP_ROT270: transform.r = {ry, width - rx - rw, rh, rw}; break;
+                case TJXOP_TRANSPOSE: transform.r = {ry, rx, rh, rw}; break;
+                case TJXOP_TRANSVERSE: transform.r = {height - ry - rh, width - rx - rw, rh, rw}; break;
+                default: return false;
+            }
+            const bool transposed = (op == TJXOP_ROT90) || (op == TJXOP_ROT270) ||
+                                    (op == TJXOP_TRANSPOSE) || (op == TJXOP_TRANSVERSE);
+            const int mcu_w = transposed ? tjMCUHeight[subsamp] : tjMCUWidth[subsamp];
+            const int mcu_h = transposed ? tjMCUWidth[subsamp] : tjMCUHeight[subsamp];
+            if (((transform.r.x % mcu_w) != 0) || ((transform.r.y % mcu_h) != 0)) return false;
+            transform.options |= TJXOPT_CROP;
+        }
+
+        unsigned char *dst = nullptr;
+        unsigned long dst_size = 0;
+        if (tjTransform(handle.get(), src.data(), static_cast<unsigned long>(src.size()), 1,
+                        &dst, &dst_size, &transform, 0) != 0) {
+            tjFree(dst); // the transform is not perfect (or the file is invalid and is left to the decoder)
+            return false;
+        }
+        jpeg.assign(dst, dst + dst_size);
+        tjFree(dst);
+        return true;
+    }
+    //============================================================================
+
 } // namespace
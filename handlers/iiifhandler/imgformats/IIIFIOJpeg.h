@@ -13,10 +13,13 @@
 #define __iiif_io_jpeg_h
 
 #include <string>
+#include <vector>
 
 #include "../IIIFImage.h"
 #include "../IIIFIO.h"
 
+struct jpeg_decompress_struct;
+
 namespace cserve {
 
     /*! Class which implements the JPEG2000-reader/writer */
@@ -24,9 +27,29 @@ namespace cserve {
     private:
         static void parse_photoshop(IIIFImage &img, char *data, int length);
 
+        /*!
+         * Read the metadata (EXIF, XMP, ICC profile, IPTC, essential metadata) from the saved markers
+         */
+        static void parse_markers(IIIFImage &img, struct jpeg_decompress_struct *cinfo, const std::string &filepath);
+
     public:
         ~IIIFIOJpeg() override = default;
 
+        /*!
+         * Get the DCT method from its name ("islow", "ifast" or "float")
+         *
+         * \returns false if the name is unknown
+         */
+        static bool dct_method_from_name(const std::string &name, DctMethod &method);
+
+        /*!
+         * Get the sampling factors of the luminance from the name of a chroma subsampling
+         * ("4:4:4", "4:2:2" or "4:2:0")
+         *
+         * \returns false if the name is unknown
+         */
+        static bool subsampling_from_name(const std::string &name, int &h_samp, int &v_samp);
+
         /*!
          * Method used to read an image file
          *
@@ -42,6 +65,17 @@ namespace cserve {
                        bool force_bps_8,
                        ScalingQuality scaling_quality) override;
 
+        /*!
+         * Open a JPEG file for reading its scanlines while they are decompressed. A reduction by a
+         * power of 2 is done by the decompressor, cropping and the remaining scaling by the stages
+         * of the strip pipeline.
+         */
+        std::unique_ptr<IIIFStripSource> read_strips(const std::string &filepath,
+                                                     std::shared_ptr<IIIFRegion> region,
+                                                     std::shared_ptr<IIIFSize> size,
+                                                     bool force_bps_8,
+                                                     ScalingQuality scaling_quality) override;
+
         /*!
          * Get the dimension of the image
          *
@@ -59,6 +93,47 @@ namespace cserve {
          * \param filepath Name of the image file to be written.
          */
         void write(IIIFImage &img, const std::string &filepath, const IIIFCompressionParams &params) override;
+
+        /*!
+         * Write the rows of a strip source as JPEG image. The scanlines are compressed while they
+         * are delivered; 16 bit samples, alpha channels and CIELAB are converted by stages.
+         *
+         * The encoder profile is given by the parameters JPEG_QUALITY (default 80), JPEG_DCT_METHOD
+         * (default "islow"), JPEG_OPTIMIZE and JPEG_PROGRESSIVE ("yes" or "no", default "yes") and
+         * JPEG_SUBSAMPLING (default "4:2:0"). Progressive images always have optimized Huffman tables.
+         * With JPEG_PARALLEL "yes", large images are written as baseline JPEG with standard Huffman
+         * tables, whose stripes (one restart interval each) are compressed on the IIIFComputePool.
+         *
+         * \param strips The rows to be written, the header holds the metadata and the connection
+         * \param filepath Name of the image file to be written ("HTTP", "stdout:" or a path)
+         */
+        void write_strips(std::unique_ptr<IIIFStripSource> strips,
+                          const std::string &filepath,
+                          const IIIFCompressionParams &params) override;
+
+        /*!
+         * Cut a region out of a JPEG file, mirror it and rotate it by a multiple of 90° without
+         * decoding it: like jpegtran, the DCT coefficients are rearranged, so the result has the
+         * quality of the master. The region (in the coordinates of the file) must start at an MCU
+         * boundary of the transformed image and the transform must be perfect, i.e. the partial
+         * MCUs at the right and bottom edges must not move. Files with an ICC profile or CMYK
+         * samples are not transformed, since the decoding path converts them to sRGB.
+         *
+         * The parameters JPEG_OPTIMIZE and JPEG_PROGRESSIVE ("yes" or "no", default "yes") select
+         * the entropy coding of the result. All markers (EXIF, XMP, ...) are copied.
+         *
+         * \param[in] filepath Pathname of the JPEG file
+         * \param[in] x, y, w, h Region of the image
+         * \param[in] angle Clockwise rotation (0, 90, 180 or 270)
+         * \param[in] mirror Mirror the region before rotating it
+         * \param[out] jpeg The transformed JPEG stream
+         * \returns false if the transform is not possible losslessly (jpeg is empty then)
+         */
+        static bool transform_lossless(const std::string &filepath,
+                                       int32_t x, int32_t y, uint32_t w, uint32_t h,
+                                       float angle, bool mirror,
+                                       const IIIFCompressionParams &params,
+                                       std::vector<unsigned char> &jpeg);
     };
 
 }
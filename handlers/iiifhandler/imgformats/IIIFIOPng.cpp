@@ -9,6 +9,7 @@
  * but WITHOUT ANY WARRANTY; without even the implied warranty of
  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
  */
+#include <algorithm>
 #include <cstdlib>
 
 #include <string>
@@ -20,6 +21,7 @@
 #include <zlib.h>
 
 #include "IIIFIOPng.h"
+#include "../IIIFBufferPool.h"
 #include "../../../lib/Cserve.h"
 
 
@@ -316,7 +318,7 @@ namespace cserve {
         // prepare storage for reading image
         //
         size_t sll = png_get_rowbytes(png_ptr, info_ptr);
-        auto buffer = std::vector<uint8_t>(height * sll);
+        auto buffer = acquirePixels<uint8_t>(height * sll);
         auto row_pointers = std::vector<png_bytep>(height);
         for (size_t i = 0; i < img.ny; i++) {
             row_pointers[i] = (buffer.data() + i * sll);
@@ -337,10 +339,11 @@ namespace cserve {
 
         if (img.bps == 16) {
             auto *ptr = reinterpret_cast<uint16_t*>(buffer.data());
-            std::vector<uint16_t> tmp(ptr, ptr + buffer.size()/2);
+            auto tmp = acquirePixels<uint16_t>(buffer.size()/2);
             for (int i = 0; i < img.nx * img.ny * img.nc; i++) {
-                tmp[i] = ntohs(tmp[i]);
+                tmp[i] = ntohs(ptr[i]);
             }
+            releasePixels(std::move(buffer));
             img.wpixels = std::move(tmp);
         }
         else {
@@ -349,34 +352,22 @@ namespace cserve {
 
         fclose(infile);
 
-        if (region != nullptr) { //we just use the image.crop method
-            img.crop(region);
-        }
-
         //
-        // resize/Scale the image if necessary
+        // crop and resize/scale the image in one pass if necessary
         //
+        int32_t x = 0, y = 0;
+        uint32_t w = img.nx, h = img.ny;
+        if ((region != nullptr) && (region->getType() != IIIFRegion::FULL)) {
+            region->crop_coords(img.nx, img.ny, x, y, w, h);
+        }
+        uint32_t nnx = w, nny = h;
         if (size != nullptr) {
-            uint32_t nnx, nny;
             uint32_t reduce = 0;
             bool redonly;
-            IIIFSize::SizeType rtype = size->get_size(img.nx, img.ny, nnx, nny, reduce, redonly);
-            if (reduce > 1) {
-                img.reduce(reduce);
-            }
-            if ((rtype != IIIFSize::FULL) || !redonly) {
-                switch (scaling_quality.png) {
-                    case HIGH:
-                        img.scale(nnx, nny);
-                        break;
-                    case MEDIUM:
-                        img.scaleMedium(nnx, nny);
-                        break;
-                    case LOW:
-                        img.scaleFast(nnx, nny);
-                        break;
-                }
-            }
+            (void) size->get_size(w, h, nnx, nny, reduce, redonly);
+        }
+        if ((nnx != img.nx) || (nny != img.ny) || (w != img.nx) || (h != img.ny)) {
+            img.cropAndScale(region, nnx, nny, scaling_quality.png);
         }
 
         if (force_bps_8) {
@@ -489,6 +480,25 @@ namespace cserve {
     void IIIFIOPng::write(IIIFImage &img,
                           const std::string &filepath,
                           const IIIFCompressionParams &params) {
+        write_strips(std::make_unique<IIIFStripImage>(img), filepath, params);
+    }
+
+    /*==========================================================================*/
+
+    void IIIFIOPng::write_strips(std::unique_ptr<IIIFStripSource> strips,
+                                 const std::string &filepath,
+                                 const IIIFCompressionParams &params) {
+        //
+        // CMYK and CIELAB are converted to sRGB while the rows are written
+        //
+        if ((strips->header().getNc() == 4) && (strips->header().getNalpha() != 1)) {
+            strips = std::make_unique<IIIFStripIcc>(std::move(strips), IIIFIcc(PredefinedProfiles::icc_sRGB), 8);
+        } else if ((strips->header().getIcc() != nullptr) && (strips->header().getIcc()->getProfileType() == icc_LAB)) {
+            strips = std::make_unique<IIIFStripIcc>(std::move(strips), IIIFIcc(PredefinedProfiles::icc_sRGB),
+                                                    strips->header().getBps());
+        }
+        const IIIFImage &img = strips->header();
+
         FILE *outfile = nullptr;
         png_structp png_ptr;
 
@@ -533,12 +543,6 @@ namespace cserve {
         } else if ((img.nc == 4) && (img.es.size() == 1)) { // RGB + ALPHA
             color_type = PNG_COLOR_TYPE_RGB_ALPHA;
         }
-        else if (img.nc == 4) {
-            img.convertToIcc(IIIFIcc(PredefinedProfiles::icc_sRGB), 8);
-            color_type = PNG_COLOR_TYPE_RGB;
-            img.nc = 3;
-            img.bps = 8;
-        }
         else {
             png_free_data(png_ptr, info_ptr, PNG_FREE_ALL, -1);
             throw IIIFImageError(file_, __LINE__,
@@ -554,9 +558,6 @@ namespace cserve {
         //
         IIIFEssentials es = img.essential_metadata();
         if ((img.icc != nullptr) || es.use_icc()) {
-            if ((img.icc != nullptr) && (img.icc->getProfileType() == icc_LAB)) {
-                img.convertToIcc(IIIFIcc(PredefinedProfiles::icc_sRGB), static_cast<int>(img.bps));
-            }
             std::vector<unsigned char> icc_buf;
             try {
                 if (es.use_icc()) {
@@ -612,28 +613,36 @@ namespace cserve {
         }
         png_write_info(png_ptr, info_ptr);
 
-        auto *row_pointers = (png_bytep *) png_malloc(png_ptr, img.ny * sizeof(png_byte *));
+        if (img.bps == 16) {
+            png_set_swap(png_ptr); // we expect the data to be little endian...
+        }
 
-        if (img.bps == 8) {
-            png_bytep raw_tmp = img.bpixels.data();
-            for (size_t i = 0; i < img.ny; i++) {
-                row_pointers[i] = (raw_tmp + i * img.nx * img.nc);
-            }
-        } else if (img.bps == 16) {
-            auto raw_tmp = (png_bytep) img.wpixels.data();
-            for (size_t i = 0; i < img.ny; i++) {
-                row_pointers[i] = (raw_tmp + 2 * i * img.nx * img.nc);
+        //
+        // the rows are compressed strip by strip while they are delivered by the source
+        //
+        const size_t sll = strips->row_size();
+        const uint32_t strip_height = std::max(strips->strip_height(), 1u);
+        std::vector<png_byte> strip(strip_height * sll);
+        try {
+            uint32_t y = 0;
+            while (y < img.ny) {
+                uint32_t n = strips->read(strip.data(), std::min(strip_height, img.ny - y));
+                if (n == 0) {
+                    throw IIIFImageError(file_, __LINE__, fmt::format("Image ends after {} of {} rows", y, img.ny));
+                }
+                for (uint32_t i = 0; i < n; i++) {
+                    png_write_row(png_ptr, strip.data() + i * sll);
+                }
+                y += n;
             }
+            png_write_end(png_ptr, info_ptr);
+        } catch (IIIFError &err) {
+            png_free_data(png_ptr, info_ptr, PNG_FREE_ALL, -1);
+            png_destroy_write_struct(&png_ptr, &info_ptr);
+            if ((outfile != nullptr) && (outfile != stdout)) fclose(outfile);
+            throw;
         }
 
-        png_set_rows(png_ptr, info_ptr, row_pointers);
-
-        png_write_png(png_ptr, info_ptr, PNG_TRANSFORM_SWAP_ENDIAN,
-                      nullptr); // we expect the data to be little endian...
-        png_write_end(png_ptr, info_ptr);
-
-        png_free(png_ptr, row_pointers);
-
         png_free_data(png_ptr, info_ptr, PNG_FREE_ALL, -1);
         png_destroy_write_struct(&png_ptr, &info_ptr);
 
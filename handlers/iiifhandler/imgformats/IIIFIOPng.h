@@ -60,6 +60,17 @@ namespace cserve {
          */
         void write(IIIFImage &img, const std::string &filepath, const IIIFCompressionParams &params) override;
 
+        /*!
+         * Write the rows of a strip source as PNG image. The rows are compressed while they are
+         * delivered; CMYK and CIELAB are converted to sRGB by a stage.
+         *
+         * \param strips The rows to be written, the header holds the metadata and the connection
+         * \param filepath Name of the image file to be written ("HTTP", "stdout:" or a path)
+         */
+        void write_strips(std::unique_ptr<IIIFStripSource> strips,
+                          const std::string &filepath,
+                          const IIIFCompressionParams &params) override;
+
     };
 }
 
@@ -17,7 +17,10 @@
 #include <cmath>
 #include <cerrno>
 #include <unordered_map>
+#include <mutex>
+#include <vector>
 
+#include "../IIIFComputePool.h"
 #include "../IIIFError.h"
 #include "../IIIFImage.h"
 #include "../IIIFImgTools.h"
@@ -591,56 +594,110 @@ namespace cserve {
     }
 
 
-    template<typename T>
-    static std::vector<T> read_tiled_data(TIFF *tif,
-                                          int32_t roi_x, int32_t roi_y,
-                                          uint32_t roi_w, uint32_t roi_h) {
-        uint16_t planar;
-        TIFF_GET_FIELD (tif, TIFFTAG_PLANARCONFIG, &planar, PLANARCONFIG_CONTIG)
-        uint32_t tile_width;
-        uint32_t tile_length;
-        TIFF_GET_FIELD (tif, TIFFTAG_TILEWIDTH, &tile_width, 0)
-        TIFF_GET_FIELD (tif, TIFFTAG_TILELENGTH, &tile_length, 0)
-        if ((tile_width == 0) ||(tile_length == 0)) {
-            throw IIIFImageError(file_, __LINE__, "Expected tiled image, but no tile dimension given!");
+    /*!
+     * TIFF handles for decompressing the tiles of a directory in parallel (a TIFF handle must not
+     * be used by several threads). The handle of the caller is used first, the others are opened
+     * on the same file and directory when needed and closed by the destructor.
+     */
+    class TiffHandles {
+    private:
+        TIFF *tif;
+        tdir_t dir;
+        std::vector<TIFF *> opened;
+        std::vector<TIFF *> available;
+        std::mutex locking;
+
+    public:
+        explicit TiffHandles(TIFF *tif_p) : tif(tif_p), dir(TIFFCurrentDirectory(tif_p)), available{tif_p} {}
+
+        TiffHandles(const TiffHandles &) = delete;
+
+        TiffHandles &operator=(const TiffHandles &) = delete;
+
+        ~TiffHandles() {
+            for (auto *handle: opened) TIFFClose(handle);
         }
 
-        uint32_t nx, ny, nc, bps;
-        TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &nx);
-        TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &ny);
-        uint32_t ntiles_x = IIIFSize::epsilon_ceil_division(static_cast<float>(nx), static_cast<float>(tile_width));
-        uint32_t ntiles_y = IIIFSize::epsilon_ceil_division(static_cast<float>(ny), static_cast<float>(tile_length));
-        uint32_t ntiles = TIFFNumberOfTiles(tif);
-        if (ntiles != (ntiles_x*ntiles_y)) {
-            throw IIIFImageError(file_, __LINE__, "Number of tiles no consistent!");
+        TIFF *acquire() {
+            {
+                std::lock_guard<std::mutex> guard(locking);
+                if (!available.empty()) {
+                    TIFF *handle = available.back();
+                    available.pop_back();
+                    return handle;
+                }
+            }
+            TIFF *handle = TIFFOpen(TIFFFileName(tif), "r");
+            if (handle == nullptr) {
+                throw IIIFImageError(file_, __LINE__, fmt::format("Couldn't open TIFF file \"{}\"", TIFFFileName(tif)));
+            }
+            if (TIFFSetDirectory(handle, dir) != 1) {
+                TIFFClose(handle);
+                throw IIIFImageError(file_, __LINE__, fmt::format("Couldn't read directory {} of \"{}\"", dir, TIFFFileName(tif)));
+            }
+            std::lock_guard<std::mutex> guard(locking);
+            opened.push_back(handle);
+            available.reserve(opened.size() + 1); // release() must not allocate, it's called by ~Lease()
+            return handle;
         }
-        uint32_t starttile_x = IIIFSize::epsilon_floor_division(static_cast<float>(roi_x), static_cast<float>(tile_width));
-        uint32_t starttile_y = IIIFSize::epsilon_floor_division(static_cast<float>(roi_y), static_cast<float>(tile_length));
-        uint32_t endtile_x = IIIFSize::epsilon_ceil_division(static_cast<float>(roi_x + roi_w), static_cast<float>(tile_width));
-        uint32_t endtile_y = IIIFSize::epsilon_ceil_division(static_cast<float>(roi_y + roi_h), static_cast<float>(tile_length));
 
-        uint16_t stmp;
-        TIFF_GET_FIELD (tif, TIFFTAG_SAMPLESPERPIXEL, &stmp, 1)
-        nc = static_cast<uint32_t>(stmp);
+        void release(TIFF *handle) {
+            std::lock_guard<std::mutex> guard(locking);
+            available.push_back(handle);
+        }
 
-        TIFF_GET_FIELD(tif, TIFFTAG_BITSPERSAMPLE, &stmp, 8)
-        bps = static_cast<uint32_t>(stmp);
+        /*!
+         * A handle acquired for the lifetime of the lease, it is released also if an exception is thrown
+         */
+        class Lease {
+        private:
+            TiffHandles &handles;
+            TIFF *handle;
 
-        if ((bps != 8) && (bps != 16)){
-            throw IIIFImageError(file_, __LINE__, fmt::format("{} bits per samples not supported for tiled tiffs!", bps));
-        }
+        public:
+            explicit Lease(TiffHandles &handles_p) : handles(handles_p), handle(handles_p.acquire()) {}
+
+            Lease(const Lease &) = delete;
+
+            Lease &operator=(const Lease &) = delete;
 
+            ~Lease() { handles.release(handle); }
+
+            [[nodiscard]] inline TIFF *get() const { return handle; }
+        };
+    };
+    //============================================================================
+
+    /*!
+     * Decompress the tiles covering a region of a tiled TIFF file on the IIIFComputePool, each band
+     * of tiles with its own TIFF handle, and copy them directly to their place in the region.
+     *
+     * \param[in] handles Handles of the file and directory
+     * \param[in] min_tiles Minimal number of tiles of a band (see IIIFComputePool::parallel_for())
+     * \param[out] out Buffer for roi_w * roi_h pixels of nc samples
+     */
+    template<typename T>
+    static void read_tiles(TiffHandles &handles, uint16_t planar, uint32_t nc,
+                           uint32_t tile_width, uint32_t tile_length, uint32_t tile_size,
+                           uint32_t roi_x, uint32_t roi_y, uint32_t roi_w, uint32_t roi_h,
+                           uint32_t min_tiles, T *out) {
         // nx = 30, tile_width = 8, roi_x = 5, roi_w = 20
         // 0 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20 21 22 23 24 25 26 27 28 29
         // 0 1 2 3 4 5 6 7|0 1  2  3  4  5  6  7| 0  1  2  3  4  5  6  7| 0  1  2  3  4  5  6  7|
         // * * * * * 0 1 2 3 4  5  6  7  8  9 10 11 12 13 14 15 16 17 18 19  *  *  *  *  *  *  *
-        uint32_t tile_size = TIFFTileSize(tif);
-        auto tilebuf = std::make_unique<T[]>(bps == 8 ? tile_size : (tile_size >> 1));
-        auto inbuf = std::vector<T>(roi_w * roi_h * nc);
-        for (uint32_t ty = starttile_y; ty < endtile_y; ++ty) {
-            for (uint32_t tx = starttile_x; tx < endtile_x; ++tx) {
-                if (TIFFReadTile(tif, tilebuf.get(), tx*tile_width, ty*tile_length, 0, 0) < 0) {
-                    TIFFClose(tif);
+        //
+        const uint32_t starttile_x = roi_x / tile_width;
+        const uint32_t starttile_y = roi_y / tile_length;
+        const uint32_t endtile_x = (roi_x + roi_w + tile_width - 1) / tile_width;
+        const uint32_t endtile_y = (roi_y + roi_h + tile_length - 1) / tile_length;
+        const uint32_t ntx = endtile_x - starttile_x;
+        IIIFComputePool::parallel_for(ntx * (endtile_y - starttile_y), [&](uint32_t first, uint32_t last) {
+            TiffHandles::Lease band_tif(handles);
+            auto tilebuf = std::make_unique<T[]>(tile_size / sizeof(T));
+            for (uint32_t t = first; t < last; ++t) {
+                const uint32_t tx = starttile_x + t % ntx;
+                const uint32_t ty = starttile_y + t / ntx;
+                if (TIFFReadTile(band_tif.get(), tilebuf.get(), tx*tile_width, ty*tile_length, 0, 0) < 0) {
                     throw IIIFImageError(file_, __LINE__,
                                          fmt::format("TIFFReadTile failed on tile ({}, {})", tx, ty));
                 }
@@ -669,14 +726,65 @@ namespace cserve {
                 }
                 uint32_t len_y = ey - start_in_y;
 
-                uint32_t start_out_x = (tx == starttile_x) ? 0 : (tx - starttile_x)*tile_width - roi_x;
-                uint32_t start_out_y = (ty == starttile_y) ? 0 : (ty - starttile_y)*tile_length - roi_y;
+                uint32_t start_out_x = (tx == starttile_x) ? 0 : tx*tile_width - roi_x;
+                uint32_t start_out_y = (ty == starttile_y) ? 0 : ty*tile_length - roi_y;
                 for (uint32_t y = start_in_y; y < (start_in_y + len_y); ++y) {
-                    std::memcpy(inbuf.data() + nc*((start_out_y + (y - start_in_y))*roi_w + start_out_x),
+                    std::memcpy(out + static_cast<size_t>(nc)*((start_out_y + (y - start_in_y))*roi_w + start_out_x),
                                 tilebuf.get() + nc*(y*tile_width + start_in_x),
                                 nc*len_x*sizeof(T));
                 }
             }
+        }, min_tiles);
+    }
+    //============================================================================
+
+    template<typename T>
+    static std::vector<T> read_tiled_data(TIFF *tif,
+                                          int32_t roi_x, int32_t roi_y,
+                                          uint32_t roi_w, uint32_t roi_h) {
+        uint16_t planar;
+        TIFF_GET_FIELD (tif, TIFFTAG_PLANARCONFIG, &planar, PLANARCONFIG_CONTIG)
+        uint32_t tile_width;
+        uint32_t tile_length;
+        TIFF_GET_FIELD (tif, TIFFTAG_TILEWIDTH, &tile_width, 0)
+        TIFF_GET_FIELD (tif, TIFFTAG_TILELENGTH, &tile_length, 0)
+        if ((tile_width == 0) ||(tile_length == 0)) {
+            throw IIIFImageError(file_, __LINE__, "Expected tiled image, but no tile dimension given!");
+        }
+
+        uint32_t nx, ny, nc, bps;
+        TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &nx);
+        TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &ny);
+        uint32_t ntiles_x = IIIFSize::epsilon_ceil_division(static_cast<float>(nx), static_cast<float>(tile_width));
+        uint32_t ntiles_y = IIIFSize::epsilon_ceil_division(static_cast<float>(ny), static_cast<float>(tile_length));
+        uint32_t ntiles = TIFFNumberOfTiles(tif);
+        if (ntiles != (ntiles_x*ntiles_y)) {
+            throw IIIFImageError(file_, __LINE__, "Number of tiles no consistent!");
+        }
+
+        uint16_t stmp;
+        TIFF_GET_FIELD (tif, TIFFTAG_SAMPLESPERPIXEL, &stmp, 1)
+        nc = static_cast<uint32_t>(stmp);
+
+        TIFF_GET_FIELD(tif, TIFFTAG_BITSPERSAMPLE, &stmp, 8)
+        bps = static_cast<uint32_t>(stmp);
+
+        if ((bps != 8) && (bps != 16)){
+            throw IIIFImageError(file_, __LINE__, fmt::format("{} bits per samples not supported for tiled tiffs!", bps));
+        }
+
+        //
+        // the tiles are decompressed in parallel and copied directly to their place in the region
+        //
+        auto inbuf = std::vector<T>(roi_w * roi_h * nc);
+        TiffHandles handles(tif);
+        try {
+            read_tiles<T>(handles, planar, nc, tile_width, tile_length, TIFFTileSize(tif),
+                          roi_x, roi_y, roi_w, roi_h, 4, inbuf.data());
+        }
+        catch (...) { // also std::bad_alloc etc., the caller doesn't close the file after an exception
+            TIFFClose(tif);
+            throw;
         }
         return inbuf;
     }
@@ -687,6 +795,17 @@ namespace cserve {
                                bool force_bps_8,
                                ScalingQuality scaling_quality) {
         IIIFImage img{};
+        TiffLayout layout;
+        TIFF *tif = read_header(filepath, region, size, img, layout);
+        return read_data(tif, std::move(img), layout, size, force_bps_8, scaling_quality);
+    }
+    //============================================================================
+
+    TIFF *IIIFIOTiff::read_header(const std::string &filepath,
+                                  const std::shared_ptr<IIIFRegion> &region,
+                                  const std::shared_ptr<IIIFSize> &size,
+                                  IIIFImage &img,
+                                  TiffLayout &layout) {
         TIFF *tif = TIFFOpen(filepath.c_str(), "r");
         if (tif == nullptr) {
             throw IIIFImageError(file_, __LINE__, fmt::format("Cannot open TIFF file '{}'", filepath));
@@ -711,7 +830,6 @@ namespace cserve {
             throw IIIFImageError(file_, __LINE__, msg);
         }
 
-        auto sll = static_cast<uint32_t>(TIFFScanlineSize(tif));
         TIFF_GET_FIELD (tif, TIFFTAG_SAMPLESPERPIXEL, &stmp, 1)
         img.nc = static_cast<uint32_t>(stmp);
 
@@ -729,10 +847,6 @@ namespace cserve {
         //
         // read the colomap if given...
         //
-        std::vector<uint16_t> rcm;
-        std::vector<uint16_t> gcm;
-        std::vector<uint16_t> bcm;
-        int colmap_len = 0;
         if (img.photo == PALETTE) {
             uint16_t *_rcm = nullptr, *_gcm = nullptr, *_bcm = nullptr;
             if (TIFFGetField(tif, TIFFTAG_COLORMAP, &_rcm, &_gcm, &_bcm) == 0) {
@@ -740,27 +854,27 @@ namespace cserve {
                 std::string msg = "TIFFGetField of TIFFTAG_COLORMAP failed: " + filepath;
                 throw IIIFImageError(file_, __LINE__, msg);
             }
-            colmap_len = 1;
+            layout.colmap_len = 1;
             size_t itmp = 0;
             while (itmp < img.bps) {
-                colmap_len *= 2;
+                layout.colmap_len *= 2;
                 itmp++;
             }
-            rcm.reserve(colmap_len);
-            gcm.reserve(colmap_len);
-            bcm.reserve(colmap_len);
-            if (colmap_len <= 256) {
-                for (int ii = 0; ii < colmap_len; ii++) {
-                    rcm[ii] = _rcm[ii] >> 8;
-                    gcm[ii] = _gcm[ii] >> 8;
-                    bcm[ii] = _bcm[ii] >> 8;
+            layout.rcm.resize(layout.colmap_len);
+            layout.gcm.resize(layout.colmap_len);
+            layout.bcm.resize(layout.colmap_len);
+            if (layout.colmap_len <= 256) {
+                for (int ii = 0; ii < layout.colmap_len; ii++) {
+                    layout.rcm[ii] = _rcm[ii] >> 8;
+                    layout.gcm[ii] = _gcm[ii] >> 8;
+                    layout.bcm[ii] = _bcm[ii] >> 8;
                 }
             }
             else {
-                for (int ii = 0; ii < colmap_len; ii++) {
-                    rcm[ii] = _rcm[ii];
-                    gcm[ii] = _gcm[ii];
-                    bcm[ii] = _bcm[ii];
+                for (int ii = 0; ii < layout.colmap_len; ii++) {
+                    layout.rcm[ii] = _rcm[ii];
+                    layout.gcm[ii] = _gcm[ii];
+                    layout.bcm[ii] = _bcm[ii];
                 }
             }
         }
@@ -996,7 +1110,6 @@ namespace cserve {
         //
         // select the right resolution
         //
-        bool is_tiled;
         uint32_t reduce = 1;
         if (resolutions.size() > 1) { // we have a resolution pyramid
             int32_t x, y;
@@ -1029,65 +1142,69 @@ namespace cserve {
             if (region != nullptr) {
                 region->set_reduce(static_cast<float>(reduce));
             }
-            is_tiled = (resolutions[level].tile_width != 0) && (resolutions[level].tile_height != 0);
-            sll = static_cast<uint32_t>(TIFFScanlineSize(tif));
+            layout.is_tiled = (resolutions[level].tile_width != 0) && (resolutions[level].tile_height != 0);
         }
         else {
             TIFFSetDirectory(tif, 0);
-            is_tiled = (resolutions[0].tile_width != 0) && (resolutions[0].tile_height != 0);
+            layout.is_tiled = (resolutions[0].tile_width != 0) && (resolutions[0].tile_height != 0);
         }
 
-        int32_t roi_x;
-        int32_t roi_y;
-        uint32_t roi_w;
-        uint32_t roi_h;
         if ((region == nullptr) || (region->getType() == IIIFRegion::FULL)) {
-            roi_x = 0;
-            roi_y = 0;
-            roi_w = img.nx;
-            roi_h = img.ny;
+            layout.roi_x = 0;
+            layout.roi_y = 0;
+            layout.roi_w = img.nx;
+            layout.roi_h = img.ny;
         }
         else {
-            region->crop_coords(img.nx, img.ny, roi_x, roi_y, roi_w, roi_h);
+            region->crop_coords(img.nx, img.ny, layout.roi_x, layout.roi_y, layout.roi_w, layout.roi_h);
         }
+        return tif;
+    }
+    //============================================================================
 
+    IIIFImage IIIFIOTiff::read_data(TIFF *tif,
+                                    IIIFImage img,
+                                    const TiffLayout &layout,
+                                    const std::shared_ptr<IIIFSize> &size,
+                                    bool force_bps_8,
+                                    ScalingQuality scaling_quality) {
         if (img.bps <= 8) {
-            if (is_tiled) {
-                img.bpixels = read_tiled_data<uint8_t>(tif, roi_x, roi_y, roi_w, roi_h);
+            if (layout.is_tiled) {
+                img.bpixels = read_tiled_data<uint8_t>(tif, layout.roi_x, layout.roi_y, layout.roi_w, layout.roi_h);
             }
             else {
-                img.bpixels = read_standard_data<uint8_t>(tif, roi_x, roi_y, roi_w, roi_h);
+                img.bpixels = read_standard_data<uint8_t>(tif, layout.roi_x, layout.roi_y, layout.roi_w, layout.roi_h);
             }
             img.bps = 8;
         }
         else if (img.bps <= 16) {
-            if (is_tiled) {
-                img.wpixels = read_tiled_data<uint16_t>(tif, roi_x, roi_y, roi_w, roi_h);
+            if (layout.is_tiled) {
+                img.wpixels = read_tiled_data<uint16_t>(tif, layout.roi_x, layout.roi_y, layout.roi_w, layout.roi_h);
             }
             else {
-                img.wpixels = read_standard_data<uint16_t>(tif, roi_x, roi_y, roi_w, roi_h);
+                img.wpixels = read_standard_data<uint16_t>(tif, layout.roi_x, layout.roi_y, layout.roi_w, layout.roi_h);
             }
             img.bps = 16;
         }
-        img.nx = roi_w;
-        img.ny = roi_h;
+        img.nx = layout.roi_w;
+        img.ny = layout.roi_h;
         TIFFClose(tif);
 
         if (img.photo == PALETTE) {
             //
             // ok, we have a palette color image we have to convert to RGB...
             //
-            if (colmap_len <= 256) { // we have bps <= 8
+            if (layout.colmap_len <= 256) { // we have bps <= 8
                 if (img.bps != 8) {
                     throw IIIFImageError(file_, __LINE__,
                                          fmt::format("Invalid palette format: bps={} colmap_length={}", img.bps,
-                                                     colmap_len));
+                                                     layout.colmap_len));
                 }
                 auto dataptr = std::vector<uint8_t>((img.nc + 2) * img.nx * img.ny);
                 for (uint32_t i = 0; i < img.nx * img.ny; i++) {
-                    dataptr[(img.nc + 2) * i] = static_cast<uint8_t>(rcm[img.bpixels[i * img.nc]]);
-                    dataptr[(img.nc + 2) * i + 1] = static_cast<uint8_t>(gcm[img.bpixels[i * img.nc]]);
-                    dataptr[(img.nc + 2) * i + 2] = static_cast<uint8_t>(bcm[img.bpixels[i * img.nc]]);
+                    dataptr[(img.nc + 2) * i] = static_cast<uint8_t>(layout.rcm[img.bpixels[i * img.nc]]);
+                    dataptr[(img.nc + 2) * i + 1] = static_cast<uint8_t>(layout.gcm[img.bpixels[i * img.nc]]);
+                    dataptr[(img.nc + 2) * i + 2] = static_cast<uint8_t>(layout.bcm[img.bpixels[i * img.nc]]);
                     if (img.nc > 1) {
                         for (uint32_t k = 1; k < img.nc; k++) {
                             dataptr[(img.nc + 2) * i + 2 + k] = img.bpixels[i * img.nc + k];
@@ -1099,13 +1216,13 @@ namespace cserve {
                 if (img.bps != 16) {
                     throw IIIFImageError(file_, __LINE__,
                                          fmt::format("Invalid palette format: bps={} colmap_length={}", img.bps,
-                                                     colmap_len));
+                                                     layout.colmap_len));
                 }
                 auto dataptr = std::vector<uint16_t>((img.nc + 2) * img.nx * img.ny);
                 for (size_t i = 0; i < img.nx * img.ny; i++) {
-                    dataptr[(img.nc + 2) * i] = rcm[img.wpixels[i*img.nc]];
-                    dataptr[(img.nc + 2) * i + 1] = gcm[img.wpixels[i*img.nc]];
-                    dataptr[(img.nc + 2) * i + 2] = bcm[img.wpixels[i*img.nc]];
+                    dataptr[(img.nc + 2) * i] = layout.rcm[img.wpixels[i*img.nc]];
+                    dataptr[(img.nc + 2) * i + 1] = layout.gcm[img.wpixels[i*img.nc]];
+                    dataptr[(img.nc + 2) * i + 2] = layout.bcm[img.wpixels[i*img.nc]];
                     if (img.nc > 1) {
                         for (uint32_t k = 1; k < img.nc; k++) {
                             dataptr[(img.nc + 2) * i + 2 + k] = img.wpixels[i * img.nc + k];
@@ -1221,16 +1338,7 @@ namespace cserve {
             bool redonly;
             IIIFSize::SizeType rtype = size->get_size(img.nx, img.ny, nnx, nny, reduce, redonly);
             if (rtype != IIIFSize::FULL) {
-                switch (scaling_quality.jpeg) {
-                    case HIGH:
-                        img.scale(nnx, nny);
-                        break;
-                    case MEDIUM:
-                        img.scaleMedium(nnx, nny);
-                        break;
-                    case LOW:
-                        img.scaleFast(nnx, nny);
-                }
+                img.cropAndScale(nullptr, nnx, nny, scaling_quality.jpeg);
             }
         }
         if (force_bps_8) {
@@ -1240,7 +1348,149 @@ namespace cserve {
         }
         return img;
     }
+    //============================================================================
+
+
+    namespace {
+        /*!
+         * Delivers the rows of the region of a TIFF file with contiguous 8 or 16 bit samples.
+         * Of a tiled file, one row of tiles (cropped to the region) is kept in memory.
+         */
+        class TiffStripSource : public IIIFStripSource {
+        private:
+            TIFF *tif;
+            TiffHandles handles;          //!< handles for decompressing the tiles of a row in parallel
+            uint32_t roi_x;
+            uint32_t roi_y;
+            uint32_t next_row{0};         //!< next row of the region to be delivered
+            size_t pixel_size;            //!< bytes per pixel
+            uint32_t image_height{0};     //!< height of the selected directory
+            uint32_t tile_width{0};
+            uint32_t tile_length{0};
+            uint32_t tile_size{0};        //!< bytes of a decompressed tile
+            std::vector<uint8_t> buffer;  //!< a scanline, or a row of tiles cropped to the region
+            uint32_t band_first{0};       //!< first image row in buffer (tiled files)
+            uint32_t band_rows{0};
+
+            void read_band(uint32_t ty) {
+                band_first = ty * tile_length;
+                band_rows = std::min(tile_length, image_height - band_first);
+                //
+                // the tiles of the row are decompressed in parallel, like by IIIFIOTiff::read()
+                //
+                if (shell.getBps() == 16) {
+                    read_tiles<uint16_t>(handles, PLANARCONFIG_CONTIG, shell.getNc(), tile_width, tile_length, tile_size,
+                                         roi_x, band_first, shell.getNx(), band_rows, 1,
+                                         reinterpret_cast<uint16_t *>(buffer.data()));
+                } else {
+                    read_tiles<uint8_t>(handles, PLANARCONFIG_CONTIG, shell.getNc(), tile_width, tile_length, tile_size,
+                                        roi_x, band_first, shell.getNx(), band_rows, 1, buffer.data());
+                }
+            }
+
+        public:
+            TiffStripSource(TIFF *tif_p, IIIFImage header_p, uint32_t roi_x, uint32_t roi_y, bool is_tiled)
+                    : IIIFStripSource(std::move(header_p)), tif(tif_p), handles(tif_p), roi_x(roi_x), roi_y(roi_y) {
+                pixel_size = shell.getNc() * (shell.getBps() / 8);
+                TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &image_height);
+                if (is_tiled) {
+                    TIFF_GET_FIELD (tif, TIFFTAG_TILEWIDTH, &tile_width, 0)
+                    TIFF_GET_FIELD (tif, TIFFTAG_TILELENGTH, &tile_length, 0)
+                    tile_size = TIFFTileSize(tif);
+                    buffer.resize(tile_length * row_size());
+                } else {
+                    buffer.resize(TIFFScanlineSize(tif));
+                }
+            }
+
+            ~TiffStripSource() override {
+                TIFFClose(tif);
+            }
+
+            [[nodiscard]] uint32_t strip_height() const override {
+                return (tile_length > 0) ? tile_length : IIIFStripSource::strip_height();
+            }
+
+            uint32_t read(uint8_t *buf, uint32_t nrows) override {
+                nrows = std::min(nrows, shell.getNy() - next_row);
+                const size_t sll = row_size();
+                for (uint32_t j = 0; j < nrows; ++j, ++next_row) {
+                    const uint32_t row = roi_y + next_row;
+                    if (tile_length > 0) {
+                        if ((band_rows == 0) || (row >= band_first + band_rows)) {
+                            read_band(row / tile_length);
+                        }
+                        std::memcpy(buf + j * sll, buffer.data() + (row - band_first) * sll, sll);
+                    } else {
+                        if (TIFFReadScanline(tif, buffer.data(), row, 0) != 1) {
+                            throw IIIFImageError(file_, __LINE__, fmt::format("TIFFReadScanline failed on scanline {}", row));
+                        }
+                        std::memcpy(buf + j * sll, buffer.data() + roi_x * pixel_size, sll);
+                    }
+                }
+                return nrows;
+            }
+        };
+    }
 
+    std::unique_ptr<IIIFStripSource> IIIFIOTiff::read_strips(const std::string &filepath,
+                                                             std::shared_ptr<IIIFRegion> region,
+                                                             std::shared_ptr<IIIFSize> size,
+                                                             bool force_bps_8,
+                                                             ScalingQuality scaling_quality) {
+        IIIFImage img{};
+        TiffLayout layout;
+        TIFF *tif = read_header(filepath, region, size, img, layout);
+
+        uint16_t planar;
+        TIFF_GET_FIELD (tif, TIFFTAG_PLANARCONFIG, &planar, PLANARCONFIG_CONTIG)
+        bool streamable = ((img.bps == 8) || (img.bps == 16)) && (planar == PLANARCONFIG_CONTIG) &&
+                          (img.photo != PALETTE) && ((img.photo != CIELAB) || (img.icc != nullptr));
+        if (streamable && (img.icc == nullptr)) {
+            switch (img.photo) {
+                case MINISBLACK:
+                case MINISWHITE: {
+                    img.icc = std::make_shared<IIIFIcc>(icc_GRAY_D50);
+                    break;
+                }
+                case SEPARATED: {
+                    img.icc = std::make_shared<IIIFIcc>(icc_CYMK_standard);
+                    break;
+                }
+                case YCBCR: // fall through!
+                case RGB: {
+                    img.icc = std::make_shared<IIIFIcc>(icc_sRGB);
+                    break;
+                }
+                default: {
+                    streamable = false;
+                }
+            }
+        }
+        if (!streamable) {
+            return std::make_unique<IIIFStripImage>(read_data(tif, std::move(img), layout, size, force_bps_8, scaling_quality));
+        }
+
+        img.nx = layout.roi_w;
+        img.ny = layout.roi_h;
+        std::unique_ptr<IIIFStripSource> strips = std::make_unique<TiffStripSource>(tif, std::move(img),
+                                                                                    layout.roi_x, layout.roi_y,
+                                                                                    layout.is_tiled);
+        if (size != nullptr) {
+            uint32_t nnx, nny;
+            uint32_t reduce = -1;
+            bool redonly;
+            IIIFSize::SizeType rtype = size->get_size(layout.roi_w, layout.roi_h, nnx, nny, reduce, redonly);
+            if (rtype != IIIFSize::FULL) {
+                strips = std::make_unique<IIIFStripResample>(std::move(strips), nnx, nny, scaling_quality.jpeg);
+            }
+        }
+        if (force_bps_8 && (strips->header().getBps() == 16)) {
+            strips = std::make_unique<IIIFStripTo8bps>(std::move(strips));
+        }
+        return strips;
+    }
+    //============================================================================
 
     IIIFImgInfo IIIFIOTiff::getDim(const std::string &filepath) {
         TIFF *tif;
@@ -1448,8 +1698,14 @@ namespace cserve {
                 throw IIIFImageError(file_, __LINE__, msg);
             }
         }
+        //
+        // an image converted by toBitonal() comes with its pixels packed to 1 bit
+        //
+        const uint8_t *bitonal = img.bitonalPixels();
         bool its_1_bit = false;
-        if ((img.photo == PhotometricInterpretation::MINISWHITE) ||
+        if (bitonal != nullptr) {
+            its_1_bit = true;
+        } else if ((img.photo == PhotometricInterpretation::MINISWHITE) ||
             (img.photo == PhotometricInterpretation::MINISBLACK)) {
             its_1_bit = true;
 
@@ -1633,10 +1889,14 @@ namespace cserve {
         }
 
         if (its_1_bit) {
-            unsigned int sll;
-            auto buf = cvrt8BitTo1bit(img, sll);
+            unsigned int sll = (img.nx + 7) / 8;
+            std::vector<uint8_t> buf;
+            if (bitonal == nullptr) {
+                buf = cvrt8BitTo1bit(img, sll);
+                bitonal = buf.data();
+            }
             for (size_t i = 0; i < img.ny; i++) {
-                TIFFWriteScanline(tif, buf.data() + i * sll, (int) i, 0);
+                TIFFWriteScanline(tif, const_cast<uint8_t *>(bitonal) + i * sll, (int) i, 0);
             }
             TIFFWriteDirectory(tif);
         } else if (img.bps == 8 ) {
@@ -44,6 +44,46 @@ namespace cserve {
          */
         static void writeExif(const IIIFImage &img, TIFF *tif);
 
+        /*!
+         * Where the pixels of the region to be read are found in the TIFF file
+         */
+        typedef struct TiffLayout_ {
+            std::vector<uint16_t> rcm;  //!< colormap of a palette image
+            std::vector<uint16_t> gcm;
+            std::vector<uint16_t> bcm;
+            int colmap_len{0};
+            bool is_tiled{false};
+            int32_t roi_x{0};           //!< region in the selected directory of the pyramid
+            int32_t roi_y{0};
+            uint32_t roi_w{0};
+            uint32_t roi_h{0};
+        } TiffLayout;
+
+        /*!
+         * Open a TIFF file, read the tags and the metadata and select the directory of
+         * the pyramid and the region to be read
+         *
+         * \param[out] img The image without pixels
+         * \param[out] layout Colormap, organisation and region of the pixels
+         * \returns The TIFF file handle, positioned at the selected directory
+         */
+        static TIFF *read_header(const std::string &filepath,
+                                 const std::shared_ptr<IIIFRegion> &region,
+                                 const std::shared_ptr<IIIFSize> &size,
+                                 IIIFImage &img,
+                                 TiffLayout &layout);
+
+        /*!
+         * Read the pixels of the region selected by read_header(), expand palette images and scale
+         * the result. The TIFF file is closed.
+         */
+        static IIIFImage read_data(TIFF *tif,
+                                   IIIFImage img,
+                                   const TiffLayout &layout,
+                                   const std::shared_ptr<IIIFSize> &size,
+                                   bool force_bps_8,
+                                   ScalingQuality scaling_quality);
+
         static void write_basic_tags(const IIIFImage &img,
                               TIFF *tif,
                               uint32_t nx, uint32_t ny,
@@ -69,6 +109,17 @@ namespace cserve {
                        bool force_bps_8,
                        ScalingQuality scaling_quality) override;
 
+        /*!
+         * Open a TIFF file for reading its rows strip by strip. Stripped and tiled files with
+         * contiguous 8 or 16 bit samples are streamed (the tiles of one row of tiles are kept in
+         * memory); palette images, CIELAB without ICC profile and other layouts are read completely.
+         */
+        std::unique_ptr<IIIFStripSource> read_strips(const std::string &filepath,
+                                                     std::shared_ptr<IIIFRegion> region,
+                                                     std::shared_ptr<IIIFSize> size,
+                                                     bool force_bps_8,
+                                                     ScalingQuality scaling_quality) override;
+
         IIIFImgInfo getDim(const std::string &filepath) override;
 
         /*!
@@ -13,6 +13,8 @@
 #include <memory>
 #include <ctime>
 
+#include <openssl/evp.h>
+
 #include "IIIFIcc.h"
 
 
@@ -66,6 +68,7 @@ namespace cserve {
             }
 
             profile_type = icc_p.profile_type;
+            digest = icc_p.digest;
         }
         else {
             icc_profile = nullptr;
@@ -76,9 +79,11 @@ namespace cserve {
     IIIFIcc::IIIFIcc(IIIFIcc &&other) noexcept : icc_profile(nullptr), profile_type(icc_undefined) {
         profile_type = other.profile_type;
         icc_profile = other.icc_profile;
+        digest = std::move(other.digest);
 
         other.profile_type = icc_undefined;
         other.icc_profile = nullptr;
+        other.digest.clear();
     }
 
     IIIFIcc::IIIFIcc(cmsHPROFILE &icc_profile_p) {
@@ -214,6 +219,7 @@ namespace cserve {
                 }
             }
             profile_type = rhs.profile_type;
+            digest = rhs.digest;
         }
         return *this;
     }
@@ -222,9 +228,11 @@ namespace cserve {
         if (this != &rhs) {
             profile_type = rhs.profile_type;
             icc_profile = rhs.icc_profile;
+            digest = std::move(rhs.digest);
 
             rhs.profile_type = icc_undefined;
             rhs.icc_profile = nullptr;
+            rhs.digest.clear();
         }
         return *this;
     }
@@ -255,6 +263,31 @@ namespace cserve {
         return icc_profile;
     }
 
+    const std::string &IIIFIcc::profileDigest() const {
+        if ((icc_profile == nullptr) || !digest.empty()) return digest;
+        cmsUInt32Number len = 0;
+        if (!cmsSaveProfileToMem(icc_profile, nullptr, &len)) {
+            throw IIIFError(file_, __LINE__, "cmsSaveProfileToMem failed");
+        }
+        std::string buf(len, '\0');
+        if (!cmsSaveProfileToMem(icc_profile, buf.data(), &len)) {
+            throw IIIFError(file_, __LINE__, "cmsSaveProfileToMem failed");
+        }
+        //
+        // the header fields without influence on the colors (e.g. creation date, creator
+        // and profile ID) are ignored, otherwise each instance of a built-in profile would
+        // have its own digest
+        //
+        std::string relevant = (buf.size() < 128) ? buf : buf.substr(8, 16) + buf.substr(64, 16) + buf.substr(128);
+        unsigned char md[EVP_MAX_MD_SIZE];
+        unsigned int md_len = 0;
+        if (EVP_Digest(relevant.data(), relevant.size(), md, &md_len, EVP_sha256(), nullptr) != 1) {
+            throw IIIFError(file_, __LINE__, "EVP_Digest failed");
+        }
+        digest.assign(reinterpret_cast<char *>(md), md_len);
+        return digest;
+    }
+
     unsigned int IIIFIcc::iccFormatter(size_t bps) const {
         cmsSetLogErrorHandler(icc_error_logger);
         cmsUInt32Number format = (bps == 16) ? BYTES_SH(2) : BYTES_SH(1);
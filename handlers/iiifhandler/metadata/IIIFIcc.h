@@ -54,6 +54,7 @@ namespace cserve {
     private:
         cmsHPROFILE icc_profile{};            //!< Handle of the littleCMS profile data
         PredefinedProfiles profile_type;    //!< Profile type that is represented
+        mutable std::string digest{};      //!< Cached result of profileDigest(), empty if not yet computed
 
     public:
         /*!
@@ -135,6 +136,15 @@ namespace cserve {
         [[nodiscard]]
         cmsHPROFILE getIccProfile() const;
 
+        /*!
+         * SHA-256 digest of the serialized profile without the header fields that don't influence
+         * the colors (creation date, creator, profile ID etc.). Profiles with the same data have the
+         * same digest. It is computed on the first call only.
+         * \returns The 32 bytes of the digest, empty for an undefined profile
+         */
+        [[nodiscard]]
+        const std::string &profileDigest() const;
+
         /*!
          * Get the profile type
          * \retruns Gives the predefined profile type
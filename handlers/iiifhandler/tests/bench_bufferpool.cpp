@@ -0,0 +1,78 @@
+//
+// Soak test of the pixel buffer pool.
+//
+// A sequence of requests of varying size is processed like IIIFImage does it (decode
+// buffer, scaling, rotation), once with and once without buffer pool. For both runs the
+// minor page faults (every fresh page of a new buffer causes one) and the resident
+// memory after every 20 requests are reported.
+//
+// Run from the tests directory with: <build-dir>/handlers/iiifhandler/tests/bufferpool_bench "[!benchmark]"
+//
+#include "catch2/catch_all.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "../IIIFBufferPool.h"
+#include "../IIIFResample.h"
+#include "../IIIFRotate.h"
+
+namespace {
+    long minor_faults() {
+        struct rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_minflt;
+    }
+
+    double rss_mb() {
+        std::ifstream statm("/proc/self/statm");
+        long size = 0, resident = 0;
+        statm >> size >> resident;
+        return static_cast<double>(resident) * static_cast<double>(sysconf(_SC_PAGESIZE)) / (1024.0 * 1024.0);
+    }
+
+    void soak(size_t pool_size, uint32_t nrequests) {
+        cserve::IIIFBufferPool::configure(pool_size);
+        std::mt19937 gen(4711);
+        std::uniform_int_distribution<uint32_t> dim(3000, 6000);
+        std::uniform_int_distribution<uint32_t> angle(0, 3);
+
+        const long faults_start = minor_faults();
+        auto start = std::chrono::steady_clock::now();
+        std::cout << (pool_size > 0 ? "with buffer pool" : "without buffer pool") << ", RSS (MB):";
+        for (uint32_t r = 0; r < nrequests; r++) {
+            const uint32_t nx = dim(gen), ny = dim(gen), nc = 3;
+            auto pixels = cserve::acquirePixels<uint8_t>(static_cast<size_t>(nx) * ny * nc);
+            for (size_t i = 0; i < pixels.size(); i += 64) pixels[i] = static_cast<uint8_t>(i >> 6); // "decoding"
+            const uint32_t nnx = nx / 2, nny = ny / 2;
+            pixels = cserve::doResample<uint8_t>(std::move(pixels), nx, ny, nc, nnx, nny, cserve::RESAMPLE_AREA);
+            uint32_t rnx, rny;
+            pixels = cserve::doRotate<uint8_t>(std::move(pixels), nnx, nny, nc, rnx, rny, 90.0f * angle(gen), false);
+            cserve::releasePixels(std::move(pixels));
+            if ((r + 1) % 20 == 0) std::cout << " " << static_cast<int>(rss_mb());
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << std::endl << "  " << nrequests << " requests: " << elapsed.count() << " s, "
+                  << minor_faults() - faults_start << " minor page faults";
+        auto pool = cserve::IIIFBufferPool::instance();
+        if (pool != nullptr) {
+            std::cout << ", hits: " << pool->hits() << ", misses: " << pool->misses() << ", discarded: "
+                      << pool->discarded() << ", peak idle: " << pool->getPeakIdleBytes() / (1024 * 1024) << " MB";
+        }
+        std::cout << std::endl;
+        cserve::IIIFBufferPool::configure(0);
+    }
+}
+
+TEST_CASE("Buffer pool soak test", "[!benchmark][IIIFBufferPool]") {
+    soak(0, 200);
+    soak(256 * 1024 * 1024, 200);
+    soak(512 * 1024 * 1024, 200);
+}
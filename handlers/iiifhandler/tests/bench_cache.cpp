@@ -0,0 +1,79 @@
+//
+// Lookup throughput of IIIFCache against the number of threads.
+//
+// Every lookup is what a cache hit of send_iiif_file does: getSize() of the master file and
+// pin() of the canonical URL. The index is sharded and lookups only take a shared lock of one
+// shard, so the throughput should grow with the number of threads up to the number of cores.
+//
+// Run from the tests directory with: <build-dir>/handlers/iiifhandler/tests/cache_bench "[!benchmark]"
+//
+#include "catch2/catch_all.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../IIIFCache.h"
+
+TEST_CASE("IIIFCache lookup throughput", "[!benchmark][IIIFCache]") {
+    const std::string cachedir = "./bench_cache";
+    const std::string origpath = "./data/image_bench_cache.jpg";
+    const int nfiles = 1000;
+    (void) mkdir(cachedir.c_str(), 0755);
+    {
+        std::ofstream orig(origpath);
+        orig << "master";
+    }
+    sleep(1); // the cache files must be newer than the master file
+
+    std::vector<std::string> canonicals;
+    {
+        cserve::IIIFCache cache(cachedir, 0, 0, 0.1f);
+        for (int i = 0; i < nfiles; i++) {
+            std::string canonical = "/iiif/images/image_bench_cache.jpg/" + std::to_string(256 * i) + ",0,256,256/256,/0/default.jpg";
+            std::string cachefile = cache.getNewCacheFileName();
+            {
+                std::ofstream out(cachefile);
+                out << "tile " << i;
+            }
+            cache.add(origpath, canonical, cachefile, 65536, 256, {});
+            canonicals.push_back(canonical);
+        }
+
+        for (int nthreads = 1; nthreads <= 64; nthreads *= 2) {
+            std::atomic<bool> stop{false};
+            std::atomic<long> nlookups{0};
+            std::vector<std::thread> workers;
+            for (int t = 0; t < nthreads; t++) {
+                workers.emplace_back([&, t] {
+                    long n = 0;
+                    size_t i = 7919 * t;
+                    size_t img_w, img_h;
+                    std::vector<cserve::SubImageInfo> resolutions;
+                    while (!stop.load(std::memory_order_relaxed)) {
+                        (void) cache.getSize(origpath, img_w, img_h, resolutions);
+                        auto pinned = cache.pin(origpath, canonicals[(i += 13) % nfiles]);
+                        if (pinned) ++n;
+                    }
+                    nlookups += n;
+                });
+            }
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            stop = true;
+            for (auto &worker: workers) worker.join();
+            std::cout << nthreads << " threads: " << nlookups.load() << " lookups/s" << std::endl;
+            CHECK(nlookups > 0);
+        }
+        for (const auto &canonical: canonicals) (void) cache.remove(canonical);
+    }
+    std::remove((cachedir + "/.iiifcache").c_str());
+    (void) rmdir(cachedir.c_str());
+    std::remove(origpath.c_str());
+}
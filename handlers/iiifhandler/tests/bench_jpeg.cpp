@@ -0,0 +1,242 @@
+//
+// Speed of JPEG region reads.
+//
+// A 512x512 tile is read out of a 20000x15000 JPEG master at several positions, and a
+// 4096x4096 region is read scaled down to 512x512 (DCT scaling by 1/8). Only the scanlines
+// and iMCU columns covering the region are decompressed. For comparison, the time to
+// decompress the whole master is given, which is what every region read used to cost.
+//
+// The encoder profiles (DCT method, Huffman optimisation, progressive, chroma subsampling) are
+// compared on the test images in data: time to encode and size of the result.
+//
+// The latency of the compression of a 60 megapixel image in parallel stripes is measured with an
+// increasing number of threads, and compared with the serial baseline and progressive compression.
+//
+// The rotation of a 50 megapixel JPEG by 90° in the DCT domain is compared with decoding, rotating
+// and encoding it again.
+//
+// Run from the tests directory with: <build-dir>/handlers/iiifhandler/tests/jpeg_bench "[!benchmark]"
+//
+#include "catch2/catch_all.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "jpeglib.h"
+
+#include "../IIIFComputePool.h"
+#include "../IIIFImage.h"
+#include "../imgformats/IIIFIOJpeg.h"
+
+namespace {
+    const char *master = "scratch/bench_master.jpg";
+    const uint32_t master_nx = 20000;
+    const uint32_t master_ny = 15000;
+
+    void write_master() {
+        FILE *outfile = fopen(master, "wb");
+        REQUIRE(outfile != nullptr);
+        struct jpeg_compress_struct cinfo{};
+        struct jpeg_error_mgr jerr{};
+        cinfo.err = jpeg_std_error(&jerr);
+        jpeg_create_compress(&cinfo);
+        jpeg_stdio_dest(&cinfo, outfile);
+        cinfo.image_width = master_nx;
+        cinfo.image_height = master_ny;
+        cinfo.input_components = 3;
+        cinfo.in_color_space = JCS_RGB;
+        jpeg_set_defaults(&cinfo);
+        jpeg_set_quality(&cinfo, 85, TRUE);
+        jpeg_start_compress(&cinfo, TRUE);
+        std::vector<uint8_t> row(master_nx * 3);
+        for (uint32_t y = 0; y < master_ny; y++) {
+            for (uint32_t x = 0; x < master_nx; x++) {
+                row[3 * x] = static_cast<uint8_t>((x * 7 + y * 3) >> 4);
+                row[3 * x + 1] = static_cast<uint8_t>((x ^ y) * 13);
+                row[3 * x + 2] = static_cast<uint8_t>((x * y) >> 8);
+            }
+            JSAMPROW rowptr = row.data();
+            jpeg_write_scanlines(&cinfo, &rowptr, 1);
+        }
+        jpeg_finish_compress(&cinfo);
+        jpeg_destroy_compress(&cinfo);
+        fclose(outfile);
+    }
+
+    void decode_all() {
+        FILE *infile = fopen(master, "rb");
+        struct jpeg_decompress_struct cinfo{};
+        struct jpeg_error_mgr jerr{};
+        cinfo.err = jpeg_std_error(&jerr);
+        jpeg_create_decompress(&cinfo);
+        jpeg_stdio_src(&cinfo, infile);
+        jpeg_read_header(&cinfo, TRUE);
+        cinfo.dct_method = JDCT_FLOAT;
+        cinfo.do_fancy_upsampling = FALSE;
+        jpeg_start_decompress(&cinfo);
+        std::vector<uint8_t> row(cinfo.output_width * cinfo.output_components);
+        JSAMPROW rowptr = row.data();
+        while (cinfo.output_scanline < cinfo.output_height) {
+            jpeg_read_scanlines(&cinfo, &rowptr, 1);
+        }
+        jpeg_finish_decompress(&cinfo);
+        jpeg_destroy_decompress(&cinfo);
+        fclose(infile);
+    }
+
+    void run_benchmark(const std::string &name, const std::function<void()> &func) {
+        double best = 1.0e9;
+        for (int rep = 0; rep < 5; rep++) {
+            auto start = std::chrono::steady_clock::now();
+            func();
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count());
+        }
+        std::cout << name << ": " << best * 1000.0 << " ms" << std::endl;
+    }
+}
+
+TEST_CASE("JPEG region read speed", "[!benchmark][IIIFIOJpeg]") {
+    write_master();
+    cserve::IIIFIOJpeg jpegio;
+
+    run_benchmark("whole master decompressed", decode_all);
+    for (auto coords: {"0,0,512,512", "9728,7168,512,512", "19456,14336,544,512"}) {
+        run_benchmark(std::string("tile ") + coords, [&]() {
+            auto img = jpegio.read(master,
+                                   std::make_shared<cserve::IIIFRegion>(coords),
+                                   std::make_shared<cserve::IIIFSize>("max"),
+                                   false,
+                                   {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH});
+            REQUIRE(img.getNy() == 512);
+        });
+    }
+    run_benchmark("region 4096,4096,4096,4096 scaled to 512,512", [&]() {
+        auto img = jpegio.read(master,
+                               std::make_shared<cserve::IIIFRegion>("4096,4096,4096,4096"),
+                               std::make_shared<cserve::IIIFSize>("512,512"),
+                               false,
+                               {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH});
+        REQUIRE(img.getNx() == 512);
+    });
+    std::filesystem::remove(master);
+}
+
+TEST_CASE("JPEG encoder profiles", "[!benchmark][IIIFIOJpeg]") {
+    typedef struct {
+        const char *name;
+        cserve::IIIFCompressionParams params;
+    } Profile;
+    const std::vector<Profile> profiles{
+        {"islow progressive 4:2:0 (default)", {}},
+        {"islow baseline 4:2:0", {{cserve::JPEG_PROGRESSIVE, "no"}, {cserve::JPEG_OPTIMIZE, "no"}}},
+        {"islow baseline optimized 4:2:0", {{cserve::JPEG_PROGRESSIVE, "no"}}},
+        {"ifast baseline 4:2:0", {{cserve::JPEG_DCT_METHOD, "ifast"}, {cserve::JPEG_PROGRESSIVE, "no"}, {cserve::JPEG_OPTIMIZE, "no"}}},
+        {"float progressive 4:2:0", {{cserve::JPEG_DCT_METHOD, "float"}}},
+        {"islow progressive 4:2:2", {{cserve::JPEG_SUBSAMPLING, "4:2:2"}}},
+        {"islow progressive 4:4:4", {{cserve::JPEG_SUBSAMPLING, "4:4:4"}}},
+    };
+    const std::string outfile = "scratch/bench_profile.jpg";
+    cserve::IIIFIOJpeg jpegio;
+
+    for (auto path: {"data/image_orientation.jpg", "data/IMG_8207.tiff", "data/tiff_01_rgb_uncompressed.tif", "data/png_rgb8.png"}) {
+        auto img = cserve::IIIFImage::read(path);
+        if (img.getBps() == 16) img.to8bps();
+        std::cout << path << " (" << img.getNx() << "x" << img.getNy() << "):" << std::endl;
+        for (const auto &profile: profiles) {
+            double best = 1.0e9;
+            for (int rep = 0; rep < 3; rep++) {
+                auto start = std::chrono::steady_clock::now();
+                jpegio.write(img, outfile, profile.params);
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                best = std::min(best, elapsed.count());
+            }
+            std::cout << "  " << std::left << std::setw(36) << profile.name << std::right
+                      << std::setw(9) << std::fixed << std::setprecision(1) << best * 1000.0 << " ms"
+                      << std::setw(10) << std::filesystem::file_size(outfile) << " bytes" << std::endl;
+            std::filesystem::remove(outfile);
+        }
+    }
+
+    //
+    // decoding with the DCT methods
+    //
+    for (auto dct: {cserve::DCT_ISLOW, cserve::DCT_IFAST, cserve::DCT_FLOAT}) {
+        static const char *names[] = {"islow", "ifast", "float"};
+        run_benchmark(std::string("decode data/image_orientation.jpg, ") + names[dct], [&]() {
+            jpegio.read("data/image_orientation.jpg", nullptr, nullptr, false,
+                        {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH, dct});
+        });
+    }
+}
+
+TEST_CASE("JPEG parallel compression latency", "[!benchmark][IIIFIOJpeg]") {
+    write_master();
+    cserve::IIIFIOJpeg jpegio;
+    auto img = jpegio.read(master,
+                           std::make_shared<cserve::IIIFRegion>("0,0,9480,6320"),
+                           std::make_shared<cserve::IIIFSize>("max"),
+                           false,
+                           {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH});
+    std::filesystem::remove(master);
+    const std::string outfile = "scratch/bench_parallel.jpg";
+    const cserve::IIIFCompressionParams baseline{{cserve::JPEG_PROGRESSIVE, "no"}, {cserve::JPEG_OPTIMIZE, "no"}};
+
+    cserve::IIIFComputePool::configure(0, 1);
+    run_benchmark("60 MP progressive, serial", [&]() { jpegio.write(img, outfile, {}); });
+    run_benchmark("60 MP baseline, serial", [&]() { jpegio.write(img, outfile, baseline); });
+    auto parallel = baseline;
+    parallel[cserve::JPEG_PARALLEL] = "yes";
+    for (uint32_t nthreads: {2u, 4u, 8u, 16u}) {
+        cserve::IIIFComputePool::configure(nthreads, nthreads);
+        run_benchmark("60 MP baseline, parallel stripes, " + std::to_string(nthreads) + " threads",
+                      [&]() { jpegio.write(img, outfile, parallel); });
+    }
+    cserve::IIIFComputePool::configure(0, 1);
+    std::filesystem::remove(outfile);
+}
+
+TEST_CASE("JPEG lossless rotation", "[!benchmark][IIIFIOJpeg]") {
+    write_master();
+    cserve::IIIFIOJpeg jpegio;
+    auto img = jpegio.read(master,
+                           std::make_shared<cserve::IIIFRegion>("0,0,8192,6144"),
+                           std::make_shared<cserve::IIIFSize>("max"),
+                           false,
+                           {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH});
+    jpegio.write(img, master, {});
+    const std::string outfile = "scratch/bench_rotated.jpg";
+
+    run_benchmark("50 MP rotated by 90 degrees, decoded and encoded", [&]() {
+        auto rotated = jpegio.read(master, nullptr, nullptr, false, {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH});
+        rotated.rotate(90.0F, false);
+        jpegio.write(rotated, outfile, {});
+    });
+    std::vector<unsigned char> jpeg;
+    run_benchmark("50 MP rotated by 90 degrees, lossless transform", [&]() {
+        REQUIRE(cserve::IIIFIOJpeg::transform_lossless(master, 0, 0, 8192, 6144, 90.0F, false, {}, jpeg));
+    });
+
+    //
+    // a tile: the lossless transform reads the whole file and the coefficients of all MCUs,
+    // the decoding path only the scanlines and iMCU columns of the region
+    //
+    auto tile_region = std::make_shared<cserve::IIIFRegion>("4096,3072,512,512");
+    run_benchmark("512x512 tile rotated by 90 degrees, decoded and encoded", [&]() {
+        auto rotated = jpegio.read(master, tile_region, nullptr, false, {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH});
+        rotated.rotate(90.0F, false);
+        jpegio.write(rotated, outfile, {});
+    });
+    run_benchmark("512x512 tile rotated by 90 degrees, lossless transform", [&]() {
+        REQUIRE(cserve::IIIFIOJpeg::transform_lossless(master, 4096, 3072, 512, 512, 90.0F, false, {}, jpeg));
+    });
+    std::filesystem::remove(master);
+    std::filesystem::remove(outfile);
+}
@@ -0,0 +1,118 @@
+//
+// Speed of the pixel conversion kernels.
+//
+// Each conversion is run on the samples of a 6000x4000 image (a single thread), once with the
+// scalar code and once with each SIMD kernel supported by the CPU. The error diffusion to black
+// and white is run with an increasing number of threads.
+//
+// Run from the tests directory with: <build-dir>/handlers/iiifhandler/tests/pixelkernels_bench "[!benchmark]"
+//
+#include "catch2/catch_all.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include "../IIIFBitonal.h"
+#include "../IIIFComputePool.h"
+#include "../IIIFPixelKernels.h"
+
+namespace {
+    void run_benchmark(const char *name, const std::function<void(cserve::ResampleKernel)> &convert) {
+        std::vector<cserve::ResampleKernel> kernels{cserve::RESAMPLE_SCALAR};
+        if (cserve::resampleKernel() == cserve::RESAMPLE_AVX2) kernels.push_back(cserve::RESAMPLE_SSE41);
+        if (cserve::resampleKernel() != cserve::RESAMPLE_SCALAR) kernels.push_back(cserve::resampleKernel());
+        std::cout << name << ":";
+        for (auto kernel: kernels) {
+            double best = 1.0e9;
+            for (int rep = 0; rep < 5; rep++) {
+                auto start = std::chrono::steady_clock::now();
+                convert(kernel);
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                best = std::min(best, elapsed.count());
+            }
+            std::cout << " " << cserve::resampleKernelName(kernel) << " " << best * 1000.0 << " ms";
+        }
+        std::cout << std::endl;
+    }
+}
+
+TEST_CASE("Pixel conversion speed", "[!benchmark][IIIFPixelKernels]") {
+    const uint32_t nx = 6000, ny = 4000, nc = 3;
+    const size_t npixels = static_cast<size_t>(nx) * ny;
+    std::vector<uint8_t> packed(npixels * 2);
+    for (size_t i = 0; i < packed.size(); i++) packed[i] = static_cast<uint8_t>((i * 7919) >> 3);
+    std::vector<uint8_t> img8(npixels * nc), out8(npixels * nc);
+    std::vector<uint16_t> img16(npixels * nc), out16(npixels * nc);
+    for (size_t i = 0; i < img8.size(); i++) {
+        img8[i] = static_cast<uint8_t>((i * 7919) >> 3);
+        img16[i] = static_cast<uint16_t>((i * 7919) >> 1);
+    }
+
+    run_benchmark("YCbCr to RGB, 8 bit", [&](cserve::ResampleKernel kernel) {
+        cserve::ycc2rgb(img8.data(), out8.data(), npixels, nc, kernel);
+    });
+    run_benchmark("YCbCr to RGB, 16 bit", [&](cserve::ResampleKernel kernel) {
+        cserve::ycc2rgb(img16.data(), out16.data(), npixels, nc, kernel);
+    });
+    run_benchmark("16 to 8 bit", [&](cserve::ResampleKernel kernel) {
+        cserve::sixteen2eight(img16.data(), out8.data(), img16.size(), kernel);
+    });
+    run_benchmark("separate to contiguous, 8 bit", [&](cserve::ResampleKernel kernel) {
+        cserve::separate2contig(img8.data(), out8.data(), npixels, nc, npixels, kernel);
+    });
+    run_benchmark("separate to contiguous, 16 bit", [&](cserve::ResampleKernel kernel) {
+        cserve::separate2contig(img16.data(), out16.data(), npixels, nc, npixels, kernel);
+    });
+    std::vector<uint8_t> wm_values(npixels);
+    for (size_t i = 0; i < wm_values.size(); i++) wm_values[i] = static_cast<uint8_t>((i * 13) >> 4);
+    run_benchmark("watermark blending, 8 bit", [&](cserve::ResampleKernel kernel) {
+        out8 = img8;
+        cserve::blendWatermark(out8.data(), wm_values.data(), npixels, nc, kernel);
+    });
+    run_benchmark("8 to 1 bit", [&](cserve::ResampleKernel kernel) {
+        for (uint32_t y = 0; y < ny; y++) {
+            cserve::eight2one(img8.data() + y * nx, packed.data() + y * (nx / 8), nx, 127, false, nullptr, kernel);
+        }
+    });
+    run_benchmark("1 to 8 bit", [&](cserve::ResampleKernel kernel) {
+        for (uint32_t y = 0; y < ny; y++) {
+            cserve::one2eight(packed.data() + y * (nx / 8), out8.data() + y * nx, nx, 0, 255, kernel);
+        }
+    });
+    run_benchmark("4 to 8 bit", [&](cserve::ResampleKernel kernel) {
+        for (uint32_t y = 0; y < ny; y++) {
+            cserve::four2eight(packed.data() + y * (nx / 2), out8.data() + y * nx, nx, false, kernel);
+        }
+    });
+    run_benchmark("12 to 16 bit", [&](cserve::ResampleKernel kernel) {
+        for (uint32_t y = 0; y < ny; y++) {
+            cserve::twelve2sixteen(packed.data() + y * (nx / 2 * 3), out16.data() + y * nx, nx, false, kernel);
+        }
+    });
+}
+
+TEST_CASE("Bitonal conversion speed", "[!benchmark][IIIFBitonal]") {
+    const uint32_t nx = 6000, ny = 4000;
+    std::vector<uint8_t> img(static_cast<size_t>(nx) * ny), bw(img.size()), packed((nx + 7) / 8 * ny);
+    for (size_t i = 0; i < img.size(); i++) img[i] = static_cast<uint8_t>((i * 7919) >> 3);
+
+    std::cout << "Floyd-Steinberg:";
+    for (uint32_t nthreads: {1u, 2u, 4u, 8u}) {
+        cserve::IIIFComputePool::configure(nthreads, nthreads);
+        double best = 1.0e9;
+        for (int rep = 0; rep < 3; rep++) {
+            bw = img;
+            auto start = std::chrono::steady_clock::now();
+            cserve::makeBitonal(bw.data(), packed.data(), nx, ny, cserve::BITONAL_DITHER, false);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count());
+        }
+        std::cout << " " << nthreads << " threads " << best * 1000.0 << " ms";
+    }
+    std::cout << std::endl;
+    cserve::IIIFComputePool::configure(0, 1);
+}
@@ -0,0 +1,122 @@
+//
+// Speed of the resampler kernels.
+//
+// A 10000x8000 RGB master is scaled to a width of 1024 pixels with each filter, once with
+// the scalar code and once with each SIMD kernel supported by the CPU.
+//
+// The second case scales a 100 megapixel image with 1, 4 and 16 threads of the IIIFComputePool.
+//
+// The third case compares cropping followed by scaling with the fused crop, integer reduction
+// and scaling (doCropReduceResample(), with the reduction factor chosen by IIIFImage::cropAndScale()).
+//
+// Run from the tests directory with: <build-dir>/handlers/iiifhandler/tests/resample_bench "[!benchmark]"
+//
+#include "catch2/catch_all.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "../IIIFResample.h"
+#include "../IIIFComputePool.h"
+
+namespace {
+    template<typename T>
+    void run_benchmark(uint32_t nx, uint32_t ny, uint32_t nc, uint32_t nnx, uint32_t nny) {
+        std::vector<T> img(static_cast<size_t>(nx) * ny * nc);
+        for (size_t i = 0; i < img.size(); i++) img[i] = static_cast<T>((i * 7919) >> 3);
+
+        std::vector<cserve::ResampleKernel> kernels{cserve::RESAMPLE_SCALAR};
+        if (cserve::resampleKernel() == cserve::RESAMPLE_AVX2) kernels.push_back(cserve::RESAMPLE_SSE41);
+        if (cserve::resampleKernel() != cserve::RESAMPLE_SCALAR) kernels.push_back(cserve::resampleKernel());
+
+        const std::pair<cserve::ResampleFilter, const char *> filters[] = {
+                {cserve::RESAMPLE_AREA, "area"},
+                {cserve::RESAMPLE_BICUBIC, "bicubic"},
+                {cserve::RESAMPLE_LANCZOS3, "lanczos3"}};
+        for (const auto &filter: filters) {
+            for (auto kernel: kernels) {
+                double best = 1.0e9;
+                for (int rep = 0; rep < 3; rep++) {
+                    std::vector<T> inbuf(img);
+                    auto start = std::chrono::steady_clock::now();
+                    auto outbuf = cserve::doResample<T>(std::move(inbuf), nx, ny, nc, nnx, nny, filter.first, kernel);
+                    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                    best = std::min(best, elapsed.count());
+                    CHECK(outbuf.size() == static_cast<size_t>(nnx) * nny * nc);
+                }
+                std::cout << 8 * sizeof(T) << " bit " << nx << "x" << ny << " -> " << nnx << "x" << nny << " "
+                          << filter.second << " (" << cserve::resampleKernelName(kernel) << "): "
+                          << best * 1000.0 << " ms, " << static_cast<double>(nx) * ny / best / 1.0e6 << " Mpixel/s" << std::endl;
+            }
+        }
+    }
+}
+
+TEST_CASE("Resampler speed", "[!benchmark][IIIFResample]") {
+    run_benchmark<uint8_t>(10000, 8000, 3, 1024, 819);
+    run_benchmark<uint16_t>(5000, 4000, 3, 1024, 819);
+    run_benchmark<uint8_t>(1024, 819, 3, 2500, 2000);
+}
+
+TEST_CASE("Resampler speed on the compute pool", "[!benchmark][IIIFResample][IIIFComputePool]") {
+    const uint32_t nx = 12000, ny = 8400, nc = 3; // 100 megapixel
+    std::vector<uint8_t> img(static_cast<size_t>(nx) * ny * nc);
+    for (size_t i = 0; i < img.size(); i++) img[i] = static_cast<uint8_t>((i * 7919) >> 3);
+
+    for (uint32_t nthreads: {1u, 4u, 16u}) {
+        cserve::IIIFComputePool::configure(nthreads, nthreads);
+        double best = 1.0e9;
+        for (int rep = 0; rep < 3; rep++) {
+            std::vector<uint8_t> inbuf(img);
+            auto start = std::chrono::steady_clock::now();
+            auto outbuf = cserve::doResample<uint8_t>(std::move(inbuf), nx, ny, nc, 3000, 2100, cserve::RESAMPLE_LANCZOS3);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count());
+            CHECK(outbuf.size() == 3000 * 2100 * nc);
+        }
+        std::cout << nx << "x" << ny << " -> 3000x2100 lanczos3, " << nthreads << " thread(s) on "
+                  << std::thread::hardware_concurrency() << " core(s): " << best * 1000.0 << " ms" << std::endl;
+    }
+    cserve::IIIFComputePool::configure(0, 1);
+}
+
+TEST_CASE("Fused crop, reduction and scaling speed", "[!benchmark][IIIFResample]") {
+    const uint32_t nx = 10000, ny = 8000, nc = 3;
+    const uint32_t x = 1000, y = 1000, w = 8000, h = 6000, nnx = 1000, nny = 750;
+    std::vector<uint8_t> img(static_cast<size_t>(nx) * ny * nc);
+    for (size_t i = 0; i < img.size(); i++) img[i] = static_cast<uint8_t>((i * 7919) >> 3);
+
+    const std::pair<cserve::ResampleFilter, const char *> filters[] = {
+            {cserve::RESAMPLE_AREA, "area"},
+            {cserve::RESAMPLE_BICUBIC, "bicubic"},
+            {cserve::RESAMPLE_LANCZOS3, "lanczos3"}};
+    for (const auto &filter: filters) {
+        double separate = 1.0e9, fused = 1.0e9;
+        const uint32_t reduce = (filter.first == cserve::RESAMPLE_AREA) ? w / nnx : w / nnx / 2;
+        for (int rep = 0; rep < 3; rep++) {
+            std::vector<uint8_t> inbuf(img);
+            auto start = std::chrono::steady_clock::now();
+            std::vector<uint8_t> cropped(static_cast<size_t>(w) * h * nc);
+            for (uint32_t j = 0; j < h; j++) {
+                std::copy_n(inbuf.data() + (static_cast<size_t>(y + j) * nx + x) * nc, w * nc, cropped.data() + static_cast<size_t>(j) * w * nc);
+            }
+            auto outbuf = cserve::doResample<uint8_t>(std::move(cropped), w, h, nc, nnx, nny, filter.first);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            separate = std::min(separate, elapsed.count());
+
+            inbuf = img;
+            start = std::chrono::steady_clock::now();
+            auto fusedbuf = cserve::doCropReduceResample<uint8_t>(std::move(inbuf), nx, ny, nc, x, y, w, h, reduce, nnx, nny, filter.first);
+            elapsed = std::chrono::steady_clock::now() - start;
+            fused = std::min(fused, elapsed.count());
+            CHECK(fusedbuf.size() == outbuf.size());
+        }
+        std::cout << nx << "x" << ny << " crop " << w << "x" << h << " -> " << nnx << "x" << nny << " " << filter.second
+                  << ": crop and scale " << separate * 1000.0 << " ms, fused (reduce " << reduce << ") "
+                  << fused * 1000.0 << " ms" << std::endl;
+    }
+}
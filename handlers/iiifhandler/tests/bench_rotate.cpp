@@ -0,0 +1,89 @@
+//
+// Speed of the rotation.
+//
+// Images with 1, 3 and 4 channels of 8 and 16 bit are rotated by 90, 180 and 270 degrees
+// (plain and mirrored) and by 30 degrees. The orthogonal rotations are compared with a
+// pixel by pixel copy as it was used before the blocked kernels.
+//
+// Run from the tests directory with: <build-dir>/handlers/iiifhandler/tests/rotate_bench "[!benchmark]"
+//
+#include "catch2/catch_all.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "../IIIFRotate.h"
+
+namespace {
+    template<typename T>
+    std::vector<T> naive_rotate(const std::vector<T> &in, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t angle) {
+        std::vector<T> out(in.size());
+        const uint32_t nnx = (angle == 180) ? nx : ny;
+        const uint32_t nny = (angle == 180) ? ny : nx;
+        for (uint32_t j = 0; j < nny; j++) {
+            for (uint32_t i = 0; i < nnx; i++) {
+                for (uint32_t k = 0; k < nc; k++) {
+                    size_t src;
+                    if (angle == 90) src = nc * ((ny - i - 1) * nx + j) + k;
+                    else if (angle == 180) src = nc * ((ny - j - 1) * nx + (nx - i - 1)) + k;
+                    else src = nc * (i * nx + (nx - j - 1)) + k;
+                    out[nc * (j * nnx + i) + k] = in[src];
+                }
+            }
+        }
+        return out;
+    }
+
+    template<typename Func>
+    double best_of_3(Func func) {
+        double best = 1.0e9;
+        for (int rep = 0; rep < 3; rep++) {
+            auto start = std::chrono::steady_clock::now();
+            func();
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count());
+        }
+        return best;
+    }
+
+    template<typename T>
+    void run_benchmark(uint32_t nx, uint32_t ny, uint32_t nc) {
+        std::vector<T> img(static_cast<size_t>(nx) * ny * nc);
+        for (size_t i = 0; i < img.size(); i++) img[i] = static_cast<T>((i * 7919) >> 3);
+        const double mpixel = static_cast<double>(nx) * ny / 1.0e6;
+
+        for (uint32_t angle: {90u, 180u, 270u}) {
+            double naive = best_of_3([&]() {
+                std::vector<T> inbuf(img); // doRotate() gets a copy, too
+                auto out = naive_rotate<T>(inbuf, nx, ny, nc, angle);
+                CHECK(out.size() == img.size());
+            });
+            for (bool mirror: {false, true}) {
+                double blocked = best_of_3([&]() {
+                    uint32_t nnx, nny;
+                    auto out = cserve::doRotate<T>(std::vector<T>(img), nx, ny, nc, nnx, nny, static_cast<float>(angle), mirror);
+                    CHECK(out.size() == img.size());
+                });
+                std::cout << 8 * sizeof(T) << " bit, " << nc << " channel(s) " << nx << "x" << ny << " " << angle
+                          << (mirror ? " mirrored" : "") << ": " << blocked * 1000.0 << " ms, " << mpixel / blocked
+                          << " Mpixel/s (pixel by pixel: " << naive * 1000.0 << " ms)" << std::endl;
+            }
+        }
+        double arbitrary = best_of_3([&]() {
+            uint32_t nnx, nny;
+            auto out = cserve::doRotate<T>(std::vector<T>(img), nx, ny, nc, nnx, nny, 30.0f, false);
+            CHECK(!out.empty());
+        });
+        std::cout << 8 * sizeof(T) << " bit, " << nc << " channel(s) " << nx << "x" << ny << " 30: "
+                  << arbitrary * 1000.0 << " ms, " << mpixel / arbitrary << " Mpixel/s" << std::endl;
+    }
+}
+
+TEST_CASE("Rotation speed", "[!benchmark][IIIFRotate]") {
+    for (uint32_t nc: {1u, 3u, 4u}) {
+        run_benchmark<uint8_t>(8000, 6000, nc);
+        run_benchmark<uint16_t>(6000, 4000, nc);
+    }
+}
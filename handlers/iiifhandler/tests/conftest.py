@@ -90,6 +90,7 @@ class CserverProcessManager:
             "IIIFHANDLER_IMGROOT": self.iiif_imgroot,
             "IIIFHANDLER_ROUTES": "GET:/{}:C++;"
                                   "GET:/iiifhandlervariables:iiifhandlervariables.lua;"
+                                  "GET:/cache_stats:cache_stats.lua;"
                                   "GET:/test_exif_gps:test_exif_gps.lua;"
                                   "POST:/upload:upload.lua;".format(self.iiif_route),
             "IIIFHANDLER_PREFIX_AS_PATH": "true",
@@ -107,6 +108,11 @@ class CserverProcessManager:
                 os.unlink(os.path.join(root, f))
             for d in dirs:
                 shutil.rmtree(os.path.join(root, d))
+        #
+        # start with an empty file cache (the IIIF handler uses it only if the directory exists)
+        #
+        shutil.rmtree('./cache', ignore_errors=True)
+        os.makedirs('./cache')
 
     def cleanup(self):
         """Cleanup files generated by the tests"""
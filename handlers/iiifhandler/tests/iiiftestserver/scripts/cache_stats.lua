@@ -0,0 +1,12 @@
+---
+--- Returns the counters of the IIIF caches
+---
+require "send_response"
+
+result = {
+    status = "OK",
+    stats = cache.stats()
+}
+
+send_success(result)
+return true
@@ -0,0 +1,108 @@
+//
+// Tests of the conversion to black and white (IIIFBitonal) against the original serial code
+//
+
+#include "catch2/catch_all.hpp"
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "../IIIFBitonal.h"
+#include "../IIIFComputePool.h"
+
+namespace {
+    std::vector<uint8_t> test_image(uint32_t nx, uint32_t ny) {
+        std::mt19937 gen(4711);
+        std::uniform_int_distribution<int> noise(-40, 40);
+        std::vector<uint8_t> img(static_cast<size_t>(nx) * ny);
+        for (uint32_t y = 0; y < ny; y++) {
+            for (uint32_t x = 0; x < nx; x++) {
+                int v = static_cast<int>((x * 255) / nx + (y * 3) % 64) + noise(gen);
+                img[static_cast<size_t>(y) * nx + x] = static_cast<uint8_t>(std::min(255, std::max(0, v)));
+            }
+        }
+        return img;
+    }
+
+    //
+    // the error diffusion as it was in IIIFImage::toBitonal()
+    //
+    std::vector<uint8_t> ref_dither(const std::vector<uint8_t> &img, uint32_t nx, uint32_t ny) {
+        std::vector<short> outbuf(img.begin(), img.end());
+        for (size_t y = 0; y < ny; y++) {
+            for (size_t x = 0; x < nx; x++) {
+                short oldpixel = outbuf[y * nx + x];
+                outbuf[y * nx + x] = (oldpixel > 127) ? 255 : 0;
+                int properr = (oldpixel - outbuf[y * nx + x]);
+                if (x < (nx - 1)) outbuf[y * nx + (x + 1)] += (7 * properr) >> 4;
+                if ((x > 0) && (y < (ny - 1))) outbuf[(y + 1) * nx + (x - 1)] += (3 * properr) >> 4;
+                if (y < (ny - 1)) outbuf[(y + 1) * nx + x] += (5 * properr) >> 4;
+                if ((x < (nx - 1)) && (y < (ny - 1))) outbuf[(y + 1) * nx + (x + 1)] += properr >> 4;
+            }
+        }
+        return {outbuf.begin(), outbuf.end()};
+    }
+
+    //
+    // the packing as in cvrt8BitTo1bit() (IIIFImgTools.cpp)
+    //
+    std::vector<uint8_t> ref_pack(const std::vector<uint8_t> &img, uint32_t nx, uint32_t ny, bool invert) {
+        const size_t sll = (nx + 7) / 8;
+        std::vector<uint8_t> packed(sll * ny);
+        for (size_t y = 0; y < ny; y++) {
+            for (size_t x = 0; x < nx; x++) {
+                if ((img[y * nx + x] > 128) != invert) packed[y * sll + x / 8] |= 0x80 >> (x % 8);
+            }
+        }
+        return packed;
+    }
+
+    void check(uint32_t nx, uint32_t ny) {
+        const auto img = test_image(nx, ny);
+        const auto ref = ref_dither(img, nx, ny);
+        for (bool invert: {false, true}) {
+            auto res = img;
+            std::vector<uint8_t> packed((nx + 7) / 8 * ny, 0xaa);
+            cserve::makeBitonal(res.data(), packed.data(), nx, ny, cserve::BITONAL_DITHER, invert);
+            REQUIRE(res == ref);
+            REQUIRE(packed == ref_pack(ref, nx, ny, invert));
+        }
+
+        auto res = img;
+        std::vector<uint8_t> packed((nx + 7) / 8 * ny);
+        cserve::makeBitonal(res.data(), packed.data(), nx, ny, cserve::BITONAL_THRESHOLD, false);
+        for (size_t i = 0; i < img.size(); i++) REQUIRE(res[i] == ((img[i] > 127) ? 255 : 0));
+        REQUIRE(packed == ref_pack(res, nx, ny, false));
+
+        //
+        // already bitonal: nothing changes
+        //
+        auto again = res;
+        cserve::makeBitonal(again.data(), packed.data(), nx, ny, cserve::BITONAL_DITHER, false);
+        REQUIRE(again == res);
+        REQUIRE(packed == ref_pack(res, nx, ny, false));
+    }
+}
+
+TEST_CASE("Testing the conversion to black and white", "[IIIFBitonal]") {
+
+    SECTION("serial") {
+        cserve::IIIFComputePool::configure(0, 1);
+        check(1, 5);
+        check(13, 1);
+        check(300, 200);
+    }
+
+    SECTION("wavefront") {
+        for (uint32_t nthreads: {2u, 3u, 8u}) {
+            cserve::IIIFComputePool::configure(nthreads, nthreads);
+            check(1, 100);
+            check(7, 64);
+            check(65, 40);
+            check(1001, 333);
+            check(2000, 1000);
+        }
+        cserve::IIIFComputePool::configure(0, 1);
+    }
+}
@@ -0,0 +1,132 @@
+//
+// Tests of the pixel buffer pool (IIIFBufferPool)
+//
+
+#include "catch2/catch_all.hpp"
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "../IIIFBufferPool.h"
+
+TEST_CASE("Testing the pixel buffer pool", "[IIIFBufferPool]") {
+
+    SECTION("size classes") {
+        REQUIRE(cserve::IIIFBufferPool::size_class(3) == 3);
+        REQUIRE(cserve::IIIFBufferPool::size_class(8) == 8);
+        REQUIRE(cserve::IIIFBufferPool::size_class(9) == 10);
+        REQUIRE(cserve::IIIFBufferPool::size_class(1024) == 1024);
+        REQUIRE(cserve::IIIFBufferPool::size_class(1025) == 1280);
+        REQUIRE(cserve::IIIFBufferPool::size_class(1281) == 1536);
+        REQUIRE(cserve::IIIFBufferPool::size_class(1537) == 1792);
+        REQUIRE(cserve::IIIFBufferPool::size_class(1793) == 2048);
+        for (size_t n = 5; n < 100000; n += 37) {
+            size_t c = cserve::IIIFBufferPool::size_class(n);
+            REQUIRE(c >= n);
+            REQUIRE(c <= n + n / 4);
+        }
+    }
+
+    SECTION("released buffers are reused") {
+        cserve::IIIFBufferPool pool(64 * 1024 * 1024);
+        auto buf = pool.get<uint8_t>(3000000);
+        REQUIRE(buf.size() == 3000000);
+        const uint8_t *data = buf.data();
+        pool.put(std::move(buf));
+        REQUIRE(pool.getIdleBytes() >= 3000000);
+
+        auto smaller = pool.get<uint8_t>(2500000); // same size class range
+        REQUIRE(smaller.size() == 2500000);
+        REQUIRE(smaller.data() == data);
+        REQUIRE(pool.getIdleBytes() == 0);
+        REQUIRE(pool.hits() == 1);
+        REQUIRE(pool.misses() == 1);
+
+        pool.put(std::move(smaller));
+        auto larger = pool.get<uint8_t>(3500000); // the idle buffer is too small
+        REQUIRE(larger.size() == 3500000);
+        REQUIRE(pool.hits() == 1);
+        REQUIRE(pool.misses() == 2);
+
+        auto much_smaller = pool.get<uint8_t>(1000000); // the idle buffer is too large
+        REQUIRE(much_smaller.data() != data);
+        REQUIRE(pool.misses() == 3);
+        REQUIRE(pool.getLargestRequest() == 3500000);
+    }
+
+    SECTION("8 and 16 bit buffers are kept apart") {
+        cserve::IIIFBufferPool pool(64 * 1024 * 1024);
+        pool.put(pool.get<uint16_t>(1000000));
+        auto buf8 = pool.get<uint8_t>(2000000);
+        REQUIRE(pool.hits() == 0);
+        auto buf16 = pool.get<uint16_t>(1000000);
+        REQUIRE(pool.hits() == 1);
+    }
+
+    SECTION("small buffers are not pooled") {
+        cserve::IIIFBufferPool pool(64 * 1024 * 1024);
+        pool.put(pool.get<uint8_t>(1000));
+        REQUIRE(pool.getIdleBytes() == 0);
+        REQUIRE(pool.hits() == 0);
+        REQUIRE(pool.misses() == 0);
+    }
+
+    SECTION("the idle memory is limited") {
+        cserve::IIIFBufferPool pool(10 * 1024 * 1024);
+        std::vector<std::vector<uint8_t>> bufs;
+        for (size_t n: {1000000, 2000000, 3000000, 4000000, 5000000}) bufs.push_back(pool.get<uint8_t>(n));
+        for (auto &buf: bufs) pool.put(std::move(buf));
+        REQUIRE(pool.getIdleBytes() <= 10 * 1024 * 1024);
+        REQUIRE(pool.getPeakIdleBytes() <= 10 * 1024 * 1024);
+        REQUIRE(pool.discarded() > 0);
+        // the smallest buffers are dropped first
+        auto small = pool.get<uint8_t>(1000000);
+        REQUIRE(pool.hits() == 0);
+        auto large = pool.get<uint8_t>(5000000);
+        REQUIRE(pool.hits() == 1);
+
+        pool.put(pool.get<uint8_t>(20000000)); // larger than the limit
+        REQUIRE(pool.getIdleBytes() <= 10 * 1024 * 1024);
+
+        pool.clear();
+        REQUIRE(pool.getIdleBytes() == 0);
+    }
+
+    SECTION("acquirePixels() and releasePixels() with and without shared pool") {
+        cserve::IIIFBufferPool::configure(0);
+        REQUIRE(cserve::IIIFBufferPool::instance() == nullptr);
+        auto buf = cserve::acquirePixels<uint16_t>(500000);
+        REQUIRE(buf.size() == 500000);
+        cserve::releasePixels(std::move(buf));
+        REQUIRE(buf.empty());
+
+        cserve::IIIFBufferPool::configure(32 * 1024 * 1024);
+        auto pool = cserve::IIIFBufferPool::instance();
+        REQUIRE(pool != nullptr);
+        buf = cserve::acquirePixels<uint16_t>(500000);
+        cserve::releasePixels(std::move(buf));
+        REQUIRE(buf.empty());
+        REQUIRE(pool->getIdleBytes() >= 1000000);
+        cserve::IIIFBufferPool::configure(0);
+    }
+
+    SECTION("concurrent use") {
+        cserve::IIIFBufferPool pool(256 * 1024 * 1024);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 8; t++) {
+            threads.emplace_back([&pool, t]() {
+                for (int i = 0; i < 200; i++) {
+                    auto buf = pool.get<uint8_t>(300000 + 10000 * ((i + t) % 16));
+                    buf[0] = static_cast<uint8_t>(t);
+                    buf[buf.size() - 1] = static_cast<uint8_t>(i);
+                    pool.put(std::move(buf));
+                }
+            });
+        }
+        for (auto &thread: threads) thread.join();
+        REQUIRE(pool.hits() + pool.misses() == 1600);
+        REQUIRE(pool.misses() <= 8 * 16);
+        REQUIRE(pool.getIdleBytes() <= pool.getPeakIdleBytes());
+    }
+}
@@ -0,0 +1,84 @@
+//
+// Tests of the replacement policy of the IIIF file cache
+//
+
+#include "catch2/catch_all.hpp"
+
+#include <string>
+
+#include "../IIIFCachePolicy.h"
+
+TEST_CASE("Testing IIIFCachePolicy", "[IIIFCachePolicy]") {
+    std::string key;
+
+    SECTION("names") {
+        cserve::IIIFCachePolicy::Type type;
+        REQUIRE(cserve::IIIFCachePolicy::type_from_name("lru", type));
+        REQUIRE(type == cserve::IIIFCachePolicy::LRU);
+        REQUIRE(cserve::IIIFCachePolicy::type_from_name("slru", type));
+        REQUIRE(type == cserve::IIIFCachePolicy::SLRU);
+        REQUIRE_FALSE(cserve::IIIFCachePolicy::type_from_name("arc", type));
+        REQUIRE(cserve::IIIFCachePolicy::type_name(cserve::IIIFCachePolicy::SLRU) == "slru");
+    }
+
+    SECTION("LRU") {
+        cserve::IIIFCachePolicy policy(cserve::IIIFCachePolicy::LRU);
+        REQUIRE_FALSE(policy.victim(key));
+        policy.add("a");
+        policy.add("b");
+        policy.add("c");
+        REQUIRE(policy.victim(key));
+        REQUIRE(key == "a");
+        policy.access("a");
+        REQUIRE(policy.victim(key));
+        REQUIRE(key == "b");
+        policy.remove("b");
+        REQUIRE(policy.victim(key));
+        REQUIRE(key == "c");
+        policy.access("unknown");
+        REQUIRE(policy.size() == 2);
+    }
+
+    SECTION("SLRU protects files that are used again") {
+        cserve::IIIFCachePolicy policy(cserve::IIIFCachePolicy::SLRU, 0.5f);
+        policy.add("hot");
+        policy.access("hot");
+        //
+        // a scan through files that are used only once
+        //
+        for (int i = 0; i < 100; i++) {
+            policy.add("scan" + std::to_string(i));
+            REQUIRE(policy.victim(key));
+            REQUIRE(key != "hot");
+            policy.remove(key);
+        }
+        REQUIRE(policy.size() == 1);
+        REQUIRE(policy.victim(key));
+        REQUIRE(key == "hot");
+    }
+
+    SECTION("SLRU limits the protected segment") {
+        cserve::IIIFCachePolicy policy(cserve::IIIFCachePolicy::SLRU, 0.5f);
+        for (int i = 0; i < 4; i++) policy.add("f" + std::to_string(i));
+        for (int i = 0; i < 4; i++) policy.access("f" + std::to_string(i));
+        //
+        // only 2 files fit into the protected segment, f0 and f1 have been demoted again
+        //
+        REQUIRE(policy.victim(key));
+        REQUIRE(key == "f0");
+        policy.remove("f0");
+        REQUIRE(policy.victim(key));
+        REQUIRE(key == "f1");
+    }
+
+    SECTION("replaced file starts on probation") {
+        cserve::IIIFCachePolicy policy(cserve::IIIFCachePolicy::SLRU);
+        policy.add("a");
+        policy.access("a");
+        policy.add("b");
+        policy.add("a");
+        REQUIRE(policy.size() == 2);
+        REQUIRE(policy.victim(key));
+        REQUIRE(key == "b");
+    }
+}
@@ -0,0 +1,103 @@
+//
+// Tests of the band-parallel execution of image operations (IIIFComputePool)
+//
+
+#include "catch2/catch_all.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../IIIFComputePool.h"
+
+TEST_CASE("Testing the compute pool", "[IIIFComputePool]") {
+
+    SECTION("every row is processed exactly once") {
+        cserve::IIIFComputePool pool(4, 4);
+        for (uint32_t nrows: {1u, 7u, 32u, 33u, 1000u, 4099u}) {
+            std::vector<std::atomic<int>> visits(nrows);
+            std::atomic<int> empty_bands{0};
+            pool.run(nrows, [&](uint32_t first, uint32_t last) {
+                if (first >= last) empty_bands++;
+                for (uint32_t y = first; y < last; y++) visits[y]++;
+            }, 16);
+            REQUIRE(empty_bands == 0);
+            for (auto &v: visits) REQUIRE(v == 1);
+        }
+    }
+
+    SECTION("at most max_per_request threads work on one operation") {
+        cserve::IIIFComputePool pool(8, 3);
+        std::mutex locking;
+        std::set<std::thread::id> threads;
+        std::atomic<int> active{0};
+        std::atomic<int> max_active{0};
+        pool.run(4096, [&](uint32_t, uint32_t) {
+            int n = ++active;
+            int m = max_active;
+            while ((n > m) && !max_active.compare_exchange_weak(m, n)) {}
+            {
+                std::lock_guard<std::mutex> guard(locking);
+                threads.insert(std::this_thread::get_id());
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            --active;
+        }, 1);
+        REQUIRE(max_active <= 3);
+        REQUIRE(threads.size() <= 3);
+    }
+
+    SECTION("an exception is passed to the caller") {
+        cserve::IIIFComputePool pool(4, 4);
+        REQUIRE_THROWS_AS(pool.run(1024, [&](uint32_t first, uint32_t) {
+            if (first == 0) throw std::runtime_error("band failed");
+        }, 8), std::runtime_error);
+        //
+        // the pool is still usable
+        //
+        std::atomic<uint32_t> nrows{0};
+        pool.run(1024, [&](uint32_t first, uint32_t last) { nrows += last - first; }, 8);
+        REQUIRE(nrows == 1024);
+    }
+
+    SECTION("concurrent operations and nested calls") {
+        cserve::IIIFComputePool pool(3, 4);
+        std::vector<std::thread> requests;
+        std::atomic<uint64_t> total{0};
+        for (int r = 0; r < 6; r++) {
+            requests.emplace_back([&pool, &total] {
+                for (int i = 0; i < 20; i++) {
+                    pool.run(256, [&](uint32_t first, uint32_t last) {
+                        pool.run(64, [&](uint32_t f, uint32_t l) { total += l - f; }, 4);
+                        total += last - first;
+                    }, 16);
+                }
+            });
+        }
+        for (auto &t: requests) t.join();
+        REQUIRE(total == 6 * 20 * (256 + 16 * 64));
+    }
+
+    SECTION("without shared pool the caller processes all rows") {
+        cserve::IIIFComputePool::configure(4, 1);
+        REQUIRE(cserve::IIIFComputePool::instance() == nullptr);
+        std::vector<std::pair<uint32_t, uint32_t>> bands;
+        cserve::IIIFComputePool::parallel_for(5000, [&](uint32_t first, uint32_t last) {
+            bands.emplace_back(first, last);
+        });
+        REQUIRE(bands.size() == 1);
+        REQUIRE(bands[0] == std::make_pair(0u, 5000u));
+
+        cserve::IIIFComputePool::configure(2, 4);
+        REQUIRE(cserve::IIIFComputePool::instance() != nullptr);
+        std::atomic<uint32_t> nrows{0};
+        cserve::IIIFComputePool::parallel_for(5000, [&](uint32_t first, uint32_t last) { nrows += last - first; });
+        REQUIRE(nrows == 5000);
+        cserve::IIIFComputePool::configure(0, 1);
+    }
+}
@@ -3,6 +3,7 @@ import shutil
 import pytest
 import os
 import pprint
+from concurrent.futures import ThreadPoolExecutor
 
 class TestBasic:
     component = "The IIIF server"
@@ -56,6 +57,17 @@ class TestBasic:
         response = manager.get('subdir/IMG_9144.jp2/full/max/0/default.jpg')
         assert response.status_code == 200
 
+    def test_coalesced_renders(self, manager):
+        """identical concurrent requests are rendered only once"""
+        iiifpath = 'test_01.tif/10,20,300,200/!150,150/0/default.jpg'  # not requested by any other test
+        before = manager.get_route_json("cache_stats")["stats"]
+        with ThreadPoolExecutor(max_workers=50) as executor:
+            responses = list(executor.map(lambda _: manager.get_raw(iiifpath), range(50)))
+        after = manager.get_route_json("cache_stats")["stats"]
+        assert all(response.status_code == 200 for response in responses)
+        assert all(response.content == responses[0].content for response in responses)
+        assert after["renders"] - before["renders"] == 1
+
     def test_iiif_bytes(self, manager):
         """return an unmodified JPG file"""
         assert manager.compare_iiif_bytes("Leaves.jpg/full/max/0/default.jpg",
@@ -2,9 +2,14 @@
 // Created by Lukas Rosenthaler on 10.08.22.
 //
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <tuple>
+#include <vector>
 
 #include "catch2/catch_all.hpp"
+#include "../IIIFComputePool.h"
 #include "../IIIFImage.h"
 #include "../imgformats/IIIFIOJpeg.h"
 #include "../metadata/IIIFExif.h"
@@ -123,6 +128,240 @@ TEST_CASE("Image tests", "JPEG") {
         REQUIRE(info.orientation == cserve::RIGHTTOP);
     }
 
+    SECTION("strips") {
+        auto region = std::make_shared<cserve::IIIFRegion>("200,300,1500,1000");
+        auto size = std::make_shared<cserve::IIIFSize>("!500,500");
+        cserve::IIIFImage img = jpegio.read("data/image_orientation.jpg",
+                                            region,
+                                            size,
+                                            false,
+                                            {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH});
+        auto strips = jpegio.read_strips("data/image_orientation.jpg",
+                                         region,
+                                         size,
+                                         false,
+                                         {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH});
+        REQUIRE(strips->header().getNx() == img.getNx());
+        REQUIRE(strips->header().getNy() == img.getNy());
+        cserve::IIIFImage streamed = cserve::IIIFStripSource::materialize(std::move(strips));
+        REQUIRE(streamed == img);
+
+        //
+        // the first strip decoded ahead is delivered unchanged
+        //
+        auto prefetched = std::make_unique<cserve::IIIFStripPrefetch>(jpegio.read_strips("data/image_orientation.jpg",
+                                                                                         region,
+                                                                                         size,
+                                                                                         false,
+                                                                                         {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH}));
+        REQUIRE(cserve::IIIFStripSource::materialize(std::move(prefetched)) == img);
+
+        cserve::IIIFCompressionParams compression;
+        REQUIRE_NOTHROW(jpegio.write_strips(std::make_unique<cserve::IIIFStripImage>(img), "scratch/strips.jpg", compression));
+        auto info = jpegio.getDim("scratch/strips.jpg");
+        REQUIRE(info.width == img.getNx());
+        REQUIRE(info.height == img.getNy());
+        std::filesystem::remove("scratch/strips.jpg");
+    }
+
+    SECTION("region") {
+        //
+        // only the scanlines and the iMCU columns covering the region are decompressed
+        //
+        auto full = jpegio.read("data/image_orientation.jpg",
+                                std::make_shared<cserve::IIIFRegion>("full"),
+                                std::make_shared<cserve::IIIFSize>("max"),
+                                false,
+                                {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH});
+        for (auto coords: {"0,0,512,512", "517,333,1000,700", "3000,2400,264,48", "1,1,1,1"}) {
+            auto region = std::make_shared<cserve::IIIFRegion>(coords);
+            cserve::IIIFImage img = jpegio.read("data/image_orientation.jpg",
+                                                region,
+                                                std::make_shared<cserve::IIIFSize>("max"),
+                                                false,
+                                                {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH});
+            int32_t x, y;
+            uint32_t w, h;
+            region->crop_coords(full.getNx(), full.getNy(), x, y, w, h);
+            cserve::IIIFImage expected = full;
+            expected.crop(x, y, w, h);
+            REQUIRE(img.getNx() == w);
+            REQUIRE(img.getNy() == h);
+            REQUIRE(img == expected);
+        }
+
+        //
+        // with DCT scaling
+        //
+        cserve::IIIFImage img = jpegio.read("data/image_orientation.jpg",
+                                            std::make_shared<cserve::IIIFRegion>("1024,512,2048,1024"),
+                                            std::make_shared<cserve::IIIFSize>("256,"),
+                                            false,
+                                            {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH});
+        REQUIRE(img.getNx() == 256);
+        REQUIRE(img.getNy() == 128);
+    }
+
+    SECTION("DCT method and encoder profiles") {
+        auto region = std::make_shared<cserve::IIIFRegion>("full");
+        auto size = std::make_shared<cserve::IIIFSize>("816,");
+        cserve::IIIFImage img = jpegio.read("data/image_orientation.jpg", region, size, false,
+                                            {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH});
+        for (auto dct: {cserve::DCT_ISLOW, cserve::DCT_IFAST, cserve::DCT_FLOAT}) {
+            cserve::IIIFImage decoded = jpegio.read("data/image_orientation.jpg", region, size, false,
+                                                    {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH, dct});
+            REQUIRE(decoded.getNx() == img.getNx());
+            REQUIRE(decoded.getNy() == img.getNy());
+            if (dct == cserve::DCT_ISLOW) REQUIRE(decoded == img); // the default
+        }
+
+        //
+        // the frame marker (SOF0: baseline, SOF1: extended, SOF2: progressive) and the sampling
+        // factors of the luminance
+        //
+        auto frame = [](const std::string &path) {
+            std::ifstream in(path, std::ios::binary);
+            std::vector<unsigned char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            size_t pos = 2;
+            while (pos + 4 < data.size()) {
+                const unsigned char marker = data[pos + 1];
+                if ((marker >= 0xc0) && (marker <= 0xc2)) {
+                    return std::make_tuple(static_cast<int>(marker), data[pos + 11] >> 4, data[pos + 11] & 0x0f);
+                }
+                pos += 2 + (data[pos + 2] << 8 | data[pos + 3]);
+            }
+            return std::make_tuple(0, 0, 0);
+        };
+
+        const std::string path = "scratch/profile.jpg";
+        cserve::IIIFCompressionParams compression;
+        REQUIRE_NOTHROW(jpegio.write(img, path, compression));
+        REQUIRE(frame(path) == std::make_tuple(0xc2, 2, 2)); // progressive, 4:2:0
+
+        compression = {{cserve::JPEG_PROGRESSIVE, "no"}, {cserve::JPEG_OPTIMIZE, "no"}, {cserve::JPEG_SUBSAMPLING, "4:2:2"}};
+        REQUIRE_NOTHROW(jpegio.write(img, path, compression));
+        REQUIRE(frame(path) == std::make_tuple(0xc0, 2, 1));
+        const auto unoptimized = std::filesystem::file_size(path);
+
+        compression[cserve::JPEG_OPTIMIZE] = "yes";
+        REQUIRE_NOTHROW(jpegio.write(img, path, compression));
+        REQUIRE(std::filesystem::file_size(path) < unoptimized);
+
+        for (auto dct: {"islow", "ifast", "float"}) {
+            compression = {{cserve::JPEG_QUALITY, "90"}, {cserve::JPEG_DCT_METHOD, dct}, {cserve::JPEG_SUBSAMPLING, "4:4:4"}};
+            REQUIRE_NOTHROW(jpegio.write(img, path, compression));
+            REQUIRE(frame(path) == std::make_tuple(0xc2, 1, 1));
+            auto info = jpegio.getDim(path);
+            REQUIRE(info.width == img.getNx());
+            REQUIRE(info.height == img.getNy());
+        }
+
+        REQUIRE_THROWS_AS(jpegio.write(img, path, {{cserve::JPEG_DCT_METHOD, "fast"}}), cserve::IIIFImageError);
+        REQUIRE_THROWS_AS(jpegio.write(img, path, {{cserve::JPEG_SUBSAMPLING, "4:1:1"}}), cserve::IIIFImageError);
+        REQUIRE_THROWS_AS(jpegio.write(img, path, {{cserve::JPEG_PROGRESSIVE, "true"}}), cserve::IIIFImageError);
+        std::filesystem::remove(path);
+    }
+
+    SECTION("parallel encoding") {
+        //
+        // the stripes compressed in parallel have the coefficients of the serially compressed image
+        //
+        cserve::IIIFComputePool::configure(3, 3);
+        auto region = std::make_shared<cserve::IIIFRegion>("full");
+        auto size = std::make_shared<cserve::IIIFSize>("max");
+        cserve::IIIFImage img = jpegio.read("data/image_orientation.jpg", region, size, false,
+                                            {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH});
+        cserve::IIIFImage gray(1000, 3000, 1, 8, cserve::MINISBLACK);
+        for (auto subsampling: {"4:2:0", "4:4:4"}) {
+            for (auto *image: {&img, &gray}) {
+                cserve::IIIFCompressionParams compression{{cserve::JPEG_PROGRESSIVE, "no"},
+                                                          {cserve::JPEG_OPTIMIZE, "no"},
+                                                          {cserve::JPEG_SUBSAMPLING, subsampling}};
+                REQUIRE_NOTHROW(jpegio.write(*image, "scratch/serial.jpg", compression));
+                compression[cserve::JPEG_PARALLEL] = "yes";
+                REQUIRE_NOTHROW(jpegio.write(*image, "scratch/parallel.jpg", compression));
+                auto serial = jpegio.read("scratch/serial.jpg", region, size, false,
+                                          {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH});
+                auto parallel = jpegio.read("scratch/parallel.jpg", region, size, false,
+                                            {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH});
+                REQUIRE(parallel.getNx() == image->getNx());
+                REQUIRE(parallel.getNy() == image->getNy());
+                REQUIRE(parallel == serial);
+
+                auto part = std::make_shared<cserve::IIIFRegion>("100,700,600,900");
+                auto serial_part = jpegio.read("scratch/serial.jpg", part, size, false,
+                                               {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH});
+                auto parallel_part = jpegio.read("scratch/parallel.jpg", part, size, false,
+                                                 {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH});
+                REQUIRE(parallel_part == serial_part);
+            }
+        }
+        std::filesystem::remove("scratch/serial.jpg");
+        std::filesystem::remove("scratch/parallel.jpg");
+        cserve::IIIFComputePool::configure(0, 1);
+    }
+
+    SECTION("lossless transform") {
+        //
+        // the blocks of the masters are flat (only DC coefficients), so that the transformed
+        // coefficients decode exactly to the rotated pixels of the decoded master
+        //
+        auto master = [](uint32_t nx, uint32_t ny, uint32_t nc) {
+            cserve::IIIFImage img(nx, ny, nc, 8, nc == 1 ? cserve::MINISBLACK : cserve::RGB);
+            for (uint32_t y = 0; y < ny; y++) {
+                for (uint32_t x = 0; x < nx; x++) {
+                    for (uint32_t c = 0; c < nc; c++) img.setPixel(x, y, c, static_cast<int>((x / 8 * 37 + y / 8 * 91 + c * 53) & 0xff));
+                }
+            }
+            return img;
+        };
+        auto region = std::make_shared<cserve::IIIFRegion>("full");
+        auto size = std::make_shared<cserve::IIIFSize>("max");
+        const std::string path = "scratch/lossless.jpg";
+        std::vector<unsigned char> jpeg;
+        for (uint32_t nc: {1, 3}) {
+            cserve::IIIFImage img = master(320, 240, nc);
+            REQUIRE_NOTHROW(jpegio.write(img, "scratch/master.jpg", {{cserve::JPEG_SUBSAMPLING, "4:4:4"}}));
+            auto full = jpegio.read("scratch/master.jpg", region, size, false,
+                                    {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH});
+            for (float angle: {0.0F, 90.0F, 180.0F, 270.0F}) {
+                for (bool mirror: {false, true}) {
+                    REQUIRE(cserve::IIIFIOJpeg::transform_lossless("scratch/master.jpg", 16, 8, 200, 120,
+                                                                  angle, mirror, {}, jpeg));
+                    std::ofstream out(path, std::ios::binary);
+                    out.write(reinterpret_cast<const char *>(jpeg.data()), static_cast<std::streamsize>(jpeg.size()));
+                    out.close();
+                    auto transformed = jpegio.read(path, region, size, false,
+                                                   {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH});
+                    cserve::IIIFImage expected = full;
+                    expected.crop(16, 8, 200, 120);
+                    expected.rotate(angle, mirror);
+                    REQUIRE(transformed.getNx() == expected.getNx());
+                    REQUIRE(transformed.getNy() == expected.getNy());
+                    REQUIRE(transformed == expected);
+                }
+            }
+            REQUIRE_FALSE(cserve::IIIFIOJpeg::transform_lossless("scratch/master.jpg", 17, 8, 200, 120, 0.0F, false, {}, jpeg));
+            REQUIRE(jpeg.empty());
+            REQUIRE_FALSE(cserve::IIIFIOJpeg::transform_lossless("scratch/master.jpg", 0, 0, 320, 240, 45.0F, false, {}, jpeg));
+        }
+
+        //
+        // the partial MCUs at the right edge would become the left edge
+        //
+        cserve::IIIFImage img = master(328, 240, 3);
+        REQUIRE_NOTHROW(jpegio.write(img, "scratch/master.jpg", {{cserve::JPEG_SUBSAMPLING, "4:2:0"}}));
+        REQUIRE_FALSE(cserve::IIIFIOJpeg::transform_lossless("scratch/master.jpg", 0, 0, 328, 240, 0.0F, true, {}, jpeg));
+        REQUIRE(cserve::IIIFIOJpeg::transform_lossless("scratch/master.jpg", 0, 0, 328, 240, 180.0F, true, {}, jpeg));
+
+        //
+        // masters with an ICC profile are converted to sRGB by the decoding path
+        //
+        REQUIRE_FALSE(cserve::IIIFIOJpeg::transform_lossless("data/jpeg_with_icc_es.jpg", 0, 0, 16, 16, 0.0F, false, {}, jpeg));
+        std::filesystem::remove("scratch/master.jpg");
+        std::filesystem::remove(path);
+    }
+
     SECTION("EXIF-metadata") {
         auto region = std::make_shared<cserve::IIIFRegion>("full");
         auto size = std::make_shared<cserve::IIIFSize>("max");
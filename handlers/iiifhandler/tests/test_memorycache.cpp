@@ -0,0 +1,118 @@
+//
+// Tests of the in-memory tile cache (first tier in front of IIIFCache)
+//
+
+#include "catch2/catch_all.hpp"
+
+#include <memory>
+#include <string>
+
+#include "../IIIFMemoryCache.h"
+
+namespace {
+    std::shared_ptr<cserve::IIIFMemoryCache::Entry> make_entry(size_t size, time_t mtime = 1000) {
+        auto entry = std::make_shared<cserve::IIIFMemoryCache::Entry>();
+        entry->data = std::string(size, 'x');
+        entry->mimetype = "image/jpeg";
+        entry->orig_mtime = {mtime, 0};
+        return entry;
+    }
+
+    std::string tile_url(int i) {
+        return "/iiif/images/scan.jp2/" + std::to_string(i * 256) + ",0,256,256/256,/0/default.jpg";
+    }
+}
+
+TEST_CASE("Testing IIIFMemoryCache", "[IIIFMemoryCache]") {
+    const struct timespec mtime{1000, 0};
+
+    SECTION("hit and miss") {
+        cserve::IIIFMemoryCache cache(1024 * 1024);
+        const std::string url = tile_url(0);
+        REQUIRE(cache.get(url, mtime) == nullptr);
+        REQUIRE(cache.put(url, make_entry(1000)));
+        auto entry = cache.get(url, mtime);
+        REQUIRE(entry != nullptr);
+        REQUIRE(entry->data.size() == 1000);
+        REQUIRE(entry->mimetype == "image/jpeg");
+        REQUIRE(cache.hits() == 1);
+        REQUIRE(cache.misses() == 1);
+        REQUIRE(cache.getNentries() == 1);
+        cache.remove(url);
+        REQUIRE(cache.getNentries() == 0);
+        REQUIRE(cache.getSize() == 0);
+    }
+
+    SECTION("modified master file") {
+        cserve::IIIFMemoryCache cache(1024 * 1024);
+        const std::string url = tile_url(0);
+        REQUIRE(cache.put(url, make_entry(1000)));
+        const struct timespec newer{1001, 0};
+        REQUIRE(cache.get(url, newer) == nullptr);
+        REQUIRE(cache.getNentries() == 0);
+    }
+
+    SECTION("oversized response") {
+        cserve::IIIFMemoryCache cache(64 * 1024);
+        REQUIRE_FALSE(cache.admits(tile_url(0), 32 * 1024));
+        REQUIRE_FALSE(cache.put(tile_url(0), make_entry(32 * 1024)));
+        REQUIRE(cache.rejected() == 1);
+        REQUIRE(cache.getNentries() == 0);
+    }
+
+    SECTION("memory budget") {
+        const size_t max_size = 256 * 1024;
+        cserve::IIIFMemoryCache cache(max_size);
+        for (int i = 0; i < 1000; i++) {
+            (void) cache.get(tile_url(i), mtime);
+            (void) cache.put(tile_url(i), make_entry(8 * 1024));
+            REQUIRE(cache.getSize() <= max_size);
+        }
+    }
+
+    SECTION("scan resistance") {
+        cserve::IIIFMemoryCache cache(256 * 1024);
+        //
+        // a small set of popular tiles ...
+        //
+        for (int round = 0; round < 5; round++) {
+            for (int i = 0; i < 10; i++) {
+                if (cache.get(tile_url(i), mtime) == nullptr) {
+                    (void) cache.put(tile_url(i), make_entry(8 * 1024));
+                }
+            }
+        }
+        //
+        // ... must survive a scan through many tiles that are requested only once
+        //
+        for (int i = 1000; i < 2000; i++) {
+            if (cache.get(tile_url(i), mtime) == nullptr) {
+                (void) cache.put(tile_url(i), make_entry(8 * 1024));
+            }
+        }
+        int nhot = 0;
+        for (int i = 0; i < 10; i++) {
+            if (cache.get(tile_url(i), mtime) != nullptr) ++nhot;
+        }
+        REQUIRE(nhot == 10);
+    }
+
+    SECTION("rejected replacement") {
+        cserve::IIIFMemoryCache cache(256 * 1024);
+        const std::string url = tile_url(100);
+        REQUIRE(cache.put(url, make_entry(8 * 1024)));
+        for (int i = 0; i < 29; i++) {
+            for (int round = 0; round < 3; round++) (void) cache.get(tile_url(i), mtime);
+            REQUIRE(cache.put(tile_url(i), make_entry(8 * 1024)));
+        }
+        //
+        // a larger version of a rarely used tile would evict popular tiles: it is not admitted
+        // and the existing entry is kept
+        //
+        REQUIRE_FALSE(cache.put(url, make_entry(24 * 1024)));
+        REQUIRE(cache.rejected() == 1);
+        auto entry = cache.get(url, mtime);
+        REQUIRE(entry != nullptr);
+        REQUIRE(entry->data.size() == 8 * 1024);
+    }
+}
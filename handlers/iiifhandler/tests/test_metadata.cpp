@@ -5,6 +5,7 @@
 #include <filesystem>
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 
 #include <lcms2.h>
 
@@ -14,6 +15,7 @@
 #include "../metadata/IIIFIptc.h"
 #include "../metadata/IIIFIcc.h"
 #include "../metadata//IIIFXmp.h"
+#include "../IIIFTransformCache.h"
 
 #include "tiffio.h"
 
@@ -212,6 +214,52 @@ TEST_CASE("Testing IIIFIcc class", "[IIIFIcc]") {
         unsigned int formatter = icc.iccFormatter(16);
         REQUIRE(formatter == 262170);
     }
+
+    SECTION("IIIFIcc profile digest") {
+        cserve::IIIFIcc srgb1(cserve::icc_sRGB);
+        cserve::IIIFIcc srgb2(cserve::icc_sRGB);
+        cserve::IIIFIcc adobe(cserve::icc_AdobeRGB);
+        auto bytes = srgb1.iccBytes();
+        cserve::IIIFIcc embedded(bytes.data(), static_cast<int>(bytes.size()));
+        REQUIRE(srgb1.profileDigest().size() == 32);
+        REQUIRE(srgb1.profileDigest() == srgb2.profileDigest());
+        REQUIRE(srgb1.profileDigest() == embedded.profileDigest());
+        REQUIRE(srgb1.profileDigest() != adobe.profileDigest());
+        REQUIRE(cserve::IIIFIcc(srgb1).profileDigest() == srgb1.profileDigest());
+        REQUIRE(cserve::IIIFIcc().profileDigest().empty());
+    }
+}
+
+TEST_CASE("Testing IIIFTransformCache class", "[IIIFTransformCache]") {
+    SECTION("IIIFTransformCache reuse and identity") {
+        cserve::IIIFTransformCache cache(2);
+        cserve::IIIFIcc srgb(cserve::icc_sRGB);
+        cserve::IIIFIcc adobe(cserve::icc_AdobeRGB);
+        cserve::IIIFIcc gray(cserve::icc_GRAY_D50);
+
+        auto t1 = cache.get(adobe, TYPE_RGB_8, srgb, TYPE_RGB_8);
+        REQUIRE(t1 != nullptr);
+        REQUIRE_FALSE(t1->identity());
+        auto t2 = cache.get(cserve::IIIFIcc(cserve::icc_AdobeRGB), TYPE_RGB_8, cserve::IIIFIcc(cserve::icc_sRGB), TYPE_RGB_8);
+        REQUIRE(t2 == t1);
+        REQUIRE(cache.hits() == 1);
+        REQUIRE(cache.misses() == 1);
+
+        auto same = cache.get(srgb, TYPE_RGB_8, cserve::IIIFIcc(srgb), TYPE_RGB_8);
+        REQUIRE(same->identity());
+        auto to_gray = cache.get(srgb, TYPE_RGB_8, gray, TYPE_GRAY_8);
+        REQUIRE_FALSE(to_gray->identity());
+        REQUIRE(cache.getNentries() == 2);
+
+        // the least recently used transform has been dropped, but is still valid
+        auto t3 = cache.get(adobe, TYPE_RGB_8, srgb, TYPE_RGB_8);
+        REQUIRE(t3 != t1);
+        REQUIRE(cache.misses() == 4);
+        unsigned char in[3] = {10, 200, 30}, out1[3], out3[3];
+        cmsDoTransform(t1->get(), in, out1, 1);
+        cmsDoTransform(t3->get(), in, out3, 1);
+        REQUIRE(std::equal(out1, out1 + 3, out3));
+    }
 }
 
 
@@ -0,0 +1,246 @@
+//
+// Tests of the SIMD pixel conversions (IIIFPixelKernels) against the original scalar code
+//
+
+#include "catch2/catch_all.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "../IIIFPixelKernels.h"
+
+namespace {
+    const cserve::ResampleKernel kernels[] = {cserve::RESAMPLE_SCALAR, cserve::RESAMPLE_SSE41, cserve::RESAMPLE_AVX2, cserve::RESAMPLE_NEON};
+
+    std::vector<uint8_t> random_bytes(size_t n) {
+        std::mt19937 gen(4711);
+        std::uniform_int_distribution<uint32_t> dist(0, 255);
+        std::vector<uint8_t> buf(n);
+        for (auto &v: buf) v = static_cast<uint8_t>(dist(gen));
+        return buf;
+    }
+
+    //
+    // the scalar code as it was in IIIFImgTools.h and IIIFImage.cpp
+    //
+    template<typename T>
+    void ref_one2eight(const uint8_t *in, T *out, uint32_t len, uint8_t black, uint8_t white) {
+        static uint8_t mask[8] = {0b10000000, 0b01000000, 0b00100000, 0b00010000,
+                                  0b00001000, 0b00000100, 0b00000010, 0b00000001};
+        uint32_t ii = 0;
+        for (uint32_t i = 0; i < len; i += 8) {
+            for (uint32_t k = 0; (k < 8) && ((k + i) < len); ++k) {
+                out[i + k] = mask[k] & in[ii] ? white : black;
+            }
+            ++ii;
+        }
+    }
+
+    template<typename T>
+    void ref_four2eight(const uint8_t *in, T *out, uint32_t len, bool is_palette) {
+        static uint8_t mask[2] = {0b11110000, 0b00001111};
+        if (is_palette) {
+            uint32_t ii = 0;
+            for (uint32_t i = 0; i < len; i += 2, ++ii) {
+                out[i] = (mask[0] & in[ii]) >> 4;
+                if ((i + 1) < len) out[i + 1] = mask[1] & in[ii];
+            }
+        } else {
+            uint32_t ii = 0;
+            for (uint32_t i = 0; i < len; i += 2, ++ii) {
+                out[i] = mask[0] & in[ii];
+                if ((i + 1) < len) out[i + 1] = (mask[1] & in[ii]) << 4;
+            }
+        }
+    }
+
+    template<typename T>
+    void ref_twelve2sixteen(const uint8_t *in, T *out, uint32_t len, bool is_palette) {
+        static uint8_t mask[2] = {0b11110000, 0b00001111};
+        if (is_palette) {
+            uint32_t ii = 0;
+            for (uint32_t i = 0; i < len; i += 2, ii += 3) {
+                out[i] = (in[ii] << 4) | ((in[ii + 1] & mask[0]) >> 4);
+                if ((i + 1) < len) out[i + 1] = ((in[ii + 1] & mask[1]) << 8) | in[ii + 2];
+            }
+        } else {
+            uint32_t ii = 0;
+            for (uint32_t i = 0; i < len; i += 2, ii += 3) {
+                out[i] = (in[ii] << 8) | (in[ii + 1] & mask[0]);
+                if ((i + 1) < len) out[i + 1] = ((in[ii + 1] & mask[1]) << 12) | (in[ii + 2] << 4);
+            }
+        }
+    }
+
+    template<typename T>
+    std::vector<T> ref_separate_to_contig(const std::vector<T> &inbuf, uint32_t nx, uint32_t ny, uint32_t nc) {
+        std::vector<T> tmp(nc * ny * nx);
+        for (uint32_t c = 0; c < nc; ++c) {
+            for (uint32_t y = 0; y < ny; ++y) {
+                for (uint32_t x = 0; x < nx; ++x) {
+                    tmp[nc * (y * nx + x) + c] = inbuf[c * ny * nx + y * nx + x];
+                }
+            }
+        }
+        return tmp;
+    }
+
+    template<typename T>
+    std::vector<T> ref_ycc2rgb(const std::vector<T> &pixels, size_t n, uint32_t nc) {
+        const int maxval = sizeof(T) == 1 ? 255 : 65535;
+        std::vector<T> outbuf(pixels.size());
+        for (size_t i = 0; i < n; i++) {
+            auto Y = (double) pixels[nc * i + 2];
+            auto Cb = (double) pixels[nc * i + 1];
+            auto Cr = (double) pixels[nc * i + 0];
+
+            int r = (int) (Y + 1.40200 * (Cr - 0x80));
+            int g = (int) (Y - 0.34414 * (Cb - 0x80) - 0.71414 * (Cr - 0x80));
+            int b = (int) (Y + 1.77200 * (Cb - 0x80));
+
+            outbuf[nc * i + 0] = std::max(0, std::min(maxval, r));
+            outbuf[nc * i + 1] = std::max(0, std::min(maxval, g));
+            outbuf[nc * i + 2] = std::max(0, std::min(maxval, b));
+            for (size_t k = 3; k < nc; k++) outbuf[nc * i + k] = pixels[nc * i + k];
+        }
+        return outbuf;
+    }
+}
+
+TEST_CASE("Testing the pixel conversion kernels", "[IIIFPixelKernels]") {
+    const auto packed = random_bytes(4096);
+    const uint32_t lengths[] = {0, 1, 7, 8, 15, 16, 17, 31, 32, 33, 63, 100, 1001, 2048};
+
+    SECTION("1, 4 and 12 bit samples") {
+        for (uint32_t len: lengths) {
+            std::vector<uint8_t> ref8(len + 1, 0x55), res8(len + 1, 0x55);
+            std::vector<uint16_t> ref16(len + 1, 0x5555), res16(len + 1, 0x5555);
+            for (auto kernel: kernels) {
+                ref_one2eight(packed.data(), ref8.data(), len, 0, 255);
+                cserve::one2eight(packed.data(), res8.data(), len, 0, 255, kernel);
+                REQUIRE(res8 == ref8);
+                ref_one2eight(packed.data(), ref16.data(), len, 255, 17);
+                cserve::one2eight(packed.data(), res16.data(), len, 255, 17, kernel);
+                REQUIRE(res16 == ref16);
+                for (bool palette: {false, true}) {
+                    ref_four2eight(packed.data(), ref8.data(), len, palette);
+                    cserve::four2eight(packed.data(), res8.data(), len, palette, kernel);
+                    REQUIRE(res8 == ref8);
+                    ref_four2eight(packed.data(), ref16.data(), len, palette);
+                    cserve::four2eight(packed.data(), res16.data(), len, palette, kernel);
+                    REQUIRE(res16 == ref16);
+                    ref_twelve2sixteen(packed.data(), ref16.data(), len, palette);
+                    cserve::twelve2sixteen(packed.data(), res16.data(), len, palette, kernel);
+                    REQUIRE(res16 == ref16);
+                    ref_twelve2sixteen(packed.data(), ref8.data(), len, palette);
+                    cserve::twelve2sixteen(packed.data(), res8.data(), len, palette, kernel);
+                    REQUIRE(res8 == ref8);
+                }
+            }
+        }
+    }
+
+    SECTION("separate to contiguous channels") {
+        for (uint32_t nc = 1; nc <= 5; nc++) {
+            for (uint32_t nx: {1U, 15U, 16U, 37U, 256U}) {
+                const uint32_t ny = 9;
+                auto bytes = random_bytes(static_cast<size_t>(nx) * ny * nc * 2);
+                std::vector<uint8_t> img8(bytes.begin(), bytes.begin() + static_cast<size_t>(nx) * ny * nc);
+                std::vector<uint16_t> img16(static_cast<size_t>(nx) * ny * nc);
+                for (size_t i = 0; i < img16.size(); i++) img16[i] = static_cast<uint16_t>((bytes[2 * i] << 8) | bytes[2 * i + 1]);
+                auto ref8 = ref_separate_to_contig(img8, nx, ny, nc);
+                auto ref16 = ref_separate_to_contig(img16, nx, ny, nc);
+                for (auto kernel: kernels) {
+                    std::vector<uint8_t> res8(img8.size());
+                    std::vector<uint16_t> res16(img16.size());
+                    cserve::separate2contig(img8.data(), res8.data(), static_cast<size_t>(nx) * ny, nc, static_cast<size_t>(nx) * ny, kernel);
+                    cserve::separate2contig(img16.data(), res16.data(), static_cast<size_t>(nx) * ny, nc, static_cast<size_t>(nx) * ny, kernel);
+                    REQUIRE(res8 == ref8);
+                    REQUIRE(res16 == ref16);
+                }
+            }
+        }
+    }
+
+    SECTION("YCbCr to RGB, all 8 bit values") {
+        std::vector<uint8_t> ycc(256 * 256 * 256 * 3);
+        for (size_t i = 0; i < 256 * 256 * 256; i++) {
+            ycc[3 * i] = static_cast<uint8_t>(i);
+            ycc[3 * i + 1] = static_cast<uint8_t>(i >> 8);
+            ycc[3 * i + 2] = static_cast<uint8_t>(i >> 16);
+        }
+        auto ref = ref_ycc2rgb(ycc, 256 * 256 * 256, 3);
+        for (auto kernel: kernels) {
+            std::vector<uint8_t> res(ycc.size());
+            cserve::ycc2rgb(ycc.data(), res.data(), 256 * 256 * 256, 3, kernel);
+            REQUIRE(res == ref);
+        }
+    }
+
+    SECTION("YCbCr to RGB with other channels") {
+        std::mt19937 gen(4711);
+        for (uint32_t nc = 3; nc <= 5; nc++) {
+            for (size_t n: {1, 3, 4, 5, 7, 8, 9, 33, 1000}) {
+                std::vector<uint8_t> img8(n * nc);
+                std::vector<uint16_t> img16(n * nc);
+                for (auto &v: img8) v = static_cast<uint8_t>(gen());
+                for (auto &v: img16) v = static_cast<uint16_t>(gen());
+                for (size_t i = 0; i < std::min<size_t>(n, 64); i++) { // extremes: clamping on both sides
+                    img16[nc * i + 2] = (i & 1) ? 65535 : 0;
+                    img16[nc * i + (i & 2 ? 0 : 1)] = (i & 1) ? 65535 : 0;
+                }
+                auto ref8 = ref_ycc2rgb(img8, n, nc);
+                auto ref16 = ref_ycc2rgb(img16, n, nc);
+                for (auto kernel: kernels) {
+                    std::vector<uint8_t> res8(img8.size());
+                    std::vector<uint16_t> res16(img16.size());
+                    cserve::ycc2rgb(img8.data(), res8.data(), n, nc, kernel);
+                    cserve::ycc2rgb(img16.data(), res16.data(), n, nc, kernel);
+                    REQUIRE(res8 == ref8);
+                    REQUIRE(res16 == ref16);
+                }
+            }
+        }
+    }
+
+    SECTION("16 to 8 bit") {
+        std::vector<uint16_t> img(70000);
+        for (size_t i = 0; i < img.size(); i++) img[i] = static_cast<uint16_t>(i * 7);
+        for (size_t n: {0, 1, 15, 16, 17, 31, 32, 33, 70000}) {
+            std::vector<uint8_t> ref(n);
+            for (size_t i = 0; i < n; i++) ref[i] = static_cast<uint8_t>(img[i] >> 8);
+            for (auto kernel: kernels) {
+                std::vector<uint8_t> res(n);
+                cserve::sixteen2eight(img.data(), res.data(), n, kernel);
+                REQUIRE(res == ref);
+            }
+        }
+    }
+
+    SECTION("8 to 1 bit") {
+        auto img = random_bytes(1000);
+        for (uint32_t len: {0u, 1u, 7u, 8u, 9u, 15u, 16u, 17u, 31u, 32u, 33u, 1000u}) {
+            for (bool invert: {false, true}) {
+                //
+                // like cvrt8BitTo1bit() (IIIFImgTools.cpp)
+                //
+                std::vector<uint8_t> ref((len + 7) / 8), ref_bw(len);
+                for (uint32_t i = 0; i < len; i++) {
+                    ref_bw[i] = (img[i] > 127) ? 255 : 0;
+                    if ((img[i] > 127) != invert) ref[i / 8] |= 0x80 >> (i % 8);
+                }
+                for (auto kernel: kernels) {
+                    std::vector<uint8_t> res((len + 7) / 8, 0xaa);
+                    cserve::eight2one(img.data(), res.data(), len, 127, invert, nullptr, kernel);
+                    REQUIRE(res == ref);
+                    std::vector<uint8_t> bw(img.begin(), img.begin() + len);
+                    cserve::eight2one(bw.data(), res.data(), len, 127, invert, bw.data(), kernel);
+                    REQUIRE(res == ref);
+                    REQUIRE(bw == ref_bw);
+                }
+            }
+        }
+    }
+}
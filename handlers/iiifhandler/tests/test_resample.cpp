@@ -0,0 +1,190 @@
+//
+// Tests of the separable resampler used by IIIFImage::scale(), scaleMedium() and scaleFast()
+//
+
+#include "catch2/catch_all.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "../IIIFResample.h"
+#include "../IIIFComputePool.h"
+
+namespace {
+    template<typename T>
+    std::vector<T> random_image(uint32_t nx, uint32_t ny, uint32_t nc, uint32_t maxval) {
+        std::mt19937 gen(4711);
+        std::uniform_int_distribution<uint32_t> dist(0, maxval);
+        std::vector<T> img(static_cast<size_t>(nx) * ny * nc);
+        for (auto &v: img) v = static_cast<T>(dist(gen));
+        return img;
+    }
+
+    const cserve::ResampleFilter filters[] = {cserve::RESAMPLE_AREA, cserve::RESAMPLE_BICUBIC, cserve::RESAMPLE_LANCZOS3};
+
+    //
+    // crop, then average blocks of reduce x reduce pixels (smaller at the border), rounded
+    //
+    template<typename T>
+    std::vector<T> crop_reduce(const std::vector<T> &img, uint32_t nx, uint32_t nc, uint32_t x, uint32_t y,
+                               uint32_t w, uint32_t h, uint32_t reduce, uint32_t &rw, uint32_t &rh) {
+        rw = (w + reduce - 1) / reduce;
+        rh = (h + reduce - 1) / reduce;
+        std::vector<T> out(static_cast<size_t>(rw) * rh * nc);
+        for (uint32_t j = 0; j < rh; j++) {
+            for (uint32_t i = 0; i < rw; i++) {
+                for (uint32_t k = 0; k < nc; k++) {
+                    uint32_t sum = 0, cnt = 0;
+                    for (uint32_t yy = j * reduce; yy < std::min((j + 1) * reduce, h); yy++) {
+                        for (uint32_t xx = i * reduce; xx < std::min((i + 1) * reduce, w); xx++) {
+                            sum += img[nc * ((y + yy) * nx + x + xx) + k];
+                            cnt++;
+                        }
+                    }
+                    out[nc * (j * rw + i) + k] = static_cast<T>((sum + cnt / 2) / cnt);
+                }
+            }
+        }
+        return out;
+    }
+
+    const cserve::ResampleKernel kernels[] = {cserve::RESAMPLE_SCALAR, cserve::RESAMPLE_SSE41, cserve::RESAMPLE_AVX2, cserve::RESAMPLE_NEON};
+}
+
+TEST_CASE("Testing the resampler", "[IIIFResample]") {
+
+    SECTION("uniform image") {
+        for (auto filter: filters) {
+            for (auto kernel: kernels) {
+                auto small = cserve::doResample<uint8_t>(std::vector<uint8_t>(97 * 61 * 3, 200), 97, 61, 3, 20, 13, filter, kernel);
+                REQUIRE(small.size() == 20 * 13 * 3);
+                for (auto v: small) REQUIRE(v == 200);
+                auto large = cserve::doResample<uint8_t>(std::vector<uint8_t>(20 * 13 * 3, 200), 20, 13, 3, 97, 61, filter, kernel);
+                REQUIRE(large.size() == 97 * 61 * 3);
+                for (auto v: large) REQUIRE(v == 200);
+                auto white = cserve::doResample<uint16_t>(std::vector<uint16_t>(97 * 61 * 4, 65535), 97, 61, 4, 33, 70, filter, kernel);
+                for (auto v: white) REQUIRE(v == 65535);
+            }
+        }
+    }
+
+    SECTION("area reduction by 2") {
+        const uint32_t nx = 64, ny = 48;
+        auto img = random_image<uint8_t>(nx, ny, 1, 255);
+        auto small = cserve::doResample<uint8_t>(std::vector<uint8_t>(img), nx, ny, 1, nx / 2, ny / 2, cserve::RESAMPLE_AREA);
+        for (uint32_t y = 0; y < ny / 2; y++) {
+            for (uint32_t x = 0; x < nx / 2; x++) {
+                uint32_t sum = img[2 * y * nx + 2 * x] + img[2 * y * nx + 2 * x + 1] +
+                               img[(2 * y + 1) * nx + 2 * x] + img[(2 * y + 1) * nx + 2 * x + 1];
+                uint32_t avg = (sum + 2) / 4;
+                // both passes round, the result may differ by one
+                REQUIRE(std::abs(static_cast<int>(small[y * nx / 2 + x]) - static_cast<int>(avg)) <= 1);
+            }
+        }
+    }
+
+    SECTION("unchanged size") {
+        auto img = random_image<uint16_t>(31, 17, 3, 65535);
+        auto same = cserve::doResample<uint16_t>(std::vector<uint16_t>(img), 31, 17, 3, 31, 17, cserve::RESAMPLE_LANCZOS3);
+        REQUIRE(same == img);
+        auto identity = cserve::doResample<uint16_t>(std::vector<uint16_t>(img), 31, 17, 3, 31, 9, cserve::RESAMPLE_BICUBIC);
+        REQUIRE(identity.size() == 31 * 9 * 3);
+    }
+
+    SECTION("all kernels give the same result") {
+        const uint32_t sizes[][4] = {{1001, 677, 130, 97}, {130, 97, 301, 211}, {64, 64, 63, 65}, {37, 5, 3, 1}};
+        for (uint32_t nc = 1; nc <= 4; nc++) {
+            for (const auto &s: sizes) {
+                auto img8 = random_image<uint8_t>(s[0], s[1], nc, 255);
+                auto img16 = random_image<uint16_t>(s[0], s[1], nc, 65535);
+                for (auto filter: filters) {
+                    auto ref8 = cserve::doResample<uint8_t>(std::vector<uint8_t>(img8), s[0], s[1], nc, s[2], s[3], filter, cserve::RESAMPLE_SCALAR);
+                    auto ref16 = cserve::doResample<uint16_t>(std::vector<uint16_t>(img16), s[0], s[1], nc, s[2], s[3], filter, cserve::RESAMPLE_SCALAR);
+                    for (auto kernel: kernels) {
+                        auto res8 = cserve::doResample<uint8_t>(std::vector<uint8_t>(img8), s[0], s[1], nc, s[2], s[3], filter, kernel);
+                        REQUIRE(res8 == ref8);
+                        auto res16 = cserve::doResample<uint16_t>(std::vector<uint16_t>(img16), s[0], s[1], nc, s[2], s[3], filter, kernel);
+                        REQUIRE(res16 == ref16);
+                    }
+                }
+            }
+        }
+    }
+
+    SECTION("bands on the compute pool give the same result") {
+        const uint32_t sizes[][4] = {{1001, 677, 130, 97}, {130, 97, 301, 211}, {640, 480, 640, 96}, {200, 900, 97, 900}};
+        for (const auto &s: sizes) {
+            auto img = random_image<uint8_t>(s[0], s[1], 3, 255);
+            for (auto filter: filters) {
+                cserve::IIIFComputePool::configure(0, 1);
+                auto serial = cserve::doResample<uint8_t>(std::vector<uint8_t>(img), s[0], s[1], 3, s[2], s[3], filter);
+                cserve::IIIFComputePool::configure(3, 4);
+                auto bands = cserve::doResample<uint8_t>(std::vector<uint8_t>(img), s[0], s[1], 3, s[2], s[3], filter);
+                REQUIRE(bands == serial);
+            }
+        }
+        cserve::IIIFComputePool::configure(0, 1);
+    }
+
+    SECTION("streaming resampler gives the same result") {
+        const uint32_t sizes[][4] = {{1001, 677, 130, 97}, {130, 97, 301, 211}, {640, 480, 640, 96}, {200, 900, 97, 900}};
+        for (const auto &s: sizes) {
+            auto img = random_image<uint16_t>(s[0], s[1], 2, 65535);
+            for (auto filter: filters) {
+                auto expected = cserve::doResample<uint16_t>(std::vector<uint16_t>(img), s[0], s[1], 2, s[2], s[3], filter);
+                cserve::IIIFResampler<uint16_t> resampler(s[0], s[1], 2, s[2], s[3], filter);
+                std::vector<uint16_t> streamed(static_cast<size_t>(s[2]) * s[3] * 2);
+                uint32_t y = 0, yy = 0;
+                while (yy < s[3]) {
+                    if (resampler.pull(streamed.data() + static_cast<size_t>(yy) * s[2] * 2)) {
+                        yy++;
+                    } else {
+                        REQUIRE(y < s[1]);
+                        resampler.push(img.data() + static_cast<size_t>(y++) * s[0] * 2);
+                    }
+                }
+                REQUIRE(y <= s[1]);
+                REQUIRE(streamed == expected);
+            }
+        }
+    }
+
+    SECTION("fused crop, reduction and scaling") {
+        // {nx, ny, x, y, w, h, reduce, nnx, nny}
+        const uint32_t cases[][9] = {{300, 200, 17, 9, 251, 170, 4, 40, 27},
+                                     {300, 200, 0, 0, 300, 200, 3, 100, 67},   // no resampling
+                                     {300, 200, 5, 7, 101, 99, 1, 101, 99},    // crop only
+                                     {300, 200, 5, 7, 101, 99, 1, 50, 50},     // crop and scale
+                                     {300, 200, 50, 20, 250, 180, 7, 36, 10},  // only vertical resampling
+                                     {300, 200, 50, 20, 250, 180, 7, 20, 26}}; // only horizontal resampling
+        for (const auto &c: cases) {
+            for (uint32_t nc: {1u, 2u, 3u, 4u}) {
+                auto img8 = random_image<uint8_t>(c[0], c[1], nc, 255);
+                auto img16 = random_image<uint16_t>(c[0], c[1], nc, 65535);
+                for (auto filter: filters) {
+                    uint32_t rw, rh;
+                    auto reduced8 = crop_reduce<uint8_t>(img8, c[0], nc, c[2], c[3], c[4], c[5], c[6], rw, rh);
+                    auto expected8 = cserve::doResample<uint8_t>(std::move(reduced8), rw, rh, nc, c[7], c[8], filter);
+                    auto fused8 = cserve::doCropReduceResample<uint8_t>(std::vector<uint8_t>(img8), c[0], c[1], nc, c[2], c[3], c[4], c[5], c[6], c[7], c[8], filter);
+                    REQUIRE(fused8 == expected8);
+
+                    auto reduced16 = crop_reduce<uint16_t>(img16, c[0], nc, c[2], c[3], c[4], c[5], c[6], rw, rh);
+                    auto expected16 = cserve::doResample<uint16_t>(std::move(reduced16), rw, rh, nc, c[7], c[8], filter);
+                    auto fused16 = cserve::doCropReduceResample<uint16_t>(std::vector<uint16_t>(img16), c[0], c[1], nc, c[2], c[3], c[4], c[5], c[6], c[7], c[8], filter);
+                    REQUIRE(fused16 == expected16);
+                }
+            }
+        }
+
+        // bands on the compute pool
+        auto img = random_image<uint8_t>(2000, 1500, 3, 255);
+        auto serial = cserve::doCropReduceResample<uint8_t>(std::vector<uint8_t>(img), 2000, 1500, 3, 100, 50, 1800, 1400, 5, 300, 233, cserve::RESAMPLE_LANCZOS3);
+        cserve::IIIFComputePool::configure(3, 4);
+        auto bands = cserve::doCropReduceResample<uint8_t>(std::vector<uint8_t>(img), 2000, 1500, 3, 100, 50, 1800, 1400, 5, 300, 233, cserve::RESAMPLE_LANCZOS3);
+        cserve::IIIFComputePool::configure(0, 1);
+        REQUIRE(bands == serial);
+    }
+}
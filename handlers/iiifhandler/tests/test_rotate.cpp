@@ -0,0 +1,133 @@
+//
+// Tests of the rotation used by IIIFImage::rotate()
+//
+
+#include "catch2/catch_all.hpp"
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "../IIIFRotate.h"
+#include "../IIIFComputePool.h"
+
+namespace {
+    template<typename T>
+    std::vector<T> random_image(uint32_t nx, uint32_t ny, uint32_t nc) {
+        std::mt19937 gen(4711);
+        std::uniform_int_distribution<uint32_t> dist(0, 65535);
+        std::vector<T> img(static_cast<size_t>(nx) * ny * nc);
+        for (auto &v: img) v = static_cast<T>(dist(gen));
+        return img;
+    }
+
+    //
+    // straightforward mirror, then rotation pixel by pixel
+    //
+    template<typename T>
+    std::vector<T> reference(const std::vector<T> &in, uint32_t nx, uint32_t ny, uint32_t nc, uint32_t angle, bool mirror,
+                             uint32_t &nnx, uint32_t &nny) {
+        std::vector<T> img(in);
+        if (mirror) {
+            for (uint32_t j = 0; j < ny; j++)
+                for (uint32_t i = 0; i < nx; i++)
+                    for (uint32_t k = 0; k < nc; k++)
+                        img[nc * (j * nx + i) + k] = in[nc * (j * nx + (nx - i - 1)) + k];
+        }
+        nnx = (angle % 180 == 0) ? nx : ny;
+        nny = (angle % 180 == 0) ? ny : nx;
+        std::vector<T> out(img.size());
+        for (uint32_t j = 0; j < nny; j++) {
+            for (uint32_t i = 0; i < nnx; i++) {
+                uint32_t x, y;
+                switch (angle) {
+                    case 90: x = j; y = ny - i - 1; break;
+                    case 180: x = nx - i - 1; y = ny - j - 1; break;
+                    case 270: x = nx - j - 1; y = i; break;
+                    default: x = i; y = j;
+                }
+                for (uint32_t k = 0; k < nc; k++) out[nc * (j * nnx + i) + k] = img[nc * (y * nx + x) + k];
+            }
+        }
+        return out;
+    }
+
+    template<typename T>
+    void check_orthogonal(uint32_t nx, uint32_t ny, uint32_t nc) {
+        auto img = random_image<T>(nx, ny, nc);
+        for (uint32_t angle: {0u, 90u, 180u, 270u}) {
+            for (bool mirror: {false, true}) {
+                uint32_t rnx, rny, nnx = 0, nny = 0;
+                auto expected = reference<T>(img, nx, ny, nc, angle, mirror, rnx, rny);
+                auto result = cserve::doRotate<T>(std::vector<T>(img), nx, ny, nc, nnx, nny, static_cast<float>(angle), mirror);
+                REQUIRE(nnx == rnx);
+                REQUIRE(nny == rny);
+                REQUIRE(result == expected);
+            }
+        }
+    }
+}
+
+TEST_CASE("Testing the rotation", "[IIIFRotate]") {
+
+    SECTION("multiples of 90 degrees") {
+        // sizes which are not multiples of the block size
+        for (uint32_t nc = 1; nc <= 5; nc++) {
+            check_orthogonal<uint8_t>(131, 67, nc);
+            check_orthogonal<uint16_t>(67, 131, nc);
+        }
+        check_orthogonal<uint8_t>(1, 200, 3);
+        check_orthogonal<uint8_t>(200, 1, 3);
+    }
+
+    SECTION("negative angles") {
+        auto img = random_image<uint8_t>(50, 30, 3);
+        uint32_t nnx1, nny1, nnx2, nny2;
+        auto r1 = cserve::doRotate<uint8_t>(std::vector<uint8_t>(img), 50, 30, 3, nnx1, nny1, -90.0f, false);
+        auto r2 = cserve::doRotate<uint8_t>(std::vector<uint8_t>(img), 50, 30, 3, nnx2, nny2, 270.0f, false);
+        REQUIRE(nnx1 == nnx2);
+        REQUIRE(nny1 == nny2);
+        REQUIRE(r1 == r2);
+    }
+
+    SECTION("arbitrary angle") {
+        const uint32_t nx = 120, ny = 80;
+        for (bool mirror: {false, true}) {
+            uint32_t nnx, nny;
+            auto out = cserve::doRotate<uint16_t>(std::vector<uint16_t>(nx * ny * 2, 40000), nx, ny, 2, nnx, nny, 30.0f, mirror);
+            REQUIRE(nnx == 144);
+            REQUIRE(nny == 129);
+            REQUIRE(out.size() == static_cast<size_t>(nnx) * nny * 2);
+            // the center lies inside the image, the corners outside
+            REQUIRE(out[2 * ((nny / 2) * nnx + nnx / 2)] == 40000);
+            REQUIRE(out[0] == 0);
+            REQUIRE(out[out.size() - 1] == 0);
+        }
+
+        // mirrored and rotated by 180 is flipped vertically, also with interpolation
+        auto img = random_image<uint8_t>(40, 30, 1);
+        uint32_t nnx, nny;
+        auto flipped = cserve::doRotate<uint8_t>(std::vector<uint8_t>(img), 40, 30, 1, nnx, nny, 180.0f, true);
+        auto rotated = cserve::doRotate<uint8_t>(std::vector<uint8_t>(img), 40, 30, 1, nnx, nny, 179.999f, true);
+        REQUIRE(nnx == 40);
+        REQUIRE(nny == 30);
+        for (uint32_t y = 1; y < nny - 1; y++) {
+            for (uint32_t x = 1; x < nnx - 1; x++) {
+                REQUIRE(std::abs(static_cast<int>(rotated[y * nnx + x]) - static_cast<int>(flipped[y * nnx + x])) <= 1);
+            }
+        }
+    }
+
+    SECTION("result is independent of the compute pool") {
+        auto img = random_image<uint8_t>(1000, 700, 3);
+        uint32_t nnx, nny;
+        auto single = cserve::doRotate<uint8_t>(std::vector<uint8_t>(img), 1000, 700, 3, nnx, nny, 90.0f, true);
+        auto single_arb = cserve::doRotate<uint8_t>(std::vector<uint8_t>(img), 1000, 700, 3, nnx, nny, 17.0f, false);
+        cserve::IIIFComputePool::configure(4, 4);
+        auto pooled = cserve::doRotate<uint8_t>(std::vector<uint8_t>(img), 1000, 700, 3, nnx, nny, 90.0f, true);
+        auto pooled_arb = cserve::doRotate<uint8_t>(std::vector<uint8_t>(img), 1000, 700, 3, nnx, nny, 17.0f, false);
+        cserve::IIIFComputePool::configure(0, 1);
+        REQUIRE(pooled == single);
+        REQUIRE(pooled_arb == single_arb);
+    }
+}
@@ -0,0 +1,82 @@
+//
+// Tests of the coalescing of identical renders (IIIFSingleFlight). The flow through the
+// IIIF handler is tested end to end by test_coalesced_renders in test_iiif_basic.py.
+//
+
+#include "catch2/catch_all.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../IIIFSingleFlight.h"
+
+TEST_CASE("Testing IIIFSingleFlight", "[IIIFSingleFlight]") {
+    const std::string canonical = "/iiif/images/new_object.jp2/0,0,512,512/256,/0/default.jpg";
+
+    SECTION("50 identical concurrent joins") {
+        cserve::IIIFSingleFlight renders;
+        std::atomic<int> nproducers{0};
+        std::atomic<int> nok{0};
+        std::vector<std::thread> clients;
+        for (int i = 0; i < 50; i++) {
+            clients.emplace_back([&] {
+                auto ticket = renders.join(canonical);
+                if (ticket.producer()) {
+                    ++nproducers;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100)); // rendering...
+                    ticket.complete();
+                    ++nok;
+                } else if (ticket.wait(std::chrono::seconds(10))) {
+                    ++nok;
+                }
+            });
+        }
+        for (auto &client: clients) client.join();
+        REQUIRE(nproducers + static_cast<int>(renders.coalesced()) == 50);
+        REQUIRE(nok == 50);
+        REQUIRE(renders.inflight() == 0);
+    }
+
+    SECTION("different keys are not coalesced") {
+        cserve::IIIFSingleFlight renders;
+        std::vector<cserve::IIIFSingleFlight::Ticket> tickets;
+        for (int i = 0; i < 4; i++) {
+            tickets.push_back(renders.join(canonical + std::to_string(i)));
+            REQUIRE(tickets.back().producer());
+        }
+        REQUIRE(renders.coalesced() == 0);
+        REQUIRE(renders.inflight() == 4);
+        tickets.clear();
+        REQUIRE(renders.inflight() == 0);
+    }
+
+    SECTION("failing producer releases the waiting requests") {
+        cserve::IIIFSingleFlight renders;
+        auto producer = std::make_unique<cserve::IIIFSingleFlight::Ticket>(renders.join(canonical));
+        REQUIRE(producer->producer());
+        auto waiter = renders.join(canonical);
+        REQUIRE_FALSE(waiter.producer());
+        REQUIRE(renders.coalesced() == 1);
+        std::thread t([&] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            producer.reset(); // e.g. the decoder threw an exception
+        });
+        REQUIRE_FALSE(waiter.wait(std::chrono::seconds(10)));
+        t.join();
+        REQUIRE(renders.inflight() == 0);
+        REQUIRE(renders.join(canonical).producer()); // the next request renders again
+    }
+
+    SECTION("waiting times out") {
+        cserve::IIIFSingleFlight renders;
+        auto producer = renders.join(canonical);
+        auto waiter = renders.join(canonical);
+        REQUIRE_FALSE(waiter.wait(std::chrono::milliseconds(10)));
+        producer.complete();
+        REQUIRE(waiter.wait(std::chrono::milliseconds(10)));
+    }
+}
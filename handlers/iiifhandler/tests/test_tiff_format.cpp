@@ -5,6 +5,7 @@
 #include <iostream>
 
 #include "catch2/catch_all.hpp"
+#include "../IIIFComputePool.h"
 #include "../IIIFImage.h"
 #include "../imgformats/IIIFIOTiff.h"
 
@@ -229,6 +230,25 @@ TEST_CASE("Image tests", "TIFF") {
         REQUIRE(img.getPhoto() == cserve::RGB);
     }
 
+    SECTION("RGB-8Bit-lzw-region-strips") {
+        auto region = std::make_shared<cserve::IIIFRegion>("100,150,400,300");
+        auto size = std::make_shared<cserve::IIIFSize>("!250,250");
+        cserve::IIIFImage img = tiffio.read("data/tiff_01_rgb_lzw.tif",
+                                            region,
+                                            size,
+                                            false,
+                                            {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH});
+        auto strips = tiffio.read_strips("data/tiff_01_rgb_lzw.tif",
+                                         region,
+                                         size,
+                                         false,
+                                         {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH});
+        REQUIRE(strips->header().getNx() == 250);
+        REQUIRE(strips->header().getNy() == 188);
+        cserve::IIIFImage streamed = cserve::IIIFStripSource::materialize(std::move(strips));
+        REQUIRE(streamed == img);
+    }
+
     SECTION("RGB-8Bit-jpg") {
         auto region = std::make_shared<cserve::IIIFRegion>("full");
         auto size = std::make_shared<cserve::IIIFSize>("max");
@@ -581,5 +601,59 @@ TEST_CASE("Image tests", "TIFF") {
         std::filesystem::remove("scratch/out.png");
 
     }
-}
 
+    SECTION("TIFF Pyramid with tiles, parallel decoding") {
+        //
+        // the tiles of a region are decompressed in parallel, each band of tiles with its own TIFF handle
+        //
+        auto full_region = std::make_shared<cserve::IIIFRegion>("full");
+        auto size = std::make_shared<cserve::IIIFSize>("max");
+        cserve::IIIFImage img = tiffio.read("data/tiff_01_rgb_uncompressed.tif", full_region, size, false,
+                                            {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH});
+        cserve::IIIFCompressionParams compression{{cserve::TIFF_COMPRESSION, "COMPRESSION_LZW"},
+                                                  {cserve::TIFF_PYRAMID, "1:128 2:64"}};
+        REQUIRE_NOTHROW(tiffio.write(img, "scratch/tiff_pyramid_128.tif", compression));
+
+        //
+        // the configuration of the pool is restored also if a test fails
+        //
+        auto previous = cserve::IIIFComputePool::instance();
+        struct PoolRestore {
+            uint32_t nthreads;
+            uint32_t per_request;
+            ~PoolRestore() { cserve::IIIFComputePool::configure(nthreads, per_request); }
+        } restore{previous ? static_cast<uint32_t>(previous->nthreads()) : 0, previous ? previous->per_request() : 1};
+        previous.reset();
+
+        cserve::IIIFComputePool::configure(0, 1);
+        cserve::IIIFImage serial = tiffio.read("scratch/tiff_pyramid_128.tif", full_region, size, false,
+                                               {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH});
+        REQUIRE(serial == img);
+
+        cserve::IIIFComputePool::configure(3, 3);
+        for (auto coords: {"full", "600,300,500,500", "130,0,1070,900", "257,129,1,1"}) {
+            auto region = std::make_shared<cserve::IIIFRegion>(coords);
+            cserve::IIIFImage parallel = tiffio.read("scratch/tiff_pyramid_128.tif", region, size, false,
+                                                     {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH});
+            int32_t x, y;
+            uint32_t w, h;
+            region->crop_coords(img.getNx(), img.getNy(), x, y, w, h);
+            cserve::IIIFImage expected = img;
+            expected.crop(x, y, w, h);
+            REQUIRE(parallel.getNx() == w);
+            REQUIRE(parallel.getNy() == h);
+            REQUIRE(parallel == expected);
+
+            //
+            // streamed (JPEG and PNG responses): the tiles of each row of tiles are decompressed in parallel
+            //
+            auto strips = tiffio.read_strips("scratch/tiff_pyramid_128.tif", region, size, false,
+                                             {cserve::HIGH, cserve::HIGH, cserve::HIGH, cserve::HIGH});
+            REQUIRE(strips->header().getNx() == w);
+            REQUIRE(strips->header().getNy() == h);
+            cserve::IIIFImage streamed = cserve::IIIFStripSource::materialize(std::move(strips));
+            REQUIRE(streamed == expected);
+        }
+        std::filesystem::remove("scratch/tiff_pyramid_128.tif");
+    }
+}
@@ -0,0 +1,193 @@
+//
+// Tests of the watermark cache (IIIFWatermarkCache) and of the watermark blending
+//
+
+#include "catch2/catch_all.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "../IIIFWatermark.h"
+#include "../IIIFPixelKernels.h"
+
+namespace {
+    const cserve::ResampleKernel kernels[] = {cserve::RESAMPLE_SCALAR, cserve::RESAMPLE_SSE41, cserve::RESAMPLE_AVX2, cserve::RESAMPLE_NEON};
+
+    //
+    // the blending as it was in IIIFImage::add_watermark()
+    //
+    uint8_t old_blend8(uint8_t p, uint8_t val) {
+        double nval = (p / 255.) * (1.0 + val / 2550.0) + val / 2550.0;
+        return (nval > 1.0) ? 255 : static_cast<uint8_t>(floorl(nval * 255. + .5));
+    }
+
+    uint16_t old_blend16(uint16_t p, uint8_t val) {
+        double nval = (p / 65535.0) * (1.0 + val / 655350.0) + val / 352500.;
+        return (nval > 1.0) ? static_cast<uint16_t>(65535) : static_cast<uint16_t>(floorl(nval * 65535. + .5));
+    }
+
+    //
+    // the interpolation as in bilinn() (IIIFImgTools.cpp) for the first channel
+    //
+    uint8_t old_bilinn(const std::vector<uint8_t> &buf, uint32_t nx, double x, double y, uint32_t n) {
+        auto pos = [&](int xx, int yy) { return static_cast<double>(buf[n * (yy * nx + xx)]); };
+        int ix = (int) x, iy = (int) y;
+        double rx = x - (double) ix, ry = y - (double) iy;
+        if ((rx < 1.0e-2) && (ry < 1.0e-2)) return buf[n * (iy * nx + ix)];
+        if (rx < 1.0e-2) return (uint8_t) lround(pos(ix, iy) * (1 - rx - ry + rx * ry) + pos(ix, iy + 1) * (ry - rx * ry));
+        if (ry < 1.0e-2) return (uint8_t) lround(pos(ix, iy) * (1 - rx - ry + rx * ry) + pos(ix + 1, iy) * (rx - rx * ry));
+        return (uint8_t) lround(pos(ix, iy) * (1 - rx - ry + rx * ry) + pos(ix + 1, iy) * (rx - rx * ry) +
+                                pos(ix, iy + 1) * (ry - rx * ry) + pos(ix + 1, iy + 1) * rx * ry);
+    }
+
+    std::vector<uint8_t> test_watermark(uint32_t nx, uint32_t ny, uint32_t nc, uint8_t seed) {
+        std::vector<uint8_t> wm(static_cast<size_t>(nx) * ny * nc);
+        for (size_t i = 0; i < wm.size(); i++) wm[i] = static_cast<uint8_t>(i * 37 + seed);
+        return wm;
+    }
+}
+
+TEST_CASE("Testing the watermarks", "[IIIFWatermark]") {
+
+    SECTION("8 bit blending") {
+        std::vector<uint8_t> pixels(256 * 256 + 7), values(256 * 256 + 7);
+        for (size_t i = 0; i < pixels.size(); i++) {
+            pixels[i] = static_cast<uint8_t>(i);
+            values[i] = static_cast<uint8_t>(i >> 8);
+        }
+        std::vector<uint8_t> ref(pixels.size());
+        size_t rounded_up = 0;
+        for (size_t i = 0; i < pixels.size(); i++) {
+            const uint32_t p = pixels[i], v = values[i];
+            ref[i] = static_cast<uint8_t>(std::min<uint32_t>(255, p + (v * (p + 255) + 1275) / 2550));
+            const uint8_t old = old_blend8(pixels[i], values[i]);
+            if (ref[i] != old) {
+                // the double precision code rounds some exact halves down
+                REQUIRE(ref[i] == old + 1);
+                REQUIRE((v * (p + 255) + 1275) % 2550 == 0);
+                rounded_up++;
+            }
+        }
+        REQUIRE(rounded_up < 32);
+        for (auto kernel: kernels) {
+            auto res = pixels;
+            cserve::blendWatermark(res.data(), values.data(), res.size(), 1, kernel);
+            REQUIRE(res == ref);
+        }
+    }
+
+    SECTION("16 bit blending") {
+        std::vector<uint16_t> pixels(70000);
+        std::vector<uint8_t> values(pixels.size());
+        std::vector<uint16_t> ref(pixels.size());
+        for (size_t i = 0; i < pixels.size(); i++) {
+            pixels[i] = static_cast<uint16_t>(i * 7);
+            values[i] = static_cast<uint8_t>(i * 13);
+            ref[i] = old_blend16(pixels[i], values[i]);
+        }
+        for (auto kernel: kernels) {
+            auto res = pixels;
+            cserve::blendWatermark(res.data(), values.data(), res.size(), 1, kernel);
+            REQUIRE(res == ref);
+        }
+    }
+
+    SECTION("one value per pixel") {
+        const uint32_t nc = 3;
+        std::vector<uint8_t> pixels(1777 * nc), values(1777), expanded(pixels.size());
+        for (size_t i = 0; i < pixels.size(); i++) pixels[i] = static_cast<uint8_t>(i * 7);
+        for (size_t i = 0; i < values.size(); i++) values[i] = static_cast<uint8_t>(i * 13);
+        for (size_t i = 0; i < expanded.size(); i++) expanded[i] = values[i / nc];
+        auto ref = pixels;
+        cserve::blendWatermark(ref.data(), expanded.data(), ref.size(), 1, cserve::RESAMPLE_SCALAR);
+        for (auto kernel: kernels) {
+            auto res = pixels;
+            cserve::blendWatermark(res.data(), values.data(), values.size(), nc, kernel);
+            REQUIRE(res == ref);
+        }
+    }
+
+    SECTION("scaling") {
+        const uint32_t wm_nx = 50, wm_ny = 40;
+        auto wm = test_watermark(wm_nx, wm_ny, 2, 0);
+        auto same = cserve::scaleWatermark(wm, wm_nx, wm_ny, 2, wm_nx, wm_ny);
+        for (size_t i = 0; i < same.size(); i++) REQUIRE(same[i] == wm[2 * i]);
+
+        const uint32_t nx = 123, ny = 77;
+        auto values = cserve::scaleWatermark(wm, wm_nx, wm_ny, 2, nx, ny);
+        REQUIRE(values.size() == static_cast<size_t>(nx) * ny);
+        for (uint32_t j = 0; j < ny; j++) {
+            for (uint32_t i = 0; i < nx; i++) {
+                const double x = (double) (wm_nx * i) / (double) nx, y = (double) (wm_ny * j) / (double) ny;
+                if ((x < wm_nx - 1) && (y < wm_ny - 1)) { // bilinn() reads beyond the watermark at the border
+                    REQUIRE(values[static_cast<size_t>(j) * nx + i] == old_bilinn(wm, wm_nx, x, y, 2));
+                }
+            }
+        }
+
+        //
+        // the watermark of large images is scaled in bands
+        //
+        std::vector<uint8_t> band(static_cast<size_t>(nx) * 10);
+        for (uint32_t first = 0; first < ny; first += 10) {
+            const uint32_t last = std::min(first + 10, ny);
+            cserve::scaleWatermarkRows(wm, wm_nx, wm_ny, 2, nx, ny, first, last, band.data());
+            REQUIRE(std::equal(values.begin() + first * nx, values.begin() + last * nx, band.begin()));
+        }
+    }
+
+    SECTION("cache") {
+        auto path = (std::filesystem::temp_directory_path() / "iiif_test_watermark.tif").string();
+        std::ofstream(path) << "watermark";
+        int nloads = 0;
+        uint8_t seed = 1;
+        cserve::IIIFWatermarkCache cache(2 * 256 * 256, [&](const std::string &, uint32_t &nx, uint32_t &ny, uint32_t &nc) {
+            ++nloads;
+            nx = 64;
+            ny = 32;
+            nc = 1;
+            return test_watermark(nx, ny, nc, seed);
+        });
+        REQUIRE(cache.fits(256, 512));
+        REQUIRE_FALSE(cache.fits(256, 513));
+
+        auto tile = cache.get(path, 256, 256);
+        REQUIRE(tile != nullptr);
+        REQUIRE(*tile == cserve::scaleWatermark(test_watermark(64, 32, 1, 1), 64, 32, 1, 256, 256));
+        REQUIRE(cache.get(path, 256, 256) == tile); // the same scaled watermark
+        REQUIRE(cache.hits() == 1);
+        REQUIRE(cache.misses() == 1);
+        REQUIRE(nloads == 1);
+
+        auto edge = cache.get(path, 100, 256);
+        REQUIRE(nloads == 1);
+        REQUIRE(cache.getBytes() == (256 + 100) * 256);
+        cache.get(path, 256, 128);
+        cache.get(path, 256, 200); // exceeds the limit: the least recently used are dropped
+        REQUIRE(cache.getBytes() <= 2 * 256 * 256);
+        REQUIRE(cache.get(path, 256, 200) != nullptr);
+        REQUIRE(cache.hits() == 2);
+
+        //
+        // the file is modified: the watermark is read again
+        //
+        seed = 2;
+        std::filesystem::last_write_time(path, std::filesystem::last_write_time(path) + std::chrono::seconds(10));
+        auto modified = cache.get(path, 256, 256);
+        REQUIRE(nloads == 2);
+        REQUIRE(*modified == cserve::scaleWatermark(test_watermark(64, 32, 1, 2), 64, 32, 1, 256, 256));
+        REQUIRE(*modified != *tile);
+        REQUIRE(cache.getBytes() == 256 * 256);
+        REQUIRE(cache.watermark(path)->pixels == test_watermark(64, 32, 1, 2));
+
+        std::filesystem::remove(path);
+        REQUIRE(cache.get(path, 256, 256) == nullptr);
+        REQUIRE(cache.getBytes() == 0);
+    }
+}
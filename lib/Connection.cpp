@@ -22,11 +22,16 @@
 
 #include <unistd.h>    //write
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
 
 #include "Error.h"
 #include "Connection.h"
 #include "HttpHelpers.h"
 #include "ChunkReader.h"
+#include "SockStream.h"
 #include "makeunique.h"
 #include "Cserve.h" // TEMPORARY !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 
@@ -902,6 +907,32 @@ namespace cserve {
     }
 //=============================================================================
 
+    string Connection::peer_name() {
+        if (_peer_name_resolved) return _peer_name;
+        _peer_name_resolved = true;
+        _peer_name = _peer_ip;
+
+        struct sockaddr_storage addr{};
+        socklen_t addrlen;
+        auto *addr4 = (struct sockaddr_in *) &addr;
+        auto *addr6 = (struct sockaddr_in6 *) &addr;
+        if (inet_pton(AF_INET, _peer_ip.c_str(), &addr4->sin_addr) == 1) {
+            addr4->sin_family = AF_INET;
+            addrlen = sizeof(struct sockaddr_in);
+        } else if (inet_pton(AF_INET6, _peer_ip.c_str(), &addr6->sin6_addr) == 1) {
+            addr6->sin6_family = AF_INET6;
+            addrlen = sizeof(struct sockaddr_in6);
+        } else {
+            return _peer_name;
+        }
+        char host[NI_MAXHOST];
+        if (getnameinfo((struct sockaddr *) &addr, addrlen, host, sizeof(host), nullptr, 0, NI_NAMEREQD) == 0) {
+            _peer_name = host;
+        }
+        return _peer_name;
+    }
+//=============================================================================
+
     string Connection::getParams(const std::string &name) {
         string result;
 
@@ -1286,6 +1317,33 @@ namespace cserve {
                 }
             }
 
+            //
+            // if possible, the file data is sent directly from the page cache to the socket
+            // (sendfile() or kernel TLS) without copying it through the stream buffers
+            //
+            auto *sockstream = dynamic_cast<SockStream *>(os->rdbuf());
+            if ((sockstream != nullptr) && (fsize > 0) && sockstream->zerocopy()) {
+                if (_chunked_transfer_out) {
+                    *os << std::hex << fsize << "\r\n";
+                }
+                os->flush();
+                if (os->eof() || os->fail()) {
+                    fclose(infile);
+                    throw InputFailure(OUTPUT_WRITE_FAIL);
+                }
+                if (sockstream->sendfile(fileno(infile), from, fsize) != fsize) {
+                    fclose(infile);
+                    throw InputFailure(OUTPUT_WRITE_FAIL);
+                }
+                fclose(infile);
+                if (_chunked_transfer_out) {
+                    *os << "\r\n";
+                    os->flush();
+                    if (os->eof() || os->fail()) throw InputFailure(OUTPUT_WRITE_FAIL);
+                }
+                return;
+            }
+
             char buf[bufsize];
             size_t n;
             size_t nn = 0;
@@ -1441,8 +1499,16 @@ namespace cserve {
 //=============================================================================
 
 
+    void Connection::abort() {
+        outbuf_nbytes = 0;
+        _aborted = true;
+        _finished = true;
+        _keep_alive = false;
+    }
+//=============================================================================
+
     void Connection::finalize() {
-        if (os == nullptr) return;
+        if ((os == nullptr) || _aborted) return;
         if (_chunked_transfer_out && !_finished) {
             *os << "0\r\n\r\n";
             if (os->eof() || os->fail()) throw InputFailure(OUTPUT_WRITE_FAIL);
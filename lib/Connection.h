@@ -249,6 +249,8 @@ namespace cserve {
     private:
         Server *_server;          //!< Pointer to the server class
         std::string _peer_ip;     //!< IP number of client (peer)
+        std::string _peer_name;   //!< Host name of client (peer), resolved on first use
+        bool _peer_name_resolved{false}; //!< true, if the reverse lookup of the peer name has been done
         int _peer_port{};           //!< Port of peer/client
         std::string http_version; //!< Holds the HTTP version of the request
         bool _secure;             //!< true if SSL used
@@ -273,6 +275,7 @@ namespace cserve {
         bool _chunked_transfer_in;      //!< Input data is chunked
         bool _chunked_transfer_out;     //!< output data is sent in chunks
         bool _finished;                 //!< Transfer of response data finished
+        bool _aborted{false};           //!< Response cut off, the client must see that it is incomplete
         char *_content;                 //!< Content if content-type is "text/plain", "application/json" etc.
         std::streamsize content_length;      //!< length of body in octets (used if not chunked transfer)
         std::string _content_type;      //!< Content-type (mime type of content)
@@ -362,7 +365,18 @@ namespace cserve {
          *
          * \param ip String containing peer ip
          */
-        inline void peer_ip(const std::string &ip) { _peer_ip = ip; }
+        inline void peer_ip(const std::string &ip) {
+            _peer_ip = ip;
+            _peer_name_resolved = false;
+        }
+
+        /*!
+         * Get the host name of the peer/client. The reverse DNS lookup is done on the
+         * first call only (and not at all if nobody asks for the name).
+         *
+         * \returns Host name of the peer, or the peer IP if the name cannot be resolved
+         */
+        std::string peer_name();
 
         /*!
          * Get port number of peer
@@ -747,6 +761,19 @@ namespace cserve {
          */
         void flush();
 
+        /*!
+         * Cut off a response whose header has already been sent (e.g. if the decoding of an image
+         * fails while it is streamed). The data not yet sent is dropped, no terminating chunk is sent
+         * and the socket is closed after the request, so that the client sees that the response is
+         * incomplete.
+         */
+        void abort();
+
+        /*!
+         * True if the HTTP header of the response has already been sent
+         */
+        [[nodiscard]] inline bool headerSent() const { return header_sent; }
+
         /*!
          * Flags the connection to be reset
          */
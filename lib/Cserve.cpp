@@ -23,6 +23,7 @@
 #include <sys/select.h>
 #include <sys/socket.h>
 #include <poll.h>
+#include <fcntl.h>
 #include <netinet/in.h>
 #include <arpa/inet.h> //inet_addr
 #include <unistd.h>    //write
@@ -58,6 +59,7 @@ namespace cserve {
         sigaddset(&set, SIGPIPE);
         sigaddset(&set, SIGINT);
         sigaddset(&set, SIGTERM);
+        sigaddset(&set, SIGHUP);
 
         int sig;
 
@@ -74,6 +76,13 @@ namespace cserve {
                 Server::logger()->info("Got SIGINT or SIGTERM, stopping server");
                 return nullptr;
             }
+            //
+            // SIGHUP reloads the SSL certificate without dropping the open connections
+            //
+            if (sig == SIGHUP) {
+                Server::logger()->info("Got SIGHUP, reloading SSL certificate");
+                (void) serverptr->reload_ssl_certificate();
+            }
         }
     }
     //=========================================================================
@@ -107,8 +116,9 @@ namespace cserve {
     Server::Server(int port,
                    unsigned nthreads,
                    const std::string &userid_str) : _port(port), _nthreads(nthreads),
-                   _sockfd(-1), _ssl_sockfd(-1), _ssl_port(-1), _max_post_size(1024*1024),
-                   running(false), _keep_alive_timeout(5) {
+                   _sockfd(-1), _ssl_sockfd(-1), _ssl_port(-1), _ssl_ctx(nullptr),
+                   _ssl_session_cache_size(SSL_SESSION_CACHE_MAX_SIZE_DEFAULT), _ssl_session_timeout(300),
+                   _lua_recycle_after(1000), _max_post_size(1024*1024), running(false), _keep_alive_timeout(5) {
         stoppipe[0] = -1;
         stoppipe[1] = -1;
 /*
@@ -161,6 +171,13 @@ namespace cserve {
         default_handler = std::make_shared<DefaultHandler>();
     }
 
+    Server::~Server() {
+        if (_ssl_ctx != nullptr) {
+            SSL_CTX_free(_ssl_ctx);
+        }
+    }
+    //=========================================================================
+
     std::string Server::version_string() {
         return fmt::format("*** CSERVE V{}.{}.{} ©Lukas Rosenthaler (2022, 2023) ***", cserver_VERSION_MAJOR, cserver_VERSION_MINOR, cserver_VERSION_PATCH);
     }
@@ -254,6 +271,16 @@ namespace cserve {
             exit(1);
         }
 
+        //
+        // the listening socket is registered edge triggered with the event engine and
+        // therefore must be non-blocking
+        //
+        int flags = fcntl(sockfd, F_GETFL, 0);
+        if ((flags < 0) || (fcntl(sockfd, F_SETFL, flags | O_NONBLOCK) < 0)) {
+            Server::logger()->error("Could not set socket to non-blocking: {}", strerror(errno));
+            exit(1);
+        }
+
         if (::listen(sockfd, SOMAXCONN) < 0) {
             Server::logger()->error("Could not listen on socket: {}", strerror(errno));
             exit(1);
@@ -296,14 +323,15 @@ namespace cserve {
      */
     static int close_socket(const SocketControl::SocketInfo &sockid) {
         if (sockid.ssl_sid != nullptr) {
-            int sstat;
-            while ((sstat = SSL_shutdown(sockid.ssl_sid)) == 0);
+            int sstat = 1;
+            if (SSL_is_init_finished(sockid.ssl_sid)) { // no shutdown if the handshake did not complete
+                while ((sstat = SSL_shutdown(sockid.ssl_sid)) == 0);
+            }
             if (sstat < 0) {
                 Server::logger()->warn("SSL socket error: shutdown of socket failed at [{}: {}] with error code {}",
                                        this_src_file, __LINE__, SSL_get_error(sockid.ssl_sid, sstat));
             }
-            SSL_free(sockid.ssl_sid);
-            SSL_CTX_free(sockid.sslctx);
+            SSL_free(sockid.ssl_sid); // releases the reference to the shared SSL context
         }
         if (shutdown(sockid.sid, SHUT_RDWR) < 0) {
             Server::logger()->debug("Debug: shutting down socket at [{}: {}]: {} failed (client terminated already?)",
@@ -319,6 +347,76 @@ namespace cserve {
     }
     //=========================================================================
 
+    /**
+     * Switch a socket between blocking and non-blocking mode
+     * @param sid Socket id
+     * @param blocking true for blocking mode
+     * @return true on success
+     */
+    static bool set_blocking(int sid, bool blocking) {
+        int flags = fcntl(sid, F_GETFL, 0);
+        if (flags < 0) return false;
+        flags = blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK);
+        return fcntl(sid, F_SETFL, flags) == 0;
+    }
+    //=========================================================================
+
+    /**
+     * Continue the non-blocking TLS handshake of a client socket. This is called by the
+     * event loop whenever the socket becomes readable while the handshake is not finished.
+     *
+     * @param socket_control SocketControl instance
+     * @param sockid The client socket
+     * @return true, if the handshake is finished and request data is already buffered by OpenSSL
+     * (the request must be dispatched now), false otherwise
+     */
+    static bool continue_ssl_handshake(SocketControl &socket_control, const SocketControl::SocketInfo &sockid) {
+        ERR_clear_error();
+        int ret = SSL_do_handshake(sockid.ssl_sid);
+        if (ret == 1) {
+            //
+            // handshake finished: the worker threads use blocking IO (with SO_RCVTIMEO)
+            //
+            (void) set_blocking(sockid.sid, true);
+            if (SSL_has_pending(sockid.ssl_sid)) {
+                return true;
+            }
+            //
+            // Re-register the socket: if the client sent its request together with the end of
+            // the handshake, the data is already in the socket and would not trigger a new edge.
+            // Adding the socket again reports it immediately.
+            //
+            std::optional<SocketControl::SocketInfo> opt_sockid = socket_control.remove(sockid.sid);
+            if (opt_sockid.has_value()) socket_control.add_dyn_socket(opt_sockid.value());
+            return false;
+        }
+        int err = SSL_get_error(sockid.ssl_sid, ret);
+        if (err == SSL_ERROR_WANT_READ) {
+            //
+            // Waiting for more data from the client. Clients that never finish the handshake are
+            // closed by the event loop (see SocketControl::close_expired_handshakes()).
+            //
+            return false;
+        }
+        if (err == SSL_ERROR_WANT_WRITE) {
+            //
+            // The socket is only watched for readability. The server's handshake messages fit into
+            // the send buffer of a fresh socket, a full buffer means the client does not read them.
+            //
+            Server::logger()->warn("OpenSSL error [{}, {}]: SSL handshake with {} stalled, client does not read",
+                                   this_src_file, __LINE__, sockid.peer_ip);
+            (void) socket_control.remove(sockid.sid);
+            close_socket(sockid);
+            return false;
+        }
+        Server::logger()->warn("OpenSSL error [{}, {}]: SSL handshake with {} failed (error {})",
+                               this_src_file, __LINE__, sockid.peer_ip, err);
+        (void) socket_control.remove(sockid.sid);
+        close_socket(sockid);
+        return false;
+    }
+    //=========================================================================
+
     static void process_request(ThreadControl::ThreadChildData &tdata) {
         //auto *tdata = static_cast<ThreadControl::ThreadChildData *>(arg);
         //pthread_t my_tid = pthread_self();
@@ -327,6 +425,8 @@ namespace cserve {
         pollfd readfds[1];
         readfds[0] = {tdata.control_pipe, POLLIN, 0};
 
+        std::unique_ptr<LuaServer> lua_state; // Lua interpreter of this worker, reused for many requests
+
         do {
             int poll_status = poll(readfds, 1, -1);
             if (poll_status < 0) {
@@ -367,10 +467,10 @@ namespace cserve {
                         auto t1 = high_resolution_clock::now();
                         if (msg.ssl_sid != nullptr) {
                             tstatus = tdata.serv->processRequest(&ins, &os, tmpstr,
-                                                                  msg.peer_port, true, keep_alive);
+                                                                  msg.peer_port, true, keep_alive, lua_state);
                         } else {
                             tstatus = tdata.serv->processRequest(&ins, &os, tmpstr,
-                                                                  msg.peer_port, false, keep_alive);
+                                                                  msg.peer_port, false, keep_alive, lua_state);
                         }
                         auto t2 = high_resolution_clock::now();
                         duration<double, std::milli> ms_double = t2 - t1;
@@ -410,6 +510,87 @@ namespace cserve {
     }
 
 
+    /**
+     * Create the server wide SSL context. The certificate and the key are loaded and checked
+     * once, and TLS session resumption (server side session cache and session tickets) is enabled.
+     *
+     * @return New SSL context
+     */
+    SSL_CTX *Server::create_ssl_context() {
+        SSL_CTX *sslCtx;
+        if ((sslCtx = SSL_CTX_new(TLS_server_method())) == nullptr) {
+            Server::logger()->error("OpenSSL error: SSL_CTX_new() failed");
+            throw SSLError(this_src_file, __LINE__, "OpenSSL error: SSL_CTX_new() failed");
+        }
+        SSL_CTX_set_options(sslCtx, SSL_OP_SINGLE_DH_USE);
+        if (SSL_CTX_use_certificate_chain_file(sslCtx, _ssl_certificate.c_str()) != 1) {
+            Server::logger()->error("OpenSSL error [{}, {}]: SSL_CTX_use_certificate_chain_file({}) failed.",
+                                    this_src_file, __LINE__, _ssl_certificate);
+            SSL_CTX_free(sslCtx);
+            throw SSLError(this_src_file, __LINE__,
+                           fmt::format("OpenSSL error: SSL_CTX_use_certificate_chain_file({}) failed.", _ssl_certificate));
+        }
+        if (SSL_CTX_use_PrivateKey_file(sslCtx, _ssl_key.c_str(), SSL_FILETYPE_PEM) != 1) {
+            Server::logger()->error("OpenSSL error [{}, {}]: SSL_CTX_use_PrivateKey_file({}) failed",
+                                    this_src_file, __LINE__, _ssl_key);
+            SSL_CTX_free(sslCtx);
+            throw SSLError(this_src_file, __LINE__,
+                           fmt::format("OpenSSL error: SSL_CTX_use_PrivateKey_file({}) failed", _ssl_key));
+        }
+        if (!SSL_CTX_check_private_key(sslCtx)) {
+            Server::logger()->error("OpenSSL error [{}, {}]: SSL_CTX_check_private_key() failed",
+                                    this_src_file, __LINE__);
+            SSL_CTX_free(sslCtx);
+            throw SSLError(this_src_file, __LINE__, "OpenSSL error: SSL_CTX_check_private_key() failed");
+        }
+
+        //
+        // TLS session resumption: sessions are cached on the server (TLS 1.2 session ids)
+        // and session tickets are issued (TLS 1.2 and TLS 1.3). The ticket keys are
+        // generated by OpenSSL for each context.
+        //
+        static const unsigned char session_id_context[] = "cserve";
+        SSL_CTX_set_session_id_context(sslCtx, session_id_context, sizeof(session_id_context) - 1);
+        SSL_CTX_set_session_cache_mode(sslCtx, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_sess_set_cache_size(sslCtx, _ssl_session_cache_size);
+        SSL_CTX_set_timeout(sslCtx, _ssl_session_timeout);
+        SSL_CTX_clear_options(sslCtx, SSL_OP_NO_TICKET);
+#ifdef SSL_OP_ENABLE_KTLS
+        //
+        // let the kernel do the record encryption if it supports the negotiated cipher. This
+        // allows Connection::sendFile to use sendfile() on the SSL port too.
+        //
+        SSL_CTX_set_options(sslCtx, SSL_OP_ENABLE_KTLS);
+#endif
+        return sslCtx;
+    }
+    //=========================================================================
+
+    bool Server::reload_ssl_certificate() {
+        if (_ssl_port <= 0) return false;
+        SSL_CTX *new_ctx;
+        try {
+            new_ctx = create_ssl_context();
+        } catch (SSLError &err) {
+            Server::logger()->error("Reloading SSL certificate failed, keeping the old one: {}", err.to_string());
+            return false;
+        }
+        SSL_CTX *old_ctx;
+        {
+            std::lock_guard<std::mutex> ctx_guard(_ssl_ctx_mutex);
+            old_ctx = _ssl_ctx;
+            _ssl_ctx = new_ctx;
+        }
+        //
+        // open connections hold their own reference to the old context, it is
+        // released when the last of them is closed
+        //
+        if (old_ctx != nullptr) SSL_CTX_free(old_ctx);
+        Server::logger()->info("SSL certificate \"{}\" loaded", _ssl_certificate);
+        return true;
+    }
+    //=========================================================================
+
     SocketControl::SocketInfo Server::accept_connection(int sock, bool ssl) {
         SocketControl::SocketInfo socket_id;
         //
@@ -417,11 +598,19 @@ namespace cserve {
         //
         struct sockaddr_storage cli_addr{};
         socklen_t cli_size = sizeof(cli_addr);
-        socket_id.sid = accept(sock, (struct sockaddr *) &cli_addr, &cli_size);
+        do {
+            socket_id.sid = accept(sock, (struct sockaddr *) &cli_addr, &cli_size);
+        } while ((socket_id.sid < 0) && (errno == EINTR));
 
-        if (socket_id.sid <= 0) {
-            Server::logger()->error("Socket error  at [{}: {}]: {}", this_src_file, __LINE__, strerror(errno));
-            // ToDo: Perform appropriate action!
+        if (socket_id.sid < 0) {
+            //
+            // the listening sockets are non-blocking: EAGAIN just means that all pending
+            // connections have been accepted
+            //
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                Server::logger()->error("Socket error  at [{}: {}]: {}", this_src_file, __LINE__, strerror(errno));
+            }
+            return socket_id;
         }
 
         if (_keep_alive_timeout > 0) {
@@ -435,91 +624,62 @@ namespace cserve {
         socket_id.socket_type = SocketControl::DYN_SOCKET;
 
         //
-        // get peer address
+        // get peer address. The (possibly slow) reverse lookup of the peer name is not done
+        // here, it is done by Connection::peer_name() only if somebody asks for it.
         //
-        const int SIZE = 1024;
-        char host[SIZE];
-        char service[SIZE];
         if (cli_addr.ss_family == AF_INET) {
             auto *s = (struct sockaddr_in *) &cli_addr;
             socket_id.peer_port = ntohs(s->sin_port);
             inet_ntop(AF_INET, &s->sin_addr, socket_id.peer_ip, sizeof(socket_id.peer_ip));
-            int res = getnameinfo((struct sockaddr*) s, sizeof(*s), host, sizeof(host), service, sizeof(service), 0);
-            if (res == 0) {
-                socket_id.set_peer_name(host);
-            }
         } else if (cli_addr.ss_family == AF_INET6) { // AF_INET6
             auto *s = (struct sockaddr_in6 *) &cli_addr;
             socket_id.peer_port = ntohs(s->sin6_port);
             inet_ntop(AF_INET6, &s->sin6_addr, socket_id.peer_ip, sizeof(socket_id.peer_ip));
-
-            int res = getnameinfo((struct sockaddr*) s, sizeof(*s), host, sizeof(host), service, sizeof(service), 0);
-            if (res == 0) {
-                socket_id.set_peer_name(host);
-            }
         } else {
             socket_id.peer_port = -1;
         }
         SSL *cSSL = nullptr;
-        SSL_CTX *sslctx = nullptr;
 
         if (ssl) {
-            SSL_CTX *sslCtx;
+            //
+            // The TLS handshake is not done here. The socket is made non-blocking and the
+            // handshake is driven by the event loop (see continue_ssl_handshake()), so that a
+            // slow or malicious client cannot stall the acceptance of new connections.
+            //
             try {
-                if ((sslCtx = SSL_CTX_new(SSLv23_server_method())) == nullptr) {
-                    Server::logger()->error("OpenSSL error: SSL_CTX_new() failed");
-                    throw SSLError(this_src_file, __LINE__, "OpenSSL error: SSL_CTX_new() failed");
-                }
-                SSL_CTX_set_options(sslCtx, SSL_OP_SINGLE_DH_USE);
-                if (SSL_CTX_use_certificate_file(sslCtx, _ssl_certificate.c_str(), SSL_FILETYPE_PEM) != 1) {
-                    Server::logger()->error("OpenSSL error [{}, {}]: SSL_CTX_use_certificate_file({}) failed.",
-                                            this_src_file, __LINE__, _ssl_certificate);
-                    throw SSLError(this_src_file, __LINE__,
-                                   fmt::format("OpenSSL error: SSL_CTX_use_certificate_file({}) failed.", _ssl_certificate));
-                }
-                if (SSL_CTX_use_PrivateKey_file(sslCtx, _ssl_key.c_str(), SSL_FILETYPE_PEM) != 1) {
-                    Server::logger()->error("OpenSSL error [{}, {}]: SSL_CTX_use_PrivateKey_file({}) failed",
-                                            this_src_file, __LINE__, _ssl_certificate);
-                    throw SSLError(this_src_file, __LINE__,
-                                   fmt::format("OpenSSL error: SSL_CTX_use_PrivateKey_file({}) failed", _ssl_certificate));
-                }
-                if (!SSL_CTX_check_private_key(sslCtx)) {
-                    Server::logger()->error("OpenSSL error [{}, {}]: SSL_CTX_check_private_key() failed",
-                                            this_src_file, __LINE__);
-                    throw SSLError(this_src_file, __LINE__, "OpenSSL error: SSL_CTX_check_private_key() failed");
+                {
+                    //
+                    // SSL_new() takes a reference on the context, therefore the connection
+                    // keeps its context even if the certificate is reloaded in the meantime
+                    //
+                    std::lock_guard<std::mutex> ctx_guard(_ssl_ctx_mutex);
+                    if (_ssl_ctx == nullptr) {
+                        throw SSLError(this_src_file, __LINE__, "OpenSSL error: no SSL context available");
+                    }
+                    if ((cSSL = SSL_new(_ssl_ctx)) == nullptr) {
+                        Server::logger()->error("OpenSSL error [{}, {}]: SSL_new() failed", this_src_file, __LINE__);
+                        throw SSLError(this_src_file, __LINE__, "OpenSSL error: SSL_new() failed");
+                    }
                 }
-                if ((cSSL = SSL_new(sslCtx)) == nullptr) {
-                    Server::logger()->error("OpenSSL error [{}, {}]: SSL_new() failed", this_src_file, __LINE__);
-                    throw SSLError(this_src_file, __LINE__, "OpenSSL error: SSL_new() failed");
+                if (!set_blocking(socket_id.sid, false)) {
+                    throw SSLError(this_src_file, __LINE__, "Could not set socket to non-blocking");
                 }
                 if (SSL_set_fd(cSSL, socket_id.sid) != 1) {
                     Server::logger()->error("OpenSSL error [{}, {}]: SSL_set_fd() failed", this_src_file, __LINE__);
                     throw SSLError(this_src_file, __LINE__, "OpenSSL error: SSL_set_fd() failed");
                 }
-
-                //Here is the SSL Accept portion.  Now all reads and writes must use SS
-                if ((SSL_accept(cSSL)) <= 0) {
-                    Server::logger()->error("OpenSSL error [{}, {}]: SSL_accept() failed", this_src_file, __LINE__);
-                    throw SSLError(this_src_file, __LINE__, "OpenSSL error: SSL_accept() failed");
-                }
+                SSL_set_accept_state(cSSL);
+                socket_id.handshake_start = time(nullptr);
             } catch (SSLError &err) {
                 Server::logger()->error(err.to_string());
-                int sstat;
-
-                while ((sstat = SSL_shutdown(cSSL)) == 0);
-
-                if (sstat < 0) {
-                    Server::logger()->warn("SSL socket error: shutdown (2) of socket failed: {}",
-                                           SSL_get_error(cSSL, sstat));
-                }
-
-                SSL_free(cSSL);
-                SSL_CTX_free(sslCtx);
-                cSSL = nullptr;
+                SSL_free(cSSL); // accepts nullptr
+                ::close(socket_id.sid);
+                socket_id.sid = -1;
+                socket_id.type = SocketControl::ERROR;
+                return socket_id;
             }
         }
         socket_id.ssl_sid = cSSL;
-        socket_id.sslctx = sslctx;
 
         return socket_id;
     }
@@ -529,6 +689,18 @@ namespace cserve {
      */
     void Server::run() {
         Server::logger()->debug("In Server::run");
+        //
+        // the SSL context is created once and shared by all SSL connections
+        //
+        if (_ssl_port > 0) {
+            try {
+                std::lock_guard<std::mutex> ctx_guard(_ssl_ctx_mutex);
+                if (_ssl_ctx == nullptr) _ssl_ctx = create_ssl_context();
+            } catch (SSLError &err) {
+                Server::logger()->error("Could not create SSL context: {}", err.to_string());
+                return;
+            }
+        }
         // Start a thread just to catch signals sent to the server process.
         pthread_t sighandler_thread;
         sigset_t set;
@@ -536,6 +708,7 @@ namespace cserve {
         sigaddset(&set, SIGINT);
         sigaddset(&set, SIGTERM);
         sigaddset(&set, SIGPIPE);
+        sigaddset(&set, SIGHUP);
 
         int pthread_sigmask_result = pthread_sigmask(SIG_BLOCK, &set, nullptr);
         if (pthread_sigmask_result != 0) {
@@ -582,70 +755,53 @@ namespace cserve {
         }
 
         running = true;
-        Server::logger()->info("Cserver ready");
+        Server::logger()->info("Cserver ready (event engine: {})", socket_control.engine_name());
+        std::vector<SocketControl::SocketEvent> events;
+        time_t last_handshake_check = 0;
         while (running) {
             //
-            // blocking poll on input sockets waiting for *new* connections
+            // blocking wait on input sockets. Only the sockets that are ready are returned. The
+            // wait is limited, so that expired TLS handshakes are closed even if nothing happens.
             //
-            pollfd *sockets = socket_control.get_sockets_arr();
-            if (poll(sockets, socket_control.get_sockets_size(), -1) < 0) {
-                Server::logger()->error("Blocking poll failed at [{}: {}]: {}", this_src_file, __LINE__, strerror(errno));
+            if (socket_control.wait(events, 1000) < 0) {
+                Server::logger()->error("Blocking wait failed at [{}: {}]: {}", this_src_file, __LINE__, strerror(errno));
                 running = false;
                 break;
             }
 
-            for (int i = 0; i < socket_control.get_sockets_size(); i++) {
-                if (sockets[i].revents) {
-                    if ((sockets[i].revents & POLLIN) || (sockets[i].revents & POLLPRI)) {
-                        //
-                        // we've got input on one of the sockets
-                        //
-                        if (i < socket_control.get_n_msg_sockets()) {
+            for (auto const &event: events) {
+                if (!running) break;
+                const SocketControl::SocketInfo &ready = event.sockid;
+                if (event.flags & EventEngine::READABLE) {
+                    //
+                    // we've got input on one of the sockets
+                    //
+                    switch (ready.socket_type) {
+                        case SocketControl::CONTROL_SOCKET: {
                             //
                             // CONTROL_SOCKET: we got input from an internal thread...
                             //
-                            SocketControl::SocketInfo msg = SocketControl::receive_control_message(sockets[i].fd);
+                            SocketControl::SocketInfo msg = SocketControl::receive_control_message(ready.sid);
                             switch (msg.type) {
-                                case SocketControl::FINISHED_AND_CONTINUE: {
-                                    //
-                                    // A thread finished, but the socket should remain open...
-                                    // If there are waiting sockets, the thread pops one from the queue, else,
-                                    // if there are no waiting sockets, the thread will pause and be put on the list of
-                                    // available threads.
-                                    //
+                                case SocketControl::FINISHED_AND_CONTINUE:
+                                case SocketControl::FINISHED_AND_CLOSE: {
                                     socket_control.remove_from_working_socket(msg);
-                                    msg.type = SocketControl::NOOP;
-                                    socket_control.add_dyn_socket(msg); // add socket to list to pe polled ==> CHANGES open_sockets!!
-                                    //
-                                    // see if we have sockets waiting for a thread.If yes, we reuse this thread directly
-                                    //
-                                    std::optional<SocketControl::SocketInfo> opt_sockid = socket_control.get_waiting();
-                                    if (opt_sockid.has_value()) {
+                                    if (msg.type == SocketControl::FINISHED_AND_CONTINUE) {
                                         //
-                                        // We have a waiting socket. Get it and make the thread processing it!
+                                        // A thread finished, but the socket should remain open...
                                         //
-                                        SocketControl::SocketInfo sockid = opt_sockid.value();
-                                        sockid.type = SocketControl::PROCESS_REQUEST;
-                                        socket_control.add_to_working_socket(sockid);
-                                        SocketControl::send_control_message(sockets[i].fd, sockid);
+                                        msg.type = SocketControl::NOOP;
+                                        socket_control.add_dyn_socket(msg); // add socket to the sockets waiting for input
                                     } else {
                                         //
-                                        // we have no waiting socket, so
-                                        // push the thread to the list of available threads
+                                        // A thread finished and expects the socket to be closed
                                         //
-                                        ThreadControl::ThreadMasterData tinfo = thread_control[i]; // get thread info
-                                        thread_control.thread_push(tinfo); // push thread to list of waiting threads
+                                        close_socket(msg); // close the socket
                                     }
-                                    break;
-                                }
-                                case SocketControl::FINISHED_AND_CLOSE: {
-                                    socket_control.remove_from_working_socket(msg);
-                                    //
-                                    // A thread finished and expects the socket to be closed
                                     //
-                                    close_socket(msg); // close the socket
-                                    //
-                                    // see if we have sockets waiting for a thread.If yes, we reuse this thread directly
+                                    // see if we have sockets waiting for a thread. If yes, we reuse this thread directly.
+                                    // If there are no waiting sockets, the thread will pause and be put on the list of
+                                    // available threads.
                                     //
                                     std::optional<SocketControl::SocketInfo> opt_sockid = socket_control.get_waiting();
                                     if (opt_sockid.has_value()) {
@@ -655,14 +811,16 @@ namespace cserve {
                                         SocketControl::SocketInfo sockid = opt_sockid.value();
                                         sockid.type = SocketControl::PROCESS_REQUEST;
                                         socket_control.add_to_working_socket(sockid);
-                                        SocketControl::send_control_message(sockets[i].fd, sockid);
+                                        SocketControl::send_control_message(ready.sid, sockid);
                                     } else {
                                         //
                                         // we have no waiting socket, so
                                         // push the thread to the list of available threads
                                         //
-                                        ThreadControl::ThreadMasterData tinfo = thread_control[i]; // get thread info
-                                        thread_control.thread_push(tinfo); // push thread to list of waiting threads
+                                        int tindex = thread_control.thread_index(ready.sid);
+                                        if (tindex >= 0) {
+                                            thread_control.thread_push(thread_control[tindex]); // push thread to list of waiting threads
+                                        }
                                     }
                                     break;
                                 }
@@ -670,8 +828,10 @@ namespace cserve {
                                     //
                                     // a control socket has been closed – we assume the thread just finished
                                     //
-                                    ::close(thread_control[i].control_pipe);
-                                    thread_control.thread_delete(i);
+                                    int tindex = thread_control.thread_index(ready.sid);
+                                    (void) socket_control.remove(ready.sid);
+                                    ::close(ready.sid);
+                                    if (tindex >= 0) thread_control.thread_delete(tindex);
                                     break;
                                 }
                                 case SocketControl::EXIT: {
@@ -691,46 +851,62 @@ namespace cserve {
                                     // error handling
                                 }
                             }
-                            // we got input ready from thread....
-                            // we expect  FINISHED or SOCKET_CLOSED
-                        } else if (i == socket_control.get_stop_socket_id()) {
+                            break;
+                        }
+                        case SocketControl::STOP_SOCKET: {
                             //
                             // STOP from interrupt thread: got input ready from stoppipe
                             //
-                            SocketControl::SocketInfo msg = SocketControl::receive_control_message(sockets[i].fd); // read the message from the pipe
+                            SocketControl::SocketInfo msg = SocketControl::receive_control_message(ready.sid); // read the message from the pipe
                             if (msg.type != SocketControl::EXIT) {
                                 Server::logger()->error("Got unexpected message from interrupt");
                             }
-
-                            SocketControl::SocketInfo sockid;
                             (void) socket_control.remove(socket_control.get_http_socket_id()); // remove the HTTP socket
                             (void) socket_control.remove(socket_control.get_ssl_socket_id()); // remove the SSL socket
                             socket_control.close_all_dynsocks(close_socket);
                             socket_control.broadcast_exit(close_socket); // broadcast EXIT to all worker threads
                             running = false;
-                        } else if (i == socket_control.get_http_socket_id()) {
+                            break;
+                        }
+                        case SocketControl::HTTP_SOCKET:
+                        case SocketControl::SSL_SOCKET: {
                             //
-                            // external HTTP request coming in
+                            // external HTTP or SSL request coming in. We accept connections until there are no
+                            // more pending connections. The listening socket is level triggered, connections
+                            // left pending after an error (e.g. EMFILE) are reported again.
                             //
-                            // we got input ready from normal listener socket
-                            SocketControl::SocketInfo sockid = accept_connection(sockets[i].fd, false);
-                            socket_control.add_dyn_socket(sockid);
-                            Server::logger()->info("Accepted connection from '{}' ({})", sockid.peer_name, sockid.peer_ip);
-                        } else if (i == socket_control.get_ssl_socket_id()) {
+                            bool ssl = ready.socket_type == SocketControl::SSL_SOCKET;
+                            while (true) {
+                                SocketControl::SocketInfo sockid = accept_connection(ready.sid, ssl);
+                                if (sockid.sid < 0) {
+                                    if (sockid.type == SocketControl::ERROR) continue; // this connection failed, try the next one
+                                    break;
+                                }
+                                socket_control.add_dyn_socket(sockid);
+                                Server::logger()->info("Accepted connection from {}:{}", sockid.peer_ip, sockid.peer_port);
+                            }
+                            break;
+                        }
+                        case SocketControl::DYN_SOCKET: {
                             //
-                            // external SSL request coming in
+                            // a TLS handshake in progress is continued without blocking. The request is only
+                            // dispatched if the handshake is finished and the request data is already available.
                             //
-                            SocketControl::SocketInfo sockid = accept_connection(sockets[i].fd, true);
-                            socket_control.add_dyn_socket(sockid);
-                            Server::logger()->info("Accepted connection from '{}' ({})", sockid.peer_name, sockid.peer_ip);
-                        } else {
+                            if ((ready.ssl_sid != nullptr) && !SSL_is_init_finished(ready.ssl_sid)) {
+                                if (!continue_ssl_handshake(socket_control, ready)) break;
+                            }
                             //
                             // DYN_SOCKET: a client socket (already accepted) has data -> dispatch the processing to a free thread
                             // or put the request in the waiting queue (waiting for a free thread...)
                             //
                             ThreadControl::ThreadMasterData tinfo;
                             if (thread_control.thread_pop(tinfo)) { // thread available
-                                SocketControl::SocketInfo sockid = socket_control.remove(i); //  ==> CHANGES open_sockets!!
+                                std::optional<SocketControl::SocketInfo> opt_sockid = socket_control.remove(ready.sid);
+                                if (!opt_sockid.has_value()) {
+                                    thread_control.thread_push(tinfo);
+                                    break;
+                                }
+                                SocketControl::SocketInfo sockid = opt_sockid.value();
                                 sockid.type = SocketControl::PROCESS_REQUEST;
                                 socket_control.add_to_working_socket(sockid);
                                 ssize_t n = SocketControl::send_control_message(tinfo.control_pipe, sockid);
@@ -738,80 +914,66 @@ namespace cserve {
                                     Server::logger()->warn("Got something unexpected...");
                                 }
                             } else { // no thread available, push socket into waiting queue
-                                socket_control.move_to_waiting(i); //  ==> CHANGES open_sockets!!
+                                socket_control.move_to_waiting(ready.sid);
                             }
+                            break;
                         }
-                    } else if (sockets[i].revents & POLLHUP) {
-                        //
-                        // we got a HANGUP from a socket
-                        //
-                        if (i >= socket_control.get_dyn_socket_base()) {
+                    }
+                } else if (event.flags & (EventEngine::HANGUP | EventEngine::FAILURE)) {
+                    //
+                    // we got a HANGUP (or an error condition) from a socket
+                    //
+                    switch (ready.socket_type) {
+                        case SocketControl::DYN_SOCKET: {
                             //
                             // ist a hangup from a dynamic client socket!
                             // we close and remove it
                             //
-                            SocketControl::SocketInfo sockid = socket_control.remove(i); //  ==> CHANGES open_sockets!!
-                            socket_control.remove_from_working_socket(sockid);
-                            close_socket(sockid);
-                        } else if (i < socket_control.get_n_msg_sockets()) {
+                            std::optional<SocketControl::SocketInfo> sockid = socket_control.remove(ready.sid);
+                            if (sockid.has_value()) {
+                                socket_control.remove_from_working_socket(sockid.value());
+                                close_socket(sockid.value());
+                            }
+                            break;
+                        }
+                        case SocketControl::CONTROL_SOCKET: {
                             //
                             // it's a hangup from one of the thread sockets -> thread exited
                             //
-                            (void) socket_control.remove(i); //  ==> CHANGES open_sockets!!
-                            thread_control.thread_delete(i); // delete the thread
+                            int tindex = thread_control.thread_index(ready.sid);
+                            (void) socket_control.remove(ready.sid);
+                            if (tindex >= 0) thread_control.thread_delete(tindex); // delete the thread
                             if (socket_control.get_n_msg_sockets() == 0) {
                                 running = false;
                             }
-                        } else if (i == socket_control.get_http_socket_id()) {
-                            //
-                            // The HTTP socked was being closed -> must be EXIT
-                            //
-                            (void) socket_control.remove(i); //  ==> CHANGES open_sockets!!
-                        } else if (i == socket_control.get_ssl_socket_id()) {
+                            break;
+                        }
+                        case SocketControl::HTTP_SOCKET:
+                        case SocketControl::SSL_SOCKET: {
                             //
-                            // The HTTP socked was being closed -> must be EXIT - do nothing!
+                            // The HTTP/SSL socket was being closed -> must be EXIT
                             //
-                            (void) socket_control.remove(i); //  ==> CHANGES open_sockets!!
-                        } else {
-                            Server::logger()->error("We got a HANGUP from an unknown socket (socket_id = {})", i);
-                        }
-                    } else {
-                        // we've got something else...
-                        if (sockets[i].revents & POLLERR) {
-                            Server::logger()->debug("-->POLLERR");
-                        }
-                        if (sockets[i].revents & POLLHUP) {
-                            Server::logger()->debug("-->POLLHUP");
-                        }
-                        if (sockets[i].revents & POLLIN) {
-                            Server::logger()->debug("-->POLLIN");
-                        }
-                        if (sockets[i].revents & POLLNVAL) {
-                            Server::logger()->debug("-->POLLNVAL");
-                        }
-                        if (sockets[i].revents & POLLOUT) {
-                            Server::logger()->debug("-->POLLOUT");
-                        }
-                        if (sockets[i].revents & POLLPRI) {
-                            Server::logger()->debug("-->POLLPRI");
-                        }
-                        if (sockets[i].revents & POLLRDBAND) {
-                            Server::logger()->debug("-->POLLRDBAND");
-                        }
-                        if (sockets[i].revents & POLLRDNORM) {
-                            Server::logger()->debug("-->POLLRDNORM");
-                        }
-                        if (sockets[i].revents & POLLWRBAND) {
-                            Server::logger()->debug("-->POLLWRBAND");
+                            (void) socket_control.remove(ready.sid);
+                            break;
                         }
-                        if (sockets[i].revents & POLLWRNORM) {
-                            Server::logger()->debug("-->POLLWRNORM");
+                        default: {
+                            Server::logger()->error("We got a HANGUP from an unknown socket (socket_id = {})", ready.sid);
                         }
-                        //running = false;
-                        //break; // accept returned something strange – probably we want to shutdown the server
                     }
                 }
             }
+            time_t now = time(nullptr);
+            if (running && (_ssl_port > 0) && (now != last_handshake_check)) {
+                //
+                // once per second: a client gets as much time for the TLS handshake as for sending a request
+                //
+                last_handshake_check = now;
+                int handshake_timeout = _keep_alive_timeout > 0 ? _keep_alive_timeout : 5;
+                int n = socket_control.close_expired_handshakes(now - handshake_timeout, close_socket);
+                if (n > 0) {
+                    Server::logger()->warn("Closed {} connection(s) with an unfinished SSL handshake", n);
+                }
+            }
         }
 
         void *res;
@@ -832,9 +994,34 @@ namespace cserve {
     }
     //=========================================================================
 
+    std::unique_ptr<LuaServer> Server::create_lua_state(Connection &conn) {
+        //
+        // pattern to be added to the Lua package.path
+        // includes Lua files in the Lua script directory
+        //
+        std::string lua_scriptdir = _lua_include_path + "/?.lua";
+
+        auto luaserver = std::make_unique<LuaServer>(conn, _initscript, true, lua_scriptdir);
+
+        for (auto &global_func : lua_globals) {
+            global_func.func(luaserver->lua(), conn, global_func.func_dataptr);
+        }
+        luaserver->snapshotGlobals();
+        return luaserver;
+    }
+    //=========================================================================
+
     cserve::ThreadStatus
     Server::processRequest(std::istream *ins, std::ostream *os, std::string &peer_ip, int peer_port, bool secure,
                            int &keep_alive, bool socket_reuse) {
+        std::unique_ptr<LuaServer> lua_state;
+        return processRequest(ins, os, peer_ip, peer_port, secure, keep_alive, lua_state);
+    }
+    //=========================================================================
+
+    cserve::ThreadStatus
+    Server::processRequest(std::istream *ins, std::ostream *os, std::string &peer_ip, int peer_port, bool secure,
+                           int &keep_alive, std::unique_ptr<LuaServer> &lua_state) {
         if (_tmpdir.empty()) {
             Server::logger()->warn("_tmpdir is empty [{}, {}].", this_src_file, __LINE__);
             throw Error(this_src_file, __LINE__, "_tmpdir is empty");
@@ -861,29 +1048,32 @@ namespace cserve {
             }
 
             //
-            // Setting up the Lua server
+            // Setting up the Lua server. The interpreter of the worker thread (with the init
+            // script and the lua_globals extensions already executed) is reused, only the
+            // request specific globals are replaced. After a Lua error or a given number of
+            // requests a fresh interpreter is created.
             //
-            // pattern to be added to the Lua package.path
-            // includes Lua files in the Lua script directory
-            //
-            std::string lua_scriptdir = _lua_include_path + "/?.lua";
-
-            LuaServer luaserver(conn, _initscript, true, lua_scriptdir);
-
-            for (auto &global_func : lua_globals) {
-                global_func.func(luaserver.lua(), conn, global_func.func_dataptr);
+            if (lua_state && (lua_state->failed() || (lua_state->nrequests() >= _lua_recycle_after))) {
+                lua_state.reset();
+            }
+            if (lua_state) {
+                lua_state->setConnection(conn);
+            } else {
+                lua_state = create_lua_state(conn);
             }
 
             try {
                 std::shared_ptr<RequestHandler> req_handler;
                 std::string route;
                 std::tie(req_handler, route) = get_handler(conn);
-                req_handler->set_lua_globals(luaserver.lua(), conn);
-                req_handler->handler(conn, luaserver, route);
+                req_handler->set_lua_globals(lua_state->lua(), conn);
+                req_handler->handler(conn, *lua_state, route);
             } catch (InputFailure &iofail) {
                 Server::logger()->error("Possibly socket closed by peer");
+                lua_state.reset();
                 return CLOSE; // or CLOSE ??
             }
+            lua_state->resetGlobals();
 
             if (!conn.cleanupUploads()) {
                 Server::logger()->error("Cleanup of uploaded files failed");
@@ -896,9 +1086,11 @@ namespace cserve {
             }
         } catch (InputFailure &iofail) { // "error" is thrown, if the socket was closed from the main thread...
             Server::logger()->debug("Socket connection: timeout or socket closed from main");
+            lua_state.reset();
             return CLOSE;
         } catch (Error &err) {
             Server::logger()->warn("Internal server error: {}", err.to_string());
+            lua_state.reset();
             try {
                 *os << "HTTP/1.1 500 INTERNAL_SERVER_ERROR\r\n";
                 *os << "Content-Type: text/plain\r\n";
@@ -161,6 +161,10 @@ namespace cserve {
 
         std::string _ssl_certificate; //!< Path to SSL certificate
         std::string _ssl_key; //!< Path to SSL certificate
+        SSL_CTX *_ssl_ctx; //!< Server wide SSL context shared by all SSL connections
+        std::mutex _ssl_ctx_mutex; //!< Protects _ssl_ctx while the certificate is reloaded
+        long _ssl_session_cache_size; //!< Maximal number of TLS sessions kept for resumption
+        long _ssl_session_timeout; //!< Lifetime of a cached TLS session in seconds
         std::string _jwt_secret;
 
         int stoppipe[2]{};
@@ -178,12 +182,17 @@ namespace cserve {
         std::string _initscript;
         std::vector<cserve::RouteInfo> _lua_routes; //!< This vector holds the routes that are served by lua scripts
         std::vector<GlobalFunc> lua_globals;
+        unsigned _lua_recycle_after; //!< number of requests a worker's Lua interpreter is reused for
         size_t _max_post_size;
 
         std::tuple<std::shared_ptr<RequestHandler>, std::string> get_handler(Connection &conn);
 
         SocketControl::SocketInfo accept_connection(int sock, bool ssl = false);
 
+        SSL_CTX *create_ssl_context();
+
+        std::unique_ptr<LuaServer> create_lua_state(Connection &conn);
+
     public:
         /*!
         * Create a server listening on the given port with the maximal number of threads
@@ -195,6 +204,8 @@ namespace cserve {
                         unsigned nthreads = 4,
                         const std::string &userid_str = "");
 
+        virtual ~Server();
+
         [[maybe_unused]] inline static void loggername(const std::string &loggername) { _loggername = loggername; }
 
         [[maybe_unused]] inline static const std::string &loggername() { return _loggername; }
@@ -253,6 +264,30 @@ namespace cserve {
          */
         inline std::string ssl_key() { return _ssl_key; }
 
+        /*!
+         * Sets the size of the TLS session cache used for session resumption
+         *
+         * \param[in] size Maximal number of cached sessions (0 means unlimited)
+         */
+        inline void ssl_session_cache_size(long size) { _ssl_session_cache_size = size; }
+
+        /*!
+         * Sets the lifetime of cached TLS sessions (and session tickets)
+         *
+         * \param[in] timeout Lifetime in seconds
+         */
+        inline void ssl_session_timeout(long timeout) { _ssl_session_timeout = timeout; }
+
+        /*!
+         * Reloads the SSL certificate and key from disk (e.g. after renewal). A new SSL
+         * context is created and used for all new connections. Connections which are already
+         * established keep their context until they are closed. If loading fails, the
+         * old context is kept.
+         *
+         * \returns true on success, false if the new certificate could not be loaded
+         */
+        bool reload_ssl_certificate();
+
         /*!
          * Return the version string
          * \return Version string
@@ -357,7 +392,23 @@ namespace cserve {
         [[maybe_unused]] [[nodiscard]] inline int keep_alive_timeout() const { return _keep_alive_timeout; }
 
         /*!
-         * Sets the path to the initialization script (lua script) which is executed for each request
+         * Set the number of requests after which the Lua interpreter of a worker thread is
+         * replaced by a new one. A value of 1 creates a new interpreter for every request.
+         * Between the requests, only the globals themselves are reset (see LuaServer::resetGlobals()),
+         * tables that are modified in place keep their contents until the interpreter is replaced.
+         *
+         * \param[in] n Number of requests
+         */
+        inline void lua_recycle_after(unsigned n) { _lua_recycle_after = n; }
+
+        /*!
+         * Returns the number of requests a Lua interpreter is reused for
+         */
+        [[maybe_unused]] [[nodiscard]] inline unsigned lua_recycle_after() const { return _lua_recycle_after; }
+
+        /*!
+         * Sets the path to the initialization script (lua script) which is executed whenever
+         * a worker thread creates its Lua interpreter (see lua_recycle_after())
          *
          * \param[in] initscript_p Path of initialization script
          */
@@ -375,8 +426,9 @@ namespace cserve {
         }
 
         /*!
-         * adds a function which is called before processing each request to initialize
-         * special Lua variables and add special Lua functions
+         * adds a function which is called when the Lua interpreter of a worker thread is
+         * created to initialize special Lua variables and add special Lua functions. The
+         * interpreter is reused for many requests, request specific values must not be stored.
          *
          * \param[in] func C++ function which extends the Lua
          */
@@ -415,6 +467,19 @@ namespace cserve {
         processRequest(std::istream *ins, std::ostream *os, std::string &peer_ip, int peer_port, bool secure,
                        int &keep_alive, bool socket_reuse = false);
 
+        /*!
+         * Process a request using the Lua interpreter of the calling worker thread. The
+         * interpreter is created if lua_state is empty and replaced if it failed or has
+         * served lua_recycle_after() requests.
+         *
+         * \param[in] peer_ip String containing IP (IP4 or IP6) of client/peer
+         * \param[in] peer_port Port number of peer/client
+         * \param[in,out] lua_state The Lua interpreter owned by the worker thread
+         */
+        ThreadStatus
+        processRequest(std::istream *ins, std::ostream *os, std::string &peer_ip, int peer_port, bool secure,
+                       int &keep_alive, std::unique_ptr<LuaServer> &lua_state);
+
         /*!
         * Return the user data that has been added previously
         */
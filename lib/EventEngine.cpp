@@ -0,0 +1,142 @@
+/*
+ * Copyright © 2022 Lukas Rosenthaler
+ * This file is part of OMAS/cserve
+ * OMAS/cserve is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * OMAS/cserve is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "Error.h"
+#include "EventEngine.h"
+
+static const char thisSourceFile[] = __FILE__;
+
+namespace cserve {
+
+    std::unique_ptr<EventEngine> EventEngine::create() {
+#ifdef CSERVE_HAVE_EPOLL
+        return std::make_unique<EpollEngine>();
+#else
+        return std::make_unique<PollEngine>();
+#endif
+    }
+    //=========================================================================
+
+#ifdef CSERVE_HAVE_EPOLL
+    EpollEngine::EpollEngine() : n_registered(0) {
+        if ((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+            throw Error(thisSourceFile, __LINE__, "epoll_create1() failed", errno);
+        }
+        epoll_events.resize(64);
+    }
+    //=========================================================================
+
+    EpollEngine::~EpollEngine() {
+        ::close(epoll_fd);
+    }
+    //=========================================================================
+
+    void EpollEngine::add(int fd, TriggerMode mode) {
+        struct epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLPRI | EPOLLRDHUP;
+        if (mode == EDGE) ev.events |= EPOLLET;
+        ev.data.fd = fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            throw Error(thisSourceFile, __LINE__, "epoll_ctl(EPOLL_CTL_ADD) failed", errno);
+        }
+        ++n_registered;
+    }
+    //=========================================================================
+
+    void EpollEngine::remove(int fd) {
+        //
+        // the fd may already have been closed (which removes it from the epoll set
+        // implicitly), therefore errors are ignored here
+        //
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr) == 0 || errno == EBADF || errno == ENOENT) {
+            if (n_registered > 0) --n_registered;
+        }
+    }
+    //=========================================================================
+
+    int EpollEngine::wait(std::vector<Event> &events, int timeout) {
+        events.clear();
+        //
+        // we let the buffer grow with the number of registered sockets, so that a burst of
+        // ready sockets can be collected with a single system call
+        //
+        if (epoll_events.size() < n_registered && epoll_events.size() < 4096) {
+            epoll_events.resize(std::min<size_t>(n_registered, 4096));
+        }
+        int n;
+        do {
+            n = epoll_wait(epoll_fd, epoll_events.data(), static_cast<int>(epoll_events.size()), timeout);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0) return -1;
+        for (int i = 0; i < n; i++) {
+            uint32_t flags = 0;
+            if (epoll_events[i].events & (EPOLLIN | EPOLLPRI)) flags |= READABLE;
+            if (epoll_events[i].events & (EPOLLHUP | EPOLLRDHUP)) flags |= HANGUP;
+            if (epoll_events[i].events & EPOLLERR) flags |= FAILURE;
+            events.push_back({epoll_events[i].data.fd, flags});
+        }
+        return n;
+    }
+    //=========================================================================
+#endif
+
+    void PollEngine::add(int fd, [[maybe_unused]] TriggerMode mode) { // poll() is always level triggered
+        if (index.find(fd) != index.end()) {
+            throw Error(thisSourceFile, __LINE__, "File descriptor already registered!");
+        }
+        index[fd] = pollfds.size();
+        pollfds.push_back({fd, POLLIN, 0});
+    }
+    //=========================================================================
+
+    void PollEngine::remove(int fd) {
+        auto it = index.find(fd);
+        if (it == index.end()) return;
+        //
+        // move the last entry into the hole, this keeps the removal O(1)
+        //
+        size_t pos = it->second;
+        index.erase(it);
+        if (pos != pollfds.size() - 1) {
+            pollfds[pos] = pollfds.back();
+            index[pollfds[pos].fd] = pos;
+        }
+        pollfds.pop_back();
+    }
+    //=========================================================================
+
+    int PollEngine::wait(std::vector<Event> &events, int timeout) {
+        events.clear();
+        int n;
+        do {
+            n = ::poll(pollfds.data(), pollfds.size(), timeout);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0) return -1;
+        for (auto &pfd: pollfds) {
+            if (pfd.revents == 0) continue;
+            uint32_t flags = 0;
+            if (pfd.revents & (POLLIN | POLLPRI)) flags |= READABLE;
+            if (pfd.revents & POLLHUP) flags |= HANGUP;
+            if (pfd.revents & (POLLERR | POLLNVAL)) flags |= FAILURE;
+            events.push_back({pfd.fd, flags});
+            pfd.revents = 0;
+        }
+        return static_cast<int>(events.size());
+    }
+    //=========================================================================
+
+}
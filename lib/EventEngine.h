@@ -0,0 +1,152 @@
+/*
+ * Copyright © 2022 Lukas Rosenthaler
+ * This file is part of OMAS/cserve
+ * OMAS/cserve is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * OMAS/cserve is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+#ifndef CSERVE_EVENTENGINE_H
+#define CSERVE_EVENTENGINE_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+
+#include <poll.h>
+
+#if defined(__linux__)
+#define CSERVE_HAVE_EPOLL 1
+#include <sys/epoll.h>
+#endif
+
+namespace cserve {
+
+    /*!
+     * Abstract readiness notification engine used by SocketControl.
+     *
+     * The engine only knows about file descriptors. SocketControl keeps the mapping from
+     * file descriptors to the socket information. On Linux an epoll based engine is used,
+     * which reports only the sockets that are ready, therefore the cost of one dispatch
+     * round is proportional to the number of ready sockets and not to the number of open
+     * sockets. On other systems a poll() based engine is used as fallback.
+     */
+    class EventEngine {
+    public:
+        /*!
+         * Flags reported for a ready file descriptor
+         */
+        enum EventFlags : uint32_t {
+            READABLE = 0x01, //!< data (or a new connection) is available
+            HANGUP = 0x02,   //!< peer closed the connection
+            FAILURE = 0x04   //!< error condition on the file descriptor
+        };
+
+        /*!
+         * Trigger mode for a registered file descriptor
+         */
+        enum TriggerMode {
+            LEVEL, //!< reported as long as the file descriptor is ready
+            EDGE   //!< reported only once when the file descriptor becomes ready
+        };
+
+        struct Event {
+            int fd;
+            uint32_t flags;
+        };
+
+        virtual ~EventEngine() = default;
+
+        /*!
+         * Register a file descriptor for read readiness
+         *
+         * @param fd File descriptor
+         * @param mode LEVEL or EDGE triggered notification
+         */
+        virtual void add(int fd, TriggerMode mode) = 0;
+
+        /*!
+         * Unregister a file descriptor
+         *
+         * @param fd File descriptor
+         */
+        virtual void remove(int fd) = 0;
+
+        /*!
+         * Wait until at least one of the registered file descriptors is ready
+         *
+         * @param events Vector that is filled with the ready file descriptors (it is cleared first)
+         * @param timeout Timeout in milliseconds, -1 for infinite
+         * @return Number of ready file descriptors, -1 on error (errno is set)
+         */
+        virtual int wait(std::vector<Event> &events, int timeout) = 0;
+
+        /*!
+         * Name of the engine (for logging)
+         */
+        [[nodiscard]] virtual const char *name() const = 0;
+
+        /*!
+         * Create the best engine available on this platform
+         */
+        static std::unique_ptr<EventEngine> create();
+    };
+
+#ifdef CSERVE_HAVE_EPOLL
+    /*!
+     * Readiness engine based on Linux epoll
+     */
+    class EpollEngine : public EventEngine {
+    private:
+        int epoll_fd;
+        std::vector<struct epoll_event> epoll_events; //!> buffer for epoll_wait, grows with the number of sockets
+        size_t n_registered;
+
+    public:
+        EpollEngine();
+
+        ~EpollEngine() override;
+
+        EpollEngine(const EpollEngine&) = delete;
+
+        EpollEngine &operator=(const EpollEngine&) = delete;
+
+        void add(int fd, TriggerMode mode) override;
+
+        void remove(int fd) override;
+
+        int wait(std::vector<Event> &events, int timeout) override;
+
+        [[nodiscard]] const char *name() const override { return "epoll"; }
+    };
+#endif
+
+    /*!
+     * Portable readiness engine based on poll(). The pollfd array is updated in place
+     * when file descriptors are added or removed. poll() is always level triggered,
+     * edge triggered registrations are treated as level triggered.
+     */
+    class PollEngine : public EventEngine {
+    private:
+        std::vector<pollfd> pollfds;
+        std::unordered_map<int, size_t> index; //!> position of a file descriptor in pollfds
+
+    public:
+        PollEngine() = default;
+
+        void add(int fd, TriggerMode mode) override;
+
+        void remove(int fd) override;
+
+        int wait(std::vector<Event> &events, int timeout) override;
+
+        [[nodiscard]] const char *name() const override { return "poll"; }
+    };
+
+}
+
+#endif //CSERVE_EVENTENGINE_H
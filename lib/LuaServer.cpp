@@ -2570,6 +2570,23 @@ using TDsec = std::chrono::time_point<std::chrono::system_clock, std::chrono::du
     }
     //=========================================================================
 
+    /*!
+     * Returns the host name of the client. The reverse DNS lookup is only done
+     * when this function is called.
+     * LUA: name = server.peer_name()
+     */
+    static int lua_peer_name(lua_State *L) {
+        lua_settop(L, 0); // clear stack
+
+        lua_getglobal(L, luaconnection); // push onto stack
+        auto *conn = (Connection *) lua_touserdata(L, -1); // does not change the stack
+        lua_remove(L, -1); // remove from stack
+
+        lua_pushstring(L, conn->peer_name().c_str());
+        return 1;
+    }
+    //=========================================================================
+
     void LuaServer::setLuaPath(const std::string &path) {
         lua_getglobal(L, "package");
         lua_getfield(L, -1, "path"); // get field "path" from table at top of stack (-1)
@@ -2861,6 +2878,10 @@ using TDsec = std::chrono::time_point<std::chrono::system_clock, std::chrono::du
         lua_pushcfunction(L, lua_systime); // table1 - "index_L1" - function
         lua_rawset(L, -3); // table1
 
+        lua_pushstring(L, "peer_name"); // table1 - "index_L1"
+        lua_pushcfunction(L, lua_peer_name); // table1 - "index_L1" - function
+        lua_rawset(L, -3); // table1
+
         lua_pushstring(L, "generate_jwt"); // table1 - "index_L1"
         lua_pushcfunction(L, lua_generate_jwt); // table1 - "index_L1" - function
         lua_rawset(L, -3); // table1 lua_decode_jwt
@@ -2922,6 +2943,81 @@ using TDsec = std::chrono::time_point<std::chrono::system_clock, std::chrono::du
 
         lua_pushlightuserdata(L, &conn);
         lua_setglobal(L, luaconnection);
+
+        ++nrequests_served;
+    }
+    //=========================================================================
+
+    void LuaServer::setConnection(Connection &conn) {
+        lua_settop(L, 0); // clear stack
+        createGlobals(conn);
+    }
+    //=========================================================================
+
+    void LuaServer::snapshotGlobals() {
+        lua_settop(L, 0); // clear stack
+        luaL_unref(L, LUA_REGISTRYINDEX, base_globals);
+        lua_newtable(L); // copy
+        lua_pushglobaltable(L); // copy - _G
+        lua_pushnil(L); // copy - _G - nil
+        while (lua_next(L, 2) != 0) { // copy - _G - key - value
+            lua_pushvalue(L, -2); // copy - _G - key - value - key
+            lua_insert(L, -2); // copy - _G - key - key - value
+            lua_rawset(L, 1); // copy - _G - key
+        }
+        lua_pop(L, 1); // copy
+        base_globals = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+    //=========================================================================
+
+    void LuaServer::resetGlobals() {
+        lua_settop(L, 0); // clear stack
+        if (base_globals == LUA_NOREF) snapshotGlobals();
+        lua_rawgeti(L, LUA_REGISTRYINDEX, base_globals); // copy
+        lua_pushglobaltable(L); // copy - _G
+        //
+        // collect first, assigning to fields while traversing the table with lua_next is undefined
+        //
+        std::vector<std::string> leftovers;
+        lua_pushnil(L); // copy - _G - nil
+        while (lua_next(L, 2) != 0) { // copy - _G - key - value
+            if (lua_type(L, -2) == LUA_TSTRING) {
+                lua_pushvalue(L, -2); // copy - _G - key - value - key
+                lua_rawget(L, 1); // copy - _G - key - value - saved_value
+                if (!lua_rawequal(L, -1, -2)) {
+                    leftovers.emplace_back(lua_tostring(L, -3));
+                }
+                lua_pop(L, 1); // copy - _G - key - value
+            }
+            lua_pop(L, 1); // copy - _G - key
+        }
+        for (const auto &name: leftovers) {
+            lua_getfield(L, 1, name.c_str()); // copy - _G - saved_value (nil if the global is new)
+            lua_setfield(L, 2, name.c_str()); // copy - _G
+        }
+        //
+        // globals of the snapshot that have been removed are restored, too
+        //
+        lua_pushnil(L); // copy - _G - nil
+        while (lua_next(L, 1) != 0) { // copy - _G - key - saved_value
+            lua_pushvalue(L, -2); // copy - _G - key - saved_value - key
+            lua_rawget(L, 2); // copy - _G - key - saved_value - value
+            if (lua_isnil(L, -1)) {
+                lua_pop(L, 1); // copy - _G - key - saved_value
+                lua_pushvalue(L, -2); // copy - _G - key - saved_value - key
+                lua_insert(L, -2); // copy - _G - key - key - saved_value
+                lua_rawset(L, 2); // copy - _G - key
+            } else {
+                lua_pop(L, 2); // copy - _G - key
+            }
+        }
+        lua_settop(L, 0);
+
+        //
+        // the connection object is destroyed after the request, the pointer must not be used anymore
+        //
+        lua_pushnil(L);
+        lua_setglobal(L, luaconnection);
     }
     //=========================================================================
 
@@ -3367,6 +3463,7 @@ using TDsec = std::chrono::time_point<std::chrono::system_clock, std::chrono::du
         }
         if (luaL_dostring(L, luastr.c_str()) != LUA_OK) {
             const char *errorMsg = nullptr;
+            has_failed = true;
 
             if (lua_gettop(L) > 0) {
                 errorMsg = lua_tostring(L, 1);
@@ -3669,6 +3766,7 @@ using TDsec = std::chrono::time_point<std::chrono::system_clock, std::chrono::du
         }
 
         if (lua_pcall(L, lvs.size(), LUA_MULTRET, 0) != LUA_OK) {
+            has_failed = true;
             std::string luaErrorMsg(lua_tostring(L, 1));
             lua_settop(L, 0); // clear stack
             std::ostringstream errMsg;
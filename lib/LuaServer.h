@@ -242,6 +242,9 @@ namespace cserve {
     private:
         lua_State *L{};
         std::string scriptfilename;
+        int base_globals{LUA_NOREF}; //!< registry reference to the copy of the globals taken by snapshotGlobals()
+        unsigned nrequests_served{0}; //!< number of connections the interpreter has been bound to
+        bool has_failed{false}; //!< a Lua chunk or function raised an error
 
     public:
         /*!
@@ -342,6 +345,40 @@ namespace cserve {
          */
         void createGlobals(Connection &conn);
 
+        /*!
+         * Bind a reused interpreter to a new connection. The server table is
+         * replaced by a fresh one containing the values of the given request.
+         *
+         * \param[in] conn HTTP connection object
+         */
+        void setConnection(Connection &conn);
+
+        /*!
+         * Remember the global variables and their values as they are now (standard libraries,
+         * server table, init script and extensions). resetGlobals() removes all other globals
+         * and assigns the remembered values again. The copy is shallow: a global table whose
+         * fields are modified in place keeps the modifications.
+         */
+        void snapshotGlobals();
+
+        /*!
+         * Remove the globals that have been created while processing a request, restore
+         * the remembered globals that have been reassigned, clear the stack and unbind the connection.
+         * Modifications of the contents of remembered tables (e.g. config or package.loaded) are not undone.
+         */
+        void resetGlobals();
+
+        /*!
+         * True if the execution of a Lua chunk or function failed. The state of such an
+         * interpreter is undefined and it should not be reused.
+         */
+        [[nodiscard]] inline bool failed() const { return has_failed; }
+
+        /*!
+         * Number of connections this interpreter has been bound to
+         */
+        [[nodiscard]] inline unsigned nrequests() const { return nrequests_served; }
+
 
 
         /*!
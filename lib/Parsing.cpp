@@ -9,9 +9,13 @@
  * but WITHOUT ANY WARRANTY; without even the implied warranty of
  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
  */
+#include <cerrno>
+#include <mutex>
 #include <regex>
 #include <sstream>
 
+#include <sys/stat.h>
+
 #include "Parsing.h"
 #include "Error.h"
 
@@ -154,19 +158,87 @@ namespace cserve::Parsing {
     }
     //=============================================================================================================
 
-    std::pair <std::string,std::string> getFileMimetype(const std::string &fpath) {
+    /*!
+     * libmagic cookie with the magic database loaded. Loading the database is expensive, and
+     * a cookie must not be used by several threads at the same time, therefore each thread
+     * keeps its own one.
+     */
+    class MagicHandle {
+    private:
         magic_t handle;
-        if ((handle = magic_open(MAGIC_MIME | MAGIC_PRESERVE_ATIME)) == nullptr) {
-            throw Error(file_, __LINE__, magic_error(handle));
+    public:
+        MagicHandle() {
+            if ((handle = magic_open(MAGIC_MIME | MAGIC_PRESERVE_ATIME)) == nullptr) {
+                throw Error(file_, __LINE__, "magic_open() failed", errno);
+            }
+            if (magic_load(handle, nullptr) != 0) {
+                std::string errmsg(magic_error(handle));
+                magic_close(handle);
+                throw Error(file_, __LINE__, errmsg);
+            }
+        }
+
+        ~MagicHandle() { magic_close(handle); }
+
+        MagicHandle(const MagicHandle&) = delete;
+
+        MagicHandle &operator=(const MagicHandle&) = delete;
+
+        [[nodiscard]] inline magic_t get() const { return handle; }
+    };
+
+    /*!
+     * Result of the content sniffing of a file. The result is valid as long as the file
+     * has not been replaced or modified.
+     */
+    struct MimetypeCacheEntry {
+        dev_t dev;
+        ino_t ino;
+        off_t size;
+        struct timespec mtime;
+        std::pair<std::string, std::string> mimetype;
+    };
+
+    static const size_t mimetype_cache_max_entries = 8192;
+    static std::unordered_map<std::string, MimetypeCacheEntry> mimetype_cache;
+    static std::mutex mimetype_cache_mutex;
+
+    std::pair <std::string,std::string> getFileMimetype(const std::string &fpath) {
+        struct stat fileinfo{};
+        bool have_stat = (stat(fpath.c_str(), &fileinfo) == 0);
+#ifdef __APPLE__
+        struct timespec mtime = fileinfo.st_mtimespec;
+#else
+        struct timespec mtime = fileinfo.st_mtim;
+#endif
+        if (have_stat) {
+            std::lock_guard<std::mutex> lock(mimetype_cache_mutex);
+            auto it = mimetype_cache.find(fpath);
+            if (it != mimetype_cache.end()) {
+                const MimetypeCacheEntry &entry = it->second;
+                if ((entry.dev == fileinfo.st_dev) && (entry.ino == fileinfo.st_ino) &&
+                    (entry.size == fileinfo.st_size) && (entry.mtime.tv_sec == mtime.tv_sec) &&
+                    (entry.mtime.tv_nsec == mtime.tv_nsec)) {
+                    return entry.mimetype;
+                }
+            }
         }
 
-        if (magic_load(handle, nullptr) != 0) {
-            throw Error(file_, __LINE__, magic_error(handle));
+        thread_local MagicHandle magic;
+        const char *mimestr = magic_file(magic.get(), fpath.c_str());
+        if (mimestr == nullptr) {
+            throw Error(file_, __LINE__, magic_error(magic.get()));
         }
+        std::pair<std::string, std::string> mimetype = parseMimetype(mimestr);
 
-        std::string mimestr(magic_file(handle, fpath.c_str()));
-        magic_close(handle);
-        return parseMimetype(mimestr);
+        if (have_stat && S_ISREG(fileinfo.st_mode)) {
+            std::lock_guard<std::mutex> lock(mimetype_cache_mutex);
+            if (mimetype_cache.size() >= mimetype_cache_max_entries) {
+                mimetype_cache.clear(); // simple bound, the entries are cheap to recreate
+            }
+            mimetype_cache[fpath] = {fileinfo.st_dev, fileinfo.st_ino, fileinfo.st_size, mtime, mimetype};
+        }
+        return mimetype;
     }
     //=============================================================================================================
 
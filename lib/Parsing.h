@@ -30,7 +30,8 @@ namespace cserve::Parsing {
 
 
         /*!
-         * Determine the mimetype of a file using the magic number
+         * Determine the mimetype of a file using the magic number. The result is cached
+         * until the file is modified or replaced (checked by stat()).
          *
          * \param[in] fpath Path to file to check for the mimetype
          * \returns pair<string,string> containing the mimetype as first part
@@ -16,6 +16,10 @@
 #include <cerrno>
 #include <unistd.h>
 
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
 
 #ifndef MSG_NOSIGNAL
 #define MSG_NOSIGNAL SO_NOSIGPIPE // for OS X
@@ -164,3 +168,44 @@ int SockStream::sync() {
 
     return 0;
 }
+
+bool SockStream::zerocopy() const {
+    if (cSSL == nullptr) {
+#ifdef __linux__
+        return sock >= 0;
+#else
+        return false;
+#endif
+    }
+    //
+    // only if OpenSSL has switched the connection to kernel TLS (SSL_OP_ENABLE_KTLS and a cipher
+    // supported by the kernel), otherwise the data has to be encrypted in user space
+    //
+    return (SSL_get_shutdown(cSSL) == 0) && (BIO_get_ktls_send(SSL_get_wbio(cSSL)) == 1);
+}
+
+std::streamsize SockStream::sendfile(int fd, off_t offset, std::streamsize count) {
+    std::streamsize nn = 0;
+
+    while (nn < count) {
+        ssize_t tmp_n;
+        if (cSSL == nullptr) {
+#ifdef __linux__
+            tmp_n = ::sendfile(sock, fd, &offset, static_cast<size_t>(count - nn)); // advances offset
+#else
+            errno = ENOSYS;
+            tmp_n = -1;
+#endif
+        } else {
+            tmp_n = SSL_sendfile(cSSL, fd, offset, static_cast<size_t>(count - nn), 0);
+            if (tmp_n > 0) offset += tmp_n;
+        }
+        if ((tmp_n < 0) && (errno == EINTR)) continue;
+        if (tmp_n <= 0) {
+            return -1;
+        }
+        nn += tmp_n;
+    }
+
+    return nn;
+}
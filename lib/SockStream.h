@@ -122,6 +122,26 @@ namespace cserve {
          * Destructor which frees all the resources, especially the input and output buffer
          */
         ~SockStream() override;
+
+        /*!
+         * Test if file data can be sent without copying it through the output buffer. This
+         * is the case for plain sockets on Linux (sendfile(2)) and for SSL connections that
+         * use kernel TLS for sending.
+         *
+         * \returns true, if sendfile() can be used
+         */
+        [[nodiscard]] bool zerocopy() const;
+
+        /*!
+         * Sends a part of a file directly from the page cache to the socket. The output
+         * buffer is not used, therefore the stream must have been flushed before.
+         *
+         * \param[in] fd File descriptor of the (regular) file
+         * \param[in] offset Start position in the file
+         * \param[in] count Number of bytes to send
+         * \returns Number of bytes sent, -1 on failure
+         */
+        std::streamsize sendfile(int fd, off_t offset, std::streamsize count);
     };
 
 }
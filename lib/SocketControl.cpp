@@ -9,6 +9,8 @@
  * but WITHOUT ANY WARRANTY; without even the implied warranty of
  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
  */
+#include <algorithm>
+
 #include "Global.h"
 #include "SocketControl.h"
 #include "spdlog/fmt/bundled/format.h"
@@ -17,102 +19,114 @@ static const char thisSourceFile[] = __FILE__;
 
 namespace cserve {
 
-    SocketControl::SocketControl(ThreadControl &thread_control) {
-        for (int i = 0; i < thread_control.nthreads(); i++) {
-            generic_open_sockets.emplace_back(NOOP, CONTROL_SOCKET, thread_control[i].control_pipe);
-        }
-        n_msg_sockets = thread_control.nthreads();
+    SocketControl::SocketControl(ThreadControl &thread_control) : engine(EventEngine::create()) {
         stop_sock_id = -1;
         http_sock_id = -1;
         ssl_sock_id = -1;
-        dyn_socket_base = -1;
+        for (int i = 0; i < thread_control.nthreads(); i++) {
+            //
+            // the control sockets are level triggered: a message that has not been read
+            // will be reported again
+            //
+            add_socket(SocketInfo(NOOP, CONTROL_SOCKET, thread_control[i].control_pipe), EventEngine::LEVEL);
+            msg_sockets.push_back(thread_control[i].control_pipe);
+        }
     }
     //=========================================================================
 
-    pollfd *SocketControl::get_sockets_arr() {
-        open_sockets.clear();
-         for (auto const &tmp: generic_open_sockets) {
-             open_sockets.push_back({tmp.sid, POLLIN, 0});
+    void SocketControl::add_socket(const SocketInfo &sockid, EventEngine::TriggerMode mode) {
+        std::unique_lock<std::mutex> mutex_guard(sockets_mutex);
+        if (open_sockets.find(sockid.sid) != open_sockets.end()) {
+            throw Error(thisSourceFile, __LINE__, fmt::format("Socket {} already registered!", sockid.sid));
         }
-        return open_sockets.data();
+        engine->add(sockid.sid, mode);
+        open_sockets.emplace(sockid.sid, sockid);
     }
+    //=========================================================================
 
-    void SocketControl::add_stop_socket(int sid) { // only called once
+    int SocketControl::wait(std::vector<SocketEvent> &events, int timeout) {
+        events.clear();
+        if (engine->wait(ready_events, timeout) < 0) {
+            return -1;
+        }
         std::unique_lock<std::mutex> mutex_guard(sockets_mutex);
-        if (dyn_socket_base != -1) {
-            throw Error(thisSourceFile, __LINE__, "Adding stop socket not allowed after adding dynamic sockets!");
+        for (auto const &ev: ready_events) {
+            auto it = open_sockets.find(ev.fd);
+            if (it == open_sockets.end()) continue; // has been removed in the meantime
+            events.push_back({it->second, ev.flags});
         }
-        generic_open_sockets.emplace_back(NOOP, STOP_SOCKET, sid);
-        stop_sock_id = static_cast<int>(generic_open_sockets.size() - 1);
+        return static_cast<int>(events.size());
+    }
+    //=========================================================================
+
+    void SocketControl::add_stop_socket(int sid) { // only called once
+        add_socket(SocketInfo(NOOP, STOP_SOCKET, sid), EventEngine::LEVEL);
+        stop_sock_id = sid;
     }
     //=========================================================================
 
     void SocketControl::add_http_socket(int sid) { // only called once
-        std::unique_lock<std::mutex> mutex_guard(sockets_mutex);
-        if (dyn_socket_base != -1) {
-            throw Error(thisSourceFile, __LINE__, "Adding HTTP socket not allowed after adding dynamic sockets!");
-        }
-        generic_open_sockets.emplace_back(NOOP, HTTP_SOCKET, sid);
-        http_sock_id = static_cast<int>(generic_open_sockets.size() - 1);
+        //
+        // The listening sockets are non-blocking and level triggered. The server accepts
+        // connections until accept() fails; if it stopped because no file descriptors were
+        // left (EMFILE, ENFILE), the still pending connections are reported again.
+        //
+        add_socket(SocketInfo(NOOP, HTTP_SOCKET, sid), EventEngine::LEVEL);
+        http_sock_id = sid;
     }
     //=========================================================================
 
     void SocketControl::add_ssl_socket(int sid) { // only called once
-        std::unique_lock<std::mutex> mutex_guard(sockets_mutex);
-        if (dyn_socket_base != -1) {
-            throw Error(thisSourceFile, __LINE__, "Adding SSL socket not allowed after adding dynamic sockets!");
-        }
-        generic_open_sockets.emplace_back(NOOP, SSL_SOCKET, sid, nullptr);
-        ssl_sock_id = static_cast<int>(generic_open_sockets.size() - 1);
+        add_socket(SocketInfo(NOOP, SSL_SOCKET, sid, nullptr), EventEngine::LEVEL);
+        ssl_sock_id = sid;
     }
     //=========================================================================
 
-    void SocketControl::add_dyn_socket(SocketInfo sockid) { // called multiple times, changes open_sockets vector!!!
-        std::unique_lock<std::mutex> mutex_guard(sockets_mutex);
+    void SocketControl::add_dyn_socket(SocketInfo sockid) { // called multiple times
         sockid.type = NOOP;
         sockid.socket_type = DYN_SOCKET;
-        generic_open_sockets.push_back(sockid);
-        if (dyn_socket_base == -1) {
-            dyn_socket_base = static_cast<int>(generic_open_sockets.size() - 1);
+        //
+        // If data is already pending when the socket is (re-)added, the engine reports it
+        // immediately, so no pipelined request gets lost in edge triggered mode.
+        //
+        add_socket(sockid, EventEngine::EDGE);
+        if ((sockid.ssl_sid != nullptr) && !SSL_is_init_finished(sockid.ssl_sid)) {
+            std::unique_lock<std::mutex> mutex_guard(sockets_mutex);
+            pending_handshakes.emplace_back(sockid.handshake_start, sockid.sid);
         }
     }
     //=========================================================================
 
-    SocketControl::SocketInfo SocketControl::remove(int pos) { // called multiple times, changes open sockets vector!!!
+    std::optional<SocketControl::SocketInfo> SocketControl::remove(int sid) { // called multiple times
         std::unique_lock<std::mutex> mutex_guard(sockets_mutex);
-        SocketControl::SocketInfo sockid;
-        if ((pos >= 0) && (pos < generic_open_sockets.size())) {
-            sockid = generic_open_sockets[pos];
-            generic_open_sockets.erase(generic_open_sockets.begin() + pos);
-        } else {
-            throw Error(thisSourceFile, __LINE__, "Socket index out of range!");
-        }
-        if (pos < n_msg_sockets) { // we removed a thread socket, therefore we have to decrement all position ids
-            n_msg_sockets--;
-            stop_sock_id--;
-            http_sock_id--;
-            ssl_sock_id--;
-            dyn_socket_base--;
-        } else if (pos == http_sock_id) {
+        auto it = open_sockets.find(sid);
+        if (it == open_sockets.end()) {
+            return {};
+        }
+        SocketControl::SocketInfo sockid = it->second;
+        open_sockets.erase(it);
+        engine->remove(sid);
+        if (sockid.socket_type == CONTROL_SOCKET) {
+            msg_sockets.erase(std::remove(msg_sockets.begin(), msg_sockets.end(), sid), msg_sockets.end());
+        } else if (sid == http_sock_id) {
             http_sock_id = -1;
-            ssl_sock_id--;
-            dyn_socket_base--;
-        } else if (pos == ssl_sock_id) {
+        } else if (sid == ssl_sock_id) {
             ssl_sock_id = -1;
-            dyn_socket_base--;
+        } else if (sid == stop_sock_id) {
+            stop_sock_id = -1;
         }
         return sockid;
     }
+    //=========================================================================
 
-    void SocketControl::move_to_waiting(int pos) { // called multiple times, changes open sockets vector!!!
-        std::unique_lock<std::mutex> mutex_guard(sockets_mutex);
-        if (((pos - dyn_socket_base) >= 0) && (pos < generic_open_sockets.size())) {
-            SocketControl::SocketInfo sockid = generic_open_sockets[pos];
-            generic_open_sockets.erase(generic_open_sockets.begin() + pos);
-            waiting_sockets.push(sockid);
-        } else {
-            throw Error(thisSourceFile, __LINE__, "Socket index out of range!");
+    void SocketControl::move_to_waiting(int sid) { // called multiple times
+        std::optional<SocketInfo> sockid = remove(sid);
+        if (!sockid.has_value()) return; // already removed (e.g. closed)
+        if (sockid->socket_type != DYN_SOCKET) {
+            throw Error(thisSourceFile, __LINE__, fmt::format("Socket {} is not a client socket!", sid));
         }
+        std::unique_lock<std::mutex> mutex_guard(sockets_mutex);
+        waiting_sockets.push(sockid.value());
     }
     //=========================================================================
 
@@ -129,7 +143,7 @@ namespace cserve {
     //=========================================================================§
 
     ssize_t SocketControl::send_control_message(int pipe_id, const SocketInfo &msg) {
-        SIData data = {msg.type, msg.socket_type, msg.sid, msg.ssl_sid, msg.sslctx, "", msg.peer_port};
+        SIData data = {msg.type, msg.socket_type, msg.sid, msg.ssl_sid, "", msg.peer_port};
         for (int i = 0; i < INET6_ADDRSTRLEN; ++i) {
             data.peer_ip[i] = msg.peer_ip[i];
         }
@@ -149,22 +163,56 @@ namespace cserve {
     //=========================================================================§
 
     void SocketControl::broadcast_exit(int (*closefunc)(const SocketInfo&)) {
-        SIData data = {EXIT, CONTROL_SOCKET, -1, nullptr, nullptr, "", -1};
+        SIData data = {EXIT, CONTROL_SOCKET, -1, nullptr, "", -1};
         for (auto &ss: working_sockets) {
             (void) closefunc(ss);
         }
         for (char &c: data.peer_ip) { c = '\0'; }
-        for (int i = 0; i < n_msg_sockets; i++) {
-            data.sid = generic_open_sockets[i].sid;
-            ::send(generic_open_sockets[i].sid, &data, sizeof(SIData), 0);
+        for (int sid: msg_sockets) {
+            data.sid = sid;
+            ::send(sid, &data, sizeof(SIData), 0);
         }
     }
+    //=========================================================================§
 
     void SocketControl::close_all_dynsocks(int (*closefunc)(const SocketInfo&)) {
         std::unique_lock<std::mutex> mutex_guard(sockets_mutex);
-        for (int i = dyn_socket_base; i < generic_open_sockets.size(); i++) {
-            (void) closefunc(generic_open_sockets[i]);
-            generic_open_sockets.erase(generic_open_sockets.begin() + i);
+        for (auto it = open_sockets.begin(); it != open_sockets.end();) {
+            if (it->second.socket_type == DYN_SOCKET) {
+                engine->remove(it->first);
+                (void) closefunc(it->second);
+                it = open_sockets.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        while (!waiting_sockets.empty()) {
+            (void) closefunc(waiting_sockets.front());
+            waiting_sockets.pop();
+        }
+    }
+    //=========================================================================§
+
+    int SocketControl::close_expired_handshakes(time_t deadline, int (*closefunc)(const SocketInfo&)) {
+        std::unique_lock<std::mutex> mutex_guard(sockets_mutex);
+        int n = 0;
+        while (!pending_handshakes.empty() && (pending_handshakes.front().first < deadline)) {
+            auto [start, sid] = pending_handshakes.front();
+            pending_handshakes.pop_front();
+            //
+            // the handshake may be finished or the socket closed (and its id reused) in the meantime
+            //
+            auto it = open_sockets.find(sid);
+            if (it == open_sockets.end()) continue;
+            const SocketInfo &sockid = it->second;
+            if ((sockid.socket_type == DYN_SOCKET) && (sockid.ssl_sid != nullptr) &&
+                (sockid.handshake_start == start) && !SSL_is_init_finished(sockid.ssl_sid)) {
+                engine->remove(it->first);
+                (void) closefunc(sockid);
+                open_sockets.erase(it);
+                ++n;
+            }
         }
+        return n;
     }
-}
\ No newline at end of file
+}
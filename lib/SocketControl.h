@@ -14,12 +14,15 @@
 
 #include <map>
 #include <vector>
+#include <deque>
 #include <queue>
 #include <unordered_set>
+#include <unordered_map>
 #include <mutex>
 #include <csignal>
 #include <iostream>
 #include <cstring>
+#include <ctime>
 #include <memory>
 #include <functional>
 #include <optional>
@@ -38,6 +41,7 @@
 
 #include "Error.h"
 #include "ThreadControl.h"
+#include "EventEngine.h"
 
 
 
@@ -58,7 +62,6 @@ namespace cserve {
             SocketType socket_type{CONTROL_SOCKET};
             int sid{};
             SSL *ssl_sid{};
-            SSL_CTX *sslctx{};
             char peer_ip[INET6_ADDRSTRLEN]{};
             int peer_port{};
         };
@@ -70,15 +73,14 @@ namespace cserve {
             SocketType socket_type;
             int sid;
             SSL *ssl_sid{};
-            SSL_CTX *sslctx{};
             char peer_ip[INET6_ADDRSTRLEN]{};
             int peer_port;
-            std::string peer_name{};
+            time_t handshake_start{0}; //!> time the TLS handshake of a client socket was started
 
             explicit SocketInfo(ControlMessageType type = NOOP,
                                 SocketType socket_type = CONTROL_SOCKET,
                                 int sid = -1) :
-                                type(type), socket_type(socket_type), sid(sid), ssl_sid(nullptr), sslctx(nullptr), peer_port(-1) {
+                                type(type), socket_type(socket_type), sid(sid), ssl_sid(nullptr), peer_port(-1) {
                 for (char & i : peer_ip) i = '\0';
             }
 
@@ -86,10 +88,9 @@ namespace cserve {
                                 SocketType socket_type,
                                 int sid,
                                 SSL * ssl_sid,
-                                SSL_CTX *sslctx = nullptr,
                                 char *_peer_ip = nullptr,
                                 int peer_port = -1) :
-                                type(type), socket_type(socket_type), sid(sid), ssl_sid(ssl_sid), sslctx(sslctx), peer_port(peer_port)
+                                type(type), socket_type(socket_type), sid(sid), ssl_sid(ssl_sid), peer_port(peer_port)
             {
                 if (_peer_ip == nullptr) {
                     for (char & i : peer_ip) i = '\0';
@@ -104,10 +105,9 @@ namespace cserve {
                 socket_type = si.socket_type;
                 sid = si.sid;
                 ssl_sid = si.ssl_sid;
-                sslctx = si.sslctx;
                 for (int i = 0; i < INET6_ADDRSTRLEN; i++) peer_ip[i] = si.peer_ip[i];
                 peer_port = si.peer_port;
-                peer_name = si.peer_name;
+                handshake_start = si.handshake_start;
             }
 
             explicit SocketInfo(const SIData &data) {
@@ -115,7 +115,6 @@ namespace cserve {
                 socket_type = data.socket_type;
                 sid = data.sid;
                 ssl_sid = data.ssl_sid;
-                sslctx = data.sslctx;
                 for (int i = 0; i < INET6_ADDRSTRLEN; i++) peer_ip[i] = data.peer_ip[i];
                 peer_port = data.peer_port;
             }
@@ -127,10 +126,9 @@ namespace cserve {
                 socket_type = si.socket_type;
                 sid = si.sid;
                 ssl_sid = si.ssl_sid;
-                sslctx = si.sslctx;
                 for (int i = 0; i < INET6_ADDRSTRLEN; i++) peer_ip[i] = si.peer_ip[i];
                 peer_port = si.peer_port;
-                peer_name = si.peer_name;
+                handshake_start = si.handshake_start;
                 return *this;
             }
 
@@ -144,27 +142,30 @@ namespace cserve {
                 return sid == sockid.sid;
             }
 
-            void set_peer_name(const std::string &peer_name_p) {
-                peer_name = peer_name_p;
-            }
-
-            [[nodiscard]] std::string get_peer_name() const {
-                return peer_name;
-            }
+        };
 
+        /*!
+         * A socket reported as ready by the event engine
+         */
+        struct SocketEvent {
+            SocketInfo sockid;
+            uint32_t flags; //!> combination of EventEngine::EventFlags
         };
 
     private:
         std::mutex sockets_mutex; //!> protecting mutex
-        std::vector<pollfd> open_sockets; //!> open sockets waiting for reading
-        std::vector<SocketInfo> generic_open_sockets; //!> open socket-info's waiting for reading
+        std::unique_ptr<EventEngine> engine; //!> readiness notification (epoll on Linux, poll elsewhere)
+        std::unordered_map<int, SocketInfo> open_sockets; //!> sockets registered with the engine, indexed by socket id
+        std::vector<EventEngine::Event> ready_events; //!> buffer for the events returned by the engine
         std::queue<SocketInfo> waiting_sockets; //!> Sockets that have input and are waiting for the thread
+        std::deque<std::pair<time_t, int>> pending_handshakes; //!> start time and socket id of the TLS handshakes in progress, in accept order
         std::unordered_set<SocketInfo, SocketInfo::socket_info_hash> working_sockets; //!> Socket's that are currently working
-        int n_msg_sockets; //!> Number of sockets communicating with the threads
-        int stop_sock_id; //!> Index of the stopsocket (the thread that catches signals sens to this socket)
-        int http_sock_id; //!> Index of the HTTP socckel
-        int ssl_sock_id; //!> Index of the SSL socket
-        int dyn_socket_base; //!> base index of the dynamic sockets created by accept
+        std::vector<int> msg_sockets; //!> Sockets communicating with the threads
+        int stop_sock_id; //!> Socket id of the stopsocket (the thread that catches signals sens to this socket)
+        int http_sock_id; //!> Socket id of the HTTP socket
+        int ssl_sock_id; //!> Socket id of the SSL socket
+
+        void add_socket(const SocketInfo &sockid, EventEngine::TriggerMode mode);
 
     public:
         /*!
@@ -180,11 +181,22 @@ namespace cserve {
          */
         explicit SocketControl(ThreadControl &thread_control);
 
-        pollfd *get_sockets_arr();
+        /*!
+         * Wait until at least one socket is ready. Only the ready sockets are returned,
+         * the cost of this call does not depend on the number of idle sockets (with epoll).
+         *
+         * @param events Vector that will be filled with the ready sockets
+         * @param timeout Timeout in milliseconds, -1 for infinite
+         * @return Number of ready sockets or -1 on error
+         */
+        int wait(std::vector<SocketEvent> &events, int timeout = -1);
 
-        [[nodiscard]] int get_sockets_size() const { return static_cast<int>(generic_open_sockets.size()); }
+        /*!
+         * Name of the event engine used ("epoll" or "poll")
+         */
+        [[nodiscard]] const char *engine_name() const { return engine->name(); }
 
-        [[nodiscard]] int get_n_msg_sockets() const { return n_msg_sockets; }
+        [[nodiscard]] int get_n_msg_sockets() const { return static_cast<int>(msg_sockets.size()); }
 
         void add_stop_socket(int sid);
 
@@ -200,13 +212,21 @@ namespace cserve {
 
         void add_dyn_socket(SocketInfo sockid);
 
-        [[nodiscard]] int get_dyn_socket_base() const { return dyn_socket_base; }
-
-        int size() { return static_cast<int>(generic_open_sockets.size()); }
-
-        inline const pollfd &operator[](int index) { return open_sockets[index]; };
+        /*!
+         * Number of sockets that are waiting for input
+         */
+        int size() {
+            std::unique_lock<std::mutex> mutex_guard(sockets_mutex);
+            return static_cast<int>(open_sockets.size());
+        }
 
-        SocketInfo remove(int pos);
+        /*!
+         * Remove a socket from the sockets waiting for input
+         *
+         * @param sid Socket id
+         * @return Socket info of the removed socket, or empty if the socket was not registered
+         */
+        std::optional<SocketInfo> remove(int sid);
 
         inline void add_to_working_socket(const SocketInfo &sockid) { working_sockets.insert(sockid); }
 
@@ -214,7 +234,7 @@ namespace cserve {
 
         inline size_t working_socket_number() { return working_sockets.size(); }
 
-        void move_to_waiting(int pos);
+        void move_to_waiting(int sid);
 
         std::optional<SocketInfo>  get_waiting();
 
@@ -226,6 +246,18 @@ namespace cserve {
 
         void close_all_dynsocks(int (*closefunc)(const SocketInfo&));
 
+        /*!
+         * Close the client sockets whose TLS handshake was started before the deadline and
+         * is not finished yet (protection against clients that never complete the handshake).
+         * Only the handshakes started before the deadline are looked at, the cost does not
+         * depend on the number of open sockets.
+         *
+         * @param deadline Handshakes started before this time are expired
+         * @param closefunc Function used to close the socket
+         * @return Number of closed sockets
+         */
+        int close_expired_handshakes(time_t deadline, int (*closefunc)(const SocketInfo&));
+
     };
 
 }
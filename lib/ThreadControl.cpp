@@ -79,6 +79,14 @@ namespace cserve {
     }
     //=========================================================================
 
+    int ThreadControl::thread_index(int control_pipe) const {
+        for (int i = 0; i < static_cast<int>(thread_list.size()); i++) {
+            if (thread_list[i].control_pipe == control_pipe) return i;
+        }
+        return -1;
+    }
+    //=========================================================================
+
     int ThreadControl::thread_delete(int pos) {
         thread_list.erase(thread_list.begin() + pos);
         return static_cast<int>(thread_list.size());
@@ -134,6 +134,13 @@ namespace cserve {
          */
         ThreadMasterData &operator[](int index);
 
+        /*!
+         * Find the position of a thread in the list using its control pipe
+         * @param control_pipe Master's endpoint of the control pipe of the thread
+         * @return Position of the thread, -1 if not found
+         */
+        [[nodiscard]] int thread_index(int control_pipe) const;
+
         /*!
          * Return the number of threads available
          * @return
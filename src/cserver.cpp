@@ -3,6 +3,7 @@
 #include <cstdlib>
 #include <csignal>
 #include <utility>
+#include <algorithm>
 #include <filesystem>
 #include <csignal>
 
@@ -153,6 +154,8 @@ int main(int argc, char *argv[]) {
     config.add_config(prefix, "sslport", 8443, "SHTTP port to be used (SLL) [default=8443]");
     config.add_config(prefix, "sslcert", "./certificate/certificate.pem", "Path to SSL certificate.");
     config.add_config(prefix, "sslkey", "./certificate/key.pem", "Path to the SSL key file.");
+    config.add_config(prefix, "sslsessioncache", 20480, "Number of TLS sessions cached for session resumption [default=20480].");
+    config.add_config(prefix, "sslsessiontimeout", 300, "Lifetime of cached TLS sessions and session tickets in seconds [default=300].");
     config.add_config(prefix, "jwtkey", "UP4014, the biggest steam engine", "The secret for generating JWT's (JSON Web Tokens) (exactly 42 characters).");
     config.add_config(prefix, "nthreads", static_cast<int>(std::thread::hardware_concurrency()), "Number of worker threads to be used by cserver");
     config.add_config(prefix, "tmpdir", "./tmp", "Path to the temporary directory (e.g. for uploads etc.).");
@@ -160,6 +163,7 @@ int main(int argc, char *argv[]) {
     config.add_config(prefix, "maxpost", cserve::DataSize("1MB"), "A string indicating the maximal size of a POST request, e.g. '100M'.");
     config.add_config(prefix, "lua_include_path", "./scripts", "Include path for Lua.");
     config.add_config(prefix, "initscript", "", "Path to LUA init script.");
+    config.add_config(prefix, "luarecycle", 1000, "Number of requests a worker thread reuses its Lua interpreter before creating a new one. Globals created or reassigned by a request are reset after it, but modifications of existing tables (e.g. config, package.loaded or a module loaded with require) are kept until the interpreter is replaced. 1 creates a new one for every request [default=1000].");
     config.add_config(prefix, "logfile", "./cserver.log", "Name of the logfile.");
     config.add_config(prefix, "loglevel", spdlog::level::debug, "Logging level Value can be: 'TRACE', 'DEBUG', 'INFO', 'WARN', 'ERR', 'CRITICAL', 'OFF'.");
 
@@ -187,11 +191,14 @@ int main(int argc, char *argv[]) {
     if (!ssl_certificate.empty()) server.ssl_certificate(ssl_certificate);
     std::string ssl_key = config.get_string("sslkey").value();
     if (!ssl_key.empty()) server.ssl_key(ssl_key);
+    server.ssl_session_cache_size(config.get_int("sslsessioncache").value());
+    server.ssl_session_timeout(config.get_int("sslsessiontimeout").value());
     server.jwt_secret(config.get_string("jwtkey").value());
     server.tmpdir(config.get_string("tmpdir").value());
     server.lua_include_path(config.get_string("lua_include_path").value());
     std::string initscript = config.get_string("initscript").value();
     if (!initscript.empty()) server.initscript(initscript);
+    server.lua_recycle_after(std::max(1, config.get_int("luarecycle").value()));
     server.max_post_size(config.get_datasize("maxpost").value().as_size_t()); // set the maximal post size
     server.keep_alive_timeout(config.get_int("keepalive").value()); // set the keep alive timeout
 
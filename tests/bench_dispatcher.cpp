@@ -0,0 +1,87 @@
+//
+// Benchmark of the dispatcher wakeup cost with many idle keep-alive connections.
+//
+// Each iteration makes exactly one of N registered sockets readable, waits for it and
+// drains it. This is what the dispatcher thread in Server::run does for every request
+// on a keep-alive connection. With poll() the cost grows with N, with epoll it only
+// depends on the number of ready sockets.
+//
+// Run with: ./bench_dispatcher "[!benchmark]"
+//
+#include "catch2/catch_all.hpp"
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <memory>
+#include <vector>
+
+#include "EventEngine.h"
+
+namespace {
+    struct IdleConnections {
+        std::vector<int> local;
+        std::vector<int> remote;
+
+        explicit IdleConnections(size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                int sp[2];
+                if (socketpair(AF_UNIX, SOCK_STREAM, 0, sp) != 0) break;
+                local.push_back(sp[0]);
+                remote.push_back(sp[1]);
+            }
+        }
+
+        ~IdleConnections() {
+            for (int fd: local) ::close(fd);
+            for (int fd: remote) ::close(fd);
+        }
+    };
+
+    bool raise_fd_limit(size_t needed) {
+        struct rlimit rl{};
+        if (getrlimit(RLIMIT_NOFILE, &rl) != 0) return false;
+        if (rl.rlim_cur >= needed) return true;
+        rl.rlim_cur = std::min<rlim_t>(rl.rlim_max, needed);
+        if (setrlimit(RLIMIT_NOFILE, &rl) != 0) return false;
+        return rl.rlim_cur >= needed;
+    }
+
+    void run_dispatch_benchmark(const std::string &name, std::unique_ptr<cserve::EventEngine> engine, size_t n) {
+        if (!raise_fd_limit(2 * n + 64)) {
+            SKIP("Not enough file descriptors for " << n << " connections");
+        }
+        IdleConnections conns(n);
+        REQUIRE(conns.local.size() == n);
+        for (int fd: conns.local) {
+            engine->add(fd, cserve::EventEngine::EDGE);
+        }
+        std::vector<cserve::EventEngine::Event> events;
+        size_t active = 0;
+        char c = 'x';
+        BENCHMARK(name + " " + std::to_string(n) + " idle connections") {
+            active = (active + 7919) % n; // walk through the sockets
+            (void) ::write(conns.remote[active], &c, 1);
+            int nready = engine->wait(events, -1);
+            for (auto const &ev: events) {
+                char tmp;
+                (void) ::read(ev.fd, &tmp, 1);
+            }
+            return nready;
+        };
+    }
+}
+
+TEST_CASE("Dispatcher wakeup cost", "[!benchmark][EventEngine]") {
+    for (size_t n: {1000, 10000, 50000}) {
+        DYNAMIC_SECTION("poll " << n) {
+            run_dispatch_benchmark("poll", std::make_unique<cserve::PollEngine>(), n);
+        }
+#ifdef CSERVE_HAVE_EPOLL
+        DYNAMIC_SECTION("epoll " << n) {
+            run_dispatch_benchmark("epoll", std::make_unique<cserve::EpollEngine>(), n);
+        }
+#endif
+    }
+}
@@ -0,0 +1,121 @@
+//
+// Latency of a IIIF tile cache hit with and without reusing the Lua interpreter of the worker.
+//
+// A cache hit of the IIIF handler calls the iiif_preflight function of the init script and
+// then sends the cached tile from disk. The handler below does exactly this, so the measured
+// difference is the cost of setting up the Lua interpreter (luaL_newstate, luaL_openlibs,
+// server table, init script and the lua_globals extensions) for every request.
+//
+// Run from the tests directory with: <build-dir>/tests/bench_luastate "[!benchmark]"
+//
+#include "catch2/catch_all.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "Cserve.h"
+#include "LuaServer.h"
+#include "LuaSqlite.h"
+#include "RequestHandler.h"
+
+namespace {
+    const char initscript[] = R"(
+function iiif_preflight(prefix, identifier, cookie)
+    if server.header['authorization'] == nil and prefix == 'restricted' then
+        return 'deny'
+    end
+    return 'allow', prefix .. '/' .. identifier
+end
+
+function file_preflight(filepath, cookie)
+    return 'allow', filepath
+end
+)";
+
+    class TileCacheHitHandler : public cserve::RequestHandler {
+    private:
+        std::string _name{"tilecachehit"};
+        std::string _tile;
+    public:
+        explicit TileCacheHitHandler(std::string tile) : _tile(std::move(tile)) {}
+
+        [[nodiscard]] const std::string &name() const override { return _name; }
+
+        void handler(cserve::Connection &conn, cserve::LuaServer &lua, const std::string &route) override {
+            std::vector<std::shared_ptr<cserve::LuaValstruct>> lvs{
+                    std::make_shared<cserve::LuaValstruct>(std::string("images")),
+                    std::make_shared<cserve::LuaValstruct>(std::string("tux.jpg")),
+                    std::make_shared<cserve::LuaValstruct>(std::string(""))
+            };
+            if (lua.luaFunctionExists("iiif_preflight")) {
+                (void) lua.executeLuafunction("iiif_preflight", lvs);
+            }
+            conn.header("Content-Type", "image/jpeg");
+            conn.sendFile(_tile);
+        }
+    };
+
+    struct Percentiles {
+        double p50;
+        double p99;
+    };
+
+    Percentiles measure(cserve::Server &server, int nrequests) {
+        std::unique_ptr<cserve::LuaServer> lua_state; // the worker's interpreter
+        std::vector<double> latencies;
+        latencies.reserve(nrequests);
+        for (int i = 0; i < nrequests; i++) {
+            std::istringstream ins("GET /iiif/images/tux.jpg/0,0,256,256/256,/0/default.jpg HTTP/1.1\r\n"
+                                   "Host: localhost\r\n"
+                                   "Connection: close\r\n\r\n");
+            std::ostringstream os;
+            std::string peer_ip("127.0.0.1");
+            int keep_alive = 1;
+            auto t1 = std::chrono::high_resolution_clock::now();
+            (void) server.processRequest(&ins, &os, peer_ip, 4711, false, keep_alive, lua_state);
+            auto t2 = std::chrono::high_resolution_clock::now();
+            latencies.push_back(std::chrono::duration<double, std::micro>(t2 - t1).count());
+        }
+        std::sort(latencies.begin(), latencies.end());
+        return {latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100]};
+    }
+}
+
+TEST_CASE("Tile cache hit latency", "[!benchmark][LuaServer]") {
+    const std::string initfile = "./bench_luastate_init.lua";
+    {
+        std::ofstream out(initfile);
+        out << initscript;
+    }
+    spdlog::set_level(spdlog::level::warn);
+
+    cserve::Server server(8080, 1);
+    server.tmpdir("./testserver/tmp");
+    server.lua_include_path("./testserver/scripts");
+    server.initscript(initfile);
+    server.add_lua_globals_func(cserve::sqliteGlobals, &server);
+    auto handler = std::make_shared<TileCacheHitHandler>("./tux.jpg");
+    server.addRoute(cserve::Connection::GET, "/iiif", handler);
+
+    const int nrequests = 5000;
+
+    server.lua_recycle_after(1);
+    (void) measure(server, 100); // warm up page cache and allocator
+    auto fresh = measure(server, nrequests);
+
+    server.lua_recycle_after(nrequests + 1);
+    auto pooled = measure(server, nrequests);
+
+    std::cout << "Tile cache hit, new Lua interpreter per request: p50 = " << fresh.p50
+              << " us, p99 = " << fresh.p99 << " us" << std::endl;
+    std::cout << "Tile cache hit, reused Lua interpreter:          p50 = " << pooled.p50
+              << " us, p99 = " << pooled.p99 << " us" << std::endl;
+    CHECK(pooled.p50 <= fresh.p50);
+
+    std::remove(initfile.c_str());
+}
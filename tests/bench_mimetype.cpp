@@ -0,0 +1,49 @@
+//
+// Throughput of Parsing::getFileMimetype.
+//
+// "libmagic per call" is what getFileMimetype did before: open a magic cookie, load and parse
+// the magic database, sniff the file and close the cookie again. getFileMimetype now keeps one
+// cookie per thread and caches the result as long as the file is not modified.
+//
+// Run from the tests directory with: <build-dir>/tests/bench_mimetype "[!benchmark]"
+//
+#include "catch2/catch_all.hpp"
+
+#include <string>
+#include <utility>
+
+#include "magic.h"
+
+#include "Parsing.h"
+
+namespace {
+    std::pair<std::string, std::string> mimetype_magic_per_call(const std::string &fpath) {
+        magic_t handle = magic_open(MAGIC_MIME | MAGIC_PRESERVE_ATIME);
+        (void) magic_load(handle, nullptr);
+        std::string mimestr(magic_file(handle, fpath.c_str()));
+        magic_close(handle);
+        return cserve::Parsing::parseMimetype(mimestr);
+    }
+}
+
+TEST_CASE("getFileMimetype throughput", "[!benchmark][Parsing]") {
+    const std::string jpeg = "./testdata/petersdom.jpg";
+    const std::string text = "./testdata/Kleist.txt";
+    REQUIRE(cserve::Parsing::getFileMimetype(jpeg).first == "image/jpeg");
+
+    BENCHMARK("libmagic per call (JPEG)") {
+        return mimetype_magic_per_call(jpeg);
+    };
+
+    BENCHMARK("getFileMimetype (JPEG)") {
+        return cserve::Parsing::getFileMimetype(jpeg);
+    };
+
+    BENCHMARK("getFileMimetype (text)") {
+        return cserve::Parsing::getFileMimetype(text);
+    };
+
+    BENCHMARK("getBestFileMimetype (JPEG)") {
+        return cserve::Parsing::getBestFileMimetype(jpeg);
+    };
+}
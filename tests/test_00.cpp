@@ -8,12 +8,16 @@
 #include <unistd.h>
 #include <sys/socket.h>
 
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 
 #include "Error.h"
 #include "SockStream.h"
 #include "Hash.h"
 #include "Parsing.h"
+#include "EventEngine.h"
 
 TEST_CASE("Testing Error class", "[Error]") {
     std::string msg("test message");
@@ -49,6 +53,39 @@ TEST_CASE("Testing socket stream", "[SockStream]") {
     }
 }
 
+TEST_CASE("Testing event engine", "[EventEngine]") {
+    auto engine = cserve::EventEngine::create();
+    int sp1[2], sp2[2];
+    REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, sp1) == 0);
+    REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, sp2) == 0);
+    engine->add(sp1[0], cserve::EventEngine::EDGE);
+    engine->add(sp2[0], cserve::EventEngine::LEVEL);
+    std::vector<cserve::EventEngine::Event> events;
+
+    REQUIRE(engine->wait(events, 0) == 0);
+
+    char c = 'x';
+    REQUIRE(write(sp2[1], &c, 1) == 1);
+    REQUIRE(engine->wait(events, 100) == 1);
+    REQUIRE(events[0].fd == sp2[0]);
+    REQUIRE((events[0].flags & cserve::EventEngine::READABLE) != 0);
+    REQUIRE(engine->wait(events, 0) == 1); // level triggered: still readable
+    REQUIRE(read(sp2[0], &c, 1) == 1);
+    REQUIRE(engine->wait(events, 0) == 0);
+
+    engine->remove(sp2[0]);
+    REQUIRE(write(sp2[1], &c, 1) == 1);
+    REQUIRE(engine->wait(events, 0) == 0);
+
+    close(sp1[1]);
+    REQUIRE(engine->wait(events, 100) == 1);
+    REQUIRE(events[0].fd == sp1[0]);
+
+    close(sp1[0]);
+    close(sp2[0]);
+    close(sp2[1]);
+}
+
 TEST_CASE("Testing hashing", "[Hash]") {
     std::string teststr("abcdefghijklmnopqrstuvwxyzöäüABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789+!");
 
@@ -103,6 +140,41 @@ TEST_CASE("Testing hashing", "[Hash]") {
     }
 }
 
+TEST_CASE("Testing sendfile of socket stream", "[SockStream]") {
+    int socketfd[2];
+    REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, socketfd) == 0);
+    std::string content;
+    {
+        std::ifstream in("./testdata/Kleist.txt", std::ios::binary);
+        std::ostringstream ss;
+        ss << in.rdbuf();
+        content = ss.str();
+    }
+    REQUIRE(content.size() > 1000);
+    cserve::SockStream sockstream(socketfd[0]);
+    std::ostream os(&sockstream);
+    if (!sockstream.zerocopy()) {
+        close(socketfd[0]);
+        close(socketfd[1]);
+        SKIP("sendfile() not supported on this platform");
+    }
+    int fd = open("./testdata/Kleist.txt", O_RDONLY);
+    REQUIRE(fd >= 0);
+    os << "HEADER" << std::flush;
+    REQUIRE(sockstream.sendfile(fd, 100, 900) == 900);
+    close(fd);
+    close(socketfd[0]);
+
+    std::string received;
+    char buf[1024];
+    ssize_t n;
+    while ((n = read(socketfd[1], buf, sizeof(buf))) > 0) {
+        received.append(buf, n);
+    }
+    close(socketfd[1]);
+    REQUIRE(received == "HEADER" + content.substr(100, 900));
+}
+
 TEST_CASE("Testing parsing of Mime types", "[Parsing]") {
     SECTION("Standard") {
         std::pair<std::string, std::string> t = cserve::Parsing::parseMimetype("text/html; charset=UTF-8");
@@ -137,6 +209,23 @@ TEST_CASE("Testing parsing of Mime types", "[Parsing]") {
         REQUIRE(t.second == "us-ascii");
     }
 
+    SECTION("getFileMimetype of a modified file") {
+        const std::string tmpfile = "./testdata/mimetype_cache.tmp";
+        {
+            std::ofstream out(tmpfile);
+            out << "Just some plain text" << std::endl;
+        }
+        REQUIRE(cserve::Parsing::getFileMimetype(tmpfile).first == "text/plain");
+        REQUIRE(cserve::Parsing::getFileMimetype(tmpfile).first == "text/plain"); // cached
+        {
+            std::ifstream in("./testdata/petersdom.jpg", std::ios::binary);
+            std::ofstream out(tmpfile, std::ios::binary | std::ios::trunc);
+            out << in.rdbuf();
+        }
+        REQUIRE(cserve::Parsing::getFileMimetype(tmpfile).first == "image/jpeg");
+        std::remove(tmpfile.c_str());
+    }
+
     SECTION("getBestFileMimetype") {
         REQUIRE(cserve::Parsing::getBestFileMimetype("./testdata/Kleist.txt") == "text/plain");
         REQUIRE(cserve::Parsing::getBestFileMimetype("./testdata/petersdom.jpg") == "image/jpeg");
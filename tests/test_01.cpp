@@ -520,4 +520,31 @@ TEST_CASE("Testing CserverConf class", "[LuaGlobals]") {
     lua_pop(L, 4);
 
     lua_close(L);
-}
\ No newline at end of file
+}
+
+TEST_CASE("Testing reuse of a LuaServer", "[LuaServer]") {
+    cserve::Connection conn;
+    cserve::LuaServer luaserver(conn, "persistent = 42", true, "./?.lua");
+    luaserver.snapshotGlobals();
+    REQUIRE(luaserver.nrequests() == 1);
+
+    luaserver.executeChunk("leaked = 1; persistent = persistent + 1; string = nil", "");
+    luaserver.resetGlobals();
+    lua_State *L = luaserver.lua();
+    REQUIRE(lua_getglobal(L, "leaked") == LUA_TNIL);
+    REQUIRE(lua_getglobal(L, "persistent") == LUA_TNUMBER);
+    REQUIRE(lua_tointeger(L, -1) == 42);
+    REQUIRE(lua_getglobal(L, "string") == LUA_TTABLE);
+    REQUIRE(lua_getglobal(L, cserve::luaconnection) == LUA_TNIL);
+    lua_settop(L, 0);
+
+    luaserver.setConnection(conn);
+    REQUIRE(luaserver.nrequests() == 2);
+    REQUIRE(lua_getglobal(L, "server") == LUA_TTABLE);
+    REQUIRE(lua_getglobal(L, cserve::luaconnection) == LUA_TLIGHTUSERDATA);
+    lua_settop(L, 0);
+    REQUIRE_FALSE(luaserver.failed());
+
+    REQUIRE_THROWS_AS(luaserver.executeChunk("error('boom')", ""), cserve::Error);
+    REQUIRE(luaserver.failed());
+}
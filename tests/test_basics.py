@@ -128,6 +128,7 @@ def test_servervariables(manager):
     assert variables['server'].get('host') == 'localhost:8080'
     assert variables['server'].get('client_ip') == '127.0.0.1'
     assert variables['server'].get('client_port')
+    assert variables['server'].get('peer_name')
     assert variables['server'].get('uri') == '/servervariables'
     assert variables['server'].get('secure') == False
     assert variables['server'].get('get') is not None
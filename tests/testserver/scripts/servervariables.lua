@@ -13,6 +13,7 @@ result = {
         client_ip = server.client_ip,
         secure = server.secure,
         client_port = server.client_port,
+        peer_name = server.peer_name(),
         host = server.host,
         uri = server.uri,
         get = server.get,